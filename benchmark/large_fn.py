@@ -0,0 +1,8 @@
+# Generate a script made of one large function to measure compile and link time
+import sys
+
+n = int(sys.argv[1]) if len(sys.argv) > 1 else 4000
+print("(let ((f (fn (x)")
+for i in range(n):
+    print('\t(if (== x %d.5) (print "case %d") (list/head (list \'sym%d)))' % (i, i, i))
+print("\t)))\n\t(f 0))")
@@ -0,0 +1,16 @@
+# Generate modules to measure how long loading them takes at startup, prints the
+# arguments to load all of them
+import os
+import sys
+
+n = int(sys.argv[1]) if len(sys.argv) > 1 else 300
+out_dir = sys.argv[2] if len(sys.argv) > 2 else "/tmp/lip_startup"
+if not os.path.isdir(out_dir):
+    os.makedirs(out_dir)
+
+for i in range(n):
+    with open(os.path.join(out_dir, "mod%d.lip" % i), "w") as f:
+        f.write("(let ((f (fn (x) (if (< x %d) (list x 'mod%d) (list/head (list x))))))\n" % (i, i))
+        f.write("\t(f %d))\n" % i)
+
+print(" ".join("-l mod%d" % i for i in range(n)))
@@ -34,8 +34,18 @@
  * - `any`: Any type. A local variable with name `name` will be declared with type ::lip_value_s.
  * - `number`: Number type. A local variable with name `name` will be declared with type `double`.
  * - `string`: String type. A local variable with name `name` will be declared with type ::lip_value_s.
+ * - `string_ref`: String or borrowed buffer (::LIP_VAL_BUFFER). A local variable with name `name` will be
+ *   declared with type ::lip_string_ref_s. It is only valid until the function returns.
  * - `symbol`: Symbol type. A local variable with name  `name` will be declared with type ::lip_value_s.
  * - `list`: List type. A local variable with name `name` will be declared with type ::lip_value_s.
+ *   Use ::lip_list_nth or ::lip_list_begin to access its elements.
+ * - `list_builder`: A list builder created with ::lip_list_builder_begin and
+ *   wrapped in a ::LIP_VAL_LIST_BUILDER value. A local variable with name
+ *   `name` will be declared with type ::lip_list_builder_s*.
+ *   Call ::lip_list_builder_freeze to return the list that it holds.
+ * - `vec`: Numeric array type. A local variable with name `name` will be declared with type ::lip_vec_s*.
+ * - `map`: Map type. A local variable with name `name` will be declared with type ::lip_value_s.
+ *   Use ::lip_map_get or ::lip_map_begin to access its entries.
  */
 #define lip_bind_args(...) \
 	lip_bind_prepare(vm); \
@@ -49,6 +59,22 @@
 	} \
 	lip_pp_map(lip_bind_arg, __VA_ARGS__)
 
+/**
+ * @brief Describe parameters as a ::lip_signature_s.
+ *
+ * Parameters have the same form as in #lip_bind_args, their names are ignored.
+ *
+ * @see lip_declare_function_with_signature
+ */
+#define lip_bind_signature(...) \
+	((lip_signature_t){ \
+		.arity_min = 0 lip_pp_map(lip_bind_count_arity, __VA_ARGS__), \
+		.arity_max = lip_pp_len(__VA_ARGS__), \
+		.param_types = { lip_pp_map(lip_bind_param_type, __VA_ARGS__) } \
+	})
+#define lip_bind_param_type(i, spec) \
+	lip_pp_sep(i) lip_pp_concat(lip_bind_type_, lip_pp_nth(1, spec, any))
+
 /**
  * @brief Bind an argument to a local variable.
  *
@@ -138,16 +164,32 @@
 #define lip_bind_wrapper(name) lip_pp_concat(lip_, lip_pp_concat(name, _wrapper))
 
 #define lip_bind_declare_any(name) lip_value_t name;
+#define lip_bind_type_any 0
 #define lip_bind_load_any(i, name, value) name = value;
 
 #define lip_bind_declare_string(name) lip_value_t name;
+#define lip_bind_type_string (1u << LIP_VAL_STRING)
 #define lip_bind_load_string(i, name, value) \
 	do { \
 		lip_bind_check_type(i, LIP_VAL_STRING, value.type); \
 		name = value; \
 	} while(0)
 
+#define lip_bind_declare_string_ref(name) lip_string_ref_t name;
+#define lip_bind_type_string_ref \
+	((1u << LIP_VAL_STRING) | (1u << LIP_VAL_BUFFER))
+#define lip_bind_load_string_ref(i, name, value) \
+	do { \
+		lip_bind_assert_fmt( \
+			lip_is_string(value), \
+			"Bad argument #%d (%s expected, got %s)", \
+			i, lip_value_type_t_to_str(LIP_VAL_STRING), lip_value_type_t_to_str(value.type) \
+		); \
+		name = lip_as_string_ref(&(value)); \
+	} while(0)
+
 #define lip_bind_declare_symbol(name) lip_value_t name;
+#define lip_bind_type_symbol (1u << LIP_VAL_SYMBOL)
 #define lip_bind_load_symbol(i, name, value) \
 	do { \
 		lip_bind_check_type(i, LIP_VAL_SYMBOL, value.type); \
@@ -155,6 +197,7 @@
 	} while(0)
 
 #define lip_bind_declare_boolean(name) bool name;
+#define lip_bind_type_boolean (1u << LIP_VAL_BOOLEAN)
 #define lip_bind_load_boolean(i, name, value) \
 	do { \
 		lip_bind_check_type(i, LIP_VAL_BOOLEAN, value.type); \
@@ -162,6 +205,7 @@
 	} while(0)
 
 #define lip_bind_declare_number(name) double name;
+#define lip_bind_type_number (1u << LIP_VAL_NUMBER)
 #define lip_bind_load_number(i, name, value) \
 	do { \
 		lip_bind_check_type(i, LIP_VAL_NUMBER, value.type); \
@@ -174,13 +218,49 @@
 	}
 
 #define lip_bind_declare_list(name) lip_value_t name;
+#define lip_bind_type_list (1u << LIP_VAL_LIST)
 #define lip_bind_load_list(i, name, value) \
 	do { \
 		lip_bind_check_type(i, LIP_VAL_LIST, value.type); \
 		name = value; \
 	} while(0)
 
+#define lip_bind_declare_list_builder(name) lip_list_builder_t* name;
+#define lip_bind_type_list_builder (1u << LIP_VAL_LIST_BUILDER)
+#define lip_bind_load_list_builder(i, name, value) \
+	do { \
+		lip_bind_check_type(i, LIP_VAL_LIST_BUILDER, value.type); \
+		name = value.data.reference; \
+	} while(0)
+#define lip_bind_store_list_builder(target, value) \
+	target = (lip_value_t){ \
+		.type = LIP_VAL_LIST_BUILDER, \
+		.data = { .reference = value } \
+	}
+
+#define lip_bind_declare_vec(name) lip_vec_t* name;
+#define lip_bind_type_vec (1u << LIP_VAL_VEC)
+#define lip_bind_load_vec(i, name, value) \
+	do { \
+		lip_bind_check_type(i, LIP_VAL_VEC, value.type); \
+		name = value.data.reference; \
+	} while(0)
+#define lip_bind_store_vec(target, value) \
+	target = (lip_value_t){ \
+		.type = LIP_VAL_VEC, \
+		.data = { .reference = value } \
+	}
+
+#define lip_bind_declare_map(name) lip_value_t name;
+#define lip_bind_type_map (1u << LIP_VAL_MAP)
+#define lip_bind_load_map(i, name, value) \
+	do { \
+		lip_bind_check_type(i, LIP_VAL_MAP, value.type); \
+		name = value; \
+	} while(0)
+
 #define lip_bind_declare_function(name) lip_value_t name;
+#define lip_bind_type_function (1u << LIP_VAL_FUNCTION)
 #define lip_bind_load_function(i, name, value) \
 	do { \
 		lip_bind_check_type(i, LIP_VAL_FUNCTION, value.type); \
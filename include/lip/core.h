@@ -40,6 +40,23 @@ typedef struct lip_script_s lip_script_t;
 typedef struct lip_repl_handler_s lip_repl_handler_t;
 typedef struct lip_context_error_s lip_context_error_t;
 typedef struct lip_error_record_s lip_error_record_t;
+typedef struct lip_vm_stats_s lip_vm_stats_t;
+typedef struct lip_list_iterator_s lip_list_iterator_t;
+typedef struct lip_map_iterator_s lip_map_iterator_t;
+typedef struct lip_list_builder_s lip_list_builder_t;
+
+/// Maximum length of a list produced by ::lip_list_append without switching to a persistent vector.
+#define LIP_LIST_FLAT_MAX 32
+
+/// Maximum length of a string stored inline in a ::lip_value_s.
+#define LIP_SMALL_STRING_MAX \
+	(sizeof(lip_value_t) - offsetof(lip_value_t, small_chars))
+
+/// Alignment of the elements of a ::lip_vec_s.
+#define LIP_VEC_ALIGNMENT 32
+
+/// Maximum depth of a map's trie, including the collision level.
+#define LIP_MAP_MAX_DEPTH 8
 
 /**
  * @brief Handle to a module context.
@@ -102,6 +119,52 @@ struct lip_runtime_config_s
 
 	/// Default configuration for virtual machines in this runtime.
 	lip_vm_config_t default_vm_config;
+
+	/**
+	 * @brief Check calls in scripts at load time.
+	 *
+	 * Calls with a wrong number of arguments or with arguments of the wrong
+	 * type are reported as compile errors.
+	 *
+	 * @see lip_declare_function_with_signature
+	 */
+	bool static_check;
+
+	/**
+	 * @brief Compile scripts without source locations.
+	 *
+	 * This makes compiled functions smaller but errors and tracebacks will not
+	 * point to the source anymore.
+	 *
+	 * @see lip_function_location
+	 */
+	bool strip_debug_info;
+
+	/**
+	 * @brief Directory to cache compiled scripts in.
+	 *
+	 * When this is not empty, ::lip_load_script hashes the source of a script
+	 * together with its filename, the compiler options and the signatures of
+	 * declared functions, then looks for `<hash>.lipc` in this directory
+	 * before compiling.
+	 * On a miss, the compiled script is written to a temporary file through
+	 * lip_runtime_config_s::fs then renamed.
+	 * Nothing is written if the filesystem cannot rename files.
+	 *
+	 * The directory must already exist.
+	 */
+	lip_string_ref_t bytecode_cache_dir;
+
+	/**
+	 * @brief Maximum number of symbols interned in this runtime.
+	 *
+	 * Interned symbols are never freed before the runtime is destroyed so
+	 * this bounds the memory a script can pin by creating symbols.
+	 * 0 means no limit.
+	 *
+	 * @see lip_make_symbol
+	 */
+	uint32_t max_symbols;
 };
 
 /**
@@ -178,6 +241,72 @@ struct lip_context_error_s
 	const lip_context_error_t* parent;
 };
 
+/**
+ * @brief Memory statistics of a virtual machine.
+ *
+ * @see lip_get_vm_stats
+ */
+struct lip_vm_stats_s
+{
+	/// Number of heap allocations made since the vm was created or reset.
+	size_t num_allocations;
+	/// Number of bytes allocated since the vm was created or reset.
+	size_t num_bytes_allocated;
+	/// Deepest use of the environment stack since the vm was created or reset,
+	/// in values.
+	size_t max_env_depth;
+};
+
+/**
+ * @brief Iterator over the elements of a list.
+ *
+ * @see lip_list_begin
+ * @see lip_list_next
+ */
+struct lip_list_iterator_s
+{
+	const lip_list_t* list;
+	size_t index;
+	const lip_value_t* chunk;
+	size_t chunk_len;
+};
+
+/**
+ * @brief Transient builder for a list.
+ *
+ * Elements are pushed into a growable buffer owned by the builder.
+ * Freezing the builder turns that buffer into an immutable list without copying.
+ *
+ * @see lip_list_builder_begin
+ * @see lip_list_builder_push
+ * @see lip_list_builder_freeze
+ */
+struct lip_list_builder_s
+{
+	lip_vm_t* vm;
+	lip_value_t* elements;
+	size_t length;
+	size_t capacity;
+};
+
+/**
+ * @brief Iterator over the entries of a map.
+ *
+ * Entries are visited in an unspecified but stable order.
+ *
+ * @see lip_map_begin
+ * @see lip_map_next
+ */
+struct lip_map_iterator_s
+{
+	unsigned int depth;
+	struct
+	{
+		const lip_map_node_t* node;
+		unsigned int index;
+	} stack[LIP_MAP_MAX_DEPTH];
+};
+
 /**
  * @brief Create a runtime instance.
  *
@@ -312,6 +441,23 @@ lip_declare_function(
 	lip_module_context_t* module, lip_string_ref_t name, lip_native_fn_t fn
 );
 
+/**
+ * @brief Define a native function together with its parameters.
+ *
+ * Calls to the function are checked against `signature` at load time when
+ * lip_runtime_config_s::static_check is enabled.
+ *
+ * @see lip_declare_function
+ * @see lip_bind_signature
+ */
+LIP_CORE_API void
+lip_declare_function_with_signature(
+	lip_module_context_t* module,
+	lip_string_ref_t name,
+	lip_native_fn_t fn,
+	lip_signature_t signature
+);
+
 /**
  * @brief Create a virtual machine instance.
  *
@@ -420,6 +566,8 @@ lip_exec_script(lip_vm_t* vm, lip_script_t* script, lip_value_t* result);
  * - `!` will expand to the module name itself. For example: while searching for
  *   `foo.bar` the pattern `bin/!.lipc` will expand to `bin/foo.bar.lipc`.
  *
+ * Bundles added with ::lip_add_bundle are searched before any pattern.
+ *
  * The first file that exists will be executed. It must contains a series of
  * `declare` calls at the top level. Before the file is executed, lip will
  * ensure that all modules that it references (and transitively, all modules
@@ -440,6 +588,92 @@ lip_exec_script(lip_vm_t* vm, lip_script_t* script, lip_value_t* result);
 LIP_CORE_API bool
 lip_load_module(lip_context_t* ctx, lip_string_ref_t name);
 
+/**
+ * @brief Native implementation of `declare`.
+ *
+ * `(declare 'name public fn)` exports `fn` from the module being loaded by
+ * ::lip_load_module. `fn` must not capture any variable.
+ * ::lip_load_stdlib registers it.
+ */
+LIP_CORE_API lip_exec_status_t
+lip_builtin_declare(lip_vm_t* vm, lip_value_t* result);
+
+/**
+ * @brief Make the modules of a bundle available to ::lip_load_module.
+ *
+ * A bundle holds many compiled modules and an index of their names so a module
+ * is found with a single lookup instead of one file per search pattern.
+ * The file is mapped through lip_fs_s::map when available and stays in use
+ * until the runtime is destroyed.
+ *
+ * @param ctx A context.
+ * @param filename Path to the bundle.
+ * @return Whether the bundle was successfully opened.
+ *
+ * @see lip_dump_bundle
+ */
+LIP_CORE_API bool
+lip_add_bundle(lip_context_t* ctx, lip_string_ref_t filename);
+
+/**
+ * @brief Write scripts into a bundle as modules.
+ *
+ * @param ctx The context used to load the scripts.
+ * @param num_modules Number of modules.
+ * @param module_names Name of each module.
+ * @param scripts Script of each module.
+ * @param filename Output filename.
+ * @param output Output stream or `NULL` to write to the filesystem.
+ *
+ * @return Whether the bundle was written successfully.
+ *
+ * @see lip_add_bundle
+ */
+LIP_CORE_API bool
+lip_dump_bundle(
+	lip_context_t* ctx,
+	unsigned int num_modules,
+	const lip_string_ref_t* module_names,
+	lip_script_t* const* scripts,
+	lip_string_ref_t filename,
+	lip_out_t* output
+);
+
+/**
+ * @brief Save all loaded modules and their linked imports into an image.
+ *
+ * Only modules made of compiled functions are saved. Functions imported from
+ * other modules, such as natives, are referenced by name.
+ *
+ * @param ctx A context.
+ * @param filename Output filename.
+ * @param output Output stream or `NULL` to write to the filesystem.
+ *
+ * @return Whether the image was written successfully.
+ *
+ * @see lip_load_image
+ */
+LIP_CORE_API bool
+lip_save_image(lip_context_t* ctx, lip_string_ref_t filename, lip_out_t* output);
+
+/**
+ * @brief Restore the modules saved in an image.
+ *
+ * Modules are installed already linked, without running or linking them
+ * again. Modules that the image imports from must be declared first, usually
+ * with ::lip_load_stdlib. Modules with the same name are replaced.
+ * The file is mapped through lip_fs_s::map when available and stays in use
+ * until the runtime is destroyed.
+ *
+ * @param ctx A context.
+ * @param filename Path to the image.
+ * @return Whether the image was successfully restored.
+ *
+ * @see lip_save_image
+ */
+LIP_CORE_API bool
+lip_load_image(lip_context_t* ctx, lip_string_ref_t filename);
+
 /**
  * @brief Start a Read-Eval-Print loop.
  *
@@ -468,6 +702,15 @@ lip_get_default_vm(lip_context_t* ctx);
 LIP_CORE_API void
 lip_reset_vm(lip_vm_t* vm);
 
+/**
+ * @brief Retrieve memory statistics of a VM.
+ *
+ * Values which do not escape the function creating them are allocated in the
+ * function's frame and are not counted.
+ */
+LIP_CORE_API lip_vm_stats_t
+lip_get_vm_stats(lip_vm_t* vm);
+
 /**
  * @brief Set a hook on this VM.
  *
@@ -542,7 +785,7 @@ lip_get_args(const lip_vm_t* vm, uint8_t* num_args);
  * @see lip_make_function
  */
 LIP_CORE_API const lip_value_t*
-lip_get_env(const lip_vm_t* vm, uint8_t* env_len);
+lip_get_env(const lip_vm_t* vm, uint32_t* env_len);
 
 /// Create a boolean value.
 LIP_MAYBE_UNUSED static inline lip_value_t
@@ -582,6 +825,18 @@ lip_make_number(lip_vm_t* vm, double number)
 LIP_CORE_API lip_value_t
 lip_make_string_copy(lip_vm_t* vm, lip_string_ref_t str);
 
+/**
+ * @brief Create a symbol.
+ *
+ * Symbols are interned in the runtime: symbols with the same name share the
+ * same storage, which lives as long as the runtime.
+ *
+ * @return The symbol, or nil if the runtime already holds
+ * lip_runtime_config_s::max_symbols symbols.
+ */
+LIP_CORE_API lip_value_t
+lip_make_symbol(lip_vm_t* vm, lip_string_ref_t name);
+
 /// Create a formatted string, similar to sprintf.
 LIP_CORE_API LIP_PRINTF_LIKE(2, 3) lip_value_t
 lip_make_string(lip_vm_t* vm, const char* fmt, ...);
@@ -595,7 +850,7 @@ lip_make_stringv(lip_vm_t* vm, const char* fmt, va_list args);
  *
  * @param vm The VM this function is bound to.
  * @param native_fn Pointer to native function.
- * @param env_len Number of bound variables.
+ * @param env_len Number of bound variables, less than 2^24.
  * @param env Array of `env_len` bound variables.
  * @return The function.
  */
@@ -603,18 +858,106 @@ LIP_CORE_API lip_value_t
 lip_make_function(
 	lip_vm_t* vm,
 	lip_native_fn_t native_fn,
-	uint8_t env_len,
+	uint32_t env_len,
 	lip_value_t env[]
 );
 
-/// Convert a lip_value_s to a string
-LIP_MAYBE_UNUSED static inline lip_string_t*
-lip_as_string(lip_value_t val)
+/// Check whether a lip_value_s is a string, either owned or borrowed.
+LIP_MAYBE_UNUSED static inline bool
+lip_is_string(lip_value_t val)
+{
+	return val.type == LIP_VAL_STRING || val.type == LIP_VAL_BUFFER;
+}
+
+/**
+ * @brief Access the content of a string, symbol or borrowed buffer.
+ *
+ * Short strings are stored inside the value itself so the reference is only
+ * valid as long as `val` is and, unlike other strings, is not null-terminated.
+ *
+ * @return A reference to the content or an empty reference for other types.
+ */
+LIP_MAYBE_UNUSED static inline lip_string_ref_t
+lip_as_string_ref(const lip_value_t* val)
+{
+	lip_string_ref_t ref = { 0, "" };
+	switch(val->type)
+	{
+		case LIP_VAL_STRING:
+		case LIP_VAL_SYMBOL:
+			if(val->small_len > 0)
+			{
+				ref.length = val->small_len - 1;
+				ref.ptr = (const char*)val + offsetof(lip_value_t, small_chars);
+			}
+			else
+			{
+				ref.length = ((lip_string_t*)val->data.reference)->length;
+				ref.ptr = ((lip_string_t*)val->data.reference)->ptr;
+			}
+			break;
+		case LIP_VAL_BUFFER:
+			ref = ((lip_buffer_t*)val->data.reference)->content;
+			break;
+		default:
+			break;
+	}
+
+	return ref;
+}
+
+/**
+ * @brief Convert a lip_value_s to a string.
+ *
+ * Unlike ::lip_as_string_ref, borrowed buffers are not converted.
+ * The value is taken by pointer since short strings are stored inside it, see
+ * ::lip_as_string_ref for how long the reference is valid.
+ *
+ * @return The content or an empty reference if the value is not a string or
+ * symbol.
+ */
+LIP_MAYBE_UNUSED static inline lip_string_ref_t
+lip_as_string(const lip_value_t* val)
 {
-	return val.type == LIP_VAL_STRING || val.type == LIP_VAL_SYMBOL
-		? (lip_string_t*)val.data.reference : NULL;
+	return val->type == LIP_VAL_STRING || val->type == LIP_VAL_SYMBOL
+		? lip_as_string_ref(val) : lip_string_ref("");
 }
 
+/**
+ * @brief Create a string which borrows host memory instead of copying it.
+ *
+ * @param vm The VM to create the buffer in.
+ * @param content The borrowed memory.
+ * @param guard Guard to notify when the memory is no longer referenced.
+ *   Can be `NULL` if the memory outlives the VM.
+ * @return A ::LIP_VAL_BUFFER value.
+ */
+LIP_CORE_API lip_value_t
+lip_make_buffer(lip_vm_t* vm, lip_string_ref_t content, lip_buffer_guard_t* guard);
+
+/**
+ * @brief Start a scope for the buffers created by a VM.
+ *
+ * Use it around work which does not keep values, such as handling one request
+ * in a long running VM, so that borrowed memory is released without resetting
+ * the VM.
+ *
+ * @see lip_end_buffer_scope
+ */
+LIP_CORE_API lip_buffer_scope_t
+lip_begin_buffer_scope(lip_vm_t* vm);
+
+/**
+ * @brief Release the buffers created since a scope began.
+ *
+ * Their guards are notified and they read as empty strings from then on.
+ * Scopes must be ended in the reverse order of their creation.
+ *
+ * @see lip_begin_buffer_scope
+ */
+LIP_CORE_API void
+lip_end_buffer_scope(lip_vm_t* vm, lip_buffer_scope_t scope);
+
 /// Convert a lip_value_s to a list
 LIP_MAYBE_UNUSED static inline const lip_list_t*
 lip_as_list(lip_value_t val)
@@ -622,6 +965,175 @@ lip_as_list(lip_value_t val)
 	return val.type == LIP_VAL_LIST ? (lip_list_t*)val.data.reference : NULL;
 }
 
+/**
+ * @brief Create a flat list.
+ *
+ * @param vm The VM to allocate the list in.
+ * @param length Number of elements.
+ * @return A list whose `length` elements must be initialized by the caller.
+ */
+LIP_CORE_API lip_list_t*
+lip_alloc_list(lip_vm_t* vm, size_t length);
+
+/// Create a new list by appending an element to the end of a list.
+LIP_CORE_API lip_value_t
+lip_list_append(lip_vm_t* vm, const lip_list_t* list, lip_value_t element);
+
+/// Create a new list by concatenating two lists.
+LIP_CORE_API lip_value_t
+lip_list_concat(lip_vm_t* vm, const lip_list_t* lhs, const lip_list_t* rhs);
+
+/// Create a new list by removing the first element of a non-empty list.
+LIP_CORE_API lip_value_t
+lip_list_tail(lip_vm_t* vm, const lip_list_t* list);
+
+/**
+ * @brief Locate a run of contiguous elements in a list.
+ *
+ * @param list The list.
+ * @param index Index of the first element, must be less than the length of the list.
+ * @param chunk Pointer to the element at `index`.
+ * @return Number of contiguous elements starting from `chunk`.
+ */
+LIP_CORE_API size_t
+lip_list_chunk(const lip_list_t* list, size_t index, const lip_value_t** chunk);
+
+/// Get an element of a list. `index` must be less than the length of the list.
+LIP_MAYBE_UNUSED static inline lip_value_t
+lip_list_nth(const lip_list_t* list, size_t index)
+{
+	if(list->vector == NULL) { return list->elements[index]; }
+
+	const lip_value_t* chunk;
+	lip_list_chunk(list, index, &chunk);
+	return *chunk;
+}
+
+/// Start iterating over a list.
+LIP_MAYBE_UNUSED static inline void
+lip_list_begin(const lip_list_t* list, lip_list_iterator_t* itr)
+{
+	itr->list = list;
+	itr->index = 0;
+	itr->chunk = NULL;
+	itr->chunk_len = 0;
+}
+
+/// Retrieve the next element of a list. Return `false` at the end of the list.
+LIP_MAYBE_UNUSED static inline bool
+lip_list_next(lip_list_iterator_t* itr, lip_value_t* element)
+{
+	if(itr->chunk_len == 0)
+	{
+		if(itr->index >= itr->list->length) { return false; }
+
+		itr->chunk_len = lip_list_chunk(itr->list, itr->index, &itr->chunk);
+	}
+
+	*element = *(itr->chunk++);
+	--itr->chunk_len;
+	++itr->index;
+	return true;
+}
+
+/// Convert a lip_value_s to a numeric array
+LIP_MAYBE_UNUSED static inline lip_vec_t*
+lip_as_vec(lip_value_t val)
+{
+	return val.type == LIP_VAL_VEC ? (lip_vec_t*)val.data.reference : NULL;
+}
+
+/**
+ * @brief Create a numeric array.
+ *
+ * @param vm The VM to allocate the array in.
+ * @param length Number of elements.
+ * @return An array whose `length` elements must be initialized by the caller.
+ */
+LIP_CORE_API lip_vec_t*
+lip_alloc_vec(lip_vm_t* vm, size_t length);
+
+/**
+ * @brief Start building a list.
+ *
+ * @param vm The VM to allocate the list in.
+ * @param builder The builder.
+ * @param capacity Expected number of elements, can be 0.
+ */
+LIP_CORE_API void
+lip_list_builder_begin(lip_vm_t* vm, lip_list_builder_t* builder, size_t capacity);
+
+/// Grow the buffer of a builder so that it can hold at least `capacity` elements.
+LIP_CORE_API void
+lip_list_builder_reserve(lip_list_builder_t* builder, size_t capacity);
+
+/// Push an element to the end of the list being built.
+LIP_MAYBE_UNUSED static inline void
+lip_list_builder_push(lip_list_builder_t* builder, lip_value_t element)
+{
+	if(builder->length == builder->capacity)
+	{
+		lip_list_builder_reserve(builder, builder->capacity * 2);
+	}
+
+	builder->elements[builder->length++] = element;
+}
+
+/**
+ * @brief Finish building a list.
+ *
+ * The builder is left empty and can be used to build another list.
+ *
+ * @return A list holding all elements pushed so far.
+ */
+LIP_CORE_API lip_value_t
+lip_list_builder_freeze(lip_list_builder_t* builder);
+
+/// Convert a lip_value_s to a list builder
+LIP_MAYBE_UNUSED static inline lip_list_builder_t*
+lip_as_list_builder(lip_value_t val)
+{
+	return val.type == LIP_VAL_LIST_BUILDER ? (lip_list_builder_t*)val.data.reference : NULL;
+}
+
+/// Convert a lip_value_s to a map
+LIP_MAYBE_UNUSED static inline const lip_map_t*
+lip_as_map(lip_value_t val)
+{
+	return val.type == LIP_VAL_MAP ? (lip_map_t*)val.data.reference : NULL;
+}
+
+/// Create an empty map.
+LIP_CORE_API lip_value_t
+lip_make_map(lip_vm_t* vm);
+
+/**
+ * @brief Lookup a key in a map.
+ *
+ * @param map The map.
+ * @param key The key.
+ * @param value Pointer to write the associated value to. Can be `NULL`.
+ * @return Whether the key is present.
+ */
+LIP_CORE_API bool
+lip_map_get(const lip_map_t* map, lip_value_t key, lip_value_t* value);
+
+/// Create a new map by associating a key with a value.
+LIP_CORE_API lip_value_t
+lip_map_assoc(lip_vm_t* vm, const lip_map_t* map, lip_value_t key, lip_value_t value);
+
+/// Create a new map by removing a key.
+LIP_CORE_API lip_value_t
+lip_map_dissoc(lip_vm_t* vm, const lip_map_t* map, lip_value_t key);
+
+/// Start iterating over a map.
+LIP_CORE_API void
+lip_map_begin(const lip_map_t* map, lip_map_iterator_t* itr);
+
+/// Retrieve the next entry of a map. Return `false` after the last entry.
+LIP_CORE_API bool
+lip_map_next(lip_map_iterator_t* itr, lip_value_t* key, lip_value_t* value);
+
 #ifndef LIP_NO_MAGIC
 
 /**
@@ -7,10 +7,18 @@
 
 #define LIP_OP_LABEL 0xFF
 
+/// Largest field in the compact form of ::LIP_OP_CLS and ::LIP_OP_LLST
+#define LIP_PAIR_FIELD_MAX 0xFFF
+/// Largest field in the wide form, where ::LIP_OP_WIDE carries the first one
+#define LIP_WIDE_FIELD_MAX 0xFFFFFF
+
 typedef uint32_t lip_asm_index_t;
 typedef struct lip_asm_s lip_asm_t;
 typedef struct lip_tagged_instruction_s lip_tagged_instruction_t;
 
+KHASH_DECLARE(lip_asm_string_index, lip_string_ref_t, lip_asm_index_t)
+KHASH_DECLARE(lip_asm_index_map, uint64_t, lip_asm_index_t)
+
 struct lip_tagged_instruction_s
 {
 	lip_instruction_t instruction;
@@ -27,11 +35,26 @@ struct lip_asm_s
 	lip_array(lip_tagged_instruction_t) instructions;
 	lip_array(lip_function_t*) functions;
 	lip_array(uint32_t) imports;
+	/// Imports linked even though no instruction uses them
+	lip_array(lip_asm_index_t) linked_imports;
+	lip_array(uint32_t) symbols;
 	lip_array(lip_value_t) constants;
 	lip_array(lip_string_ref_t) string_pool;
 	lip_array(lip_memblock_info_t) string_layout;
 	lip_array(lip_memblock_info_t) nested_layout;
 	lip_array(lip_memblock_info_t*) function_layout;
+	lip_array(uint8_t) location_table;
+
+	khash_t(lip_asm_string_index)* string_index;
+	khash_t(lip_asm_index_map)* import_index;
+	khash_t(lip_asm_index_map)* symbol_index;
+	khash_t(lip_asm_index_map)* number_index;
+	khash_t(lip_asm_index_map)* string_constant_index;
+
+	/// Leave out the location table of assembled functions
+	bool strip_debug_info;
+	/// Set by ::lip_asm_end when the instructions fail ::lip_verify_instructions
+	const char* error;
 };
 
 LIP_CORE_API void
@@ -60,6 +83,13 @@ lip_asm_new_function(lip_asm_t* lasm, lip_function_t* function);
 LIP_CORE_API lip_asm_index_t
 lip_asm_alloc_import(lip_asm_t* lasm, lip_string_ref_t import);
 
+/**
+ * Allocate an import which is linked like one used by ::LIP_OP_IMP, so that
+ * loading fails if it is undefined, even if no instruction uses it.
+ */
+LIP_CORE_API lip_asm_index_t
+lip_asm_alloc_linked_import(lip_asm_t* lasm, lip_string_ref_t import);
+
 LIP_CORE_API lip_asm_index_t
 lip_asm_alloc_numeric_constant(lip_asm_t* lasm, double number);
 
@@ -69,6 +99,21 @@ lip_asm_alloc_string_constant(lip_asm_t* lasm, lip_string_ref_t string);
 LIP_CORE_API lip_asm_index_t
 lip_asm_alloc_symbol(lip_asm_t* lasm, lip_string_ref_t string);
 
+/// Add ::LIP_OP_CLS or ::LIP_OP_LLST, prefixed with ::LIP_OP_WIDE if needed
+LIP_CORE_API void
+lip_asm_add_pair(
+	lip_asm_t* lasm,
+	lip_opcode_t opcode,
+	uint32_t first,
+	uint32_t second,
+	lip_loc_range_t location
+);
+
+/**
+ * Assemble the function, with lip_function_t::max_stack computed by
+ * ::lip_verify_instructions.
+ * lip_asm_t::error is set if the instructions fail verification.
+ */
 LIP_CORE_API lip_function_t*
 lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator);
 
@@ -85,4 +130,24 @@ lip_disasm(lip_instruction_t instr, lip_opcode_t* opcode, lip_operand_t* operand
 	*operand = (lip_operand_t)((int32_t)((uint32_t)instr << 8) >> 8);
 }
 
+LIP_MAYBE_UNUSED static inline void
+lip_disasm_pair(lip_operand_t operand, uint32_t* first, uint32_t* second)
+{
+	*first = operand & LIP_PAIR_FIELD_MAX;
+	*second = (operand >> 12) & LIP_PAIR_FIELD_MAX;
+}
+
+/// Decode the fields of an instruction following ::LIP_OP_WIDE
+LIP_MAYBE_UNUSED static inline void
+lip_disasm_wide_pair(
+	lip_operand_t wide_operand,
+	lip_operand_t operand,
+	uint32_t* first,
+	uint32_t* second
+)
+{
+	*first = (uint32_t)wide_operand & LIP_WIDE_FIELD_MAX;
+	*second = (uint32_t)operand & LIP_WIDE_FIELD_MAX;
+}
+
 #endif
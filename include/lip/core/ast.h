@@ -14,7 +14,9 @@
 	F(LIP_AST_LET) \
 	F(LIP_AST_LETREC) \
 	F(LIP_AST_LAMBDA) \
-	F(LIP_AST_DO)
+	F(LIP_AST_DO) \
+	F(LIP_AST_LOOP) \
+	F(LIP_AST_RECUR)
 
 LIP_ENUM(lip_ast_type_t, LIP_AST)
 
@@ -51,6 +53,7 @@ struct lip_ast_s
 			lip_ast_t* else_;
 		} if_;
 
+		// Also used by `loop`
 		struct
 		{
 			lip_array(lip_let_binding_t) bindings;
@@ -65,10 +68,41 @@ struct lip_ast_s
 		} lambda;
 
 		lip_array(lip_ast_t*) do_;
+		// New values of the bindings of the innermost `loop`
+		lip_array(lip_ast_t*) recur;
 	} data;
 };
 
+/**
+ * @brief Translate an s-expression into an AST.
+ *
+ * `(loop (<bindings...>) <exp...>)` binds its variables like `let`.
+ * `(recur <exp...>)` rebinds them all at once and evaluates the body again.
+ * It is only allowed in tail position of the body of the innermost `loop`.
+ */
 LIP_CORE_API lip_ast_result_t
 lip_translate_sexp(lip_allocator_t* allocator, const lip_sexp_t* sexp);
 
+/**
+ * @brief Simplify an AST without changing its behaviour.
+ *
+ * Level 0 returns the AST as is. Level 1 folds prim ops applied to literals,
+ * removes branches with a constant condition, drops unused bindings and
+ * expressions without side effects and flattens nested `do`. Level 2 also
+ * inlines calls to small non-vararg lambdas which are applied directly or bound
+ * with `let`/`letrec`, as long as their free variables are not shadowed at the
+ * call site.
+ *
+ * Unchanged nodes are shared with the input, new ones are taken from
+ * `allocator`. Scratch memory is taken from `temp_allocator`, which must be
+ * able to reallocate, and is released before returning.
+ */
+LIP_CORE_API lip_ast_t*
+lip_optimize_ast(
+	lip_allocator_t* allocator,
+	lip_allocator_t* temp_allocator,
+	lip_ast_t* ast,
+	unsigned int level
+);
+
 #endif
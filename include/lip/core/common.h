@@ -93,16 +93,29 @@
  *
  * @var LIP_VAL_STRING
  * A string.
- * When lip_value_s has this value, access it using ::lip_as_string.
+ * When lip_value_s has this value, access it using ::lip_as_string_ref.
  *
  * @var LIP_VAL_SYMBOL
- * A symbol.
- * When lip_value_s has this value, access it using ::lip_as_string.
+ * An interned symbol, see ::lip_make_symbol.
+ * When lip_value_s has this value, access it using ::lip_as_string_ref.
  *
  * @var LIP_VAL_LIST
  * A list.
  * When lip_value_s has this value, access it using ::lip_as_list.
  *
+ * @var LIP_VAL_MAP
+ * An immutable map.
+ * When lip_value_s has this value, access it using ::lip_as_map.
+ *
+ * @var LIP_VAL_VEC
+ * An array of unboxed numbers.
+ * When lip_value_s has this value, access it using ::lip_as_vec.
+ *
+ * @var LIP_VAL_BUFFER
+ * A string borrowed from host memory.
+ * It is accepted wherever a ::LIP_VAL_STRING is.
+ * Access its content using ::lip_as_string_ref.
+ *
  * @var LIP_VAL_FUNCTION
  * A function.
  * Use ::lip_call to call a function.
@@ -113,6 +126,10 @@
  *
  * @var LIP_VAL_NATIVE
  * An opaque native pointer.
+ *
+ * @var LIP_VAL_LIST_BUILDER
+ * A list being built by a script.
+ * When lip_value_s has this value, access it using ::lip_as_list_builder.
  */
 
 #define LIP_VAL(F) \
@@ -122,9 +139,13 @@
 	F(LIP_VAL_STRING) \
 	F(LIP_VAL_SYMBOL) \
 	F(LIP_VAL_LIST) \
+	F(LIP_VAL_MAP) \
+	F(LIP_VAL_VEC) \
+	F(LIP_VAL_BUFFER) \
 	F(LIP_VAL_FUNCTION) \
 	F(LIP_VAL_PLACEHOLDER) \
-	F(LIP_VAL_NATIVE)
+	F(LIP_VAL_NATIVE) \
+	F(LIP_VAL_LIST_BUILDER)
 
 LIP_ENUM(lip_value_type_t, LIP_VAL)
 
@@ -154,6 +175,13 @@ typedef struct lip_loc_range_s lip_loc_range_t;
 typedef struct lip_string_ref_s lip_string_ref_t;
 typedef struct lip_string_s lip_string_t;
 typedef struct lip_list_s lip_list_t;
+typedef struct lip_vector_s lip_vector_t;
+typedef struct lip_map_s lip_map_t;
+typedef struct lip_map_node_s lip_map_node_t;
+typedef struct lip_vec_s lip_vec_t;
+typedef struct lip_buffer_s lip_buffer_t;
+typedef struct lip_buffer_guard_s lip_buffer_guard_t;
+typedef struct lip_buffer_scope_s lip_buffer_scope_t;
 typedef struct lip_in_s lip_in_t;
 typedef struct lip_out_s lip_out_t;
 typedef struct lip_allocator_s lip_allocator_t;
@@ -162,6 +190,7 @@ typedef struct lip_vm_s lip_vm_t;
 typedef struct lip_vm_config_s lip_vm_config_t;
 typedef struct lip_vm_hook_s lip_vm_hook_t;
 typedef struct lip_module_loader_s lip_module_loader_t;
+typedef struct lip_signature_s lip_signature_t;
 
 /**
  * @brief Native function signature.
@@ -177,6 +206,33 @@ typedef struct lip_module_loader_s lip_module_loader_t;
  */
 typedef lip_exec_status_t(*lip_native_fn_t)(lip_vm_t* vm, lip_value_t* result);
 
+/// Maximum number of parameters described by a ::lip_signature_s.
+#define LIP_SIGNATURE_MAX_PARAMS 10
+
+/**
+ * @brief Parameters of a native function.
+ *
+ * Used to check calls at load time.
+ *
+ * @see lip_declare_function_with_signature
+ * @see lip_bind_signature
+ */
+struct lip_signature_s
+{
+	/// Minimum number of arguments.
+	uint8_t arity_min;
+	/// Maximum number of arguments.
+	uint8_t arity_max;
+	/// Accepted types of each parameter as a mask of `1 << type`, 0 accepts any type.
+	uint16_t param_types[LIP_SIGNATURE_MAX_PARAMS];
+	/**
+	 * The function never keeps a reference to its arguments once it returns.
+	 *
+	 * Lists passed to it may then be allocated in the frame of the caller.
+	 */
+	bool borrows_args;
+};
+
 /// Source file location.
 struct lip_loc_s
 {
@@ -209,6 +265,8 @@ struct lip_string_s
 {
 	/// Length of the string.
 	size_t length;
+	/// Cached hash of the content, 0 if not computed yet. See ::lip_string_hash.
+	uint32_t hash;
 	/// Content of the string.
 	LIP_FLEXIBLE_ARRAY_MEMBER(char, ptr);
 };
@@ -216,24 +274,124 @@ struct lip_string_s
 /**
  * @brief Lip's list type.
  *
- * Members are packed contiguously in memory, starting with lip_list_s::elements.
+ * Small lists are flat: members are packed contiguously in memory, starting
+ * with lip_list_s::elements.
  * When a list is sliced, it retains a reference to its parent through lip_list_s::root.
  *
+ * Lists grown past ::LIP_LIST_FLAT_MAX elements through ::lip_list_append or
+ * ::lip_list_concat are backed by a persistent vector which shares structure
+ * between versions.
+ * Their lip_list_s::elements is `NULL`.
+ * Use ::lip_list_nth or a ::lip_list_iterator_s to access elements of any list.
+ *
  * @see LIP_VAL_LIST
  */
 struct lip_list_s
 {
 	/// Number of elmements.
 	size_t length;
-	/// Pointer to first element.
+	/// Pointer to first element or `NULL` if the list is backed by a vector.
 	lip_value_t* elements;
 	/// Reference to parent list.
 	lip_value_t* root;
+	/// Persistent vector backing this list or `NULL` if the list is flat.
+	const lip_vector_t* vector;
+	/// Index of the first element in lip_list_s::vector.
+	size_t offset;
+};
+
+/**
+ * @brief Lip's map type.
+ *
+ * A persistent hash array mapped trie.
+ * Keys are hashed and compared by content, the same way `==` compares values.
+ * Updating a map creates a new map which shares most of its structure with
+ * the old one.
+ *
+ * @see LIP_VAL_MAP
+ */
+struct lip_map_s
+{
+	/// Number of entries.
+	size_t size;
+	/// Root node of the trie or `NULL` if the map is empty.
+	const lip_map_node_t* root;
+};
+
+/**
+ * @brief Lip's numeric array type.
+ *
+ * Numbers are stored unboxed and contiguously, starting at a
+ * ::LIP_VEC_ALIGNMENT aligned address.
+ *
+ * @see LIP_VAL_VEC
+ */
+struct lip_vec_s
+{
+	/// Number of elements.
+	size_t length;
+	/// Pointer to first element.
+	double* elements;
+};
+
+/**
+ * @brief Lifetime guard for memory borrowed by a ::lip_buffer_s.
+ *
+ * Embed it in a host structure and use ::LIP_CONTAINER_OF in
+ * lip_buffer_guard_s::release to retrieve that structure.
+ */
+struct lip_buffer_guard_s
+{
+	/**
+	 * @brief Called when the VM no longer references the borrowed memory.
+	 *
+	 * This happens when the buffer scope it was created in ends or when the VM
+	 * which created it is reset or destroyed, whichever comes first.
+	 * It is called once for each buffer created with this guard.
+	 *
+	 * @param guard The guard.
+	 */
+	void(*release)(lip_buffer_guard_t* guard);
+};
+
+/**
+ * @brief A view over host memory.
+ *
+ * The memory is not copied. It must stay valid until lip_buffer_guard_s::release
+ * is called.
+ *
+ * @see LIP_VAL_BUFFER
+ * @see lip_make_buffer
+ */
+struct lip_buffer_s
+{
+	/// Borrowed content.
+	lip_string_ref_t content;
+	/// Guard to notify when the buffer is no longer referenced or `NULL`.
+	lip_buffer_guard_t* guard;
+	/// Next buffer created by the same VM.
+	lip_buffer_t* next;
+};
+
+/**
+ * @brief Buffers created by a VM since a point in time.
+ *
+ * @see lip_begin_buffer_scope
+ * @see lip_end_buffer_scope
+ */
+struct lip_buffer_scope_s
+{
+	/// Most recent buffer created before the scope began.
+	lip_buffer_t* outer;
 };
 
 /**
  * @brief A value in lip
  *
+ * Strings of up to ::LIP_SMALL_STRING_MAX bytes are stored inline,
+ * starting at lip_value_s::small_chars and spilling into lip_value_s::data.
+ * lip_value_s::small_len is then their length plus one.
+ *
  * Except for `type`, its members should not be accessed directly.
  * Unless specified otherwise, use `lip_as_*` and `lip_make_*` functions to create and access this struct instead.
  */
@@ -241,6 +399,10 @@ struct lip_value_s
 {
 	/// Type of the value
 	lip_value_type_t type;
+	/// Should not be accessed directly.
+	uint8_t small_len;
+	/// Should not be accessed directly.
+	char small_chars[3];
 	union
 	{
 		/// Should not be accessed directly.
@@ -15,6 +15,19 @@ struct lip_compiler_s
 	lip_scope_t* current_scope;
 	lip_scope_t* free_scopes;
 	khash_t(lip_string_ref_set)* free_var_names;
+	khash_t(lip_ptr_set)* tail_calls;
+	khash_t(lip_ptr_set)* number_exps;
+	/// Level passed to ::lip_optimize_ast, 0 disables AST optimizations
+	unsigned int optimization_level;
+	/// Leave out the location table of functions, see lip_asm_s::strip_debug_info
+	bool strip_debug_info;
+	/**
+	 * Whether a global function never keeps a reference to its arguments, see
+	 * lip_signature_s::borrows_args. `NULL` if none of them can be relied on.
+	 */
+	bool(*is_borrowing)(lip_compiler_t* compiler, lip_string_ref_t name);
+	/// First error reported by ::lip_asm_end since ::lip_compiler_begin
+	const char* error;
 };
 
 LIP_CORE_API void
@@ -29,6 +42,7 @@ lip_compiler_begin(lip_compiler_t* compiler, lip_string_ref_t source_name);
 LIP_CORE_API void
 lip_compiler_add_ast(lip_compiler_t* compiler, const lip_ast_t* ast);
 
+/// Returns `NULL` when lip_compiler_t::error is set
 LIP_CORE_API lip_function_t*
 lip_compiler_end(lip_compiler_t* compiler, lip_allocator_t* allocator);
 
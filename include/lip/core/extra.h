@@ -4,7 +4,49 @@
 #include "common.h"
 #include "vendor/khash.h"
 
+typedef struct lip_hashed_string_ref_s lip_hashed_string_ref_t;
+
+/// A lip_string_ref_s along with the hash of its content.
+struct lip_hashed_string_ref_s
+{
+	lip_string_ref_t str;
+	uint32_t hash;
+};
+
 KHASH_DECLARE(lip_string_ref_set, lip_string_ref_t, char)
+KHASH_DECLARE(lip_ptr_set, void*, char)
+
+/// Hash the content of a string. The result is never 0.
+LIP_CORE_API uint32_t
+lip_string_ref_hash(lip_string_ref_t str);
+
+/// Hash a lip_string_s, the result is cached in lip_string_s::hash.
+LIP_CORE_API uint32_t
+lip_string_hash(lip_string_t* str);
+
+LIP_MAYBE_UNUSED static inline lip_hashed_string_ref_t
+lip_hashed_string_ref(lip_string_ref_t str)
+{
+	return (lip_hashed_string_ref_t){
+		.str = str,
+		.hash = lip_string_ref_hash(str)
+	};
+}
+
+LIP_MAYBE_UNUSED static inline lip_hashed_string_ref_t
+lip_hashed_string_ref_from_string(lip_string_t* str)
+{
+	return (lip_hashed_string_ref_t){
+		.str = { .length = str->length, .ptr = str->ptr },
+		.hash = lip_string_hash(str)
+	};
+}
+
+LIP_MAYBE_UNUSED static inline bool
+lip_hashed_string_ref_equal(lip_hashed_string_ref_t lhs, lip_hashed_string_ref_t rhs)
+{
+	return lhs.hash == rhs.hash && lip_string_ref_equal(lhs.str, rhs.str);
+}
 
 #define LIP_STREAM(F) \
 	F(LIP_STREAM_OK) \
@@ -65,6 +65,40 @@ struct lip_fs_s
 	 * Should have similar behaviour to `strerror(errno)`.
 	 */
 	lip_string_ref_t(*last_error)(lip_fs_t* self);
+
+	/**
+	 * @brief Optional callback to rename a file, replacing `to` if it exists.
+	 *
+	 * Should have similar behaviour to `rename(from, to) == 0`.
+	 * Can be `NULL`, lip_runtime_config_s::bytecode_cache_dir is then never
+	 * written to.
+	 */
+	bool(*rename)(lip_fs_t* self, lip_string_ref_t from, lip_string_ref_t to);
+
+	/**
+	 * @brief Callback to remove a file, required along with lip_fs_s::rename.
+	 *
+	 * Should have similar behaviour to `remove(path)`.
+	 */
+	void(*remove)(lip_fs_t* self, lip_string_ref_t path);
+
+	/**
+	 * @brief Optional callback to map a file into read-only memory.
+	 *
+	 * Compiled scripts are executed in place when this is available.
+	 * Can be `NULL` if the filesystem does not support mapping.
+	 *
+	 * @param self Filesystem.
+	 * @param path Path to file.
+	 * @param size Receives the size of the file.
+	 * @return start of the mapping or `NULL` if file cannot be mapped.
+	 */
+	const void*(*map)(lip_fs_t* self, lip_string_ref_t path, size_t* size);
+
+	/**
+	 * @brief Callback to release a mapping previously returned by lip_fs_s::map.
+	 */
+	void(*unmap)(lip_fs_t* self, const void* ptr, size_t size);
 };
 
 /// Input stream interface.
@@ -11,6 +11,7 @@
 	F(LIP_OP_POP) \
 	F(LIP_OP_NIL) \
 	F(LIP_OP_LDK) \
+	F(LIP_OP_LDS) \
 	F(LIP_OP_LDI) \
 	F(LIP_OP_LDB) \
 	F(LIP_OP_PLHR) \
@@ -18,15 +19,21 @@
 	F(LIP_OP_LDLV) \
 	F(LIP_OP_LDCV) \
 	F(LIP_OP_IMP) \
-	F(LIP_OP_IMPS) \
 	F(LIP_OP_SET) \
 	F(LIP_OP_JMP) \
 	F(LIP_OP_JOF) \
 	F(LIP_OP_CALL) \
 	F(LIP_OP_TAIL) \
+	F(LIP_OP_CALLK) \
+	F(LIP_OP_TAILK) \
+	F(LIP_OP_CALLSELF) \
+	F(LIP_OP_TAILSELF) \
 	F(LIP_OP_RET) \
 	F(LIP_OP_CLS) \
 	F(LIP_OP_RCLS) \
+	F(LIP_OP_LCLS) \
+	F(LIP_OP_LLST) \
+	F(LIP_OP_WIDE) \
 	F(LIP_OP_ADD) \
 	F(LIP_OP_SUB) \
 	F(LIP_OP_MUL) \
@@ -38,7 +45,17 @@
 	F(LIP_OP_GT) \
 	F(LIP_OP_LT) \
 	F(LIP_OP_GTE) \
-	F(LIP_OP_LTE)
+	F(LIP_OP_LTE) \
+	F(LIP_OP_ADDN) \
+	F(LIP_OP_SUBN) \
+	F(LIP_OP_MULN) \
+	F(LIP_OP_FDIVN) \
+	F(LIP_OP_EQN) \
+	F(LIP_OP_NEQN) \
+	F(LIP_OP_GTN) \
+	F(LIP_OP_LTN) \
+	F(LIP_OP_GTEN) \
+	F(LIP_OP_LTEN)
 
 LIP_ENUM(lip_opcode_t, LIP_OP)
 
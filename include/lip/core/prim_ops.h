@@ -33,4 +33,33 @@
 
 LIP_PRIM_OP(LIP_DECLARE_PRIM_OP)
 
+/**
+ * @brief Compare two values.
+ *
+ * Values of different types are ordered by type.
+ * Strings and lists are compared by content.
+ * Symbols are interned and compared by identity: their relative order is
+ * arbitrary but consistent within a runtime.
+ *
+ * @return 0 if the values are equal, a negative number if `lhs` is ordered
+ * before `rhs` and a positive number otherwise.
+ */
+LIP_CORE_API int
+lip_gen_cmp(lip_value_t lhs, lip_value_t rhs);
+
+/// Compare two numbers the same way ::lip_gen_cmp does.
+LIP_MAYBE_UNUSED static inline int
+lip_number_cmp(double lhs, double rhs)
+{
+	if(lhs < rhs) { return -1; }
+	if(lhs > rhs) { return 1; }
+	if(lhs == rhs) { return 0; }
+	// NaNs are equal to each other and ordered before other numbers
+	return (rhs != rhs) - (lhs != lhs);
+}
+
+/// Hash a value. Values which compare equal with ::lip_gen_cmp hash to the same value.
+LIP_CORE_API uint32_t
+lip_gen_hash(lip_value_t value);
+
 #endif
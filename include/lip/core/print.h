@@ -27,6 +27,22 @@ lip_print_list(
 	const lip_list_t* list
 );
 
+LIP_CORE_API void
+lip_print_map(
+	unsigned int depth,
+	unsigned int indent,
+	lip_out_t* output,
+	const lip_map_t* map
+);
+
+LIP_CORE_API void
+lip_print_vec(
+	unsigned int depth,
+	unsigned int indent,
+	lip_out_t* output,
+	const lip_vec_t* vec
+);
+
 LIP_CORE_API void
 lip_print_closure(
 	unsigned int depth,
@@ -14,8 +14,15 @@
 typedef struct lip_stack_frame_s lip_stack_frame_t;
 typedef struct lip_function_layout_s lip_function_layout_t;
 typedef struct lip_import_s lip_import_t;
+typedef struct lip_loc_reader_s lip_loc_reader_t;
 typedef struct lip_runtime_interface_s lip_runtime_interface_t;
 
+/**
+ * Services of the runtime used by a VM.
+ *
+ * `intern` was added with interned symbols: implementations written before it
+ * must set it, and code built against the previous layout must be rebuilt.
+ */
 struct lip_runtime_interface_s
 {
 	bool(*resolve_import)(
@@ -23,28 +30,55 @@ struct lip_runtime_interface_s
 		lip_string_t* symbol_name,
 		lip_value_t* result
 	);
+	/// Return the interned copy of `name`, `NULL` if no more symbols can be interned
+	lip_string_t*(*intern)(lip_runtime_interface_t* rt, lip_string_ref_t name);
 	void*(*malloc)(lip_runtime_interface_t* rt, lip_value_type_t type, size_t size);
 	const char*(*format)(lip_runtime_interface_t* rt, const char* fmt, va_list args);
 };
 
+#define LIP_IMPORT(F) \
+	F(LIP_IMPORT_UNUSED) \
+	F(LIP_IMPORT_FUNCTION) \
+	F(LIP_IMPORT_SYMBOL)
+
+/// How the instructions of a function use an import
+LIP_ENUM(lip_import_kind_t, LIP_IMPORT)
+
 struct lip_import_s
 {
 	uint32_t name;
-	lip_value_t value;
+	/// A lip_import_kind_t, so imports are linked without decoding instructions
+	uint32_t kind;
 };
 
+/**
+ * Operand stack slots allocated below lip_vm_config_s::os_len so that a frame
+ * using all of it can still shift its arguments for an empty vararg list and
+ * push an error message.
+ */
+#define LIP_VM_STACK_RESERVE 2
+
+/// Version of the serialised layout below and of the instruction encoding
+#define LIP_BYTECODE_VERSION 9
+
 /**
  * Layout:
  *
  * [lip_function_t]: header
  * [lip_string_t]: source name
- * [lip_import_t...]: imports
+ * [lip_import_t...]: imports, followed by the symbols loaded with LIP_OP_LDS.
+ *   Imports replaced with builtin operations are kept as LIP_IMPORT_UNUSED.
  * [lip_value_t...]: constant pool, with each string as offset to lip_string_t
  * [uint32_t...]: nested function offsets
  * [lip_instruction_t...]: instructions
- * [lip_loc_range_t...]: source locations
  * [lip_string_t...]: string pool, including source name
  * [lip_function_t...]: nested functions
+ * [uint8_t...]: location table, see ::lip_function_location
+ *
+ * A function is never written to once it is loaded so it can be executed from
+ * read-only memory. Linked imports are kept in a separate link table instead:
+ * one value per import of the function, followed by the link tables of its
+ * nested functions.
  */
 struct lip_function_s
 {
@@ -54,10 +88,18 @@ struct lip_function_s
 	uint8_t num_args;
 	uint8_t is_vararg;
 	uint16_t num_locals;
-	uint16_t num_imports;
-	uint16_t num_constants;
-	uint16_t num_instructions;
-	uint16_t num_functions;
+	uint32_t num_imports;
+	uint32_t num_constants;
+	uint32_t num_instructions;
+	uint32_t num_functions;
+	/// Length of the link table, including the ones of nested functions
+	uint32_t num_links;
+	/// Offset of the link table in the link table of the enclosing function
+	uint32_t link_offset;
+	/// Deepest use of the operand stack, see ::lip_verify_instructions
+	uint32_t max_stack;
+	/// Offset of the location table, 0 if it was stripped
+	uint32_t location_offset;
 };
 
 struct lip_function_layout_s
@@ -67,7 +109,15 @@ struct lip_function_layout_s
 	lip_value_t* constants;
 	uint32_t* function_offsets;
 	lip_instruction_t* instructions;
-	lip_loc_range_t* locations;
+};
+
+/// Sequential reader of a location table, see ::lip_function_location
+struct lip_loc_reader_s
+{
+	const uint8_t* next;
+	const uint8_t* end;
+	uint32_t run_length;
+	lip_loc_range_t location;
 };
 
 struct lip_closure_s
@@ -79,8 +129,10 @@ struct lip_closure_s
 	} function;
 
 	lip_string_t* debug_name;
+	/// Link table of the function, `NULL` for native functions
+	lip_value_t* links;
 
-	unsigned env_len:8;
+	unsigned env_len:24;
 	unsigned is_native:1;
 
 	LIP_FLEXIBLE_ARRAY_MEMBER(lip_value_t, environment);
@@ -110,6 +162,14 @@ struct lip_vm_s
 	lip_value_t* sp;
 	lip_stack_frame_t* fp;
 	lip_vm_hook_t* hook;
+
+	/// Bounds of the stacks, checked once per call instead of on every push
+	lip_value_t* os_limit;
+	lip_value_t* env_limit;
+	lip_stack_frame_t* cs_limit;
+
+	/// Lowest environment pointer of a script frame, see ::lip_vm_max_env_depth
+	lip_value_t* env_low;
 };
 
 struct lip_string_t_alignment_helper
@@ -147,6 +207,76 @@ lip_vm_init(
 	void* mem
 );
 
+/// Deepest use of the environment stack since the vm was initialized, in values
+LIP_CORE_API size_t
+lip_vm_max_env_depth(const lip_vm_t* vm);
+
+/**
+ * Check the instructions of a function so that the VM can execute them without
+ * further checks: opcodes, operand ranges, jump targets and the depth of the
+ * operand stack along every path.
+ *
+ * Arguments, locals and captured variables are only checked with `check_frame`
+ * since the assembler does not know them yet.
+ * Nested functions are not checked.
+ *
+ * @return `NULL` with the deepest use of the operand stack in `max_stack`, or
+ * a description of the problem.
+ */
+LIP_CORE_API const char*
+lip_verify_instructions(
+	lip_allocator_t* allocator,
+	const lip_function_t* function,
+	bool check_frame,
+	uint32_t num_captures,
+	uint32_t* max_stack
+);
+
+/**
+ * Check a function from an untrusted source, including its layout and its
+ * nested functions.
+ *
+ * @param size Number of bytes readable at `function`.
+ * @param num_captures Size of the environment of closures of `function`.
+ *
+ * @return `NULL` if the function can be executed, or a description of the
+ * problem.
+ */
+LIP_CORE_API const char*
+lip_verify_function(
+	lip_allocator_t* allocator,
+	const lip_function_t* function,
+	size_t size,
+	uint32_t num_captures
+);
+
+/**
+ * Decode an entry of the location table of a function.
+ *
+ * The table is a sequence of runs of entries sharing a location. Each run is
+ * written as its length, the start of the location relative to the start of
+ * the previous run and the end relative to its own start, all as zigzag
+ * LEB128. A run of length 0 ends the table.
+ *
+ * It is not needed to execute a function so it is only decoded when reporting
+ * errors, in tracebacks and by tools.
+ *
+ * @param index 0 for the location of the function itself, `i + 1` for the one
+ * of instruction `i`.
+ *
+ * @return The location or ::LIP_LOC_NOWHERE if it was stripped.
+ */
+LIP_CORE_API lip_loc_range_t
+lip_function_location(const lip_function_t* function, uint32_t index);
+
+/// Start reading all entries of the location table of a function in order
+LIP_CORE_API void
+lip_loc_reader_init(lip_loc_reader_t* reader, const lip_function_t* function);
+
+/// Read the next entry of a location table, ::LIP_LOC_NOWHERE past its end
+LIP_CORE_API lip_loc_range_t
+lip_loc_reader_next(lip_loc_reader_t* reader);
+
 LIP_MAYBE_UNUSED static inline void
 lip_vm_reset(lip_vm_t* vm)
 {
@@ -173,9 +303,6 @@ lip_function_layout(const lip_function_t* function, lip_function_layout_t* layou
 	layout->instructions = (lip_instruction_t*)lip_align_ptr(
 		layout->function_offsets + function->num_functions, LIP_ALIGN_OF(lip_instruction_t)
 	);
-	layout->locations = (lip_loc_range_t*)lip_align_ptr(
-		layout->instructions + function->num_instructions, LIP_ALIGN_OF(lip_loc_range_t)
-	);
 }
 
 LIP_MAYBE_UNUSED static inline void*
@@ -184,6 +311,42 @@ lip_function_resource(const lip_function_t* function, uint32_t offset)
 	return ((char*)function + offset);
 }
 
+/// Allocate an unlinked link table for a function
+LIP_MAYBE_UNUSED static inline lip_value_t*
+lip_new_link_table(lip_allocator_t* allocator, const lip_function_t* function)
+{
+	size_t num_links = LIP_MAX(function->num_links, 1);
+	lip_value_t* links = lip_malloc(allocator, sizeof(lip_value_t) * num_links);
+	for(size_t i = 0; i < num_links; ++i)
+	{
+		links[i] = (lip_value_t){ .type = LIP_VAL_PLACEHOLDER };
+	}
+
+	return links;
+}
+
+/**
+ * Number of environment slots needed to hold a closure in a frame's scratch
+ * region.
+ *
+ * Closures which do not escape their frame are placed right after the frame's
+ * locals (see ::LIP_OP_LCLS) and are released together with them on return.
+ */
+LIP_MAYBE_UNUSED static inline size_t
+lip_closure_scratch_slots(unsigned int num_captures)
+{
+	size_t size = sizeof(lip_closure_t) + sizeof(lip_value_t) * num_captures;
+	return (size + sizeof(lip_value_t) - 1) / sizeof(lip_value_t);
+}
+
+/// Number of environment slots needed to hold a list in a frame's scratch region.
+LIP_MAYBE_UNUSED static inline size_t
+lip_list_scratch_slots(unsigned int num_elements)
+{
+	return (sizeof(lip_list_t) + sizeof(lip_value_t) - 1) / sizeof(lip_value_t)
+		+ num_elements;
+}
+
 LIP_MAYBE_UNUSED static inline bool
 lip_stack_frame_is_native(const lip_stack_frame_t* frame)
 {
@@ -199,7 +362,7 @@ lip_vm_memory_layout(
 )
 {
 	os_block->element_size = sizeof(lip_value_t);
-	os_block->num_elements = config->os_len;
+	os_block->num_elements = config->os_len + LIP_VM_STACK_RESERVE;
 	os_block->alignment = LIP_ALIGN_OF(lip_value_t);
 
 	env_block->element_size = sizeof(lip_value_t);
@@ -7,4 +7,16 @@
 LIP_STD_API void
 lip_load_stdlib(lip_context_t* ctx);
 
+/**
+ * @brief Load the `vec` module.
+ *
+ * Kernels are chosen once per process for the best instruction set supported
+ * by the CPU. They give the same results on every instruction set: reductions
+ * add elements in a fixed order and `min` and `max` return NaN if any element
+ * is NaN.
+ * This is called by ::lip_load_stdlib.
+ */
+LIP_STD_API void
+lip_load_veclib(lip_context_t* ctx);
+
 #endif
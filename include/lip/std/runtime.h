@@ -20,6 +20,7 @@
  * - Initialize lip_runtime_config_s::module_search_patterns with the following:
  *   `?.lip`, `?.lipc`, `?/index.lip`, `?/index.lipc`, `!.lip`, `!.lipc`,
  *   '!/index.lip`, `!/index.lipc`
+ * - Set lip_runtime_config_s::max_symbols to 65536.
  *
  */
 LIP_STD_API lip_runtime_config_t*
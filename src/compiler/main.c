@@ -4,6 +4,7 @@
 #include <lip/core/print.h>
 #include <lip/std/runtime.h>
 #include <lip/std/io.h>
+#include <lip/std/lib.h>
 #define OPTPARSE_IMPLEMENTATION
 #define OPTPARSE_API static
 #include <optparse/optparse.h>
@@ -16,6 +17,8 @@ const struct optparse_long opts[] = {
 	{ "version", 'v', OPTPARSE_NONE },
 	{ "output", 'o', OPTPARSE_REQUIRED },
 	{ "inspect", 'i', OPTPARSE_OPTIONAL },
+	{ "bundle", 'b', OPTPARSE_NONE },
+	{ "strip", 's', OPTPARSE_NONE },
 	{ 0 }
 };
 
@@ -24,27 +27,100 @@ const char* help[] = {
 	NULL, "Show version information",
 	"name", "Output bytecode to file `name`",
 	"depth", "Inspect script up to depth `depth` (default: 1)",
+	NULL, "Compile all inputs as modules into a bundle",
+	NULL, "Leave out source locations from the output",
 };
 
 static void
 show_usage()
 {
 	fprintf(stderr, "Usage: lipc [options] [--] <input>\n");
+	fprintf(stderr, "       lipc --bundle --output <bundle> [--] <input>...\n");
 	fprintf(stderr, "Available options:\n");
 	show_options(opts, help);
 	fprintf(stderr, "\nUse '-' as `input` to read from stdin\n");
+	fprintf(stderr, "Module names in a bundle follow input paths: 'foo/bar.lip' is 'foo.bar'\n");
+}
+
+// Inverse of the `?` module search pattern
+static char*
+module_name(const char* path)
+{
+	if(strncmp(path, "./", 2) == 0) { path += 2; }
+
+	size_t length = strlen(path);
+	const char* slash = strrchr(path, '/');
+	const char* dot = strrchr(path, '.');
+	if(dot && (!slash || dot > slash)) { length = dot - path; }
+	if(length > 5 && strncmp(path + length - 5, "/init", 5) == 0) { length -= 5; }
+
+	char* name = malloc(length + 1);
+	for(size_t i = 0; i < length; ++i)
+	{
+		name[i] = path[i] == '/' ? '.' : path[i];
+	}
+	name[length] = '\0';
+	return name;
+}
+
+static bool
+dump_bundle(
+	lip_context_t* ctx,
+	unsigned int num_inputs,
+	const char** inputs,
+	const char* output_file
+)
+{
+	lip_string_ref_t* names = malloc(sizeof(lip_string_ref_t) * num_inputs);
+	lip_script_t** scripts = malloc(sizeof(lip_script_t*) * num_inputs);
+	unsigned int num_scripts = 0;
+
+	bool result = true;
+	for(unsigned int i = 0; i < num_inputs && result; ++i)
+	{
+		scripts[i] = lip_load_script(ctx, lip_string_ref(inputs[i]), NULL);
+		if(scripts[i])
+		{
+			names[i] = lip_string_ref(module_name(inputs[i]));
+			++num_scripts;
+		}
+		else
+		{
+			result = false;
+		}
+	}
+
+	if(result)
+	{
+		result = lip_dump_bundle(
+			ctx, num_scripts, names, scripts, lip_string_ref(output_file), NULL
+		);
+	}
+
+	if(!result) { lip_print_error(lip_stderr(), ctx); }
+
+	for(unsigned int i = 0; i < num_scripts; ++i)
+	{
+		lip_unload_script(ctx, scripts[i]);
+		free((char*)names[i].ptr);
+	}
+	free(scripts);
+	free(names);
+
+	return result;
 }
 
 int
 main(int argc, char* argv[])
 {
-	(void)argc;
-
 	int exit_code = EXIT_SUCCESS;
 
 	const char* input_file = NULL;
 	const char* output_file = NULL;
 	int print_depth = -1;
+	bool bundle = false;
+	bool strip = false;
+	const char** inputs = NULL;
 
 	lip_runtime_config_t* config = NULL;
 	lip_runtime_t* runtime = NULL;
@@ -77,6 +153,12 @@ main(int argc, char* argv[])
 			case 'i':
 				print_depth = options.optarg ? atoi(options.optarg) : 1;
 				break;
+			case 'b':
+				bundle = true;
+				break;
+			case 's':
+				strip = true;
+				break;
 		}
 	}
 
@@ -90,8 +172,30 @@ main(int argc, char* argv[])
 	}
 
 	config = lip_create_std_runtime_config(NULL);
+	config->strip_debug_info = strip;
 	runtime = lip_create_runtime(config);
 	ctx = lip_create_context(runtime, NULL);
+	// Calls to the standard library are compiled knowing its functions
+	lip_load_stdlib(ctx);
+
+	if(bundle)
+	{
+		if(!output_file)
+		{
+			fprintf(stderr, "lipc: A bundle needs an output file\n");
+			show_usage();
+			quit(EXIT_FAILURE);
+		}
+
+		inputs = malloc(sizeof(const char*) * argc);
+		unsigned int num_inputs = 0;
+		for(const char* arg = input_file; arg; arg = optparse_arg(&options))
+		{
+			inputs[num_inputs++] = arg;
+		}
+
+		quit(dump_bundle(ctx, num_inputs, inputs, output_file) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
 
 	lip_in_t* input;
 
@@ -130,6 +234,7 @@ main(int argc, char* argv[])
 	}
 
 quit:
+	free(inputs);
 	if(script) { lip_unload_script(ctx, script); }
 	if(ctx) { lip_destroy_context(ctx); }
 	if(runtime) { lip_destroy_runtime(runtime); }
@@ -12,20 +12,38 @@ lip_asm_init(lip_asm_t* lasm, lip_allocator_t* allocator)
 	lasm->instructions = lip_array_create(allocator, lip_tagged_instruction_t, 0);
 	lasm->functions = lip_array_create(allocator, lip_function_t*, 0);
 	lasm->imports = lip_array_create(allocator, uint32_t, 0);
+	lasm->linked_imports = lip_array_create(allocator, lip_asm_index_t, 0);
+	lasm->symbols = lip_array_create(allocator, uint32_t, 0);
 	lasm->constants = lip_array_create(allocator, lip_value_t, 0);
 	lasm->string_pool = lip_array_create(allocator, lip_string_ref_t, 0);
 	lasm->string_layout = lip_array_create(allocator, lip_memblock_info_t, 0);
 	lasm->nested_layout = lip_array_create(allocator, lip_memblock_info_t, 0);
 	lasm->function_layout = lip_array_create(allocator, lip_memblock_info_t*, 0);
+	lasm->location_table = lip_array_create(allocator, uint8_t, 0);
+	lasm->string_index = kh_init(lip_asm_string_index, allocator);
+	lasm->import_index = kh_init(lip_asm_index_map, allocator);
+	lasm->symbol_index = kh_init(lip_asm_index_map, allocator);
+	lasm->number_index = kh_init(lip_asm_index_map, allocator);
+	lasm->string_constant_index = kh_init(lip_asm_index_map, allocator);
+	lasm->strip_debug_info = false;
+	lasm->error = NULL;
 }
 
 void lip_asm_cleanup(lip_asm_t* lasm)
 {
+	kh_destroy(lip_asm_index_map, lasm->string_constant_index);
+	kh_destroy(lip_asm_index_map, lasm->number_index);
+	kh_destroy(lip_asm_index_map, lasm->symbol_index);
+	kh_destroy(lip_asm_index_map, lasm->import_index);
+	kh_destroy(lip_asm_string_index, lasm->string_index);
+	lip_array_destroy(lasm->location_table);
 	lip_array_destroy(lasm->function_layout);
 	lip_array_destroy(lasm->nested_layout);
 	lip_array_destroy(lasm->string_layout);
 	lip_array_destroy(lasm->string_pool);
 	lip_array_destroy(lasm->constants);
+	lip_array_destroy(lasm->symbols);
+	lip_array_destroy(lasm->linked_imports);
 	lip_array_destroy(lasm->imports);
 	lip_array_destroy(lasm->functions);
 	lip_array_destroy(lasm->instructions);
@@ -37,16 +55,25 @@ void lip_asm_begin(lip_asm_t* lasm, lip_string_ref_t source_name, lip_loc_range_
 {
 	lasm->source_name = source_name;
 	lasm->location = location;
+	lasm->error = NULL;
 	lip_array_clear(lasm->labels);
 	lip_array_clear(lasm->jumps);
 	lip_array_clear(lasm->instructions);
 	lip_array_clear(lasm->functions);
 	lip_array_clear(lasm->imports);
+	lip_array_clear(lasm->linked_imports);
+	lip_array_clear(lasm->symbols);
 	lip_array_clear(lasm->constants);
 	lip_array_clear(lasm->string_pool);
 	lip_array_clear(lasm->string_layout);
 	lip_array_clear(lasm->nested_layout);
 	lip_array_clear(lasm->function_layout);
+	lip_array_clear(lasm->location_table);
+	kh_clear(lip_asm_string_index, lasm->string_index);
+	kh_clear(lip_asm_index_map, lasm->import_index);
+	kh_clear(lip_asm_index_map, lasm->symbol_index);
+	kh_clear(lip_asm_index_map, lasm->number_index);
+	kh_clear(lip_asm_index_map, lasm->string_constant_index);
 }
 
 lip_asm_index_t
@@ -73,16 +100,12 @@ lip_asm_new_function(lip_asm_t* lasm, lip_function_t* function)
 static uint32_t
 lip_asm_alloc_string(lip_asm_t* lasm, lip_string_ref_t string)
 {
-	uint32_t num_strings = lip_array_len(lasm->string_pool);
-	for(uint32_t i = 0; i < num_strings; ++i)
-	{
-		if(lip_string_ref_equal(lasm->string_pool[i], string))
-		{
-			return i;
-		}
-	}
+	int ret;
+	khiter_t itr = kh_put(lip_asm_string_index, lasm->string_index, string, &ret);
+	if(ret == 0) { return kh_val(lasm->string_index, itr); }
 
 	uint32_t index = lip_array_len(lasm->string_pool);
+	kh_val(lasm->string_index, itr) = index;
 	lip_array_push(lasm->string_pool, string);
 	lip_array_push(lasm->string_layout, ((lip_memblock_info_t){
 		.element_size = sizeof(lip_string_t) + string.length + 1, // 1 = null-terminator
@@ -95,34 +118,39 @@ lip_asm_alloc_string(lip_asm_t* lasm, lip_string_ref_t string)
 lip_asm_index_t
 lip_asm_alloc_import(lip_asm_t* lasm, lip_string_ref_t import)
 {
-	uint32_t num_imports = lip_array_len(lasm->imports);
-	for(uint32_t i = 0; i < num_imports; ++i)
-	{
-		if(lip_string_ref_equal(lasm->string_pool[lasm->imports[i]], import))
-		{
-			return i;
-		}
-	}
+	uint32_t string_index = lip_asm_alloc_string(lasm, import);
+
+	int ret;
+	khiter_t itr = kh_put(lip_asm_index_map, lasm->import_index, string_index, &ret);
+	if(ret == 0) { return kh_val(lasm->import_index, itr); }
 
 	uint32_t index = lip_array_len(lasm->imports);
-	lip_array_push(lasm->imports, lip_asm_alloc_string(lasm, import));
+	kh_val(lasm->import_index, itr) = index;
+	lip_array_push(lasm->imports, string_index);
+	return index;
+}
+
+lip_asm_index_t
+lip_asm_alloc_linked_import(lip_asm_t* lasm, lip_string_ref_t import)
+{
+	lip_asm_index_t index = lip_asm_alloc_import(lasm, import);
+	lip_array_push(lasm->linked_imports, index);
 	return index;
 }
 
 lip_asm_index_t
 lip_asm_alloc_numeric_constant(lip_asm_t* lasm, double number)
 {
-	uint32_t num_constants = lip_array_len(lasm->constants);
-	for(uint32_t i = 0; i < num_constants; ++i)
-	{
-		lip_value_t constant = lasm->constants[i];
-		if(constant.type == LIP_VAL_NUMBER && constant.data.number == number)
-		{
-			return i;
-		}
-	}
+	// Constants are told apart by their bit pattern
+	uint64_t key;
+	memcpy(&key, &number, sizeof(key));
+
+	int ret;
+	khiter_t itr = kh_put(lip_asm_index_map, lasm->number_index, key, &ret);
+	if(ret == 0) { return kh_val(lasm->number_index, itr); }
 
 	uint32_t index = lip_array_len(lasm->constants);
+	kh_val(lasm->number_index, itr) = index;
 	lip_array_push(lasm->constants, ((lip_value_t){
 		.type = LIP_VAL_NUMBER,
 		.data = {.number = number}
@@ -130,41 +158,39 @@ lip_asm_alloc_numeric_constant(lip_asm_t* lasm, double number)
 	return index;
 }
 
-static lip_asm_index_t
-lip_asm_alloc_string_type_constant(
-	lip_asm_t* lasm, lip_string_ref_t string, lip_value_type_t type
-)
+lip_asm_index_t
+lip_asm_alloc_string_constant(lip_asm_t* lasm, lip_string_ref_t string)
 {
-	uint32_t num_constants = lip_array_len(lasm->constants);
-	for(uint32_t i = 0; i < num_constants; ++i)
-	{
-		lip_value_t constant = lasm->constants[i];
-		if(true
-			&& constant.type == type
-			&& lip_string_ref_equal(lasm->string_pool[constant.data.index], string))
-		{
-			return i;
-		}
-	}
+	uint32_t string_index = lip_asm_alloc_string(lasm, string);
+
+	int ret;
+	khiter_t itr = kh_put(
+		lip_asm_index_map, lasm->string_constant_index, string_index, &ret
+	);
+	if(ret == 0) { return kh_val(lasm->string_constant_index, itr); }
 
 	uint32_t index = lip_array_len(lasm->constants);
+	kh_val(lasm->string_constant_index, itr) = index;
 	lip_array_push(lasm->constants, ((lip_value_t){
-		.type = type,
-		.data = {.index = lip_asm_alloc_string(lasm, string)}
+		.type = LIP_VAL_STRING,
+		.data = {.index = string_index}
 	}));
 	return index;
 }
 
-lip_asm_index_t
-lip_asm_alloc_string_constant(lip_asm_t* lasm, lip_string_ref_t string)
-{
-	return lip_asm_alloc_string_type_constant(lasm, string, LIP_VAL_STRING);
-}
-
 lip_asm_index_t
 lip_asm_alloc_symbol(lip_asm_t* lasm, lip_string_ref_t string)
 {
-	return lip_asm_alloc_string_type_constant(lasm, string, LIP_VAL_SYMBOL);
+	uint32_t string_index = lip_asm_alloc_string(lasm, string);
+
+	int ret;
+	khiter_t itr = kh_put(lip_asm_index_map, lasm->symbol_index, string_index, &ret);
+	if(ret == 0) { return kh_val(lasm->symbol_index, itr); }
+
+	uint32_t index = lip_array_len(lasm->symbols);
+	kh_val(lasm->symbol_index, itr) = index;
+	lip_array_push(lasm->symbols, string_index);
+	return index;
 }
 
 void
@@ -181,6 +207,109 @@ lip_asm_add(
 	}));
 }
 
+void
+lip_asm_add_pair(
+	lip_asm_t* lasm,
+	lip_opcode_t opcode,
+	uint32_t first,
+	uint32_t second,
+	lip_loc_range_t location
+)
+{
+	if(first <= LIP_PAIR_FIELD_MAX && second <= LIP_PAIR_FIELD_MAX)
+	{
+		lip_asm_add(lasm, opcode, first | (second << 12), location);
+	}
+	else
+	{
+		lip_asm_add(lasm, LIP_OP_WIDE, first, location);
+		lip_asm_add(lasm, opcode, second, location);
+	}
+}
+
+// Call opcode which also replaces the current frame, NOP if there is none
+static lip_opcode_t
+lip_asm_tail_opcode(lip_opcode_t opcode)
+{
+	switch(opcode)
+	{
+		case LIP_OP_CALL:
+			return LIP_OP_TAIL;
+		case LIP_OP_CALLK:
+			return LIP_OP_TAILK;
+		case LIP_OP_CALLSELF:
+			return LIP_OP_TAILSELF;
+		default:
+			return LIP_OP_NOP;
+	}
+}
+
+static void
+lip_asm_write_varint(lip_asm_t* lasm, uint32_t value)
+{
+	while(value >= 0x80)
+	{
+		lip_array_push(lasm->location_table, (uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	lip_array_push(lasm->location_table, (uint8_t)value);
+}
+
+// Lines and columns are unsigned but deltas can go both ways, so zigzag them
+static void
+lip_asm_write_delta(lip_asm_t* lasm, uint32_t value, uint32_t base)
+{
+	uint32_t delta = value - base;
+	lip_asm_write_varint(lasm, (delta << 1) ^ (0u - (delta >> 31)));
+}
+
+static void
+lip_asm_write_location_run(
+	lip_asm_t* lasm, uint32_t length, lip_loc_range_t location, lip_loc_t* previous
+)
+{
+	lip_asm_write_varint(lasm, length);
+	lip_asm_write_delta(lasm, location.start.line, previous->line);
+	lip_asm_write_delta(lasm, location.start.column, previous->column);
+	lip_asm_write_delta(lasm, location.end.line, location.start.line);
+	lip_asm_write_delta(lasm, location.end.column, location.start.column);
+	*previous = location.start;
+}
+
+static bool
+lip_asm_same_location(lip_loc_range_t lhs, lip_loc_range_t rhs)
+{
+	return true
+		&& lhs.start.line == rhs.start.line
+		&& lhs.start.column == rhs.start.column
+		&& lhs.end.line == rhs.end.line
+		&& lhs.end.column == rhs.end.column;
+}
+
+// See lip_function_location for the format
+static void
+lip_asm_encode_locations(lip_asm_t* lasm)
+{
+	lip_loc_t previous = { 0, 0 };
+	lip_loc_range_t run = lasm->location;
+	uint32_t length = 1;
+	lip_array_foreach(lip_tagged_instruction_t, itr, lasm->instructions)
+	{
+		if(lip_asm_same_location(itr->location, run))
+		{
+			++length;
+		}
+		else
+		{
+			lip_asm_write_location_run(lasm, length, run, &previous);
+			run = itr->location;
+			length = 1;
+		}
+	}
+	lip_asm_write_location_run(lasm, length, run, &previous);
+	lip_asm_write_varint(lasm, 0);
+}
+
 lip_function_t*
 lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 {
@@ -222,6 +351,7 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 
 	// Transform [JMP l] where l points to RET into [RET]
 	{
+		// Record the position of all labels first
 		lip_asm_index_t num_instructions = lip_array_len(lasm->instructions);
 		for(lip_asm_index_t i = 0; i < num_instructions; ++i)
 		{
@@ -229,19 +359,18 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 			lip_operand_t operand;
 			lip_disasm(lasm->instructions[i].instruction, &opcode, &operand);
 
-			if(opcode != LIP_OP_JMP) { continue; }
+			if((uint32_t)opcode == LIP_OP_LABEL) { lasm->labels[operand] = i; }
+		}
 
-			lip_instruction_t label = lip_asm(LIP_OP_LABEL, operand);
-			lip_asm_index_t jump_target = num_instructions;
-			for(lip_asm_index_t j = 0; j < num_instructions; ++j)
-			{
-				if(lasm->instructions[j].instruction == label)
-				{
-					jump_target = j + 1;
-					break;
-				}
-			}
+		for(lip_asm_index_t i = 0; i < num_instructions; ++i)
+		{
+			lip_opcode_t opcode;
+			lip_operand_t operand;
+			lip_disasm(lasm->instructions[i].instruction, &opcode, &operand);
+
+			if(opcode != LIP_OP_JMP) { continue; }
 
+			lip_asm_index_t jump_target = lasm->labels[operand] + 1;
 			for(lip_asm_index_t j = jump_target; j < num_instructions; ++j)
 			{
 				lip_opcode_t target_opcode;
@@ -312,7 +441,7 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 
 	// Perform Tail call optimization
 	{
-		// Transform [CALL n; RET] into [TAIL n]
+		// Transform [CALL n; RET] into [TAIL n], likewise for the other calls
 		lip_asm_index_t num_instructions = lip_array_len(lasm->instructions);
 		lip_asm_index_t out_index = 0;
 		for(lip_asm_index_t i = 0; i < num_instructions; ++i)
@@ -326,9 +455,10 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 				lip_disasm(lasm->instructions[i].instruction, &opcode1, &operand1);
 				lip_disasm(lasm->instructions[i + 1].instruction, &opcode2, &operand2);
 
-				if(opcode1 == LIP_OP_CALL && opcode2 == LIP_OP_RET)
+				lip_opcode_t tail_opcode = lip_asm_tail_opcode(opcode1);
+				if(tail_opcode != LIP_OP_NOP && opcode2 == LIP_OP_RET)
 				{
-					lip_instruction_t tailcall = lip_asm(LIP_OP_TAIL, operand1);
+					lip_instruction_t tailcall = lip_asm(tail_opcode, operand1);
 					lasm->instructions[out_index].instruction = tailcall;
 					++i;
 				}
@@ -346,7 +476,8 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 			lip_operand_t operand1;
 			lip_disasm(lasm->instructions[i].instruction, &opcode1, &operand1);
 
-			if(opcode1 != LIP_OP_CALL) { continue; }
+			lip_opcode_t tail_opcode = lip_asm_tail_opcode(opcode1);
+			if(tail_opcode == LIP_OP_NOP) { continue; }
 
 			for(lip_asm_index_t j = i + 1; j < num_instructions; ++j)
 			{
@@ -356,7 +487,7 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 
 				if(opcode2 == LIP_OP_RET)
 				{
-					lasm->instructions[i].instruction = lip_asm(LIP_OP_TAIL, operand1);
+					lasm->instructions[i].instruction = lip_asm(tail_opcode, operand1);
 				}
 				else if((uint32_t)opcode2 == LIP_OP_LABEL)
 				{
@@ -411,6 +542,27 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 		}
 	}
 
+	// Symbols are stored in the import table, after imports
+	{
+		lip_asm_index_t num_imports = lip_array_len(lasm->imports);
+		lip_array_foreach(lip_tagged_instruction_t, itr, lasm->instructions)
+		{
+			lip_opcode_t opcode;
+			lip_operand_t operand;
+			lip_disasm(itr->instruction, &opcode, &operand);
+
+			if(opcode == LIP_OP_LDS)
+			{
+				itr->instruction = lip_asm(LIP_OP_LDS, num_imports + operand);
+			}
+		}
+
+		lip_array_foreach(uint32_t, symbol, lasm->symbols)
+		{
+			lip_array_push(lasm->imports, *symbol);
+		}
+	}
+
 	size_t num_imports = lip_array_len(lasm->imports);
 	size_t num_constants = lip_array_len(lasm->constants);
 	size_t num_functions = lip_array_len(lasm->functions);
@@ -438,9 +590,6 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 	lip_memblock_info_t instruction_block = LIP_ARRAY_BLOCK(lip_instruction_t, num_instructions);
 	lip_array_push(lasm->function_layout, &instruction_block);
 
-	lip_memblock_info_t location_block = LIP_ARRAY_BLOCK(lip_loc_range_t, num_instructions + 1);
-	lip_array_push(lasm->function_layout, &location_block);
-
 	lip_array_foreach(lip_memblock_info_t, block, lasm->string_layout)
 	{
 		lip_array_push(lasm->function_layout, block);
@@ -451,6 +600,13 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 		lip_array_push(lasm->function_layout, block);
 	}
 
+	// Locations are only read when something goes wrong so they are kept
+	// away from the rest
+	if(!lasm->strip_debug_info) { lip_asm_encode_locations(lasm); }
+	lip_memblock_info_t location_block =
+		LIP_ARRAY_BLOCK(uint8_t, lip_array_len(lasm->location_table));
+	lip_array_push(lasm->function_layout, &location_block);
+
 	lip_memblock_info_t block_info = lip_align_memblocks(
 		lip_array_len(lasm->function_layout), lasm->function_layout
 	);
@@ -469,6 +625,7 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 
 	lip_string_t* source_name = lip_locate_memblock(function, &source_name_block);
 	source_name->length = lasm->source_name.length;
+	source_name->hash = lip_string_ref_hash(lasm->source_name);
 	memcpy(source_name->ptr, lasm->source_name.ptr, lasm->source_name.length);
 
 	lip_import_t* imports = lip_locate_memblock(function, &import_block);
@@ -476,10 +633,33 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 	{
 		uint32_t import_string_index = lasm->imports[i];
 		imports[i].name = lasm->string_layout[import_string_index].offset;
-		imports[i].value = (lip_value_t){
-			.type = LIP_VAL_PLACEHOLDER,
-			.data = { .reference = NULL }
-		};
+		imports[i].kind = LIP_IMPORT_UNUSED;
+	}
+
+	// Record how each import is used so linking does not need to decode
+	// instructions
+	lip_array_foreach(lip_tagged_instruction_t, itr, lasm->instructions)
+	{
+		lip_opcode_t opcode;
+		lip_operand_t operand;
+		lip_disasm(itr->instruction, &opcode, &operand);
+
+		if(opcode == LIP_OP_IMP)
+		{
+			imports[operand].kind = LIP_IMPORT_FUNCTION;
+		}
+		else if(opcode == LIP_OP_LDS)
+		{
+			imports[operand].kind = LIP_IMPORT_SYMBOL;
+		}
+	}
+
+	lip_array_foreach(lip_asm_index_t, index, lasm->linked_imports)
+	{
+		if(imports[*index].kind == LIP_IMPORT_UNUSED)
+		{
+			imports[*index].kind = LIP_IMPORT_FUNCTION;
+		}
 	}
 
 	lip_value_t* constants = lip_locate_memblock(function, &constant_block);
@@ -508,12 +688,19 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 	}
 
 	lip_instruction_t* instructions = lip_locate_memblock(function, &instruction_block);
-	lip_loc_range_t* locations = lip_locate_memblock(function, &location_block);
-	locations[0] = lasm->location;
 	for(uint32_t i = 0; i < num_instructions; ++i)
 	{
 		instructions[i] = lasm->instructions[i].instruction;
-		locations[i + 1] = lasm->instructions[i].location;
+	}
+
+	if(!lasm->strip_debug_info)
+	{
+		function->location_offset = location_block.offset;
+		memcpy(
+			lip_locate_memblock(function, &location_block),
+			lasm->location_table,
+			lip_array_len(lasm->location_table)
+		);
 	}
 
 	size_t num_strings = lip_array_len(lasm->string_pool);
@@ -521,15 +708,127 @@ lip_asm_end(lip_asm_t* lasm, lip_allocator_t* allocator)
 	{
 		lip_string_t* string = lip_locate_memblock(function, &lasm->string_layout[i]);
 		string->length = lasm->string_pool[i].length;
+		string->hash = lip_string_ref_hash(lasm->string_pool[i]);
 		memcpy(string->ptr, lasm->string_pool[i].ptr, lasm->string_pool[i].length);
 		string->ptr[string->length] = '\0';
 	}
 
+	function->num_links = num_imports;
 	for(uint32_t i = 0; i < num_functions; ++i)
 	{
 		lip_function_t* nested_function = lip_locate_memblock(function, &lasm->nested_layout[i]);
 		memcpy(nested_function, lasm->functions[i], lasm->functions[i]->size);
+		nested_function->link_offset = function->num_links;
+		function->num_links += nested_function->num_links;
 	}
 
+	// Nested functions were verified when they were assembled
+	lasm->error = lip_verify_instructions(
+		lasm->allocator, function, false, 0, &function->max_stack
+	);
+
 	return function;
 }
+
+static bool
+lip_read_varint(const uint8_t** itr, const uint8_t* end, uint32_t* value)
+{
+	uint32_t result = 0;
+	for(unsigned int shift = 0; shift < 32; shift += 7)
+	{
+		if(*itr == end) { return false; }
+
+		uint8_t byte = *(*itr)++;
+		result |= (uint32_t)(byte & 0x7F) << shift;
+		if((byte & 0x80) == 0)
+		{
+			*value = result;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool
+lip_read_delta(const uint8_t** itr, const uint8_t* end, uint32_t* delta)
+{
+	uint32_t value;
+	if(!lip_read_varint(itr, end, &value)) { return false; }
+
+	*delta = (value >> 1) ^ (0u - (value & 1));
+	return true;
+}
+
+// Decode the next run into reader->location
+static bool
+lip_loc_reader_next_run(lip_loc_reader_t* reader)
+{
+	uint32_t start_line, start_column, end_line, end_column;
+	bool valid = true
+		&& lip_read_varint(&reader->next, reader->end, &reader->run_length)
+		&& reader->run_length > 0
+		&& lip_read_delta(&reader->next, reader->end, &start_line)
+		&& lip_read_delta(&reader->next, reader->end, &start_column)
+		&& lip_read_delta(&reader->next, reader->end, &end_line)
+		&& lip_read_delta(&reader->next, reader->end, &end_column);
+	if(!valid)
+	{
+		reader->next = reader->end;
+		reader->run_length = 0;
+		reader->location = LIP_LOC_NOWHERE;
+		return false;
+	}
+
+	lip_loc_t start = {
+		.line = reader->location.start.line + start_line,
+		.column = reader->location.start.column + start_column
+	};
+	reader->location = (lip_loc_range_t){
+		.start = start,
+		.end = {
+			.line = start.line + end_line,
+			.column = start.column + end_column
+		}
+	};
+	return true;
+}
+
+void
+lip_loc_reader_init(lip_loc_reader_t* reader, const lip_function_t* function)
+{
+	const uint8_t* base = (const uint8_t*)function;
+	*reader = (lip_loc_reader_t){
+		.next = function->location_offset ? base + function->location_offset : NULL,
+		.end = function->location_offset ? base + function->size : NULL,
+		.run_length = 0,
+		.location = LIP_LOC_NOWHERE
+	};
+}
+
+lip_loc_range_t
+lip_loc_reader_next(lip_loc_reader_t* reader)
+{
+	if(reader->run_length == 0 && !lip_loc_reader_next_run(reader))
+	{
+		return LIP_LOC_NOWHERE;
+	}
+
+	--reader->run_length;
+	return reader->location;
+}
+
+lip_loc_range_t
+lip_function_location(const lip_function_t* function, uint32_t index)
+{
+	lip_loc_reader_t reader;
+	lip_loc_reader_init(&reader, function);
+	while(lip_loc_reader_next_run(&reader))
+	{
+		if(index < reader.run_length) { return reader.location; }
+
+		index -= reader.run_length;
+	}
+
+	return LIP_LOC_NOWHERE;
+}
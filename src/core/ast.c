@@ -15,23 +15,40 @@
 
 #define ENSURE(cond, msg) CHECK_SEXP(sexp, cond, msg)
 
-#define TRANSLATE(var, sexp) \
+#define TRANSLATE(var, scope, sexp) \
 	lip_ast_t* var; \
 	do { \
-		lip_ast_result_t result = lip_translate_sexp(allocator, sexp); \
+		lip_ast_result_t result = lip_translate_exp(allocator, (scope), sexp); \
 		if(!result.success) { return result; } \
 		var = result.value.result; \
 	} while(0)
 
-#define TRANSLATE_BLOCK(var, sexps, num_sexps) \
+#define TRANSLATE_BLOCK(var, scope, sexps, num_sexps) \
 	lip_array(lip_ast_t*) var = lip_array_create(\
 		allocator, lip_ast_t*, (num_sexps) \
 	); \
 	for(uint32_t i = 0; i < (num_sexps); ++i) { \
-		TRANSLATE(exp, &(sexps)[i]); \
+		TRANSLATE(exp, scope, &(sexps)[i]); \
 		lip_array_push(var, exp); \
 	}
 
+typedef struct lip_ast_scope_s lip_ast_scope_t;
+
+// Names bound around the expression being translated
+struct lip_ast_scope_s
+{
+	const lip_ast_scope_t* parent;
+	// Arguments of a `fn` or bindings of a `let`, `letrec` or `loop`
+	const lip_sexp_t* names;
+	size_t num_names;
+	bool is_lambda;
+};
+
+static lip_ast_result_t
+lip_translate_exp(
+	lip_allocator_t* allocator, const lip_ast_scope_t* scope, const lip_sexp_t* sexp
+);
+
 static lip_ast_result_t
 lip_success(lip_ast_t* ast)
 {
@@ -63,8 +80,43 @@ lip_alloc_ast(lip_allocator_t* allocator, const lip_sexp_t* sexp)
 	return ast;
 }
 
+// `loop` and `recur` are only special forms when they are not shadowed
+static bool
+lip_is_bound(const lip_ast_scope_t* scope, lip_string_ref_t name)
+{
+	for(; scope != NULL; scope = scope->parent)
+	{
+		for(size_t i = 0; i < scope->num_names; ++i)
+		{
+			const lip_sexp_t* sexp = &scope->names[i];
+			if(!scope->is_lambda)
+			{
+				if(sexp->type != LIP_SEXP_LIST || lip_array_len(sexp->data.list) == 0)
+				{
+					continue;
+				}
+
+				sexp = &sexp->data.list[0];
+			}
+			if(sexp->type != LIP_SEXP_SYMBOL) { continue; }
+
+			lip_string_ref_t bound_name = sexp->data.string;
+			if(scope->is_lambda && bound_name.length > 0 && bound_name.ptr[0] == '&')
+			{
+				++bound_name.ptr;
+				--bound_name.length;
+			}
+			if(lip_string_ref_equal(bound_name, name)) { return true; }
+		}
+	}
+
+	return false;
+}
+
 static lip_ast_result_t
-lip_translate_if(lip_allocator_t* allocator, const lip_sexp_t* sexp)
+lip_translate_if(
+	lip_allocator_t* allocator, const lip_ast_scope_t* scope, const lip_sexp_t* sexp
+)
 {
 	lip_array(lip_sexp_t) list = sexp->data.list;
 	unsigned int arity = lip_array_len(list) - 1;
@@ -73,12 +125,12 @@ lip_translate_if(lip_allocator_t* allocator, const lip_sexp_t* sexp)
 		arity == 2 || arity == 3,
 		"'if' must have the form: (if <condition> <then> [else])"
 	);
-	TRANSLATE(condition, &list[1]);
-	TRANSLATE(then, &list[2]);
+	TRANSLATE(condition, scope, &list[1]);
+	TRANSLATE(then, scope, &list[2]);
 	lip_ast_t* else_ = NULL;
 	if(arity == 3)
 	{
-		lip_ast_result_t result = lip_translate_sexp(allocator, &list[3]);
+		lip_ast_result_t result = lip_translate_exp(allocator, scope, &list[3]);
 		if(!result.success) { return result; }
 		else_ = result.value.result;
 	}
@@ -93,7 +145,10 @@ lip_translate_if(lip_allocator_t* allocator, const lip_sexp_t* sexp)
 
 static lip_ast_result_t
 lip_translate_let(
-	lip_allocator_t* allocator, const lip_sexp_t* sexp, bool recursive
+	lip_allocator_t* allocator,
+	const lip_ast_scope_t* scope,
+	const lip_sexp_t* sexp,
+	lip_ast_type_t type
 )
 {
 	lip_array(lip_sexp_t) list = sexp->data.list;
@@ -101,8 +156,10 @@ lip_translate_let(
 
 	ENSURE(
 		arity >= 2 && list[1].type == LIP_SEXP_LIST,
-		recursive ?
+		type == LIP_AST_LETREC ?
 			"'letrec' must have the form: (letrec (<bindings...>) <exp...>)" :
+		type == LIP_AST_LOOP ?
+			"'loop' must have the form: (loop (<bindings...>) <exp...>)" :
 			"'let' must have the form: (let (<bindings...>) <exp...>)"
 	);
 
@@ -111,6 +168,12 @@ lip_translate_let(
 		lip_let_binding_t,
 		lip_array_len(list[1].data.list)
 	);
+	// Only `letrec` bindings see the ones which follow them
+	lip_ast_scope_t inner_scope = {
+		.parent = scope,
+		.names = list[1].data.list,
+		.num_names = type == LIP_AST_LETREC ? lip_array_len(list[1].data.list) : 0
+	};
 	lip_array_foreach(lip_sexp_t, binding, list[1].data.list)
 	{
 		CHECK_SEXP(
@@ -120,25 +183,28 @@ lip_translate_let(
 			&& binding->data.list[0].type == LIP_SEXP_SYMBOL,
 			"a binding must have the form: (<symbol> <expr>)"
 		);
-		TRANSLATE(value, &binding->data.list[1]);
+		TRANSLATE(value, &inner_scope, &binding->data.list[1]);
 		lip_array_push(bindings, ((lip_let_binding_t){
 			.name = binding->data.list[0].data.string,
 			.value = value,
 			.location = binding->location
 		}));
+		inner_scope.num_names = LIP_MAX(inner_scope.num_names, lip_array_len(bindings));
 	}
 
-	TRANSLATE_BLOCK(body, &list[2], arity - 1);
+	TRANSLATE_BLOCK(body, &inner_scope, &list[2], arity - 1);
 
 	lip_ast_t* let = lip_alloc_ast(allocator, sexp);
-	let->type = recursive ? LIP_AST_LETREC : LIP_AST_LET;
+	let->type = type;
 	let->data.let.bindings = bindings;
 	let->data.let.body = body;
 	return lip_success(let);
 }
 
 static lip_ast_result_t
-lip_translate_lambda(lip_allocator_t* allocator, const lip_sexp_t* sexp)
+lip_translate_lambda(
+	lip_allocator_t* allocator, const lip_ast_scope_t* scope, const lip_sexp_t* sexp
+)
 {
 	lip_array(lip_sexp_t) list = sexp->data.list;
 	unsigned int arity = lip_array_len(list) - 1;
@@ -190,7 +256,13 @@ lip_translate_lambda(lip_allocator_t* allocator, const lip_sexp_t* sexp)
 		lip_array_push(arguments, arg_name);
 	}
 
-	TRANSLATE_BLOCK(body, &list[2], arity - 1);
+	lip_ast_scope_t inner_scope = {
+		.parent = scope,
+		.names = list[1].data.list,
+		.num_names = lip_array_len(list[1].data.list),
+		.is_lambda = true
+	};
+	TRANSLATE_BLOCK(body, &inner_scope, &list[2], arity - 1);
 
 	lip_ast_t* lambda = lip_alloc_ast(allocator, sexp);
 	lambda->type = LIP_AST_LAMBDA;
@@ -201,10 +273,12 @@ lip_translate_lambda(lip_allocator_t* allocator, const lip_sexp_t* sexp)
 }
 
 static lip_ast_result_t
-lip_translate_do(lip_allocator_t* allocator, const lip_sexp_t* sexp)
+lip_translate_do(
+	lip_allocator_t* allocator, const lip_ast_scope_t* scope, const lip_sexp_t* sexp
+)
 {
 	TRANSLATE_BLOCK(
-		body, sexp->data.list + 1, lip_array_len(sexp->data.list) - 1
+		body, scope, sexp->data.list + 1, lip_array_len(sexp->data.list) - 1
 	);
 
 	lip_ast_t* do_ = lip_alloc_ast(allocator, sexp);
@@ -214,13 +288,30 @@ lip_translate_do(lip_allocator_t* allocator, const lip_sexp_t* sexp)
 }
 
 static lip_ast_result_t
-lip_translate_application(lip_allocator_t* allocator, const lip_sexp_t* sexp)
+lip_translate_recur(
+	lip_allocator_t* allocator, const lip_ast_scope_t* scope, const lip_sexp_t* sexp
+)
+{
+	TRANSLATE_BLOCK(
+		args, scope, sexp->data.list + 1, lip_array_len(sexp->data.list) - 1
+	);
+
+	lip_ast_t* recur = lip_alloc_ast(allocator, sexp);
+	recur->type = LIP_AST_RECUR;
+	recur->data.recur = args;
+	return lip_success(recur);
+}
+
+static lip_ast_result_t
+lip_translate_application(
+	lip_allocator_t* allocator, const lip_ast_scope_t* scope, const lip_sexp_t* sexp
+)
 {
 	lip_sexp_t* list = sexp->data.list;
 	unsigned int arity = lip_array_len(list) - 1;
 
-	TRANSLATE(function, &list[0]);
-	TRANSLATE_BLOCK(arguments, &list[1], arity);
+	TRANSLATE(function, scope, &list[0]);
+	TRANSLATE_BLOCK(arguments, scope, &list[1], arity);
 
 	lip_ast_t* application = lip_alloc_ast(allocator, sexp);
 	application->type = LIP_AST_APPLICATION;
@@ -391,8 +482,10 @@ lip_translate_number(lip_allocator_t* allocator, const lip_sexp_t* sexp)
 	return lip_success(number);
 }
 
-lip_ast_result_t
-lip_translate_sexp(lip_allocator_t* allocator, const lip_sexp_t* sexp)
+static lip_ast_result_t
+lip_translate_exp(
+	lip_allocator_t* allocator, const lip_ast_scope_t* scope, const lip_sexp_t* sexp
+)
 {
 	switch(sexp->type)
 	{
@@ -406,23 +499,37 @@ lip_translate_sexp(lip_allocator_t* allocator, const lip_sexp_t* sexp)
 				lip_string_ref_t symbol = sexp->data.list[0].data.string;
 				if(lip_string_ref_equal(symbol, lip_string_ref("if")))
 				{
-					return lip_translate_if(allocator, sexp);
+					return lip_translate_if(allocator, scope, sexp);
 				}
 				else if(lip_string_ref_equal(symbol, lip_string_ref("let")))
 				{
-					return lip_translate_let(allocator, sexp, false);
+					return lip_translate_let(allocator, scope, sexp, LIP_AST_LET);
 				}
 				else if(lip_string_ref_equal(symbol, lip_string_ref("letrec")))
 				{
-					return lip_translate_let(allocator, sexp, true);
+					return lip_translate_let(allocator, scope, sexp, LIP_AST_LETREC);
+				}
+				else if(true
+					&& lip_string_ref_equal(symbol, lip_string_ref("loop"))
+					&& !lip_is_bound(scope, symbol)
+				)
+				{
+					return lip_translate_let(allocator, scope, sexp, LIP_AST_LOOP);
+				}
+				else if(true
+					&& lip_string_ref_equal(symbol, lip_string_ref("recur"))
+					&& !lip_is_bound(scope, symbol)
+				)
+				{
+					return lip_translate_recur(allocator, scope, sexp);
 				}
 				else if(lip_string_ref_equal(symbol, lip_string_ref("fn")))
 				{
-					return lip_translate_lambda(allocator, sexp);
+					return lip_translate_lambda(allocator, scope, sexp);
 				}
 				else if(lip_string_ref_equal(symbol, lip_string_ref("do")))
 				{
-					return lip_translate_do(allocator, sexp);
+					return lip_translate_do(allocator, scope, sexp);
 				}
 				else if(lip_string_ref_equal(symbol, lip_string_ref("quote"))
 					&& lip_array_len(sexp->data.list) == 2
@@ -432,12 +539,12 @@ lip_translate_sexp(lip_allocator_t* allocator, const lip_sexp_t* sexp)
 				}
 				else
 				{
-					return lip_translate_application(allocator, sexp);
+					return lip_translate_application(allocator, scope, sexp);
 				}
 			}
 			else
 			{
-				return lip_translate_application(allocator, sexp);
+				return lip_translate_application(allocator, scope, sexp);
 			}
 		case LIP_SEXP_SYMBOL:
 			return lip_translate_identifier(allocator, sexp);
@@ -450,3 +557,89 @@ lip_translate_sexp(lip_allocator_t* allocator, const lip_sexp_t* sexp)
 	// Impossibru!!
 	return lip_syntax_error(sexp->location, "Unknown error");
 }
+
+static lip_ast_result_t
+lip_check_recur(const lip_ast_t* ast, const lip_ast_t* loop, bool is_tail);
+
+static lip_ast_result_t
+lip_check_recur_in_block(
+	lip_array(lip_ast_t*) block, const lip_ast_t* loop, bool is_tail
+)
+{
+	size_t block_size = lip_array_len(block);
+	for(size_t i = 0; i < block_size; ++i)
+	{
+		lip_ast_result_t result =
+			lip_check_recur(block[i], loop, is_tail && i == block_size - 1);
+		if(!result.success) { return result; }
+	}
+
+	return lip_success(NULL);
+}
+
+// A `recur` jumps back to its loop so nothing else can be waiting for its value
+static lip_ast_result_t
+lip_check_recur(const lip_ast_t* ast, const lip_ast_t* loop, bool is_tail)
+{
+	lip_ast_result_t result;
+	switch(ast->type)
+	{
+		case LIP_AST_RECUR:
+			if(loop == NULL || !is_tail)
+			{
+				return lip_syntax_error(
+					ast->location, "'recur' must be in tail position of a 'loop'"
+				);
+			}
+			if(lip_array_len(ast->data.recur) != lip_array_len(loop->data.let.bindings))
+			{
+				return lip_syntax_error(
+					ast->location,
+					"'recur' must have as many arguments as its 'loop' has bindings"
+				);
+			}
+			return lip_check_recur_in_block(ast->data.recur, loop, false);
+		case LIP_AST_APPLICATION:
+			result = lip_check_recur(ast->data.application.function, loop, false);
+			if(!result.success) { return result; }
+			return lip_check_recur_in_block(ast->data.application.arguments, loop, false);
+		case LIP_AST_IF:
+			result = lip_check_recur(ast->data.if_.condition, loop, false);
+			if(!result.success) { return result; }
+			result = lip_check_recur(ast->data.if_.then, loop, is_tail);
+			if(!result.success || !ast->data.if_.else_) { return result; }
+			return lip_check_recur(ast->data.if_.else_, loop, is_tail);
+		case LIP_AST_LET:
+		case LIP_AST_LETREC:
+		case LIP_AST_LOOP:
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+			{
+				result = lip_check_recur(binding->value, loop, false);
+				if(!result.success) { return result; }
+			}
+			return ast->type == LIP_AST_LOOP
+				? lip_check_recur_in_block(ast->data.let.body, ast, true)
+				: lip_check_recur_in_block(ast->data.let.body, loop, is_tail);
+		case LIP_AST_LAMBDA:
+			return lip_check_recur_in_block(ast->data.lambda.body, NULL, false);
+		case LIP_AST_DO:
+			return lip_check_recur_in_block(ast->data.do_, loop, is_tail);
+		case LIP_AST_IDENTIFIER:
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			break;
+	}
+
+	return lip_success(NULL);
+}
+
+lip_ast_result_t
+lip_translate_sexp(lip_allocator_t* allocator, const lip_sexp_t* sexp)
+{
+	lip_ast_result_t result = lip_translate_exp(allocator, NULL, sexp);
+	if(!result.success) { return result; }
+
+	lip_ast_result_t check = lip_check_recur(result.value.result, NULL, false);
+	return check.success ? result : check;
+}
@@ -0,0 +1,420 @@
+#include "lip_internal.h"
+#include <lip/core/io.h>
+#include "utils.h"
+
+/**
+ * Layout:
+ *
+ * [lip_bundle_header_t]: header
+ * [lip_bundle_entry_t...]: open addressing hash table of modules, keyed by name
+ * [char...]: module names
+ * [lip_function_t...]: compiled modules, each aligned to LIP_BUNDLE_ALIGNMENT
+ */
+
+typedef struct lip_bundle_header_s lip_bundle_header_t;
+typedef struct lip_bundle_entry_s lip_bundle_entry_t;
+
+static const char LIP_BUNDLE_MAGIC[] = {'L', 'I', 'P', 'B'};
+
+#define LIP_BUNDLE_ALIGNMENT 16
+
+struct lip_bundle_header_s
+{
+	char magic[sizeof(LIP_BUNDLE_MAGIC)];
+	uint8_t ptr_size;
+	uint8_t padding;
+	uint16_t bom;
+	uint32_t version;
+	uint32_t num_modules;
+	/// Number of entries in the index, a power of 2
+	uint32_t capacity;
+	uint32_t reserved[3];
+};
+
+struct lip_bundle_entry_s
+{
+	uint32_t hash;
+	uint32_t name_offset;
+	uint32_t name_length;
+	/// 0 marks an empty entry
+	uint32_t function_offset;
+};
+
+static const lip_bundle_entry_t*
+lip_bundle_index(const lip_bundle_t* bundle)
+{
+	return (const lip_bundle_entry_t*)(
+		(const char*)bundle->mapping.ptr + sizeof(lip_bundle_header_t)
+	);
+}
+
+static size_t
+lip_bundle_align(size_t offset)
+{
+	return (offset + LIP_BUNDLE_ALIGNMENT - 1) & ~(size_t)(LIP_BUNDLE_ALIGNMENT - 1);
+}
+
+static uint32_t
+lip_bundle_capacity(uint32_t num_modules)
+{
+	uint32_t capacity = 1;
+	while(capacity < num_modules * 2) { capacity *= 2; }
+	return capacity;
+}
+
+static bool
+lip_bundle_is_valid(lip_allocator_t* allocator, const char* ptr, size_t size)
+{
+	lip_bundle_header_t header;
+	if(size < sizeof(header)) { return false; }
+	memcpy(&header, ptr, sizeof(header));
+
+	if(false
+		|| memcmp(header.magic, LIP_BUNDLE_MAGIC, sizeof(LIP_BUNDLE_MAGIC)) != 0
+		|| header.ptr_size != sizeof(void*)
+		|| header.bom != 1
+		|| header.version != LIP_BYTECODE_VERSION
+		|| header.capacity == 0
+		|| (header.capacity & (header.capacity - 1)) != 0
+		|| header.capacity > (size - sizeof(header)) / sizeof(lip_bundle_entry_t)
+		|| (uintptr_t)ptr % LIP_BUNDLE_ALIGNMENT != 0
+	)
+	{
+		return false;
+	}
+
+	// Check every entry and its bytecode once so that lookups can trust them
+	const lip_bundle_entry_t* index =
+		(const lip_bundle_entry_t*)(ptr + sizeof(header));
+	uint32_t num_modules = 0;
+	for(uint32_t i = 0; i < header.capacity; ++i)
+	{
+		lip_bundle_entry_t entry = index[i];
+		if(entry.function_offset == 0) { continue; }
+		++num_modules;
+
+		if(false
+			|| entry.name_offset > size
+			|| entry.name_length > size - entry.name_offset
+			|| entry.function_offset % LIP_BUNDLE_ALIGNMENT != 0
+			|| entry.function_offset > size - sizeof(lip_function_t)
+		)
+		{
+			return false;
+		}
+
+		const lip_function_t* function =
+			(const lip_function_t*)(ptr + entry.function_offset);
+		if(lip_verify_function(
+			allocator, function, size - entry.function_offset, 0
+		) != NULL)
+		{
+			return false;
+		}
+	}
+
+	return num_modules == header.num_modules && num_modules < header.capacity;
+}
+
+const char*
+lip_read_file(
+	lip_context_t* ctx,
+	lip_string_ref_t filename,
+	size_t alignment,
+	size_t* size,
+	void** block
+)
+{
+	lip_fs_t* fs = ctx->runtime->cfg.fs;
+	lip_in_t* input = fs->begin_read(fs, filename);
+	if(input == NULL) { return NULL; }
+
+	lip_array(char) content = lip_array_create(ctx->allocator, char, 4096);
+	for(;;)
+	{
+		size_t length = lip_array_len(content);
+		lip_array_resize(content, length + 4096);
+		size_t bytes_read = lip_read(content + length, 4096, input);
+		lip_array_resize(content, length + bytes_read);
+		if(bytes_read < 4096) { break; }
+	}
+	fs->end_read(fs, input);
+
+	// Allocators only promise LIP_MAX_ALIGNMENT
+	*size = lip_array_len(content);
+	*block = lip_malloc(ctx->runtime->cfg.allocator, *size + alignment);
+	char* buf = lip_align_ptr(*block, alignment);
+	memcpy(buf, content, *size);
+	lip_array_destroy(content);
+	return buf;
+}
+
+bool
+lip_add_bundle(lip_context_t* ctx, lip_string_ref_t filename)
+{
+	lip_runtime_t* runtime = ctx->runtime;
+	lip_fs_t* fs = runtime->cfg.fs;
+
+	// Read the whole file when it cannot be mapped
+	bool mapped = fs->map != NULL && fs->unmap != NULL;
+	size_t size = 0;
+	void* block = NULL;
+	const char* ptr = mapped
+		? fs->map(fs, filename, &size)
+		: lip_read_file(ctx, filename, LIP_BUNDLE_ALIGNMENT, &size, &block);
+	if(ptr == NULL)
+	{
+		lip_set_context_error(
+			ctx, "IO error", fs->last_error(fs), filename, LIP_LOC_NOWHERE
+		);
+		return false;
+	}
+
+	if(!lip_bundle_is_valid(ctx->allocator, ptr, size))
+	{
+		if(mapped)
+		{
+			fs->unmap(fs, ptr, size);
+		}
+		else
+		{
+			lip_free(runtime->cfg.allocator, block);
+		}
+
+		lip_set_context_error(
+			ctx, "Format error",
+			lip_string_ref("Malformed bundle"), filename, LIP_LOC_NOWHERE
+		);
+		return false;
+	}
+
+	char* filename_copy = lip_malloc(runtime->cfg.allocator, filename.length + 1);
+	memcpy(filename_copy, filename.ptr, filename.length);
+	filename_copy[filename.length] = '\0';
+
+	lip_bundle_header_t header;
+	memcpy(&header, ptr, sizeof(header));
+	lip_bundle_t bundle = {
+		.mapping = { .ptr = ptr, .size = size },
+		.mapped = mapped,
+		.block = block,
+		.filename = { .length = filename.length, .ptr = filename_copy },
+		.capacity = header.capacity
+	};
+
+	lip_ctx_begin_rt_write(ctx);
+	lip_array_push(runtime->bundles, bundle);
+	lip_ctx_end_rt_write(ctx);
+	return true;
+}
+
+lip_function_t*
+lip_find_bundled_module(
+	lip_context_t* ctx, lip_string_ref_t name, lip_string_ref_t* filename
+)
+{
+	uint32_t hash = lip_string_ref_hash(name);
+	lip_function_t* function = NULL;
+
+	// lip_add_bundle can grow the array from another thread
+	lip_ctx_begin_rt_read(ctx);
+	lip_array_foreach(lip_bundle_t, bundle, ctx->runtime->bundles)
+	{
+		const lip_bundle_entry_t* index = lip_bundle_index(bundle);
+		uint32_t mask = bundle->capacity - 1;
+		for(uint32_t i = hash & mask;; i = (i + 1) & mask)
+		{
+			const lip_bundle_entry_t* entry = &index[i];
+			if(entry->function_offset == 0) { break; }
+
+			const char* entry_name =
+				(const char*)bundle->mapping.ptr + entry->name_offset;
+			if(true
+				&& entry->hash == hash
+				&& entry->name_length == name.length
+				&& memcmp(entry_name, name.ptr, name.length) == 0
+			)
+			{
+				*filename = bundle->filename;
+				function = (lip_function_t*)(
+					(const char*)bundle->mapping.ptr + entry->function_offset
+				);
+				goto end;
+			}
+		}
+	}
+
+end:
+	lip_ctx_end_rt_read(ctx);
+	return function;
+}
+
+void
+lip_destroy_all_bundles(lip_runtime_t* runtime)
+{
+	lip_fs_t* fs = runtime->cfg.fs;
+
+	lip_array_foreach(lip_bundle_t, bundle, runtime->bundles)
+	{
+		if(bundle->mapped)
+		{
+			fs->unmap(fs, bundle->mapping.ptr, bundle->mapping.size);
+		}
+		else
+		{
+			lip_free(runtime->cfg.allocator, bundle->block);
+		}
+		lip_free(runtime->cfg.allocator, (void*)bundle->filename.ptr);
+	}
+}
+
+static bool
+lip_do_dump_bundle(
+	lip_context_t* ctx,
+	unsigned int num_modules,
+	const lip_string_ref_t* module_names,
+	lip_script_t* const* scripts,
+	lip_string_ref_t filename,
+	lip_out_t* output
+)
+{
+	lip_arena_allocator_reset(ctx->temp_pool);
+	uint32_t capacity = lip_bundle_capacity(num_modules);
+	lip_bundle_entry_t* index =
+		lip_malloc(ctx->temp_pool, sizeof(lip_bundle_entry_t) * capacity);
+	memset(index, 0, sizeof(lip_bundle_entry_t) * capacity);
+	// Module in each entry, to find duplicated names
+	unsigned int* entry_modules =
+		lip_malloc(ctx->temp_pool, sizeof(unsigned int) * capacity);
+
+	// Names follow the index and compiled modules follow the names
+	size_t name_offset =
+		sizeof(lip_bundle_header_t) + sizeof(lip_bundle_entry_t) * capacity;
+	size_t function_offset = name_offset;
+	for(unsigned int i = 0; i < num_modules; ++i)
+	{
+		function_offset += module_names[i].length;
+	}
+	function_offset = lip_bundle_align(function_offset);
+
+	uint32_t mask = capacity - 1;
+	for(unsigned int i = 0; i < num_modules; ++i)
+	{
+		lip_string_ref_t name = module_names[i];
+		lip_function_t* function = scripts[i]->closure->function.lip;
+		uint32_t hash = lip_string_ref_hash(name);
+
+		uint32_t slot = hash & mask;
+		for(; index[slot].function_offset != 0; slot = (slot + 1) & mask)
+		{
+			if(lip_string_ref_equal(module_names[entry_modules[slot]], name))
+			{
+				lip_array(char) msg_buf = lip_array_create(ctx->module_pool, char, 64);
+				lip_sprintf(
+					&msg_buf, "Duplicated module: %.*s", (int)name.length, name.ptr
+				);
+				lip_set_context_error(
+					ctx, "Bundle error",
+					(lip_string_ref_t){ .length = lip_array_len(msg_buf), .ptr = msg_buf },
+					filename, LIP_LOC_NOWHERE
+				);
+				return false;
+			}
+		}
+
+		if(function_offset + function->size > UINT32_MAX)
+		{
+			lip_set_context_error(
+				ctx, "Bundle error",
+				lip_string_ref("Bundle is too large"), filename, LIP_LOC_NOWHERE
+			);
+			return false;
+		}
+
+		index[slot] = (lip_bundle_entry_t){
+			.hash = hash,
+			.name_offset = name_offset,
+			.name_length = name.length,
+			.function_offset = function_offset
+		};
+		entry_modules[slot] = i;
+
+		name_offset += name.length;
+		function_offset = lip_bundle_align(function_offset + function->size);
+	}
+
+	lip_bundle_header_t header = {
+		.ptr_size = sizeof(void*),
+		.bom = 1,
+		.version = LIP_BYTECODE_VERSION,
+		.num_modules = num_modules,
+		.capacity = capacity
+	};
+	memcpy(header.magic, LIP_BUNDLE_MAGIC, sizeof(LIP_BUNDLE_MAGIC));
+
+#define lip_checked_write(buff, size, output) \
+	do { \
+		if(lip_write(buff, size, output) != (size)) { \
+			lip_fs_t* fs = ctx->runtime->cfg.fs; \
+			lip_set_context_error( \
+				ctx, "IO error", fs->last_error(fs), filename, LIP_LOC_NOWHERE \
+			); \
+			return false; \
+		} \
+	} while(0)
+
+	lip_checked_write(&header, sizeof(header), output);
+	lip_checked_write(index, sizeof(lip_bundle_entry_t) * capacity, output);
+
+	size_t offset = sizeof(header) + sizeof(lip_bundle_entry_t) * capacity;
+	for(unsigned int i = 0; i < num_modules; ++i)
+	{
+		lip_checked_write(module_names[i].ptr, module_names[i].length, output);
+		offset += module_names[i].length;
+	}
+
+	static const char padding[LIP_BUNDLE_ALIGNMENT] = { 0 };
+	for(unsigned int i = 0; i < num_modules; ++i)
+	{
+		lip_function_t* function = scripts[i]->closure->function.lip;
+		size_t aligned_offset = lip_bundle_align(offset);
+		lip_checked_write(padding, aligned_offset - offset, output);
+		lip_checked_write(function, function->size, output);
+		offset = aligned_offset + function->size;
+	}
+
+	return true;
+}
+
+bool
+lip_dump_bundle(
+	lip_context_t* ctx,
+	unsigned int num_modules,
+	const lip_string_ref_t* module_names,
+	lip_script_t* const* scripts,
+	lip_string_ref_t filename,
+	lip_out_t* output
+)
+{
+	lip_fs_t* fs = ctx->runtime->cfg.fs;
+	bool own_output = output == NULL;
+	if(own_output)
+	{
+		output = fs->begin_write(fs, filename);
+		if(output == NULL)
+		{
+			lip_set_context_error(
+				ctx, "IO error", fs->last_error(fs), filename, LIP_LOC_NOWHERE
+			);
+			return false;
+		}
+	}
+
+	bool result = lip_do_dump_bundle(
+		ctx, num_modules, module_names, scripts, filename, output
+	);
+
+	if(own_output) { fs->end_write(fs, output); }
+
+	return result;
+}
@@ -0,0 +1,513 @@
+#include "lip_internal.h"
+#include <stdio.h>
+#include <lip/core/memory.h>
+#include <lip/core/array.h>
+#include <lip/core/prim_ops.h>
+
+#define LIP_TYPE_MASK(type) ((uint16_t)(1u << (type)))
+#define LIP_ANY_TYPE ((uint16_t)((1u << (LIP_VAL_LIST_BUILDER + 1)) - 1))
+#define LIP_ERROR_MSG_LEN 128
+
+typedef struct lip_checker_s lip_checker_t;
+typedef struct lip_static_value_s lip_static_value_t;
+typedef struct lip_static_var_s lip_static_var_t;
+
+// What is known about the value of an expression
+struct lip_static_value_s
+{
+	// Types that the value may have
+	uint16_t types;
+	// The value is a function which accepts these arguments
+	bool has_signature;
+	lip_signature_t signature;
+	// Type of arguments past the ones in the signature, 0 for any
+	uint16_t rest_type;
+	// Type of the result when the function returns
+	uint16_t result_type;
+	// 1 if the value is known to be truthy, -1 if it is known to be falsy
+	int8_t truth;
+};
+
+struct lip_static_var_s
+{
+	lip_string_ref_t name;
+	lip_static_value_t value;
+};
+
+struct lip_checker_s
+{
+	lip_context_t* ctx;
+	lip_string_ref_t filename;
+	lip_array(lip_static_var_t) vars;
+};
+
+static const lip_static_value_t lip_unknown_value = { .types = LIP_ANY_TYPE };
+
+static bool
+lip_check_exp(lip_checker_t* checker, const lip_ast_t* ast, lip_static_value_t* result);
+
+static bool
+lip_check_error(
+	lip_checker_t* checker, lip_loc_range_t location, const char* fmt, ...
+) LIP_PRINTF_LIKE(3, 4);
+
+static bool
+lip_check_error(
+	lip_checker_t* checker, lip_loc_range_t location, const char* fmt, ...
+)
+{
+	char* msg = lip_malloc(checker->ctx->temp_pool, LIP_ERROR_MSG_LEN);
+	va_list args;
+	va_start(args, fmt);
+	int length = vsnprintf(msg, LIP_ERROR_MSG_LEN, fmt, args);
+	va_end(args);
+
+	lip_string_ref_t message = {
+		.ptr = msg,
+		.length = LIP_MIN((size_t)length, LIP_ERROR_MSG_LEN - 1)
+	};
+	lip_set_compile_error(checker->ctx, message, checker->filename, location);
+	return false;
+}
+
+static const char*
+lip_type_name(uint16_t types)
+{
+	for(unsigned int i = 0; i <= LIP_VAL_LIST_BUILDER; ++i)
+	{
+		if(types & LIP_TYPE_MASK(i)) { return lip_value_type_t_to_str(i); }
+	}
+
+	return "";
+}
+
+static lip_static_value_t
+lip_function_value(uint8_t arity_min, uint8_t arity_max)
+{
+	return (lip_static_value_t){
+		.types = LIP_TYPE_MASK(LIP_VAL_FUNCTION),
+		.has_signature = true,
+		.signature = {
+			.arity_min = arity_min,
+			.arity_max = arity_max
+		},
+		.result_type = LIP_ANY_TYPE
+	};
+}
+
+static lip_static_value_t
+lip_lambda_value(const lip_ast_t* lambda)
+{
+	uint8_t num_args = lip_array_len(lambda->data.lambda.arguments);
+	return lambda->data.lambda.is_vararg
+		? lip_function_value(num_args - 1, UINT8_MAX)
+		: lip_function_value(num_args, num_args);
+}
+
+static bool
+lip_prim_op_value(lip_string_ref_t name, lip_static_value_t* result)
+{
+	const uint16_t number = LIP_TYPE_MASK(LIP_VAL_NUMBER);
+	const uint16_t boolean = LIP_TYPE_MASK(LIP_VAL_BOOLEAN);
+
+	if(false
+		|| lip_string_ref_equal(name, lip_string_ref("+"))
+		|| lip_string_ref_equal(name, lip_string_ref("*"))
+	)
+	{
+		*result = lip_function_value(0, UINT8_MAX);
+		result->rest_type = number;
+		result->result_type = number;
+	}
+	else if(false
+		|| lip_string_ref_equal(name, lip_string_ref("-"))
+		|| lip_string_ref_equal(name, lip_string_ref("/"))
+	)
+	{
+		*result = lip_function_value(1, 2);
+		result->signature.param_types[0] = number;
+		result->signature.param_types[1] = number;
+		result->result_type = number;
+	}
+	else if(lip_string_ref_equal(name, lip_string_ref("!")))
+	{
+		*result = lip_function_value(1, 1);
+		result->result_type = boolean;
+	}
+	else if(lip_string_ref_equal(name, lip_string_ref("cmp")))
+	{
+		*result = lip_function_value(2, 2);
+		result->result_type = number;
+	}
+	else
+	{
+#define LIP_CMP_OP_MATCH(op, id) \
+		if(lip_string_ref_equal(lip_string_ref(#op), name)) { \
+			*result = lip_function_value(2, 2); \
+			result->result_type = boolean; \
+			return true; \
+		}
+		LIP_CMP_OP(LIP_CMP_OP_MATCH)
+#undef LIP_CMP_OP_MATCH
+
+		return false;
+	}
+
+	return true;
+}
+
+static lip_static_value_t
+lip_symbol_value(lip_checker_t* checker, lip_string_ref_t name)
+{
+	lip_static_value_t result;
+	if(lip_prim_op_value(name, &result)) { return result; }
+
+	const lip_symbol_t* symbol = lip_find_declared_symbol(checker->ctx, name);
+	// Undefined symbols are reported by the linker
+	if(symbol == NULL) { return lip_unknown_value; }
+
+	const lip_closure_t* closure = symbol->value;
+	if(closure->is_native)
+	{
+		if(!symbol->has_signature)
+		{
+			result = lip_unknown_value;
+			result.types = LIP_TYPE_MASK(LIP_VAL_FUNCTION);
+			return result;
+		}
+
+		result = lip_function_value(0, 0);
+		result.signature = symbol->signature;
+		return result;
+	}
+	else
+	{
+		const lip_function_t* function = closure->function.lip;
+		return function->is_vararg
+			? lip_function_value(function->num_args - 1, UINT8_MAX)
+			: lip_function_value(function->num_args, function->num_args);
+	}
+}
+
+static lip_static_value_t
+lip_identifier_value(lip_checker_t* checker, lip_string_ref_t name)
+{
+	size_t num_vars = lip_array_len(checker->vars);
+	for(size_t i = num_vars; i > 0; --i)
+	{
+		if(lip_string_ref_equal(checker->vars[i - 1].name, name))
+		{
+			return checker->vars[i - 1].value;
+		}
+	}
+
+	if(lip_string_ref_equal(name, lip_string_ref("true")))
+	{
+		return (lip_static_value_t){ .types = LIP_TYPE_MASK(LIP_VAL_BOOLEAN), .truth = 1 };
+	}
+	else if(lip_string_ref_equal(name, lip_string_ref("false")))
+	{
+		return (lip_static_value_t){ .types = LIP_TYPE_MASK(LIP_VAL_BOOLEAN), .truth = -1 };
+	}
+	else if(lip_string_ref_equal(name, lip_string_ref("nil")))
+	{
+		return (lip_static_value_t){ .types = LIP_TYPE_MASK(LIP_VAL_NIL) };
+	}
+
+	return lip_symbol_value(checker, name);
+}
+
+static int
+lip_static_truth(const lip_static_value_t* value)
+{
+	const uint16_t falsy_types =
+		LIP_TYPE_MASK(LIP_VAL_NIL) | LIP_TYPE_MASK(LIP_VAL_BOOLEAN);
+
+	if(value->truth != 0) { return value->truth; }
+	if(value->types == LIP_TYPE_MASK(LIP_VAL_NIL)) { return -1; }
+	if(value->types != 0 && !(value->types & falsy_types)) { return 1; }
+	return 0;
+}
+
+static void
+lip_push_static_var(
+	lip_checker_t* checker, lip_string_ref_t name, lip_static_value_t value
+)
+{
+	*lip_array_alloc(checker->vars) = (lip_static_var_t){
+		.name = name,
+		.value = value
+	};
+}
+
+static bool
+lip_check_block(
+	lip_checker_t* checker,
+	lip_array(lip_ast_t*) block,
+	lip_static_value_t* result
+)
+{
+	*result = (lip_static_value_t){ .types = LIP_TYPE_MASK(LIP_VAL_NIL) };
+	lip_array_foreach(lip_ast_t*, exp, block)
+	{
+		if(!lip_check_exp(checker, *exp, result)) { return false; }
+	}
+
+	return true;
+}
+
+static bool
+lip_check_arity(
+	lip_checker_t* checker, const lip_ast_t* ast, const lip_signature_t* signature
+)
+{
+	unsigned int num_args = lip_array_len(ast->data.application.arguments);
+	if(signature->arity_min == signature->arity_max)
+	{
+		if(num_args != signature->arity_min)
+		{
+			return lip_check_error(
+				checker, ast->location,
+				"Bad number of arguments (exactly %u expected, got %u)",
+				signature->arity_min, num_args
+			);
+		}
+	}
+	else if(num_args < signature->arity_min)
+	{
+		return lip_check_error(
+			checker, ast->location,
+			"Bad number of arguments (at least %u expected, got %u)",
+			signature->arity_min, num_args
+		);
+	}
+	else if(num_args > signature->arity_max)
+	{
+		return lip_check_error(
+			checker, ast->location,
+			"Bad number of arguments (at most %u expected, got %u)",
+			signature->arity_max, num_args
+		);
+	}
+
+	return true;
+}
+
+static bool
+lip_check_application(
+	lip_checker_t* checker, const lip_ast_t* ast, lip_static_value_t* result
+)
+{
+	lip_static_value_t function;
+	if(!lip_check_exp(checker, ast->data.application.function, &function))
+	{
+		return false;
+	}
+
+	if(!(function.types & LIP_TYPE_MASK(LIP_VAL_FUNCTION)))
+	{
+		return lip_check_error(
+			checker, ast->location, "Trying to call a non-function"
+		);
+	}
+
+	if(function.has_signature && !lip_check_arity(checker, ast, &function.signature))
+	{
+		return false;
+	}
+
+	lip_array(lip_ast_t*) args = ast->data.application.arguments;
+	size_t num_args = lip_array_len(args);
+	for(size_t i = 0; i < num_args; ++i)
+	{
+		lip_static_value_t arg;
+		if(!lip_check_exp(checker, args[i], &arg)) { return false; }
+
+		if(!function.has_signature) { continue; }
+
+		uint16_t expected_type = i < LIP_SIGNATURE_MAX_PARAMS
+			? function.signature.param_types[i]
+			: 0;
+		expected_type = expected_type ? expected_type : function.rest_type;
+		if(expected_type && !(arg.types & expected_type))
+		{
+			return lip_check_error(
+				checker, args[i]->location,
+				"Bad argument #%u (%s expected, got %s)",
+				(unsigned int)(i + 1),
+				lip_type_name(expected_type), lip_type_name(arg.types)
+			);
+		}
+	}
+
+	*result = lip_unknown_value;
+	if(function.has_signature) { result->types = function.result_type; }
+	return true;
+}
+
+static bool
+lip_check_exp(lip_checker_t* checker, const lip_ast_t* ast, lip_static_value_t* result)
+{
+	size_t num_vars = lip_array_len(checker->vars);
+
+	switch(ast->type)
+	{
+		case LIP_AST_NUMBER:
+			*result = (lip_static_value_t){ .types = LIP_TYPE_MASK(LIP_VAL_NUMBER) };
+			return true;
+		case LIP_AST_STRING:
+			*result = (lip_static_value_t){ .types = LIP_TYPE_MASK(LIP_VAL_STRING) };
+			return true;
+		case LIP_AST_SYMBOL:
+			*result = (lip_static_value_t){ .types = LIP_TYPE_MASK(LIP_VAL_SYMBOL) };
+			return true;
+		case LIP_AST_IDENTIFIER:
+			*result = lip_identifier_value(checker, ast->data.string);
+			return true;
+		case LIP_AST_APPLICATION:
+			return lip_check_application(checker, ast, result);
+		case LIP_AST_IF:
+			{
+				lip_static_value_t condition;
+				if(!lip_check_exp(checker, ast->data.if_.condition, &condition))
+				{
+					return false;
+				}
+
+				// A branch which is never taken is not checked
+				int truth = lip_static_truth(&condition);
+				lip_static_value_t then = { .types = 0 };
+				lip_static_value_t else_ = { .types = 0 };
+				if(truth >= 0 && !lip_check_exp(checker, ast->data.if_.then, &then))
+				{
+					return false;
+				}
+
+				if(truth <= 0)
+				{
+					if(ast->data.if_.else_ == NULL)
+					{
+						else_ = (lip_static_value_t){ .types = LIP_TYPE_MASK(LIP_VAL_NIL) };
+					}
+					else if(!lip_check_exp(checker, ast->data.if_.else_, &else_))
+					{
+						return false;
+					}
+				}
+
+				*result = lip_unknown_value;
+				result->types = then.types | else_.types;
+			}
+			return true;
+		case LIP_AST_LET:
+			{
+				lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+				{
+					lip_static_value_t value;
+					if(!lip_check_exp(checker, binding->value, &value))
+					{
+						return false;
+					}
+
+					lip_push_static_var(checker, binding->name, value);
+				}
+
+				bool success = lip_check_block(checker, ast->data.let.body, result);
+				lip_array_resize(checker->vars, num_vars);
+				return success;
+			}
+		case LIP_AST_LETREC:
+			{
+				// Only lambdas are known before all bindings are evaluated
+				lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+				{
+					lip_push_static_var(
+						checker, binding->name,
+						binding->value->type == LIP_AST_LAMBDA
+							? lip_lambda_value(binding->value)
+							: lip_unknown_value
+					);
+				}
+
+				bool success = true;
+				lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+				{
+					lip_static_value_t value;
+					success = success && lip_check_exp(checker, binding->value, &value);
+				}
+
+				success = success
+					&& lip_check_block(checker, ast->data.let.body, result);
+				lip_array_resize(checker->vars, num_vars);
+				return success;
+			}
+		case LIP_AST_LAMBDA:
+			{
+				lip_array_foreach(lip_string_ref_t, arg, ast->data.lambda.arguments)
+				{
+					lip_push_static_var(checker, *arg, lip_unknown_value);
+				}
+
+				lip_static_value_t body;
+				bool success = lip_check_block(checker, ast->data.lambda.body, &body);
+				lip_array_resize(checker->vars, num_vars);
+
+				*result = lip_lambda_value(ast);
+				return success;
+			}
+		case LIP_AST_DO:
+			return lip_check_block(checker, ast->data.do_, result);
+		case LIP_AST_LOOP:
+			{
+				// Variables may be rebound to anything by `recur`
+				lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+				{
+					lip_static_value_t value;
+					if(!lip_check_exp(checker, binding->value, &value))
+					{
+						return false;
+					}
+
+					lip_push_static_var(checker, binding->name, lip_unknown_value);
+				}
+
+				bool success = lip_check_block(checker, ast->data.let.body, result);
+				lip_array_resize(checker->vars, num_vars);
+				if(result->types == 0) { *result = lip_unknown_value; }
+				return success;
+			}
+		case LIP_AST_RECUR:
+			{
+				lip_array_foreach(lip_ast_t*, arg, ast->data.recur)
+				{
+					lip_static_value_t value;
+					if(!lip_check_exp(checker, *arg, &value)) { return false; }
+				}
+
+				// Never produces a value
+				*result = (lip_static_value_t){ .types = 0 };
+			}
+			return true;
+	}
+
+	*result = lip_unknown_value;
+	return true;
+}
+
+bool
+lip_check_ast(lip_context_t* ctx, lip_string_ref_t filename, const lip_ast_t* ast)
+{
+	lip_checker_t checker = {
+		.ctx = ctx,
+		.filename = filename,
+		.vars = lip_array_create(ctx->allocator, lip_static_var_t, 16)
+	};
+
+	lip_ctx_begin_rt_read(ctx);
+	lip_static_value_t result;
+	bool success = lip_check_exp(&checker, ast, &result);
+	lip_ctx_end_rt_read(ctx);
+
+	lip_array_destroy(checker.vars);
+	return success;
+}
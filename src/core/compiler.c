@@ -3,21 +3,49 @@
 #include <lip/core/ast.h>
 #include <lip/core/asm.h>
 #include <lip/core/array.h>
+#include <lip/core/prim_ops.h>
+#include <string.h>
 #include "arena_allocator.h"
 
 #define LASM(compiler, opcode, operand, location) \
 	lip_asm_add(&compiler->current_scope->lasm, opcode, operand, location)
 
+#define LIP_NUMBER_INFERENCE_MAX_PASSES 8
+// Environment slots a frame may use for lists and closures allocated in it,
+// larger values are allocated on the heap
+#define LIP_MAX_SCRATCH_SLOTS 16
+
 typedef struct lip_var_s lip_var_t;
+typedef struct lip_loop_s lip_loop_t;
+typedef struct lip_number_fn_s lip_number_fn_t;
+typedef struct lip_number_env_s lip_number_env_t;
+typedef struct lip_number_inference_s lip_number_inference_t;
 
 struct lip_scope_s
 {
 	lip_scope_t* parent;
 	lip_asm_t lasm;
+	// Lambda being compiled, NULL at the top level
+	const lip_ast_t* lambda;
 
 	uint16_t max_num_locals;
 	uint16_t current_num_locals;
+	// Slots taken by lip_alloc_scratch, never given back so that it bounds
+	// how much larger the frame gets
+	uint16_t num_scratch_slots;
 	lip_array(lip_var_t) vars;
+	// Variables from this index on belong to scopes which end with the
+	// expression being compiled. Their slots can be reused once they are dead.
+	size_t first_reusable_var;
+	// Innermost `loop`, NULL if there is none
+	const lip_loop_t* loop;
+};
+
+struct lip_loop_s
+{
+	lip_asm_index_t head;
+	// Index of the first loop variable in lip_scope_t::vars
+	size_t first_var;
 };
 
 struct lip_var_s
@@ -25,11 +53,28 @@ struct lip_var_s
 	lip_string_ref_t name;
 	lip_opcode_t load_op;
 	lip_asm_index_t index;
+	// Lambda whose closure the variable is known to hold when read
+	const lip_ast_t* known_fn;
 };
 
 static void
 lip_compile_exp(lip_compiler_t* compiler, const lip_ast_t* ast);
 
+static void
+lip_compile_final_exp(lip_compiler_t* compiler, const lip_ast_t* ast);
+
+static bool
+lip_compile_lambda(lip_compiler_t* compiler, const lip_ast_t* ast, bool in_scratch);
+
+static bool
+lip_escapes(
+	lip_compiler_t* compiler,
+	lip_string_ref_t name,
+	const lip_ast_t* ast,
+	bool is_closure,
+	bool same_frame
+);
+
 static bool
 lip_compile_number(lip_compiler_t* compiler, const lip_ast_t* ast)
 {
@@ -66,7 +111,7 @@ lip_compile_symbol(lip_compiler_t* compiler, const lip_ast_t* ast)
 	lip_asm_index_t index = lip_asm_alloc_symbol(
 		&compiler->current_scope->lasm, ast->data.string
 	);
-	LASM(compiler, LIP_OP_LDK, index, ast->location);
+	LASM(compiler, LIP_OP_LDS, index, ast->location);
 	return true;
 }
 
@@ -90,10 +135,15 @@ lip_begin_scope(lip_compiler_t* compiler, lip_loc_range_t location)
 	}
 
 	scope->parent = compiler->current_scope;
+	scope->lambda = NULL;
+	scope->loop = NULL;
+	scope->first_reusable_var = 0;
 	scope->current_num_locals = 0;
 	scope->max_num_locals = 0;
+	scope->num_scratch_slots = 0;
 	compiler->current_scope = scope;
 	lip_asm_begin(&scope->lasm, compiler->source_name, location);
+	scope->lasm.strip_debug_info = compiler->strip_debug_info;
 	return scope;
 }
 
@@ -108,6 +158,7 @@ lip_end_scope(lip_compiler_t* compiler, lip_allocator_t* allocator)
 
 	lip_function_t* function = lip_asm_end(&scope->lasm, allocator);
 	function->num_locals = scope->max_num_locals;
+	if(compiler->error == NULL) { compiler->error = scope->lasm.error; }
 	return function;
 }
 
@@ -175,18 +226,215 @@ lip_compile_identifier(lip_compiler_t* compiler, const lip_ast_t* ast)
 }
 
 static bool
-lip_compile_application(lip_compiler_t* compiler, const lip_ast_t* ast)
+lip_is_tail_call(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	khiter_t itr = kh_get(lip_ptr_set, compiler->tail_calls, (void*)ast);
+	return itr != kh_end(compiler->tail_calls);
+}
+
+static bool
+lip_is_prim_op(lip_string_ref_t name)
+{
+#define LIP_PRIM_OP_MATCH(op, id) \
+	if(lip_string_ref_equal(lip_string_ref(#op), name)) { return true; }
+	LIP_PRIM_OP(LIP_PRIM_OP_MATCH)
+#undef LIP_PRIM_OP_MATCH
+
+	return false;
+}
+
+static bool
+lip_is_borrowing_name(lip_compiler_t* compiler, lip_string_ref_t name)
+{
+	if(lip_is_prim_op(name)) { return true; }
+
+	return compiler->is_borrowing != NULL && compiler->is_borrowing(compiler, name);
+}
+
+// A frame-allocated value can be passed to a borrowing function as long as the
+// call does not replace the current frame.
+static bool
+lip_is_borrowing_call(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	const lip_ast_t* function = ast->data.application.function;
+	if(function->type != LIP_AST_IDENTIFIER) { return false; }
+
+	lip_var_t var;
+	lip_string_ref_t name = function->data.string;
+	if(lip_find_var(compiler->current_scope, name, &var)) { return false; }
+
+	// Prim ops are inlined and never become tail calls
+	if(lip_is_prim_op(name)) { return true; }
+
+	return lip_is_borrowing_name(compiler, name) && !lip_is_tail_call(compiler, ast);
+}
+
+static bool
+lip_is_list_constructor(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	if(ast->type != LIP_AST_APPLICATION) { return false; }
+
+	const lip_ast_t* function = ast->data.application.function;
+	if(function->type != LIP_AST_IDENTIFIER) { return false; }
+
+	lip_string_ref_t name = function->data.string;
+	lip_var_t var;
+	return true
+		&& (false
+			|| lip_string_ref_equal(lip_string_ref("list"), name)
+			|| lip_string_ref_equal(lip_string_ref("/list"), name))
+		&& !lip_find_var(compiler->current_scope, name, &var)
+		&& lip_array_len(ast->data.application.arguments) <= LIP_WIDE_FIELD_MAX;
+}
+
+static bool
+lip_alloc_scratch(
+	lip_compiler_t* compiler, size_t num_slots, lip_asm_index_t* index
+)
+{
+	lip_scope_t* scope = compiler->current_scope;
+	if(false
+		|| scope->num_scratch_slots + num_slots > LIP_MAX_SCRATCH_SLOTS
+		|| scope->current_num_locals + num_slots > UINT16_MAX
+	)
+	{
+		return false;
+	}
+
+	*index = scope->current_num_locals;
+	scope->current_num_locals += num_slots;
+	scope->num_scratch_slots += num_slots;
+	scope->max_num_locals = LIP_MAX(scope->max_num_locals, scope->current_num_locals);
+	return true;
+}
+
+static bool
+lip_compile_list(lip_compiler_t* compiler, const lip_ast_t* ast)
 {
-	lip_compile_arguments(compiler, ast->data.application.arguments);
-	lip_compile_exp(compiler, ast->data.application.function);
-	LASM(
-		compiler,
-		LIP_OP_CALL, lip_array_len(ast->data.application.arguments),
+	lip_array(lip_ast_t*) elements = ast->data.application.arguments;
+	size_t num_elements = lip_array_len(elements);
+	lip_asm_index_t local_index;
+	// Past this point, frames grow too large for the environment stack
+	if(false
+		|| compiler->current_scope->current_num_locals > LIP_PAIR_FIELD_MAX
+		|| !lip_alloc_scratch(
+			compiler, lip_list_scratch_slots(num_elements), &local_index
+		)
+	)
+	{
+		lip_compile_exp(compiler, ast);
+		return true;
+	}
+
+	lip_compile_arguments(compiler, elements);
+	lip_asm_add_pair(
+		&compiler->current_scope->lasm,
+		LIP_OP_LLST, local_index, num_elements,
 		ast->location
 	);
 	return true;
 }
 
+static void
+lip_compile_value(lip_compiler_t* compiler, const lip_ast_t* ast, bool in_scratch)
+{
+	if(in_scratch && ast->type == LIP_AST_LAMBDA)
+	{
+		lip_compile_lambda(compiler, ast, true);
+	}
+	else if(in_scratch && lip_is_list_constructor(compiler, ast))
+	{
+		lip_compile_list(compiler, ast);
+	}
+	else
+	{
+		lip_compile_exp(compiler, ast);
+	}
+}
+
+// Typed opcode for a binary prim op on numbers, NOP for other functions
+static lip_opcode_t
+lip_number_opcode(lip_compiler_t* compiler, const lip_ast_t* function)
+{
+	if(function->type != LIP_AST_IDENTIFIER) { return LIP_OP_NOP; }
+
+	lip_var_t var;
+	lip_string_ref_t name = function->data.string;
+	if(lip_find_var(compiler->current_scope, name, &var)) { return LIP_OP_NOP; }
+
+	if(lip_string_ref_equal(lip_string_ref("+"), name)) { return LIP_OP_ADDN; }
+	if(lip_string_ref_equal(lip_string_ref("-"), name)) { return LIP_OP_SUBN; }
+	if(lip_string_ref_equal(lip_string_ref("*"), name)) { return LIP_OP_MULN; }
+	if(lip_string_ref_equal(lip_string_ref("/"), name)) { return LIP_OP_FDIVN; }
+	if(lip_string_ref_equal(lip_string_ref("=="), name)) { return LIP_OP_EQN; }
+	if(lip_string_ref_equal(lip_string_ref("!="), name)) { return LIP_OP_NEQN; }
+	if(lip_string_ref_equal(lip_string_ref(">"), name)) { return LIP_OP_GTN; }
+	if(lip_string_ref_equal(lip_string_ref("<"), name)) { return LIP_OP_LTN; }
+	if(lip_string_ref_equal(lip_string_ref(">="), name)) { return LIP_OP_GTEN; }
+	if(lip_string_ref_equal(lip_string_ref("<="), name)) { return LIP_OP_LTEN; }
+
+	return LIP_OP_NOP;
+}
+
+// Whether an expression can only evaluate to a number
+static bool
+lip_is_number_exp(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	khiter_t itr = kh_get(lip_ptr_set, compiler->number_exps, (void*)ast);
+	return itr != kh_end(compiler->number_exps);
+}
+
+static bool
+lip_compile_application(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	lip_array(lip_ast_t*) args = ast->data.application.arguments;
+	size_t arity = lip_array_len(args);
+	bool is_borrowing = lip_is_borrowing_call(compiler, ast);
+	for(size_t i = 0; i < arity; ++i)
+	{
+		const lip_ast_t* arg = args[arity - i - 1];
+		lip_compile_value(
+			compiler, arg, is_borrowing && lip_is_list_constructor(compiler, arg)
+		);
+	}
+
+	// Arithmetic and comparisons on two numbers need no type checks
+	const lip_ast_t* function = ast->data.application.function;
+	lip_opcode_t number_op = lip_number_opcode(compiler, function);
+	if(true
+		&& number_op != LIP_OP_NOP
+		&& arity == 2
+		&& lip_is_number_exp(compiler, args[0])
+		&& lip_is_number_exp(compiler, args[1])
+	)
+	{
+		LASM(compiler, number_op, 0, ast->location);
+		return true;
+	}
+
+	// A known closure of the right arity needs no checks at runtime
+	lip_var_t var;
+	bool is_known = true
+		&& function->type == LIP_AST_IDENTIFIER
+		&& lip_find_var(compiler->current_scope, function->data.string, &var)
+		&& var.known_fn != NULL
+		&& lip_array_len(var.known_fn->data.lambda.arguments) == arity;
+	if(is_known && var.known_fn == compiler->current_scope->lambda)
+	{
+		LASM(compiler, LIP_OP_CALLSELF, arity, ast->location);
+		return true;
+	}
+
+	// An immediately applied lambda lives as long as the call unless the
+	// call replaces the current frame
+	lip_compile_value(
+		compiler, function,
+		function->type == LIP_AST_LAMBDA && !lip_is_tail_call(compiler, ast)
+	);
+	LASM(compiler, is_known ? LIP_OP_CALLK : LIP_OP_CALL, arity, ast->location);
+	return true;
+}
+
 static bool
 lip_compile_if(lip_compiler_t* compiler, const lip_ast_t* ast)
 {
@@ -200,12 +448,12 @@ lip_compile_if(lip_compiler_t* compiler, const lip_ast_t* ast)
 			.start = ast->location.start,
 			.end = ast->data.if_.condition->location.end
 		}));
-	lip_compile_exp(compiler, ast->data.if_.then);
+	lip_compile_final_exp(compiler, ast->data.if_.then);
 	LASM(compiler, LIP_OP_JMP, done_label, LIP_LOC_NOWHERE);
 	LASM(compiler, LIP_OP_LABEL, else_label, LIP_LOC_NOWHERE);
 	if(ast->data.if_.else_)
 	{
-		lip_compile_exp(compiler, ast->data.if_.else_);
+		lip_compile_final_exp(compiler, ast->data.if_.else_);
 	}
 	else
 	{
@@ -227,7 +475,7 @@ lip_compile_block(lip_compiler_t* compiler, lip_array(lip_ast_t*) block)
 	}
 	else if(block_size == 1)
 	{
-		lip_compile_exp(compiler, block[0]);
+		lip_compile_final_exp(compiler, block[0]);
 	}
 	else
 	{
@@ -236,292 +484,1592 @@ lip_compile_block(lip_compiler_t* compiler, lip_array(lip_ast_t*) block)
 			lip_compile_exp(compiler, block[i]);
 		}
 		LASM(compiler, LIP_OP_POP, block_size - 1, LIP_LOC_NOWHERE);
-		lip_compile_exp(compiler, block[block_size - 1]);
+		lip_compile_final_exp(compiler, block[block_size - 1]);
 	}
 }
 
-static lip_asm_index_t
-lip_alloc_local(lip_compiler_t* compiler, lip_string_ref_t name)
-{
-	lip_scope_t* scope = compiler->current_scope;
-	uint16_t local_index = scope->current_num_locals++;
-	scope->max_num_locals = LIP_MAX(scope->max_num_locals, scope->current_num_locals);
-	*lip_array_alloc(scope->vars) = (lip_var_t) {
-		.name = name,
-		.index = local_index,
-		.load_op = LIP_OP_LDLV
-	};
-	return local_index;
-}
+static bool
+lip_var_occurs(lip_string_ref_t name, const lip_ast_t* ast);
 
 static bool
-lip_compile_let(lip_compiler_t* compiler, const lip_ast_t* ast)
+lip_var_occurs_in_block(lip_string_ref_t name, lip_array(lip_ast_t*) block)
 {
-	lip_scope_t* scope = compiler->current_scope;
-	size_t num_vars = lip_array_len(scope->vars);
-	uint16_t num_locals = scope->current_num_locals;
-
-	// Compile bindings
-	lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+	lip_array_foreach(lip_ast_t*, exp, block)
 	{
-		lip_compile_exp(compiler, binding->value);
-		lip_asm_index_t local = lip_alloc_local(compiler, binding->name);
-		LASM(compiler, LIP_OP_SET, local, binding->location);
+		if(lip_var_occurs(name, *exp)) { return true; }
 	}
 
-	// Compile body
-	lip_compile_block(compiler, ast->data.let.body);
-
-	lip_array_resize(scope->vars, num_vars);
-	scope->current_num_locals = num_locals;
-
-	return true;
+	return false;
 }
 
+// Conservatively check whether a name occurs in an expression, ignoring
+// shadowing
 static bool
-lip_compile_letrec(lip_compiler_t* compiler, const lip_ast_t* ast)
+lip_var_occurs(lip_string_ref_t name, const lip_ast_t* ast)
 {
-	lip_scope_t* scope = compiler->current_scope;
-	size_t num_vars = lip_array_len(scope->vars);
-	uint16_t num_locals = scope->current_num_locals;
-
-	// Compile bindings
-	// Declare placeholders
-	lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
-	{
-		lip_asm_index_t local = lip_alloc_local(compiler, binding->name);
-		LASM(compiler, LIP_OP_PLHR, local, LIP_LOC_NOWHERE);
-	}
-
-	// Bind value to locals
-	lip_asm_index_t local_index = num_vars;
-	lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
-	{
-		lip_compile_exp(compiler, binding->value);
-		LASM(
-			compiler,
-			LIP_OP_SET, scope->vars[local_index++].index,
-			binding->location
-		);
-	}
-
-	// Make recursive closure
-	local_index = num_vars;
-	lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+	switch(ast->type)
 	{
-		LASM(
-			compiler,
-			LIP_OP_RCLS, compiler->current_scope->vars[local_index++].index,
-			LIP_LOC_NOWHERE
-		);
+		case LIP_AST_IDENTIFIER:
+			return lip_string_ref_equal(name, ast->data.string);
+		case LIP_AST_IF:
+			return lip_var_occurs(name, ast->data.if_.condition)
+				|| lip_var_occurs(name, ast->data.if_.then)
+				|| (ast->data.if_.else_ && lip_var_occurs(name, ast->data.if_.else_));
+		case LIP_AST_APPLICATION:
+			return lip_var_occurs(name, ast->data.application.function)
+				|| lip_var_occurs_in_block(name, ast->data.application.arguments);
+		case LIP_AST_LAMBDA:
+			return lip_var_occurs_in_block(name, ast->data.lambda.body);
+		case LIP_AST_DO:
+			return lip_var_occurs_in_block(name, ast->data.do_);
+		case LIP_AST_RECUR:
+			return lip_var_occurs_in_block(name, ast->data.recur);
+		case LIP_AST_LET:
+		case LIP_AST_LETREC:
+		case LIP_AST_LOOP:
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+			{
+				if(lip_var_occurs(name, binding->value)) { return true; }
+			}
+			return lip_var_occurs_in_block(name, ast->data.let.body);
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			return false;
 	}
 
-	// Compile body
-	lip_compile_block(compiler, ast->data.let.body);
-
-	lip_array_resize(scope->vars, num_vars);
-	scope->current_num_locals = num_locals;
-
 	return true;
 }
 
-static void
-lip_set_add(khash_t(lip_string_ref_set)* set, lip_string_ref_t elem)
+static bool
+lip_escapes_in_block(
+	lip_compiler_t* compiler,
+	lip_string_ref_t name,
+	lip_array(lip_ast_t*) block,
+	bool is_closure,
+	bool same_frame
+)
 {
-	int ret;
-	kh_put(lip_string_ref_set, set, elem, &ret);
-}
+	lip_array_foreach(lip_ast_t*, exp, block)
+	{
+		if(lip_escapes(compiler, name, *exp, is_closure, same_frame))
+		{
+			return true;
+		}
+	}
 
-static void
-lip_set_remove(khash_t(lip_string_ref_set)* set, lip_string_ref_t elem)
-{
-	khiter_t iter = kh_get(lip_string_ref_set, set, elem);
-	if(iter != kh_end(set)) { kh_del(lip_string_ref_set, set, iter); }
+	return false;
 }
 
-static void
-lip_find_free_vars(const lip_ast_t* ast, khash_t(lip_string_ref_set)* out);
-
-static void
-lip_find_free_vars_in_block(
-	lip_array(lip_ast_t*) block, khash_t(lip_string_ref_set)* out
+// Check the bindings of a let starting from `first`, followed by its body
+static bool
+lip_escapes_in_bindings(
+	lip_compiler_t* compiler,
+	lip_string_ref_t name,
+	lip_array(lip_let_binding_t) bindings,
+	size_t first,
+	lip_array(lip_ast_t*) body,
+	bool is_closure
 )
 {
-	lip_array_foreach(lip_ast_t*, sub_exp, block)
+	size_t num_bindings = lip_array_len(bindings);
+	for(size_t i = first; i < num_bindings; ++i)
 	{
-		lip_find_free_vars(*sub_exp, out);
+		if(lip_escapes(compiler, name, bindings[i].value, is_closure, true))
+		{
+			return true;
+		}
+
+		if(lip_string_ref_equal(name, bindings[i].name)) { return false; }
+
+		// Borrowing calls are no longer recognizable after shadowing
+		if(lip_is_borrowing_name(compiler, bindings[i].name))
+		{
+			for(size_t j = i + 1; j < num_bindings; ++j)
+			{
+				if(lip_var_occurs(name, bindings[j].value)) { return true; }
+			}
+			return lip_var_occurs_in_block(name, body);
+		}
 	}
+
+	return lip_escapes_in_block(compiler, name, body, is_closure, true);
 }
 
-static void
-lip_find_free_vars(const lip_ast_t* ast, khash_t(lip_string_ref_set)* out)
+/*
+ * Check whether the value bound to `name` can outlive the current frame.
+ *
+ * A closure must only be called, never from a position which replaces the
+ * frame it lives in. A list may only be passed to borrowing functions.
+ * Anything else, including being captured by a nested lambda, is an escape.
+ */
+static bool
+lip_escapes(
+	lip_compiler_t* compiler,
+	lip_string_ref_t name,
+	const lip_ast_t* ast,
+	bool is_closure,
+	bool same_frame
+)
 {
 	switch(ast->type)
 	{
 		case LIP_AST_IDENTIFIER:
-			lip_set_add(out, ast->data.string);
-			break;
-		case LIP_AST_IF:
-			lip_find_free_vars(ast->data.if_.condition, out);
-			lip_find_free_vars(ast->data.if_.then, out);
-			if(ast->data.if_.else_)
-			{
-				lip_find_free_vars(ast->data.if_.else_, out);
-			}
-			break;
+			return lip_string_ref_equal(name, ast->data.string);
 		case LIP_AST_APPLICATION:
-			lip_find_free_vars_in_block(ast->data.application.arguments, out);
-			lip_find_free_vars(ast->data.application.function, out);
-			break;
-		case LIP_AST_LAMBDA:
-			lip_find_free_vars_in_block(ast->data.lambda.body, out);
-			lip_array_foreach(lip_string_ref_t, param, ast->data.lambda.arguments)
 			{
-				lip_set_remove(out, *param);
+				const lip_ast_t* function = ast->data.application.function;
+				if(true
+					&& function->type == LIP_AST_IDENTIFIER
+					&& lip_string_ref_equal(name, function->data.string)
+				)
+				{
+					if(!is_closure) { return true; }
+					if(same_frame && lip_is_tail_call(compiler, ast)) { return true; }
+				}
+				else if(lip_escapes(compiler, name, function, is_closure, same_frame))
+				{
+					return true;
+				}
+
+				bool is_borrowing = !is_closure && lip_is_borrowing_call(compiler, ast);
+				lip_array_foreach(lip_ast_t*, arg, ast->data.application.arguments)
+				{
+					bool is_lent = true
+						&& is_borrowing
+						&& (*arg)->type == LIP_AST_IDENTIFIER
+						&& lip_string_ref_equal(name, (*arg)->data.string);
+
+					if(!is_lent && lip_escapes(compiler, name, *arg, is_closure, same_frame))
+					{
+						return true;
+					}
+				}
+
+				return false;
 			}
-			break;
+		case LIP_AST_IF:
+			return lip_escapes(compiler, name, ast->data.if_.condition, is_closure, same_frame)
+				|| lip_escapes(compiler, name, ast->data.if_.then, is_closure, same_frame)
+				|| (ast->data.if_.else_
+					&& lip_escapes(compiler, name, ast->data.if_.else_, is_closure, same_frame));
 		case LIP_AST_DO:
-			lip_find_free_vars_in_block(ast->data.do_, out);
-			break;
+			return lip_escapes_in_block(
+				compiler, name, ast->data.do_, is_closure, same_frame
+			);
+		case LIP_AST_RECUR:
+			// Loop variables outlive the iteration which binds them
+			return lip_escapes_in_block(
+				compiler, name, ast->data.recur, is_closure, same_frame
+			);
 		case LIP_AST_LET:
+		case LIP_AST_LOOP:
+			if(!same_frame) { return lip_var_occurs(name, ast); }
+			return lip_escapes_in_bindings(
+				compiler, name,
+				ast->data.let.bindings, 0, ast->data.let.body,
+				is_closure
+			);
+		case LIP_AST_LETREC:
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
 			{
-				lip_find_free_vars_in_block(ast->data.let.body, out);
-				size_t num_bindings = lip_array_len(ast->data.let.bindings);
-				for(int i = num_bindings - 1; i >= 0; --i)
+				if(lip_string_ref_equal(name, binding->name)) { return false; }
+				if(lip_is_borrowing_name(compiler, binding->name) || !same_frame)
 				{
-					lip_let_binding_t* binding = &ast->data.let.bindings[i];
-					lip_set_remove(out, binding->name);
-					lip_find_free_vars(binding->value, out);
+					return lip_var_occurs(name, ast);
 				}
 			}
-			break;
-		case LIP_AST_LETREC:
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
 			{
-				lip_find_free_vars_in_block(ast->data.let.body, out);
-				size_t num_bindings = lip_array_len(ast->data.let.bindings);
-				for(int i = num_bindings - 1; i >= 0; --i)
-				{
-					lip_find_free_vars(ast->data.let.bindings[i].value, out);
-				}
-				for(int i = num_bindings - 1; i >= 0; --i)
+				if(lip_escapes(compiler, name, binding->value, is_closure, same_frame))
 				{
-					lip_set_remove(out, ast->data.let.bindings[i].name);
+					return true;
 				}
 			}
-			break;
+			return lip_escapes_in_block(
+				compiler, name, ast->data.let.body, is_closure, same_frame
+			);
+		case LIP_AST_LAMBDA:
+			lip_array_foreach(lip_string_ref_t, param, ast->data.lambda.arguments)
+			{
+				if(lip_string_ref_equal(name, *param)) { return false; }
+			}
+			return lip_var_occurs_in_block(name, ast->data.lambda.body);
 		case LIP_AST_SYMBOL:
 		case LIP_AST_STRING:
 		case LIP_AST_NUMBER:
-			break;
+			return false;
 	}
+
+	return true;
 }
 
+// Check whether the closure bound by the i-th binding of a letrec can outlive
+// the current frame, given the other closures which are frame-allocated
 static bool
-lip_compile_lambda(lip_compiler_t* compiler, const lip_ast_t* ast)
+lip_escapes_in_letrec(
+	lip_compiler_t* compiler,
+	const lip_ast_t* ast,
+	size_t index,
+	const bool* in_scratch
+)
 {
-	lip_scope_t* scope = lip_begin_scope(compiler, ast->location);
+	lip_string_ref_t name = ast->data.let.bindings[index].name;
+	if(lip_escapes_in_block(compiler, name, ast->data.let.body, true, true))
+	{
+		return true;
+	}
 
-	// Allocate arguments
+	size_t num_bindings = lip_array_len(ast->data.let.bindings);
+	for(size_t i = 0; i < num_bindings; ++i)
+	{
+		const lip_ast_t* value = ast->data.let.bindings[i].value;
+		if(value->type != LIP_AST_LAMBDA)
+		{
+			if(lip_escapes(compiler, name, value, true, true)) { return true; }
+		}
+		else if(!in_scratch[i])
+		{
+			// Captured by a closure which may outlive this frame
+			if(lip_var_occurs(name, value)) { return true; }
+		}
+		else if(lip_escapes(compiler, name, value, true, true))
+		{
+			// A sibling only captures this closure to call it.  It can do so
+			// from any position since both live in the same frame.
+			bool is_shadowed = false;
+			lip_array_foreach(lip_string_ref_t, param, value->data.lambda.arguments)
+			{
+				is_shadowed = is_shadowed || lip_string_ref_equal(name, *param);
+			}
+
+			if(!is_shadowed && lip_escapes_in_block(
+				compiler, name, value->data.lambda.body, true, false
+			))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// Slots of variables which die while a binding form is being compiled
+typedef struct lip_dead_slots_s
+{
+	// Index of the last binding reading each name, the body counts as the
+	// binding after the last one. NULL when no slot can be freed.
+	khash_t(lip_asm_string_index)* last_reads;
+	size_t num_bindings;
+	// Bindings whose value is evaluated
+	size_t num_evaluated;
+	lip_array(uint16_t) free_slots;
+	// Slots whose variable is last read by each binding, plus one, chained
+	// through next_dying
+	uint32_t* dying;
+	lip_array(uint32_t) next_dying;
+} lip_dead_slots_t;
+
+static void
+lip_record_reads(
+	khash_t(lip_asm_string_index)* last_reads,
+	const lip_ast_t* ast,
+	lip_asm_index_t binding
+);
+
+static void
+lip_record_reads_in_block(
+	khash_t(lip_asm_string_index)* last_reads,
+	lip_array(lip_ast_t*) block,
+	lip_asm_index_t binding
+)
+{
+	lip_array_foreach(lip_ast_t*, exp, block)
+	{
+		lip_record_reads(last_reads, *exp, binding);
+	}
+}
+
+// Like lip_var_occurs, names are matched regardless of shadowing
+static void
+lip_record_reads(
+	khash_t(lip_asm_string_index)* last_reads,
+	const lip_ast_t* ast,
+	lip_asm_index_t binding
+)
+{
+	switch(ast->type)
+	{
+		case LIP_AST_IDENTIFIER:
+			{
+				int ret;
+				khiter_t itr = kh_put(
+					lip_asm_string_index, last_reads, ast->data.string, &ret
+				);
+				kh_val(last_reads, itr) = binding;
+			}
+			break;
+		case LIP_AST_IF:
+			lip_record_reads(last_reads, ast->data.if_.condition, binding);
+			lip_record_reads(last_reads, ast->data.if_.then, binding);
+			if(ast->data.if_.else_)
+			{
+				lip_record_reads(last_reads, ast->data.if_.else_, binding);
+			}
+			break;
+		case LIP_AST_APPLICATION:
+			lip_record_reads(last_reads, ast->data.application.function, binding);
+			lip_record_reads_in_block(
+				last_reads, ast->data.application.arguments, binding
+			);
+			break;
+		case LIP_AST_LAMBDA:
+			lip_record_reads_in_block(last_reads, ast->data.lambda.body, binding);
+			break;
+		case LIP_AST_DO:
+			lip_record_reads_in_block(last_reads, ast->data.do_, binding);
+			break;
+		case LIP_AST_RECUR:
+			lip_record_reads_in_block(last_reads, ast->data.recur, binding);
+			break;
+		case LIP_AST_LET:
+		case LIP_AST_LETREC:
+		case LIP_AST_LOOP:
+			lip_array_foreach(lip_let_binding_t, nested, ast->data.let.bindings)
+			{
+				lip_record_reads(last_reads, nested->value, binding);
+			}
+			lip_record_reads_in_block(last_reads, ast->data.let.body, binding);
+			break;
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			break;
+	}
+}
+
+// Let a slot be reused once the last binding reading `name` is evaluated
+static void
+lip_track_slot(lip_dead_slots_t* slots, lip_string_ref_t name, uint16_t slot)
+{
+	if(slots->last_reads == NULL) { return; }
+
+	khiter_t itr = kh_get(lip_asm_string_index, slots->last_reads, name);
+	if(itr == kh_end(slots->last_reads))
+	{
+		lip_array_push(slots->free_slots, slot);
+		return;
+	}
+
+	lip_asm_index_t last_read = kh_val(slots->last_reads, itr);
+	if(last_read < slots->num_evaluated)
+	{
+		lip_array_push(slots->free_slots, slot);
+	}
+	else if(last_read < slots->num_bindings)
+	{
+		if(lip_array_len(slots->next_dying) <= slot)
+		{
+			lip_array_resize(slots->next_dying, (size_t)slot + 1);
+		}
+		slots->next_dying[slot] = slots->dying[last_read];
+		slots->dying[last_read] = (uint32_t)slot + 1;
+	}
+}
+
+static void
+lip_begin_binding_form(
+	lip_compiler_t* compiler, lip_dead_slots_t* slots, const lip_ast_t* ast
+)
+{
+	lip_scope_t* scope = compiler->current_scope;
+	size_t num_vars = lip_array_len(scope->vars);
+	size_t num_bindings = lip_array_len(ast->data.let.bindings);
+	*slots = (lip_dead_slots_t){ .num_bindings = num_bindings };
+
+	// A variable of a let can give its slot to the next ones
+	bool has_candidates = ast->type == LIP_AST_LET && num_bindings > 1;
+	for(size_t i = scope->first_reusable_var; i < num_vars && !has_candidates; ++i)
+	{
+		has_candidates = scope->vars[i].load_op == LIP_OP_LDLV;
+	}
+	if(!has_candidates) { return; }
+
+	slots->last_reads = kh_init(lip_asm_string_index, compiler->allocator);
+	for(size_t i = 0; i < num_bindings; ++i)
+	{
+		lip_record_reads(
+			slots->last_reads, ast->data.let.bindings[i].value, (lip_asm_index_t)i
+		);
+	}
+	lip_record_reads_in_block(
+		slots->last_reads, ast->data.let.body, (lip_asm_index_t)num_bindings
+	);
+
+	slots->free_slots = lip_array_create(compiler->allocator, uint16_t, 4);
+	slots->next_dying = lip_array_create(compiler->allocator, uint32_t, 4);
+	slots->dying = lip_malloc(
+		compiler->allocator, sizeof(uint32_t) * LIP_MAX(num_bindings, 1)
+	);
+	memset(slots->dying, 0, sizeof(uint32_t) * LIP_MAX(num_bindings, 1));
+
+	// A slot may have been handed over already
+	bool* is_taken = lip_malloc(
+		compiler->allocator, sizeof(bool) * LIP_MAX(scope->max_num_locals, 1)
+	);
+	memset(is_taken, 0, sizeof(bool) * LIP_MAX(scope->max_num_locals, 1));
+	for(size_t i = num_vars; i > scope->first_reusable_var; --i)
+	{
+		const lip_var_t* var = &scope->vars[i - 1];
+		if(var->load_op != LIP_OP_LDLV || is_taken[var->index]) { continue; }
+
+		is_taken[var->index] = true;
+		lip_track_slot(slots, var->name, var->index);
+	}
+	lip_free(compiler->allocator, is_taken);
+}
+
+static void
+lip_end_binding_form(lip_compiler_t* compiler, lip_dead_slots_t* slots)
+{
+	if(slots->last_reads == NULL) { return; }
+
+	lip_free(compiler->allocator, slots->dying);
+	lip_array_destroy(slots->next_dying);
+	lip_array_destroy(slots->free_slots);
+	kh_destroy(lip_asm_string_index, slots->last_reads);
+}
+
+// Allocate a slot for a variable of a binding form once bindings[0, first_binding)
+// are evaluated
+static lip_asm_index_t
+lip_alloc_local(
+	lip_compiler_t* compiler,
+	lip_dead_slots_t* slots,
+	lip_string_ref_t name,
+	size_t first_binding
+)
+{
+	lip_scope_t* scope = compiler->current_scope;
+	for(; slots->num_evaluated < first_binding; ++slots->num_evaluated)
+	{
+		if(slots->last_reads == NULL) { continue; }
+
+		for(
+			uint32_t slot = slots->dying[slots->num_evaluated];
+			slot != 0;
+			slot = slots->next_dying[slot - 1]
+		)
+		{
+			lip_array_push(slots->free_slots, (uint16_t)(slot - 1));
+		}
+	}
+
+	uint16_t local_index;
+	size_t num_free_slots = slots->last_reads ? lip_array_len(slots->free_slots) : 0;
+	if(num_free_slots > 0)
+	{
+		local_index = slots->free_slots[num_free_slots - 1];
+		lip_array_resize(slots->free_slots, num_free_slots - 1);
+	}
+	else
+	{
+		local_index = scope->current_num_locals++;
+		scope->max_num_locals = LIP_MAX(scope->max_num_locals, scope->current_num_locals);
+	}
+	*lip_array_alloc(scope->vars) = (lip_var_t) {
+		.name = name,
+		.index = local_index,
+		.load_op = LIP_OP_LDLV
+	};
+	return local_index;
+}
+
+static void
+lip_set_known_fn(lip_var_t* var, const lip_ast_t* value)
+{
+	bool is_known = value->type == LIP_AST_LAMBDA && !value->data.lambda.is_vararg;
+	var->known_fn = is_known ? value : NULL;
+}
+
+static bool
+lip_compile_let(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	lip_scope_t* scope = compiler->current_scope;
+	size_t num_vars = lip_array_len(scope->vars);
+	uint16_t num_locals = scope->current_num_locals;
+	lip_dead_slots_t slots;
+	lip_begin_binding_form(compiler, &slots, ast);
+
+	// Compile bindings
+	size_t num_bindings = lip_array_len(ast->data.let.bindings);
+	for(size_t i = 0; i < num_bindings; ++i)
+	{
+		const lip_let_binding_t* binding = &ast->data.let.bindings[i];
+		const lip_ast_t* value = binding->value;
+		bool is_closure = value->type == LIP_AST_LAMBDA;
+		bool in_scratch = (is_closure || lip_is_list_constructor(compiler, value))
+			&& !lip_escapes_in_bindings(
+				compiler, binding->name,
+				ast->data.let.bindings, i + 1, ast->data.let.body,
+				is_closure
+			);
+		lip_compile_value(compiler, value, in_scratch);
+		lip_asm_index_t local = lip_alloc_local(
+			compiler, &slots, binding->name, i + 1
+		);
+		lip_track_slot(&slots, binding->name, local);
+		lip_set_known_fn(&scope->vars[lip_array_len(scope->vars) - 1], value);
+		LASM(compiler, LIP_OP_SET, local, binding->location);
+	}
+	lip_end_binding_form(compiler, &slots);
+
+	// Compile body
+	lip_compile_block(compiler, ast->data.let.body);
+
+	lip_array_resize(scope->vars, num_vars);
+	scope->current_num_locals = num_locals;
+
+	return true;
+}
+
+static bool
+lip_compile_letrec(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	lip_scope_t* scope = compiler->current_scope;
+	size_t num_vars = lip_array_len(scope->vars);
+	uint16_t num_locals = scope->current_num_locals;
+
+	// Compile bindings
+	// Declare placeholders
+	lip_dead_slots_t slots;
+	lip_begin_binding_form(compiler, &slots, ast);
+	lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+	{
+		lip_asm_index_t local = lip_alloc_local(compiler, &slots, binding->name, 0);
+		LASM(compiler, LIP_OP_PLHR, local, LIP_LOC_NOWHERE);
+	}
+	lip_end_binding_form(compiler, &slots);
+
+	// Find closures which do not escape the current frame
+	size_t num_bindings = lip_array_len(ast->data.let.bindings);
+	bool* in_scratch = lip_malloc(
+		compiler->arena_allocator, sizeof(bool) * LIP_MAX(num_bindings, 1)
+	);
+	for(size_t i = 0; i < num_bindings; ++i)
+	{
+		in_scratch[i] = ast->data.let.bindings[i].value->type == LIP_AST_LAMBDA;
+	}
+	for(bool changed = true; changed;)
+	{
+		changed = false;
+		for(size_t i = 0; i < num_bindings; ++i)
+		{
+			if(in_scratch[i] && lip_escapes_in_letrec(compiler, ast, i, in_scratch))
+			{
+				in_scratch[i] = false;
+				changed = true;
+			}
+		}
+	}
+
+	// Closures can be called as soon as every binding is made recursive.
+	// Siblings only see them as known if nothing can run before that.
+	bool all_closures = true;
+	lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+	{
+		all_closures = all_closures && binding->value->type == LIP_AST_LAMBDA;
+	}
+	for(size_t i = 0; all_closures && i < num_bindings; ++i)
+	{
+		lip_set_known_fn(&scope->vars[num_vars + i], ast->data.let.bindings[i].value);
+	}
+
+	// Bind value to locals
+	lip_asm_index_t local_index = num_vars;
+	lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+	{
+		lip_compile_value(
+			compiler, binding->value,
+			in_scratch[binding - ast->data.let.bindings]
+		);
+		LASM(
+			compiler,
+			LIP_OP_SET, scope->vars[local_index++].index,
+			binding->location
+		);
+	}
+
+	// Make recursive closure
+	local_index = num_vars;
+	lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+	{
+		LASM(
+			compiler,
+			LIP_OP_RCLS, compiler->current_scope->vars[local_index++].index,
+			LIP_LOC_NOWHERE
+		);
+	}
+	lip_free(compiler->arena_allocator, in_scratch);
+
+	for(size_t i = 0; i < num_bindings; ++i)
+	{
+		lip_set_known_fn(&scope->vars[num_vars + i], ast->data.let.bindings[i].value);
+	}
+
+	// Compile body
+	lip_compile_block(compiler, ast->data.let.body);
+
+	lip_array_resize(scope->vars, num_vars);
+	scope->current_num_locals = num_locals;
+
+	return true;
+}
+
+static void
+lip_set_add(khash_t(lip_string_ref_set)* set, lip_string_ref_t elem)
+{
+	int ret;
+	kh_put(lip_string_ref_set, set, elem, &ret);
+}
+
+static void
+lip_find_free_vars(
+	const lip_ast_t* ast,
+	lip_array(lip_string_ref_t)* bound,
+	khash_t(lip_string_ref_set)* out
+);
+
+static void
+lip_find_free_vars_in_block(
+	lip_array(lip_ast_t*) block,
+	lip_array(lip_string_ref_t)* bound,
+	khash_t(lip_string_ref_set)* out
+)
+{
+	lip_array_foreach(lip_ast_t*, sub_exp, block)
+	{
+		lip_find_free_vars(*sub_exp, bound, out);
+	}
+}
+
+// Names bound inside ast are tracked in bound instead of being removed from
+// out afterwards, a sibling expression may use the same name freely
+static void
+lip_find_free_vars(
+	const lip_ast_t* ast,
+	lip_array(lip_string_ref_t)* bound,
+	khash_t(lip_string_ref_set)* out
+)
+{
+	size_t num_bound = lip_array_len(*bound);
+	switch(ast->type)
+	{
+		case LIP_AST_IDENTIFIER:
+			for(size_t i = 0; i < num_bound; ++i)
+			{
+				if(lip_string_ref_equal(ast->data.string, (*bound)[i])) { return; }
+			}
+			lip_set_add(out, ast->data.string);
+			break;
+		case LIP_AST_IF:
+			lip_find_free_vars(ast->data.if_.condition, bound, out);
+			lip_find_free_vars(ast->data.if_.then, bound, out);
+			if(ast->data.if_.else_)
+			{
+				lip_find_free_vars(ast->data.if_.else_, bound, out);
+			}
+			break;
+		case LIP_AST_APPLICATION:
+			lip_find_free_vars_in_block(ast->data.application.arguments, bound, out);
+			lip_find_free_vars(ast->data.application.function, bound, out);
+			break;
+		case LIP_AST_LAMBDA:
+			lip_array_foreach(lip_string_ref_t, param, ast->data.lambda.arguments)
+			{
+				lip_array_push(*bound, *param);
+			}
+			lip_find_free_vars_in_block(ast->data.lambda.body, bound, out);
+			break;
+		case LIP_AST_DO:
+			lip_find_free_vars_in_block(ast->data.do_, bound, out);
+			break;
+		case LIP_AST_RECUR:
+			lip_find_free_vars_in_block(ast->data.recur, bound, out);
+			break;
+		case LIP_AST_LET:
+		case LIP_AST_LOOP:
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+			{
+				lip_find_free_vars(binding->value, bound, out);
+				lip_array_push(*bound, binding->name);
+			}
+			lip_find_free_vars_in_block(ast->data.let.body, bound, out);
+			break;
+		case LIP_AST_LETREC:
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+			{
+				lip_array_push(*bound, binding->name);
+			}
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+			{
+				lip_find_free_vars(binding->value, bound, out);
+			}
+			lip_find_free_vars_in_block(ast->data.let.body, bound, out);
+			break;
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			break;
+	}
+
+	lip_array_resize(*bound, num_bound);
+}
+
+static bool
+lip_compile_lambda(lip_compiler_t* compiler, const lip_ast_t* ast, bool in_scratch)
+{
+	lip_scope_t* scope = lip_begin_scope(compiler, ast->location);
+	scope->lambda = ast;
+
+	// Allocate arguments
 	uint16_t arg_index = 0;
 	lip_array_foreach(lip_string_ref_t, arg, ast->data.lambda.arguments)
 	{
-		*lip_array_alloc(scope->vars) = (lip_var_t){
-			.name = *arg,
-			.index = arg_index++,
-			.load_op = LIP_OP_LARG
-		};
+		*lip_array_alloc(scope->vars) = (lip_var_t){
+			.name = *arg,
+			.index = arg_index++,
+			.load_op = LIP_OP_LARG
+		};
+	}
+
+	// Allocate free vars
+	kh_clear(lip_string_ref_set, compiler->free_var_names);
+	lip_array(lip_string_ref_t) bound_names = lip_array_create(
+		compiler->allocator, lip_string_ref_t, 8
+	);
+	lip_find_free_vars(ast, &bound_names, compiler->free_var_names);
+	lip_array_destroy(bound_names);
+
+	lip_var_t* free_vars = lip_malloc(
+		compiler->arena_allocator,
+		kh_size(compiler->free_var_names) * sizeof(lip_var_t)
+	);
+	lip_asm_index_t captured_var_index = 0;
+
+	kh_foreach(itr, compiler->free_var_names)
+	{
+		lip_string_ref_t var_name = kh_key(compiler->free_var_names, itr);
+		if(lip_find_var(scope->parent, var_name, &free_vars[captured_var_index]))
+		{
+			*lip_array_alloc(scope->vars) = (lip_var_t){
+				.name = var_name,
+				.index = captured_var_index,
+				.load_op = LIP_OP_LDCV,
+				.known_fn = free_vars[captured_var_index].known_fn
+			};
+			++captured_var_index;
+		}
+	}
+
+	// Compile body
+	lip_compile_block(compiler, ast->data.lambda.body);
+
+	LASM(compiler, LIP_OP_RET, 0, LIP_LOC_NOWHERE);
+	lip_function_t* function = lip_end_scope(compiler, compiler->arena_allocator);
+	function->num_args = lip_array_len(ast->data.lambda.arguments);
+	function->is_vararg = ast->data.lambda.is_vararg;
+
+	// Compile closure capture
+	lip_asm_index_t function_index =
+		lip_asm_new_function(&compiler->current_scope->lasm, function);
+
+	lip_asm_index_t local_index;
+	if(in_scratch && lip_alloc_scratch(
+		compiler, lip_closure_scratch_slots(captured_var_index), &local_index
+	))
+	{
+		LASM(compiler, LIP_OP_LCLS, local_index, ast->location);
+	}
+	lip_asm_add_pair(
+		&compiler->current_scope->lasm,
+		LIP_OP_CLS, function_index, captured_var_index,
+		ast->location
+	);
+	// Pseudo-instructions to capture local variables into closure
+	for(size_t i = 0; i < captured_var_index; ++i)
+	{
+		LASM(compiler, free_vars[i].load_op, free_vars[i].index, LIP_LOC_NOWHERE);
+	}
+	lip_free(compiler->arena_allocator, free_vars);
+
+	return true;
+}
+
+static void
+lip_compile_do(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	lip_compile_block(compiler, ast->data.do_);
+}
+
+static bool
+lip_compile_loop(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	lip_scope_t* scope = compiler->current_scope;
+	size_t num_vars = lip_array_len(scope->vars);
+	uint16_t num_locals = scope->current_num_locals;
+	const lip_loop_t* parent_loop = scope->loop;
+
+	// Loop variables are rebound by position so they can never share a slot
+	lip_dead_slots_t slots;
+	lip_begin_binding_form(compiler, &slots, ast);
+	size_t num_bindings = lip_array_len(ast->data.let.bindings);
+	for(size_t i = 0; i < num_bindings; ++i)
+	{
+		const lip_let_binding_t* binding = &ast->data.let.bindings[i];
+		lip_compile_exp(compiler, binding->value);
+		lip_asm_index_t local = lip_alloc_local(
+			compiler, &slots, binding->name, i + 1
+		);
+		LASM(compiler, LIP_OP_SET, local, binding->location);
+	}
+	lip_end_binding_form(compiler, &slots);
+
+	// Anything read in the body is read again on the next iteration
+	size_t first_reusable_var = scope->first_reusable_var;
+	scope->first_reusable_var = lip_array_len(scope->vars);
+	lip_loop_t loop = {
+		.head = lip_asm_new_label(&scope->lasm),
+		.first_var = num_vars
+	};
+	LASM(compiler, LIP_OP_LABEL, loop.head, LIP_LOC_NOWHERE);
+	scope->loop = &loop;
+	lip_compile_block(compiler, ast->data.let.body);
+	scope->loop = parent_loop;
+	scope->first_reusable_var = first_reusable_var;
+
+	lip_array_resize(scope->vars, num_vars);
+	scope->current_num_locals = num_locals;
+
+	return true;
+}
+
+static bool
+lip_compile_recur(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	lip_scope_t* scope = compiler->current_scope;
+	const lip_loop_t* loop = scope->loop;
+	lip_array(lip_ast_t*) args = ast->data.recur;
+	size_t num_args = lip_array_len(args);
+
+	// Every new value is computed before the variables are updated.
+	// Variables passed back as is are left alone.
+	bool* is_unchanged = lip_malloc(
+		compiler->arena_allocator, sizeof(bool) * LIP_MAX(num_args, 1)
+	);
+	for(size_t i = 0; i < num_args; ++i)
+	{
+		const lip_var_t* loop_var = &scope->vars[loop->first_var + i];
+		lip_var_t var;
+		is_unchanged[i] = true
+			&& args[i]->type == LIP_AST_IDENTIFIER
+			&& lip_find_var(scope, args[i]->data.string, &var)
+			&& var.load_op == LIP_OP_LDLV
+			&& var.index == loop_var->index;
+		if(!is_unchanged[i]) { lip_compile_exp(compiler, args[i]); }
+	}
+
+	for(size_t i = num_args; i > 0; --i)
+	{
+		if(is_unchanged[i - 1]) { continue; }
+
+		LASM(
+			compiler,
+			LIP_OP_SET, scope->vars[loop->first_var + i - 1].index,
+			args[i - 1]->location
+		);
+	}
+	lip_free(compiler->arena_allocator, is_unchanged);
+
+	LASM(compiler, LIP_OP_JMP, loop->head, ast->location);
+	return true;
+}
+
+// Compile an expression whose value is also the value of every scope with a
+// reusable variable
+static void
+lip_compile_final_exp(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	switch(ast->type)
+	{
+		case LIP_AST_NUMBER:
+			lip_compile_number(compiler, ast);
+			break;
+		case LIP_AST_STRING:
+			lip_compile_string(compiler, ast);
+			break;
+		case LIP_AST_SYMBOL:
+			lip_compile_symbol(compiler, ast);
+			break;
+		case LIP_AST_IDENTIFIER:
+			lip_compile_identifier(compiler, ast);
+			break;
+		case LIP_AST_APPLICATION:
+			lip_compile_application(compiler, ast);
+			break;
+		case LIP_AST_IF:
+			lip_compile_if(compiler, ast);
+			break;
+		case LIP_AST_LET:
+			lip_compile_let(compiler, ast);
+			break;
+		case LIP_AST_LETREC:
+			lip_compile_letrec(compiler, ast);
+			break;
+		case LIP_AST_LAMBDA:
+			lip_compile_lambda(compiler, ast, false);
+			break;
+		case LIP_AST_DO:
+			lip_compile_do(compiler, ast);
+			break;
+		case LIP_AST_LOOP:
+			lip_compile_loop(compiler, ast);
+			break;
+		case LIP_AST_RECUR:
+			lip_compile_recur(compiler, ast);
+			break;
+	}
+}
+
+static void
+lip_compile_exp(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	// Variables in scope may still be read once the expression is done
+	lip_scope_t* scope = compiler->current_scope;
+	size_t first_reusable_var = scope->first_reusable_var;
+	scope->first_reusable_var = lip_array_len(scope->vars);
+	lip_compile_final_exp(compiler, ast);
+	scope->first_reusable_var = first_reusable_var;
+}
+
+static void
+lip_find_tail_calls(lip_compiler_t* compiler, const lip_ast_t* ast, bool is_tail);
+
+static void
+lip_find_tail_calls_in_block(
+	lip_compiler_t* compiler, lip_array(lip_ast_t*) block, bool is_tail
+)
+{
+	size_t block_size = lip_array_len(block);
+	for(size_t i = 0; i < block_size; ++i)
+	{
+		lip_find_tail_calls(compiler, block[i], is_tail && i == block_size - 1);
+	}
+}
+
+static void
+lip_find_tail_calls(lip_compiler_t* compiler, const lip_ast_t* ast, bool is_tail)
+{
+	switch(ast->type)
+	{
+		case LIP_AST_APPLICATION:
+			if(is_tail)
+			{
+				int ret;
+				kh_put(lip_ptr_set, compiler->tail_calls, (void*)ast, &ret);
+			}
+			lip_find_tail_calls(compiler, ast->data.application.function, false);
+			lip_find_tail_calls_in_block(
+				compiler, ast->data.application.arguments, false
+			);
+			break;
+		case LIP_AST_IF:
+			lip_find_tail_calls(compiler, ast->data.if_.condition, false);
+			lip_find_tail_calls(compiler, ast->data.if_.then, is_tail);
+			if(ast->data.if_.else_)
+			{
+				lip_find_tail_calls(compiler, ast->data.if_.else_, is_tail);
+			}
+			break;
+		case LIP_AST_LET:
+		case LIP_AST_LETREC:
+		case LIP_AST_LOOP:
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+			{
+				lip_find_tail_calls(compiler, binding->value, false);
+			}
+			lip_find_tail_calls_in_block(compiler, ast->data.let.body, is_tail);
+			break;
+		case LIP_AST_RECUR:
+			lip_find_tail_calls_in_block(compiler, ast->data.recur, false);
+			break;
+		case LIP_AST_LAMBDA:
+			lip_find_tail_calls_in_block(compiler, ast->data.lambda.body, true);
+			break;
+		case LIP_AST_DO:
+			lip_find_tail_calls_in_block(compiler, ast->data.do_, is_tail);
+			break;
+		case LIP_AST_IDENTIFIER:
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			break;
+	}
+}
+
+// What is known about a lambda which is only ever called directly, or about
+// the variables of a loop
+struct lip_number_fn_s
+{
+	// Bit i is set when the i-th argument is always a number
+	uint32_t number_args;
+	bool returns_number;
+};
+
+struct lip_number_env_s
+{
+	const lip_number_env_t* parent;
+	lip_string_ref_t name;
+	bool is_number;
+	// Index of the lambda held by the variable, -1 if unknown
+	int fn_index;
+};
+
+struct lip_number_inference_s
+{
+	lip_compiler_t* compiler;
+	lip_array(lip_number_fn_t) fns;
+	size_t next_fn;
+	// Index of the innermost loop, -1 if there is none
+	int loop_index;
+	bool changed;
+	// Expressions which are not numbers in at least one of their contexts
+	khash_t(lip_ptr_set)* generic_exps;
+};
+
+static const lip_number_env_t*
+lip_number_env_find(const lip_number_env_t* env, lip_string_ref_t name)
+{
+	for(; env != NULL; env = env->parent)
+	{
+		if(lip_string_ref_equal(name, env->name)) { return env; }
 	}
 
-	// Allocate free vars
-	kh_clear(lip_string_ref_set, compiler->free_var_names);
-	lip_find_free_vars(ast, compiler->free_var_names);
+	return NULL;
+}
 
-	lip_var_t* free_vars = lip_malloc(
-		compiler->arena_allocator,
-		kh_size(compiler->free_var_names) * sizeof(lip_var_t)
-	);
-	uint8_t captured_var_index = 0;
+// Whether an expression calls the given global function
+static bool
+lip_is_global_call(
+	const lip_number_env_t* env, const lip_ast_t* ast, const char* name
+)
+{
+	if(ast->type != LIP_AST_APPLICATION) { return false; }
 
-	kh_foreach(itr, compiler->free_var_names)
+	const lip_ast_t* function = ast->data.application.function;
+	return true
+		&& function->type == LIP_AST_IDENTIFIER
+		&& lip_string_ref_equal(lip_string_ref(name), function->data.string)
+		&& lip_number_env_find(env, function->data.string) == NULL;
+}
+
+// Local variable which is a number whenever `condition` is truthy, or falsy
+// when `negated` is set
+static const lip_number_env_t*
+lip_number_guard(
+	const lip_number_env_t* env, const lip_ast_t* condition, bool* negated
+)
+{
+	*negated = false;
+	while(true
+		&& lip_is_global_call(env, condition, "!")
+		&& lip_array_len(condition->data.application.arguments) == 1
+	)
 	{
-		lip_string_ref_t var_name = kh_key(compiler->free_var_names, itr);
-		if(lip_find_var(scope->parent, var_name, &free_vars[captured_var_index]))
-		{
-			*lip_array_alloc(scope->vars) = (lip_var_t){
-				.name = var_name,
-				.index = captured_var_index++,
-				.load_op = LIP_OP_LDCV
-			};
-		}
+		*negated = !*negated;
+		condition = condition->data.application.arguments[0];
 	}
 
-	// Compile body
-	lip_compile_block(compiler, ast->data.lambda.body);
+	if(false
+		|| !(false
+			|| lip_is_global_call(env, condition, "number?")
+			|| lip_is_global_call(env, condition, "/number?"))
+		|| lip_array_len(condition->data.application.arguments) != 1
+	)
+	{
+		return NULL;
+	}
 
-	LASM(compiler, LIP_OP_RET, 0, LIP_LOC_NOWHERE);
-	lip_function_t* function = lip_end_scope(compiler, compiler->arena_allocator);
-	function->num_args = lip_array_len(ast->data.lambda.arguments);
-	function->is_vararg = ast->data.lambda.is_vararg;
+	const lip_ast_t* arg = condition->data.application.arguments[0];
+	return arg->type == LIP_AST_IDENTIFIER
+		? lip_number_env_find(env, arg->data.string)
+		: NULL;
+}
 
-	// Compile closure capture
-	lip_asm_index_t function_index =
-		lip_asm_new_function(&compiler->current_scope->lasm, function);
-	lip_operand_t operand =
-		(function_index & 0xFFF) | ((captured_var_index & 0xFFF) << 12);
+static bool
+lip_is_only_called(lip_string_ref_t name, size_t arity, const lip_ast_t* ast);
 
-	LASM(compiler, LIP_OP_CLS, operand, ast->location);
-	// Pseudo-instructions to capture local variables into closure
-	for(size_t i = 0; i < captured_var_index; ++i)
+static bool
+lip_is_only_called_in_block(
+	lip_string_ref_t name, size_t arity, lip_array(lip_ast_t*) block
+)
+{
+	lip_array_foreach(lip_ast_t*, exp, block)
 	{
-		LASM(compiler, free_vars[i].load_op, free_vars[i].index, LIP_LOC_NOWHERE);
+		if(!lip_is_only_called(name, arity, *exp)) { return false; }
 	}
-	lip_free(compiler->arena_allocator, free_vars);
 
 	return true;
 }
 
-static void
-lip_compile_do(lip_compiler_t* compiler, const lip_ast_t* ast)
+// Conservatively check whether a name is only used to make calls of the given
+// arity, ignoring shadowing
+static bool
+lip_is_only_called(lip_string_ref_t name, size_t arity, const lip_ast_t* ast)
 {
-	lip_compile_block(compiler, ast->data.do_);
+	switch(ast->type)
+	{
+		case LIP_AST_IDENTIFIER:
+			return !lip_string_ref_equal(name, ast->data.string);
+		case LIP_AST_APPLICATION:
+			{
+				const lip_ast_t* function = ast->data.application.function;
+				lip_array(lip_ast_t*) args = ast->data.application.arguments;
+				if(true
+					&& function->type == LIP_AST_IDENTIFIER
+					&& lip_string_ref_equal(name, function->data.string)
+				)
+				{
+					if(lip_array_len(args) != arity) { return false; }
+				}
+				else if(!lip_is_only_called(name, arity, function))
+				{
+					return false;
+				}
+
+				return lip_is_only_called_in_block(name, arity, args);
+			}
+		case LIP_AST_IF:
+			return lip_is_only_called(name, arity, ast->data.if_.condition)
+				&& lip_is_only_called(name, arity, ast->data.if_.then)
+				&& (ast->data.if_.else_ == NULL
+					|| lip_is_only_called(name, arity, ast->data.if_.else_));
+		case LIP_AST_LAMBDA:
+			return lip_is_only_called_in_block(name, arity, ast->data.lambda.body);
+		case LIP_AST_DO:
+			return lip_is_only_called_in_block(name, arity, ast->data.do_);
+		case LIP_AST_RECUR:
+			return lip_is_only_called_in_block(name, arity, ast->data.recur);
+		case LIP_AST_LET:
+		case LIP_AST_LETREC:
+		case LIP_AST_LOOP:
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+			{
+				if(!lip_is_only_called(name, arity, binding->value)) { return false; }
+			}
+			return lip_is_only_called_in_block(name, arity, ast->data.let.body);
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			return true;
+	}
+
+	return false;
+}
+
+static int
+lip_alloc_number_fn(lip_number_inference_t* inf)
+{
+	// Start from the most optimistic assumption, the fixpoint refines it
+	size_t fn_index = inf->next_fn++;
+	if(fn_index == lip_array_len(inf->fns))
+	{
+		lip_number_fn_t fn = { .number_args = UINT32_MAX, .returns_number = true };
+		lip_array_push(inf->fns, fn);
+	}
+
+	return (int)fn_index;
+}
+
+// Give an index to the i-th binding of a let if it holds a lambda whose calls
+// can all be seen, -1 otherwise
+static int
+lip_number_fn_index(
+	lip_number_inference_t* inf, const lip_ast_t* ast, size_t index
+)
+{
+	lip_array(lip_let_binding_t) bindings = ast->data.let.bindings;
+	const lip_let_binding_t* binding = &bindings[index];
+	const lip_ast_t* value = binding->value;
+	if(value->type != LIP_AST_LAMBDA || value->data.lambda.is_vararg) { return -1; }
+
+	size_t arity = lip_array_len(value->data.lambda.arguments);
+	size_t num_bindings = lip_array_len(bindings);
+	size_t first = ast->type == LIP_AST_LETREC ? 0 : index + 1;
+	for(size_t i = first; i < num_bindings; ++i)
+	{
+		if(!lip_is_only_called(binding->name, arity, bindings[i].value)) { return -1; }
+	}
+	if(!lip_is_only_called_in_block(binding->name, arity, ast->data.let.body))
+	{
+		return -1;
+	}
+
+	return lip_alloc_number_fn(inf);
 }
 
+// Record that the i-th argument of a lambda or loop may not be a number
 static void
-lip_compile_exp(lip_compiler_t* compiler, const lip_ast_t* ast)
+lip_refine_number_arg(
+	lip_number_inference_t* inf, int fn_index, size_t index, bool is_number
+)
+{
+	if(fn_index < 0 || index >= 32) { return; }
+
+	uint32_t mask = UINT32_C(1) << index;
+	if(!is_number && (inf->fns[fn_index].number_args & mask))
+	{
+		inf->fns[fn_index].number_args &= ~mask;
+		inf->changed = true;
+	}
+}
+
+static bool
+lip_is_number_arg(lip_number_inference_t* inf, int fn_index, size_t index)
+{
+	return true
+		&& fn_index >= 0
+		&& index < 32
+		&& (inf->fns[fn_index].number_args & (UINT32_C(1) << index));
+}
+
+static bool
+lip_infer_number_exp(
+	lip_number_inference_t* inf,
+	const lip_number_env_t* env,
+	const lip_ast_t* ast,
+	int fn_index
+);
+
+static bool
+lip_infer_number(
+	lip_number_inference_t* inf, const lip_number_env_t* env, const lip_ast_t* ast
+)
+{
+	return lip_infer_number_exp(inf, env, ast, -1);
+}
+
+static bool
+lip_infer_number_block(
+	lip_number_inference_t* inf,
+	const lip_number_env_t* env,
+	lip_array(lip_ast_t*) block
+)
+{
+	bool is_number = false;
+	lip_array_foreach(lip_ast_t*, exp, block)
+	{
+		is_number = lip_infer_number(inf, env, *exp);
+	}
+
+	return is_number;
+}
+
+static bool
+lip_infer_number_lambda(
+	lip_number_inference_t* inf,
+	const lip_number_env_t* env,
+	const lip_ast_t* ast,
+	size_t index,
+	uint32_t number_args
+)
+{
+	lip_array(lip_string_ref_t) params = ast->data.lambda.arguments;
+	if(index == lip_array_len(params))
+	{
+		return lip_infer_number_block(inf, env, ast->data.lambda.body);
+	}
+
+	lip_number_env_t param = {
+		.parent = env,
+		.name = params[index],
+		.is_number = index < 32 && (number_args & (UINT32_C(1) << index)),
+		.fn_index = -1
+	};
+	return lip_infer_number_lambda(inf, &param, ast, index + 1, number_args);
+}
+
+static bool
+lip_infer_number_let(
+	lip_number_inference_t* inf,
+	const lip_number_env_t* env,
+	const lip_ast_t* ast,
+	size_t index
+)
+{
+	if(index == lip_array_len(ast->data.let.bindings))
+	{
+		return lip_infer_number_block(inf, env, ast->data.let.body);
+	}
+
+	const lip_let_binding_t* binding = &ast->data.let.bindings[index];
+	int fn_index = lip_number_fn_index(inf, ast, index);
+	lip_number_env_t var = {
+		.parent = env,
+		.name = binding->name,
+		.is_number = lip_infer_number_exp(inf, env, binding->value, fn_index),
+		.fn_index = fn_index
+	};
+	return lip_infer_number_let(inf, &var, ast, index + 1);
+}
+
+// Letrec values are only inferred once every binding is in scope
+static bool
+lip_infer_number_letrec(
+	lip_number_inference_t* inf,
+	const lip_number_env_t* env,
+	const lip_ast_t* ast,
+	size_t index
+)
+{
+	lip_array(lip_let_binding_t) bindings = ast->data.let.bindings;
+	size_t num_bindings = lip_array_len(bindings);
+	if(index == num_bindings)
+	{
+		const lip_number_env_t* var = env;
+		for(size_t i = num_bindings; i > 0; --i)
+		{
+			lip_infer_number_exp(inf, env, bindings[i - 1].value, var->fn_index);
+			var = var->parent;
+		}
+
+		return lip_infer_number_block(inf, env, ast->data.let.body);
+	}
+
+	lip_number_env_t var = {
+		.parent = env,
+		.name = bindings[index].name,
+		.is_number = false,
+		.fn_index = lip_number_fn_index(inf, ast, index)
+	};
+	return lip_infer_number_letrec(inf, &var, ast, index + 1);
+}
+
+// Loop variables are numbers if they start as numbers and are only rebound
+// to numbers
+static bool
+lip_infer_number_loop(
+	lip_number_inference_t* inf,
+	const lip_number_env_t* env,
+	const lip_ast_t* ast,
+	size_t index,
+	int loop_index
+)
+{
+	if(index == lip_array_len(ast->data.let.bindings))
+	{
+		int parent_loop = inf->loop_index;
+		inf->loop_index = loop_index;
+		bool is_number = lip_infer_number_block(inf, env, ast->data.let.body);
+		inf->loop_index = parent_loop;
+		return is_number;
+	}
+
+	const lip_let_binding_t* binding = &ast->data.let.bindings[index];
+	bool is_number = lip_infer_number(inf, env, binding->value);
+	lip_refine_number_arg(inf, loop_index, index, is_number);
+	lip_number_env_t var = {
+		.parent = env,
+		.name = binding->name,
+		.is_number = lip_is_number_arg(inf, loop_index, index),
+		.fn_index = -1
+	};
+	return lip_infer_number_loop(inf, &var, ast, index + 1, loop_index);
+}
+
+static bool
+lip_infer_number_application(
+	lip_number_inference_t* inf, const lip_number_env_t* env, const lip_ast_t* ast
+)
+{
+	const lip_ast_t* function = ast->data.application.function;
+	lip_array(lip_ast_t*) args = ast->data.application.arguments;
+	const lip_number_env_t* callee = function->type == LIP_AST_IDENTIFIER
+		? lip_number_env_find(env, function->data.string)
+		: NULL;
+	int fn_index = callee != NULL ? callee->fn_index : -1;
+
+	lip_infer_number(inf, env, function);
+	size_t arity = lip_array_len(args);
+	for(size_t i = 0; i < arity; ++i)
+	{
+		lip_refine_number_arg(inf, fn_index, i, lip_infer_number(inf, env, args[i]));
+	}
+
+	if(fn_index >= 0) { return inf->fns[fn_index].returns_number; }
+
+	// Arithmetic prim ops either return a number or throw
+	return false
+		|| lip_is_global_call(env, ast, "+")
+		|| lip_is_global_call(env, ast, "-")
+		|| lip_is_global_call(env, ast, "*")
+		|| lip_is_global_call(env, ast, "/")
+		|| lip_is_global_call(env, ast, "cmp");
+}
+
+static bool
+lip_infer_number_if(
+	lip_number_inference_t* inf, const lip_number_env_t* env, const lip_ast_t* ast
+)
+{
+	bool negated;
+	const lip_number_env_t* guarded =
+		lip_number_guard(env, ast->data.if_.condition, &negated);
+	lip_infer_number(inf, env, ast->data.if_.condition);
+
+	// Variables never change so a guard holds for the whole branch
+	lip_number_env_t narrowed;
+	const lip_number_env_t* then_env = env;
+	const lip_number_env_t* else_env = env;
+	if(guarded != NULL)
+	{
+		narrowed = *guarded;
+		narrowed.parent = env;
+		narrowed.is_number = true;
+		if(negated) { else_env = &narrowed; } else { then_env = &narrowed; }
+	}
+
+	bool then_is_number = lip_infer_number(inf, then_env, ast->data.if_.then);
+	bool else_is_number = ast->data.if_.else_ != NULL
+		&& lip_infer_number(inf, else_env, ast->data.if_.else_);
+	return then_is_number && else_is_number;
+}
+
+static bool
+lip_infer_number_exp(
+	lip_number_inference_t* inf,
+	const lip_number_env_t* env,
+	const lip_ast_t* ast,
+	int fn_index
+)
 {
+	bool is_number = false;
 	switch(ast->type)
 	{
 		case LIP_AST_NUMBER:
-			lip_compile_number(compiler, ast);
-			break;
-		case LIP_AST_STRING:
-			lip_compile_string(compiler, ast);
-			break;
-		case LIP_AST_SYMBOL:
-			lip_compile_symbol(compiler, ast);
+			is_number = true;
 			break;
 		case LIP_AST_IDENTIFIER:
-			lip_compile_identifier(compiler, ast);
+			{
+				const lip_number_env_t* var = lip_number_env_find(env, ast->data.string);
+				is_number = var != NULL && var->is_number;
+			}
 			break;
 		case LIP_AST_APPLICATION:
-			lip_compile_application(compiler, ast);
+			is_number = lip_infer_number_application(inf, env, ast);
 			break;
 		case LIP_AST_IF:
-			lip_compile_if(compiler, ast);
+			is_number = lip_infer_number_if(inf, env, ast);
 			break;
 		case LIP_AST_LET:
-			lip_compile_let(compiler, ast);
+			is_number = lip_infer_number_let(inf, env, ast, 0);
 			break;
 		case LIP_AST_LETREC:
-			lip_compile_letrec(compiler, ast);
+			is_number = lip_infer_number_letrec(inf, env, ast, 0);
 			break;
 		case LIP_AST_LAMBDA:
-			lip_compile_lambda(compiler, ast);
+			{
+				uint32_t number_args =
+					fn_index >= 0 ? inf->fns[fn_index].number_args : 0;
+				bool returns_number =
+					lip_infer_number_lambda(inf, env, ast, 0, number_args);
+				if(fn_index >= 0 && !returns_number && inf->fns[fn_index].returns_number)
+				{
+					inf->fns[fn_index].returns_number = false;
+					inf->changed = true;
+				}
+			}
 			break;
 		case LIP_AST_DO:
-			lip_compile_do(compiler, ast);
+			is_number = lip_infer_number_block(inf, env, ast->data.do_);
+			break;
+		case LIP_AST_LOOP:
+			is_number = lip_infer_number_loop(
+				inf, env, ast, 0, lip_alloc_number_fn(inf)
+			);
+			break;
+		case LIP_AST_RECUR:
+			{
+				size_t num_args = lip_array_len(ast->data.recur);
+				for(size_t i = 0; i < num_args; ++i)
+				{
+					bool arg_is_number = lip_infer_number(inf, env, ast->data.recur[i]);
+					lip_refine_number_arg(inf, inf->loop_index, i, arg_is_number);
+				}
+			}
+			// Control never comes back so any type will do
+			is_number = true;
 			break;
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+			break;
+	}
+
+	int ret;
+	khash_t(lip_ptr_set)* number_exps = inf->compiler->number_exps;
+	if(!is_number)
+	{
+		kh_put(lip_ptr_set, inf->generic_exps, (void*)ast, &ret);
+		khiter_t itr = kh_get(lip_ptr_set, number_exps, (void*)ast);
+		if(itr != kh_end(number_exps)) { kh_del(lip_ptr_set, number_exps, itr); }
+	}
+	else if(kh_get(lip_ptr_set, inf->generic_exps, (void*)ast) == kh_end(inf->generic_exps))
+	{
+		kh_put(lip_ptr_set, number_exps, (void*)ast, &ret);
+	}
+
+	return is_number;
+}
+
+/*
+ * Find expressions which can only evaluate to numbers.
+ *
+ * Lambdas bound by a let or letrec whose every call can be seen learn the
+ * types of their arguments from their call sites.  Every other lambda, along
+ * with anything coming from a global, is assumed to be of any type.
+ */
+static void
+lip_find_number_exps(lip_compiler_t* compiler, const lip_ast_t* ast)
+{
+	lip_number_inference_t inf = {
+		.compiler = compiler,
+		.fns = lip_array_create(compiler->allocator, lip_number_fn_t, 0),
+		.loop_index = -1,
+		.generic_exps = kh_init(lip_ptr_set, compiler->allocator)
+	};
+
+	for(unsigned int pass = 1; ; ++pass)
+	{
+		kh_clear(lip_ptr_set, compiler->number_exps);
+		kh_clear(lip_ptr_set, inf.generic_exps);
+		inf.next_fn = 0;
+		inf.changed = false;
+		lip_infer_number(&inf, NULL, ast);
+		if(!inf.changed) { break; }
+
+		// Drop every assumption so that the next pass is the last one
+		if(pass == LIP_NUMBER_INFERENCE_MAX_PASSES)
+		{
+			lip_array_foreach(lip_number_fn_t, fn, inf.fns)
+			{
+				*fn = (lip_number_fn_t){ .number_args = 0, .returns_number = false };
+			}
+		}
 	}
+
+	kh_destroy(lip_ptr_set, inf.generic_exps);
+	lip_array_destroy(inf.fns);
 }
 
 void
@@ -533,6 +2081,12 @@ lip_compiler_init(lip_compiler_t* compiler, lip_allocator_t* allocator)
 	compiler->current_scope = NULL;
 	compiler->free_scopes = NULL;
 	compiler->free_var_names = kh_init(lip_string_ref_set, allocator);
+	compiler->tail_calls = kh_init(lip_ptr_set, allocator);
+	compiler->number_exps = kh_init(lip_ptr_set, allocator);
+	compiler->optimization_level = 2;
+	compiler->strip_debug_info = false;
+	compiler->is_borrowing = NULL;
+	compiler->error = NULL;
 }
 
 static void
@@ -569,6 +2123,8 @@ lip_compiler_cleanup(lip_compiler_t* compiler)
 	}
 
 	kh_destroy(lip_string_ref_set, compiler->free_var_names);
+	kh_destroy(lip_ptr_set, compiler->tail_calls);
+	kh_destroy(lip_ptr_set, compiler->number_exps);
 	lip_arena_allocator_destroy(compiler->arena_allocator);
 }
 
@@ -576,6 +2132,7 @@ void
 lip_compiler_begin(lip_compiler_t* compiler, lip_string_ref_t source_name)
 {
 	compiler->source_name = source_name;
+	compiler->error = NULL;
 	lip_compiler_reset(compiler);
 	lip_begin_scope(compiler, LIP_LOC_NOWHERE);
 	// Push nil so that the next expression has something to pop
@@ -583,10 +2140,59 @@ lip_compiler_begin(lip_compiler_t* compiler, lip_string_ref_t source_name)
 	LASM(compiler, LIP_OP_NIL, 0, LIP_LOC_NOWHERE);
 }
 
+// Code removed by the optimizer must still fail to link when it refers to an
+// undefined symbol, import its globals into the script function
+static void
+lip_import_pruned_globals(
+	lip_compiler_t* compiler, const lip_ast_t* original, const lip_ast_t* optimized
+)
+{
+	if(original == optimized) { return; }
+
+	khash_t(lip_string_ref_set)* pruned = kh_init(lip_string_ref_set, compiler->allocator);
+	lip_array(lip_string_ref_t) bound_names = lip_array_create(
+		compiler->allocator, lip_string_ref_t, 8
+	);
+	lip_find_free_vars(original, &bound_names, pruned);
+	kh_clear(lip_string_ref_set, compiler->free_var_names);
+	lip_find_free_vars(optimized, &bound_names, compiler->free_var_names);
+	lip_array_destroy(bound_names);
+
+	kh_foreach(itr, pruned)
+	{
+		lip_string_ref_t name = kh_key(pruned, itr);
+		bool is_used = kh_get(lip_string_ref_set, compiler->free_var_names, name)
+			!= kh_end(compiler->free_var_names);
+		bool is_builtin = false
+			|| lip_is_prim_op(name)
+			|| lip_string_ref_equal(lip_string_ref("true"), name)
+			|| lip_string_ref_equal(lip_string_ref("false"), name)
+			|| lip_string_ref_equal(lip_string_ref("nil"), name);
+		if(!is_used && !is_builtin)
+		{
+			lip_asm_alloc_linked_import(&compiler->current_scope->lasm, name);
+		}
+	}
+
+	kh_destroy(lip_string_ref_set, pruned);
+}
+
 void
 lip_compiler_add_ast(lip_compiler_t* compiler, const lip_ast_t* ast)
 {
 	LASM(compiler, LIP_OP_POP, 1, LIP_LOC_NOWHERE); // previous exp's result
+	const lip_ast_t* original = ast;
+	ast = lip_optimize_ast(
+		compiler->arena_allocator,
+		compiler->allocator,
+		(lip_ast_t*)ast,
+		compiler->optimization_level
+	);
+	lip_import_pruned_globals(compiler, original, ast);
+	// Any top-level expression could be the last one
+	kh_clear(lip_ptr_set, compiler->tail_calls);
+	lip_find_tail_calls(compiler, ast, true);
+	lip_find_number_exps(compiler, ast);
 	lip_compile_exp(compiler, ast);
 }
 
@@ -594,5 +2200,14 @@ lip_function_t*
 lip_compiler_end(lip_compiler_t* compiler, lip_allocator_t* allocator)
 {
 	LASM(compiler, LIP_OP_RET, 0, LIP_LOC_NOWHERE);
-	return lip_end_scope(compiler, allocator);
+	lip_function_t* function = lip_end_scope(compiler, allocator);
+
+	// Only a bug in code generation produces instructions which do not verify
+	if(compiler->error != NULL)
+	{
+		lip_free(allocator, function);
+		return NULL;
+	}
+
+	return function;
 }
@@ -0,0 +1,858 @@
+#include "lip_internal.h"
+#include <lip/core/io.h>
+#include "utils.h"
+
+/**
+ * Layout:
+ *
+ * [lip_image_header_t]: header
+ * [lip_image_string_t...]: strings
+ * [lip_image_ref_t...]: functions imported from modules outside of the image
+ * [lip_image_module_t...]: modules
+ * [lip_image_symbol_t...]: symbols, grouped by module
+ * [lip_image_link_t...]: link tables of all symbols
+ * [char...]: string data
+ * [lip_function_t...]: functions, each aligned to LIP_IMAGE_ALIGNMENT
+ *
+ * Pointers are replaced with indices into the tables so an image is relocated
+ * by looking up each index once. Native functions are never saved, they are
+ * referenced by module and symbol name.
+ */
+
+typedef struct lip_image_header_s lip_image_header_t;
+typedef struct lip_image_string_s lip_image_string_t;
+typedef struct lip_image_ref_s lip_image_ref_t;
+typedef struct lip_image_module_s lip_image_module_t;
+typedef struct lip_image_symbol_s lip_image_symbol_t;
+typedef struct lip_image_link_s lip_image_link_t;
+typedef struct lip_image_owner_s lip_image_owner_t;
+typedef struct lip_image_builder_s lip_image_builder_t;
+
+static const char LIP_IMAGE_MAGIC[] = {'L', 'I', 'P', 'I'};
+
+#define LIP_IMAGE_ALIGNMENT 16
+
+enum lip_image_link_type_e
+{
+	/// Not linked yet, resolved by name when first used
+	LIP_IMAGE_LINK_NONE,
+	/// Index of an interned symbol name in the string table
+	LIP_IMAGE_LINK_SYMBOL,
+	/// Index of a symbol in the image
+	LIP_IMAGE_LINK_LOCAL,
+	/// Index of a reference to a function outside of the image
+	LIP_IMAGE_LINK_EXTERNAL
+};
+
+struct lip_image_header_s
+{
+	char magic[sizeof(LIP_IMAGE_MAGIC)];
+	uint8_t ptr_size;
+	uint8_t padding;
+	uint16_t bom;
+	uint32_t version;
+	uint32_t num_strings;
+	uint32_t num_refs;
+	uint32_t num_modules;
+	uint32_t num_symbols;
+	uint32_t num_links;
+	uint32_t reserved[2];
+};
+
+struct lip_image_string_s
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct lip_image_ref_s
+{
+	uint32_t module_name;
+	uint32_t symbol_name;
+};
+
+struct lip_image_module_s
+{
+	uint32_t name;
+	uint32_t first_symbol;
+	uint32_t num_symbols;
+};
+
+struct lip_image_symbol_s
+{
+	uint32_t name;
+	uint32_t is_public;
+	uint32_t function_offset;
+	uint32_t first_link;
+};
+
+struct lip_image_link_s
+{
+	uint32_t type;
+	uint32_t index;
+};
+
+struct lip_image_owner_s
+{
+	lip_string_ref_t module_name;
+	lip_string_ref_t symbol_name;
+};
+
+struct lip_image_builder_s
+{
+	lip_context_t* ctx;
+	lip_string_ref_t filename;
+	lip_array(lip_string_ref_t) strings;
+	lip_array(lip_image_ref_t) refs;
+	lip_array(lip_image_module_t) modules;
+	lip_array(lip_image_symbol_t) symbols;
+	lip_array(lip_image_link_t) links;
+	lip_array(lip_closure_t*) closures;
+	// Closure to index + 1 of its symbol
+	khash_t(lip_ptr_map)* locals;
+	// Closure to index + 1 of its reference
+	khash_t(lip_ptr_map)* externals;
+	// Closure to its lip_image_owner_t, for every module of the runtime
+	khash_t(lip_ptr_map)* owners;
+};
+
+static size_t
+lip_image_align(size_t offset)
+{
+	return (offset + LIP_IMAGE_ALIGNMENT - 1) & ~(size_t)(LIP_IMAGE_ALIGNMENT - 1);
+}
+
+static size_t
+lip_image_tables_size(const lip_image_header_t* header)
+{
+	return sizeof(lip_image_header_t)
+		+ sizeof(lip_image_string_t) * (size_t)header->num_strings
+		+ sizeof(lip_image_ref_t) * (size_t)header->num_refs
+		+ sizeof(lip_image_module_t) * (size_t)header->num_modules
+		+ sizeof(lip_image_symbol_t) * (size_t)header->num_symbols
+		+ sizeof(lip_image_link_t) * (size_t)header->num_links;
+}
+
+static bool
+lip_image_error(lip_context_t* ctx, lip_string_ref_t filename, const char* fmt, ...)
+{
+	lip_array(char) msg_buf = lip_array_create(ctx->module_pool, char, 64);
+	struct lip_osstream_s osstream;
+	lip_out_t* out = lip_make_osstream(&msg_buf, &osstream);
+	va_list args;
+	va_start(args, fmt);
+	lip_vprintf(out, fmt, args);
+	va_end(args);
+
+	lip_set_context_error(
+		ctx, "Image error",
+		(lip_string_ref_t){ .length = lip_array_len(msg_buf), .ptr = msg_buf },
+		filename, LIP_LOC_NOWHERE
+	);
+	return false;
+}
+
+static uint32_t
+lip_image_add_string(lip_image_builder_t* builder, lip_string_ref_t str)
+{
+	lip_array_push(builder->strings, str);
+	return lip_array_len(builder->strings) - 1;
+}
+
+// Only modules made entirely of compiled functions are saved, the others are
+// registered by the host before the image is loaded
+static bool
+lip_image_should_save(khash_t(lip_module)* module)
+{
+	if(kh_size(module) == 0) { return false; }
+
+	kh_foreach(i, module)
+	{
+		if(kh_val(module, i).value->is_native) { return false; }
+	}
+
+	return true;
+}
+
+static bool
+lip_image_add_link(
+	lip_image_builder_t* builder, lip_value_t value, lip_image_link_t* link
+)
+{
+	switch(value.type)
+	{
+		case LIP_VAL_PLACEHOLDER:
+			*link = (lip_image_link_t){ .type = LIP_IMAGE_LINK_NONE };
+			return true;
+		case LIP_VAL_SYMBOL:
+			*link = (lip_image_link_t){
+				.type = LIP_IMAGE_LINK_SYMBOL,
+				.index = lip_image_add_string(
+					builder, lip_string_ref_from_string(value.data.reference)
+				)
+			};
+			return true;
+		case LIP_VAL_FUNCTION:
+			break;
+		default:
+			return lip_image_error(
+				builder->ctx, builder->filename, "Cannot save a link of type %s",
+				lip_value_type_t_to_str(value.type)
+			);
+	}
+
+	khiter_t itr = kh_get(lip_ptr_map, builder->locals, value.data.reference);
+	if(itr != kh_end(builder->locals))
+	{
+		*link = (lip_image_link_t){
+			.type = LIP_IMAGE_LINK_LOCAL,
+			.index = (uintptr_t)kh_val(builder->locals, itr) - 1
+		};
+		return true;
+	}
+
+	itr = kh_get(lip_ptr_map, builder->externals, value.data.reference);
+	if(itr == kh_end(builder->externals))
+	{
+		khiter_t owner_itr = kh_get(lip_ptr_map, builder->owners, value.data.reference);
+		if(owner_itr == kh_end(builder->owners))
+		{
+			return lip_image_error(
+				builder->ctx, builder->filename,
+				"Cannot save a link to a function outside of any module"
+			);
+		}
+
+		const lip_image_owner_t* owner = kh_val(builder->owners, owner_itr);
+		lip_image_ref_t ref = {
+			.module_name = lip_image_add_string(builder, owner->module_name),
+			.symbol_name = lip_image_add_string(builder, owner->symbol_name)
+		};
+		lip_array_push(builder->refs, ref);
+
+		int ret;
+		itr = kh_put(lip_ptr_map, builder->externals, value.data.reference, &ret);
+		kh_val(builder->externals, itr) =
+			(void*)(uintptr_t)lip_array_len(builder->refs);
+	}
+
+	*link = (lip_image_link_t){
+		.type = LIP_IMAGE_LINK_EXTERNAL,
+		.index = (uintptr_t)kh_val(builder->externals, itr) - 1
+	};
+	return true;
+}
+
+static bool
+lip_image_collect(lip_image_builder_t* builder)
+{
+	lip_runtime_t* runtime = builder->ctx->runtime;
+
+	// Number every saved symbol first so links between them can be resolved
+	kh_foreach(i, runtime->symtab)
+	{
+		lip_string_ref_t module_name = kh_key(runtime->symtab, i).str;
+		khash_t(lip_module)* module = kh_val(runtime->symtab, i);
+		bool save = lip_image_should_save(module);
+
+		if(save)
+		{
+			lip_image_module_t image_module = {
+				.name = lip_image_add_string(builder, module_name),
+				.first_symbol = lip_array_len(builder->symbols),
+				.num_symbols = kh_size(module)
+			};
+			lip_array_push(builder->modules, image_module);
+		}
+
+		kh_foreach(j, module)
+		{
+			lip_string_ref_t symbol_name = kh_key(module, j).str;
+			lip_symbol_t symbol = kh_val(module, j);
+			int ret;
+
+			lip_image_owner_t* owner = lip_new(builder->ctx->temp_pool, lip_image_owner_t);
+			*owner = (lip_image_owner_t){
+				.module_name = module_name,
+				.symbol_name = symbol_name
+			};
+			khiter_t itr = kh_put(lip_ptr_map, builder->owners, symbol.value, &ret);
+			kh_val(builder->owners, itr) = owner;
+
+			if(!save) { continue; }
+
+			if(symbol.value->env_len > 0)
+			{
+				return lip_image_error(
+					builder->ctx, builder->filename,
+					"Cannot save closure with captured variables: %.*s/%.*s",
+					(int)module_name.length, module_name.ptr,
+					(int)symbol_name.length, symbol_name.ptr
+				);
+			}
+
+			lip_image_symbol_t image_symbol = {
+				.name = lip_image_add_string(builder, symbol_name),
+				.is_public = symbol.is_public
+			};
+			lip_array_push(builder->symbols, image_symbol);
+			lip_array_push(builder->closures, symbol.value);
+
+			itr = kh_put(lip_ptr_map, builder->locals, symbol.value, &ret);
+			kh_val(builder->locals, itr) =
+				(void*)(uintptr_t)lip_array_len(builder->symbols);
+		}
+	}
+
+	for(uint32_t i = 0; i < lip_array_len(builder->closures); ++i)
+	{
+		const lip_closure_t* closure = builder->closures[i];
+		builder->symbols[i].first_link = lip_array_len(builder->links);
+
+		for(uint32_t j = 0; j < closure->function.lip->num_links; ++j)
+		{
+			lip_image_link_t link;
+			if(!lip_image_add_link(builder, closure->links[j], &link))
+			{
+				return false;
+			}
+			lip_array_push(builder->links, link);
+		}
+	}
+
+	return true;
+}
+
+static bool
+lip_image_write(lip_image_builder_t* builder, lip_out_t* output)
+{
+	lip_context_t* ctx = builder->ctx;
+	lip_string_ref_t filename = builder->filename;
+
+	lip_image_header_t header = {
+		.ptr_size = sizeof(void*),
+		.bom = 1,
+		.version = LIP_BYTECODE_VERSION,
+		.num_strings = lip_array_len(builder->strings),
+		.num_refs = lip_array_len(builder->refs),
+		.num_modules = lip_array_len(builder->modules),
+		.num_symbols = lip_array_len(builder->symbols),
+		.num_links = lip_array_len(builder->links)
+	};
+	memcpy(header.magic, LIP_IMAGE_MAGIC, sizeof(LIP_IMAGE_MAGIC));
+
+	// Strings follow the tables and functions follow the strings
+	size_t offset = lip_image_tables_size(&header);
+	lip_array_foreach(lip_string_ref_t, str, builder->strings)
+	{
+		offset += str->length;
+	}
+
+	for(uint32_t i = 0; i < header.num_symbols; ++i)
+	{
+		offset = lip_image_align(offset);
+		builder->symbols[i].function_offset = offset;
+		offset += builder->closures[i]->function.lip->size;
+	}
+
+	if(offset > UINT32_MAX)
+	{
+		return lip_image_error(ctx, filename, "Image is too large");
+	}
+
+#define lip_checked_write(buff, size, output) \
+	do { \
+		if(lip_write(buff, size, output) != (size)) { \
+			lip_fs_t* fs = ctx->runtime->cfg.fs; \
+			lip_set_context_error( \
+				ctx, "IO error", fs->last_error(fs), filename, LIP_LOC_NOWHERE \
+			); \
+			return false; \
+		} \
+	} while(0)
+
+	lip_checked_write(&header, sizeof(header), output);
+
+	offset = lip_image_tables_size(&header);
+	lip_array_foreach(lip_string_ref_t, str, builder->strings)
+	{
+		lip_image_string_t entry = { .offset = offset, .length = str->length };
+		lip_checked_write(&entry, sizeof(entry), output);
+		offset += str->length;
+	}
+
+	lip_checked_write(builder->refs, sizeof(lip_image_ref_t) * header.num_refs, output);
+	lip_checked_write(
+		builder->modules, sizeof(lip_image_module_t) * header.num_modules, output
+	);
+	lip_checked_write(
+		builder->symbols, sizeof(lip_image_symbol_t) * header.num_symbols, output
+	);
+	lip_checked_write(builder->links, sizeof(lip_image_link_t) * header.num_links, output);
+
+	lip_array_foreach(lip_string_ref_t, str, builder->strings)
+	{
+		lip_checked_write(str->ptr, str->length, output);
+	}
+
+	static const char padding[LIP_IMAGE_ALIGNMENT] = { 0 };
+	for(uint32_t i = 0; i < header.num_symbols; ++i)
+	{
+		lip_function_t* function = builder->closures[i]->function.lip;
+		size_t aligned_offset = builder->symbols[i].function_offset;
+		lip_checked_write(padding, aligned_offset - offset, output);
+		lip_checked_write(function, function->size, output);
+		offset = aligned_offset + function->size;
+	}
+
+	return true;
+}
+
+bool
+lip_save_image(lip_context_t* ctx, lip_string_ref_t filename, lip_out_t* output)
+{
+	lip_fs_t* fs = ctx->runtime->cfg.fs;
+	bool own_output = output == NULL;
+	if(own_output)
+	{
+		output = fs->begin_write(fs, filename);
+		if(output == NULL)
+		{
+			lip_set_context_error(
+				ctx, "IO error", fs->last_error(fs), filename, LIP_LOC_NOWHERE
+			);
+			return false;
+		}
+	}
+
+	lip_arena_allocator_reset(ctx->temp_pool);
+	lip_image_builder_t builder = {
+		.ctx = ctx,
+		.filename = filename,
+		.strings = lip_array_create(ctx->allocator, lip_string_ref_t, 64),
+		.refs = lip_array_create(ctx->allocator, lip_image_ref_t, 16),
+		.modules = lip_array_create(ctx->allocator, lip_image_module_t, 16),
+		.symbols = lip_array_create(ctx->allocator, lip_image_symbol_t, 64),
+		.links = lip_array_create(ctx->allocator, lip_image_link_t, 64),
+		.closures = lip_array_create(ctx->allocator, lip_closure_t*, 64),
+		.locals = kh_init(lip_ptr_map, ctx->allocator),
+		.externals = kh_init(lip_ptr_map, ctx->allocator),
+		.owners = kh_init(lip_ptr_map, ctx->allocator)
+	};
+
+	lip_ctx_begin_rt_read(ctx);
+	bool result = lip_image_collect(&builder) && lip_image_write(&builder, output);
+	lip_ctx_end_rt_read(ctx);
+
+	kh_destroy(lip_ptr_map, builder.owners);
+	kh_destroy(lip_ptr_map, builder.externals);
+	kh_destroy(lip_ptr_map, builder.locals);
+	lip_array_destroy(builder.closures);
+	lip_array_destroy(builder.links);
+	lip_array_destroy(builder.symbols);
+	lip_array_destroy(builder.modules);
+	lip_array_destroy(builder.refs);
+	lip_array_destroy(builder.strings);
+
+	if(own_output) { fs->end_write(fs, output); }
+
+	return result;
+}
+
+static bool
+lip_image_is_valid(lip_allocator_t* allocator, const char* ptr, size_t size)
+{
+	lip_image_header_t header;
+	if(size < sizeof(header)) { return false; }
+	memcpy(&header, ptr, sizeof(header));
+
+	if(false
+		|| memcmp(header.magic, LIP_IMAGE_MAGIC, sizeof(LIP_IMAGE_MAGIC)) != 0
+		|| header.ptr_size != sizeof(void*)
+		|| header.bom != 1
+		|| header.version != LIP_BYTECODE_VERSION
+		|| lip_image_tables_size(&header) > size
+		|| (uintptr_t)ptr % LIP_IMAGE_ALIGNMENT != 0
+	)
+	{
+		return false;
+	}
+
+	const lip_image_string_t* strings =
+		(const lip_image_string_t*)(ptr + sizeof(header));
+	const lip_image_ref_t* refs =
+		(const lip_image_ref_t*)(strings + header.num_strings);
+	const lip_image_module_t* modules =
+		(const lip_image_module_t*)(refs + header.num_refs);
+	const lip_image_symbol_t* symbols =
+		(const lip_image_symbol_t*)(modules + header.num_modules);
+	const lip_image_link_t* links =
+		(const lip_image_link_t*)(symbols + header.num_symbols);
+
+	for(uint32_t i = 0; i < header.num_strings; ++i)
+	{
+		if(strings[i].offset > size || strings[i].length > size - strings[i].offset)
+		{
+			return false;
+		}
+	}
+
+	for(uint32_t i = 0; i < header.num_refs; ++i)
+	{
+		if(false
+			|| refs[i].module_name >= header.num_strings
+			|| refs[i].symbol_name >= header.num_strings
+		)
+		{
+			return false;
+		}
+	}
+
+	// Modules own consecutive runs of symbols, covering all of them
+	uint32_t num_owned_symbols = 0;
+	for(uint32_t i = 0; i < header.num_modules; ++i)
+	{
+		if(false
+			|| modules[i].name >= header.num_strings
+			|| modules[i].first_symbol != num_owned_symbols
+			|| modules[i].num_symbols > header.num_symbols - num_owned_symbols
+		)
+		{
+			return false;
+		}
+		num_owned_symbols += modules[i].num_symbols;
+	}
+	if(num_owned_symbols != header.num_symbols) { return false; }
+
+	for(uint32_t i = 0; i < header.num_symbols; ++i)
+	{
+		lip_image_symbol_t symbol = symbols[i];
+		if(false
+			|| symbol.name >= header.num_strings
+			|| symbol.function_offset % LIP_IMAGE_ALIGNMENT != 0
+			|| symbol.function_offset < lip_image_tables_size(&header)
+			|| symbol.function_offset > size - sizeof(lip_function_t)
+		)
+		{
+			return false;
+		}
+
+		const lip_function_t* function =
+			(const lip_function_t*)(ptr + symbol.function_offset);
+		if(false
+			|| lip_verify_function(
+				allocator, function, size - symbol.function_offset, 0
+			) != NULL
+			|| symbol.first_link > header.num_links
+			|| function->num_links > header.num_links - symbol.first_link
+		)
+		{
+			return false;
+		}
+	}
+
+	for(uint32_t i = 0; i < header.num_links; ++i)
+	{
+		uint32_t index = links[i].index;
+		switch(links[i].type)
+		{
+			case LIP_IMAGE_LINK_NONE:
+				break;
+			case LIP_IMAGE_LINK_SYMBOL:
+				if(index >= header.num_strings) { return false; }
+				break;
+			case LIP_IMAGE_LINK_LOCAL:
+				if(index >= header.num_symbols) { return false; }
+				break;
+			case LIP_IMAGE_LINK_EXTERNAL:
+				if(index >= header.num_refs) { return false; }
+				break;
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static lip_hashed_string_ref_t
+lip_image_string(const char* ptr, uint32_t index)
+{
+	const lip_image_string_t* strings =
+		(const lip_image_string_t*)(ptr + sizeof(lip_image_header_t));
+	return lip_hashed_string_ref((lip_string_ref_t){
+		.length = strings[index].length,
+		.ptr = ptr + strings[index].offset
+	});
+}
+
+// Check names which would make the image replace its own imports or define a
+// symbol twice
+static bool
+lip_image_check_names(
+	lip_context_t* ctx,
+	lip_string_ref_t filename,
+	const char* ptr,
+	khash_t(lip_symbol_set)* names
+)
+{
+	lip_image_header_t header;
+	memcpy(&header, ptr, sizeof(header));
+	const lip_image_ref_t* refs = (const lip_image_ref_t*)(
+		ptr + sizeof(header) + sizeof(lip_image_string_t) * header.num_strings
+	);
+	const lip_image_module_t* modules =
+		(const lip_image_module_t*)(refs + header.num_refs);
+	const lip_image_symbol_t* symbols =
+		(const lip_image_symbol_t*)(modules + header.num_modules);
+
+	for(uint32_t i = 0; i < header.num_modules; ++i)
+	{
+		lip_hashed_string_ref_t name = lip_image_string(ptr, modules[i].name);
+		int ret;
+		kh_put(lip_symbol_set, names, name, &ret);
+		if(ret == 0)
+		{
+			return lip_image_error(
+				ctx, filename, "Duplicated module: %.*s",
+				(int)name.str.length, name.str.ptr
+			);
+		}
+	}
+
+	for(uint32_t i = 0; i < header.num_refs; ++i)
+	{
+		lip_hashed_string_ref_t name = lip_image_string(ptr, refs[i].module_name);
+		if(kh_get(lip_symbol_set, names, name) != kh_end(names))
+		{
+			return lip_image_error(
+				ctx, filename, "Module imports from itself: %.*s",
+				(int)name.str.length, name.str.ptr
+			);
+		}
+	}
+
+	for(uint32_t i = 0; i < header.num_modules; ++i)
+	{
+		kh_clear(lip_symbol_set, names);
+		for(uint32_t j = 0; j < modules[i].num_symbols; ++j)
+		{
+			lip_hashed_string_ref_t name =
+				lip_image_string(ptr, symbols[modules[i].first_symbol + j].name);
+			int ret;
+			kh_put(lip_symbol_set, names, name, &ret);
+			if(ret == 0)
+			{
+				return lip_image_error(
+					ctx, filename, "Duplicated symbol: %.*s",
+					(int)name.str.length, name.str.ptr
+				);
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool
+lip_restore_image_locked(
+	lip_context_t* ctx, lip_string_ref_t filename, const char* ptr, bool mapped
+)
+{
+	lip_runtime_t* runtime = ctx->runtime;
+	lip_allocator_t* allocator = runtime->cfg.allocator;
+
+	lip_image_header_t header;
+	memcpy(&header, ptr, sizeof(header));
+	const lip_image_ref_t* refs = (const lip_image_ref_t*)(
+		ptr + sizeof(header) + sizeof(lip_image_string_t) * header.num_strings
+	);
+	const lip_image_module_t* modules =
+		(const lip_image_module_t*)(refs + header.num_refs);
+	const lip_image_symbol_t* symbols =
+		(const lip_image_symbol_t*)(modules + header.num_modules);
+	const lip_image_link_t* links =
+		(const lip_image_link_t*)(symbols + header.num_symbols);
+
+	lip_arena_allocator_reset(ctx->temp_pool);
+	khash_t(lip_symbol_set)* names = kh_init(lip_symbol_set, ctx->allocator);
+	bool names_valid = lip_image_check_names(ctx, filename, ptr, names);
+	kh_destroy(lip_symbol_set, names);
+	if(!names_valid) { return false; }
+
+	// Imports from the rest of the runtime must be defined already
+	lip_closure_t** externals =
+		lip_malloc(ctx->temp_pool, sizeof(lip_closure_t*) * LIP_MAX(header.num_refs, 1));
+	for(uint32_t i = 0; i < header.num_refs; ++i)
+	{
+		lip_hashed_string_ref_t module_name = lip_image_string(ptr, refs[i].module_name);
+		lip_hashed_string_ref_t symbol_name = lip_image_string(ptr, refs[i].symbol_name);
+
+		externals[i] = NULL;
+		khiter_t itr = kh_get(lip_symtab, runtime->symtab, module_name);
+		if(itr != kh_end(runtime->symtab))
+		{
+			khash_t(lip_module)* module = kh_val(runtime->symtab, itr);
+			khiter_t symbol_itr = kh_get(lip_module, module, symbol_name);
+			if(symbol_itr != kh_end(module))
+			{
+				externals[i] = kh_val(module, symbol_itr).value;
+			}
+		}
+
+		if(externals[i] == NULL)
+		{
+			return lip_image_error(
+				ctx, filename, "Undefined symbol: %.*s/%.*s",
+				(int)module_name.str.length, module_name.str.ptr,
+				(int)symbol_name.str.length, symbol_name.str.ptr
+			);
+		}
+	}
+
+	lip_closure_t** closures =
+		lip_malloc(ctx->temp_pool, sizeof(lip_closure_t*) * LIP_MAX(header.num_symbols, 1));
+	for(uint32_t i = 0; i < header.num_symbols; ++i)
+	{
+		lip_function_t* function = (lip_function_t*)(ptr + symbols[i].function_offset);
+		if(!mapped)
+		{
+			lip_function_t* function_copy = lip_malloc(allocator, function->size);
+			memcpy(function_copy, function, function->size);
+			function = function_copy;
+		}
+
+		closures[i] = lip_new(allocator, lip_closure_t);
+		*closures[i] = (lip_closure_t){
+			.function = { .lip = function },
+			.links = lip_new_link_table(allocator, function),
+			.env_len = 0,
+			.is_native = false
+		};
+	}
+
+	// Relocate link tables
+	for(uint32_t i = 0; i < header.num_symbols; ++i)
+	{
+		lip_closure_t* closure = closures[i];
+		for(uint32_t j = 0; j < closure->function.lip->num_links; ++j)
+		{
+			lip_image_link_t link = links[symbols[i].first_link + j];
+			switch(link.type)
+			{
+				case LIP_IMAGE_LINK_NONE:
+					break;
+				case LIP_IMAGE_LINK_SYMBOL:
+					{
+						lip_string_t* symbol =
+							lip_intern_symbol(runtime, lip_image_string(ptr, link.index));
+						if(symbol == NULL) { break; }
+
+						closure->links[j] = (lip_value_t){
+							.type = LIP_VAL_SYMBOL,
+							.data = { .reference = symbol }
+						};
+					}
+					break;
+				case LIP_IMAGE_LINK_LOCAL:
+					closure->links[j] = (lip_value_t){
+						.type = LIP_VAL_FUNCTION,
+						.data = { .reference = closures[link.index] }
+					};
+					break;
+				case LIP_IMAGE_LINK_EXTERNAL:
+					closure->links[j] = (lip_value_t){
+						.type = LIP_VAL_FUNCTION,
+						.data = { .reference = externals[link.index] }
+					};
+					break;
+			}
+		}
+	}
+
+	for(uint32_t i = 0; i < header.num_modules; ++i)
+	{
+		lip_hashed_string_ref_t module_name = lip_image_string(ptr, modules[i].name);
+		khash_t(lip_module)* module = lip_reset_module_locked(runtime, module_name);
+
+		for(uint32_t j = 0; j < modules[i].num_symbols; ++j)
+		{
+			uint32_t index = modules[i].first_symbol + j;
+			lip_hashed_string_ref_t key = lip_image_string(ptr, symbols[index].name);
+			lip_closure_t* closure = closures[index];
+			closure->debug_name =
+				lip_new_debug_name(allocator, module_name.str, key.str);
+
+			char* key_copy = lip_malloc(allocator, key.str.length + 1);
+			memcpy(key_copy, key.str.ptr, key.str.length);
+			key_copy[key.str.length] = '\0';
+			key.str.ptr = key_copy;
+
+			int ret;
+			khiter_t itr = kh_put(lip_module, module, key, &ret);
+			kh_val(module, itr) = (lip_symbol_t){
+				.is_public = symbols[index].is_public,
+				.value = closure
+			};
+		}
+	}
+
+	return true;
+}
+
+bool
+lip_load_image(lip_context_t* ctx, lip_string_ref_t filename)
+{
+	lip_runtime_t* runtime = ctx->runtime;
+	lip_fs_t* fs = runtime->cfg.fs;
+
+	bool mapped = fs->map != NULL && fs->unmap != NULL;
+	size_t size = 0;
+	void* block = NULL;
+	const char* ptr = mapped
+		? fs->map(fs, filename, &size)
+		: lip_read_file(ctx, filename, LIP_IMAGE_ALIGNMENT, &size, &block);
+	if(ptr == NULL)
+	{
+		lip_set_context_error(
+			ctx, "IO error", fs->last_error(fs), filename, LIP_LOC_NOWHERE
+		);
+		return false;
+	}
+
+	bool result;
+	if(lip_image_is_valid(ctx->allocator, ptr, size))
+	{
+		lip_ctx_begin_rt_write(ctx);
+		result = lip_restore_image_locked(ctx, filename, ptr, mapped);
+		if(result && mapped)
+		{
+			// Restored functions execute from the mapping
+			lip_mapping_t mapping = { .ptr = ptr, .size = size };
+			lip_array_push(runtime->mappings, mapping);
+		}
+		lip_ctx_end_rt_write(ctx);
+	}
+	else
+	{
+		lip_set_context_error(
+			ctx, "Format error",
+			lip_string_ref("Malformed image"), filename, LIP_LOC_NOWHERE
+		);
+		result = false;
+	}
+
+	if(!result || !mapped)
+	{
+		if(mapped)
+		{
+			fs->unmap(fs, ptr, size);
+		}
+		else
+		{
+			lip_free(runtime->cfg.allocator, block);
+		}
+	}
+
+	return result;
+}
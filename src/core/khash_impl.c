@@ -2,12 +2,34 @@
 #include <lip/core/common.h>
 #include <lip/core/vendor/khash.h>
 #include <lip/core/compiler.h>
+#include <lip/core/asm.h>
+#include "utils.h"
 #include "vendor/xxhash.h"
 
-#define lip_string_ref_hash(str) XXH32(str.ptr, str.length, __LINE__)
+#define lip_hashed_string_ref_hash(str) ((str).hash)
+#define lip_index_hash(index) kh_int64_hash_func(index)
 #define lip_value_hash(ptr) XXH32(&ptr, sizeof(ptr), __LINE__)
 #define lip_value_equal(lhs, rhs) ((lhs) == (rhs))
 
+uint32_t
+lip_string_ref_hash(lip_string_ref_t str)
+{
+	uint32_t hash = XXH32(str.ptr, str.length, 0);
+	// 0 marks a lip_string_t whose hash is not computed yet
+	return hash != 0 ? hash : 1;
+}
+
+uint32_t
+lip_string_hash(lip_string_t* str)
+{
+	if(str->hash == 0)
+	{
+		str->hash = lip_string_ref_hash(lip_string_ref_from_string(str));
+	}
+
+	return str->hash;
+}
+
 __KHASH_IMPL(
 	lip_string_ref_set,
 	,
@@ -21,21 +43,31 @@ __KHASH_IMPL(
 __KHASH_IMPL(
 	lip_module,
 	,
-	lip_string_ref_t,
+	lip_hashed_string_ref_t,
 	lip_symbol_t,
 	1,
-	lip_string_ref_hash,
-	lip_string_ref_equal
+	lip_hashed_string_ref_hash,
+	lip_hashed_string_ref_equal
 )
 
 __KHASH_IMPL(
 	lip_symtab,
 	,
-	lip_string_ref_t,
+	lip_hashed_string_ref_t,
 	khash_t(lip_module)*,
 	1,
-	lip_string_ref_hash,
-	lip_string_ref_equal
+	lip_hashed_string_ref_hash,
+	lip_hashed_string_ref_equal
+)
+
+__KHASH_IMPL(
+	lip_symbol_set,
+	,
+	lip_hashed_string_ref_t,
+	char,
+	0,
+	lip_hashed_string_ref_hash,
+	lip_hashed_string_ref_equal
 )
 
 __KHASH_IMPL(
@@ -57,3 +89,23 @@ __KHASH_IMPL(
 	lip_value_hash,
 	lip_value_equal
 )
+
+__KHASH_IMPL(
+	lip_asm_string_index,
+	,
+	lip_string_ref_t,
+	lip_asm_index_t,
+	1,
+	lip_string_ref_hash,
+	lip_string_ref_equal
+)
+
+__KHASH_IMPL(
+	lip_asm_index_map,
+	,
+	uint64_t,
+	lip_asm_index_t,
+	1,
+	lip_index_hash,
+	lip_value_equal
+)
@@ -12,9 +12,13 @@ lip_create_runtime(const lip_runtime_config_t* cfg)
 	*runtime = (lip_runtime_t){
 		.cfg = *cfg,
 		.symtab = kh_init(lip_symtab, cfg->allocator),
+		.symbols = kh_init(lip_symbol_set, cfg->allocator),
+		.mappings = lip_array_create(cfg->allocator, lip_mapping_t, 0),
+		.bundles = lip_array_create(cfg->allocator, lip_bundle_t, 0),
 	};
 
 	lip_rwlock_init(&runtime->rt_lock);
+	lip_rwlock_init(&runtime->symbol_lock);
 	return runtime;
 }
 
@@ -23,11 +27,76 @@ lip_destroy_runtime(lip_runtime_t* runtime)
 {
 	lip_destroy_all_modules(runtime);
 
+	lip_array_foreach(lip_mapping_t, mapping, runtime->mappings)
+	{
+		runtime->cfg.fs->unmap(runtime->cfg.fs, mapping->ptr, mapping->size);
+	}
+	lip_array_destroy(runtime->mappings);
+	lip_destroy_all_bundles(runtime);
+	lip_array_destroy(runtime->bundles);
+
+	kh_foreach(itr, runtime->symbols)
+	{
+		lip_free(
+			runtime->cfg.allocator,
+			LIP_CONTAINER_OF(kh_key(runtime->symbols, itr).str.ptr, lip_string_t, ptr)
+		);
+	}
+
+	lip_rwlock_destroy(&runtime->symbol_lock);
+	kh_destroy(lip_symbol_set, runtime->symbols);
 	lip_rwlock_destroy(&runtime->rt_lock);
 	kh_destroy(lip_symtab, runtime->symtab);
 	lip_free(runtime->cfg.allocator, runtime);
 }
 
+static lip_string_t*
+lip_find_symbol(lip_runtime_t* runtime, lip_hashed_string_ref_t name)
+{
+	khiter_t itr = kh_get(lip_symbol_set, runtime->symbols, name);
+	if(itr == kh_end(runtime->symbols)) { return NULL; }
+
+	// Keys point into the interned strings
+	return LIP_CONTAINER_OF(kh_key(runtime->symbols, itr).str.ptr, lip_string_t, ptr);
+}
+
+lip_string_t*
+lip_intern_symbol(lip_runtime_t* runtime, lip_hashed_string_ref_t name)
+{
+	if(!lip_rwlock_begin_read(&runtime->symbol_lock)) { return NULL; }
+	lip_string_t* symbol = lip_find_symbol(runtime, name);
+	lip_rwlock_end_read(&runtime->symbol_lock);
+	if(symbol) { return symbol; }
+
+	if(!lip_rwlock_begin_write(&runtime->symbol_lock)) { return NULL; }
+	// Another thread may have interned it in between
+	symbol = lip_find_symbol(runtime, name);
+	if(true
+		&& symbol == NULL
+		&& (runtime->cfg.max_symbols == 0 || kh_size(runtime->symbols) < runtime->cfg.max_symbols)
+	)
+	{
+		symbol = lip_malloc(
+			runtime->cfg.allocator, sizeof(lip_string_t) + name.str.length + 1
+		);
+		symbol->length = name.str.length;
+		symbol->hash = name.hash;
+		memcpy(symbol->ptr, name.str.ptr, name.str.length);
+		symbol->ptr[name.str.length] = '\0';
+
+		int ret;
+		kh_put(
+			lip_symbol_set,
+			runtime->symbols,
+			lip_hashed_string_ref_from_string(symbol),
+			&ret
+		);
+	}
+	lip_rwlock_end_write(&runtime->symbol_lock);
+
+	return symbol;
+}
+
 void
 lip_ctx_begin_rt_read(lip_context_t* ctx)
 {
@@ -82,6 +151,22 @@ lip_default_panic_handler(lip_context_t* ctx, const char* msg)
 	abort();
 }
 
+static bool
+lip_ctx_is_borrowing(lip_compiler_t* compiler, lip_string_ref_t name)
+{
+	lip_context_t* ctx = LIP_CONTAINER_OF(compiler, lip_context_t, compiler);
+
+	lip_ctx_begin_rt_read(ctx);
+	const lip_symbol_t* symbol = lip_find_declared_symbol(ctx, name);
+	bool borrows_args = true
+		&& symbol != NULL
+		&& symbol->has_signature
+		&& symbol->signature.borrows_args;
+	lip_ctx_end_rt_read(ctx);
+
+	return borrows_args;
+}
+
 lip_context_t*
 lip_create_context(lip_runtime_t* runtime, lip_allocator_t* allocator)
 {
@@ -103,6 +188,8 @@ lip_create_context(lip_runtime_t* runtime, lip_allocator_t* allocator)
 	};
 	lip_parser_init(&ctx->parser, allocator);
 	lip_compiler_init(&ctx->compiler, allocator);
+	ctx->compiler.strip_debug_info = runtime->cfg.strip_debug_info;
+	ctx->compiler.is_borrowing = lip_ctx_is_borrowing;
 
 	return ctx;
 }
@@ -171,13 +258,25 @@ const lip_context_error_t*
 lip_traceback(lip_context_t* ctx, lip_vm_t* vm, lip_value_t msg)
 {
 	lip_string_ref_t error_message;
-	if(msg.type == LIP_VAL_STRING)
+	lip_runtime_link_t* rt = LIP_CONTAINER_OF(vm->rt, lip_runtime_link_t, vtable);
+	if(lip_is_string(msg) && msg.small_len == 0)
 	{
-		error_message = lip_string_ref_from_string(msg.data.reference);
+		error_message = lip_as_string_ref(&msg);
+	}
+	else if(lip_is_string(msg))
+	{
+		// Inline strings live in msg, copy them out before it goes away
+		lip_string_ref_t content = lip_as_string_ref(&msg);
+		lip_array_resize(rt->ctx->string_buff, content.length + 1);
+		memcpy(rt->ctx->string_buff, content.ptr, content.length);
+		rt->ctx->string_buff[content.length] = '\0';
+		error_message = (lip_string_ref_t){
+			.ptr = rt->ctx->string_buff,
+			.length = content.length
+		};
 	}
 	else
 	{
-		lip_runtime_link_t* rt = LIP_CONTAINER_OF(vm->rt, lip_runtime_link_t, vtable);
 		lip_array_clear(rt->ctx->string_buff);
 		struct lip_osstream_s osstream;
 		lip_out_t* output = lip_make_osstream(&rt->ctx->string_buff, &osstream);
@@ -222,8 +321,10 @@ lip_traceback(lip_context_t* ctx, lip_vm_t* vm, lip_value_t msg)
 		{
 			lip_function_layout_t function_layout;
 			lip_function_layout(fp->closure->function.lip, &function_layout);
-			lip_loc_range_t location =
-				function_layout.locations[LIP_MAX(0, fp->pc - function_layout.instructions)];
+			lip_loc_range_t location = lip_function_location(
+				fp->closure->function.lip,
+				LIP_MAX(0, fp->pc - function_layout.instructions)
+			);
 			*lip_array_alloc(ctx->error_records) = (lip_error_record_t){
 				.filename = lip_string_ref_from_string(function_layout.source_name),
 				.location = location,
@@ -300,11 +401,20 @@ lip_rt_resolve_import(
 	return lip_lookup_symbol(rt->ctx, symbol_name_ref, result);
 }
 
+static lip_string_t*
+lip_rt_intern(lip_runtime_interface_t* vtable, lip_string_ref_t name)
+{
+	lip_runtime_link_t* rt = LIP_CONTAINER_OF(vtable, lip_runtime_link_t, vtable);
+	return lip_intern_symbol(rt->ctx->runtime, lip_hashed_string_ref(name));
+}
+
 static void*
 lip_rt_malloc(lip_runtime_interface_t* vtable, lip_value_type_t type, size_t size)
 {
 	(void)type;
 	lip_runtime_link_t* rt = LIP_CONTAINER_OF(vtable, lip_runtime_link_t, vtable);
+	++rt->stats.num_allocations;
+	rt->stats.num_bytes_allocated += size;
 	return lip_malloc(rt->allocator, size);
 }
 
@@ -355,6 +465,7 @@ lip_create_vm(lip_context_t* ctx, const lip_vm_config_t* config)
 		.ctx = ctx,
 		.vtable = {
 			.resolve_import = lip_rt_resolve_import,
+			.intern = lip_rt_intern,
 			.malloc = lip_rt_malloc,
 			.format = lip_rt_format
 		}
@@ -364,18 +475,78 @@ lip_create_vm(lip_context_t* ctx, const lip_vm_config_t* config)
 	return vm;
 }
 
+lip_value_t
+lip_make_buffer(lip_vm_t* vm, lip_string_ref_t content, lip_buffer_guard_t* guard)
+{
+	lip_runtime_link_t* rt = LIP_CONTAINER_OF(vm->rt, lip_runtime_link_t, vtable);
+	lip_buffer_t* buffer = vm->rt->malloc(vm->rt, LIP_VAL_BUFFER, sizeof(lip_buffer_t));
+	*buffer = (lip_buffer_t){
+		.content = content,
+		.guard = guard,
+		.next = rt->buffers
+	};
+	rt->buffers = buffer;
+
+	return (lip_value_t){
+		.type = LIP_VAL_BUFFER,
+		.data = { .reference = buffer }
+	};
+}
+
+// Release buffers up to `outer`, excluded
+static void
+lip_release_buffers(lip_runtime_link_t* rt, lip_buffer_t* outer)
+{
+	for(lip_buffer_t* buffer = rt->buffers; buffer != outer; buffer = buffer->next)
+	{
+		if(buffer->guard) { buffer->guard->release(buffer->guard); }
+
+		// Values may still point to the header, which lives in the VM's arena
+		buffer->content = lip_string_ref("");
+		buffer->guard = NULL;
+	}
+
+	rt->buffers = outer;
+}
+
+lip_buffer_scope_t
+lip_begin_buffer_scope(lip_vm_t* vm)
+{
+	lip_runtime_link_t* rt = LIP_CONTAINER_OF(vm->rt, lip_runtime_link_t, vtable);
+	return (lip_buffer_scope_t){ .outer = rt->buffers };
+}
+
+void
+lip_end_buffer_scope(lip_vm_t* vm, lip_buffer_scope_t scope)
+{
+	lip_runtime_link_t* rt = LIP_CONTAINER_OF(vm->rt, lip_runtime_link_t, vtable);
+	lip_release_buffers(rt, scope.outer);
+}
+
 void
 lip_reset_vm(lip_vm_t* vm)
 {
 	lip_runtime_link_t* rt = LIP_CONTAINER_OF(vm->rt, lip_runtime_link_t, vtable);
+	lip_release_buffers(rt, NULL);
 	lip_arena_allocator_reset(rt->allocator);
+	rt->stats = (lip_vm_stats_t){ 0 };
 	lip_vm_reset(vm);
 }
 
+lip_vm_stats_t
+lip_get_vm_stats(lip_vm_t* vm)
+{
+	lip_runtime_link_t* rt = LIP_CONTAINER_OF(vm->rt, lip_runtime_link_t, vtable);
+	lip_vm_stats_t stats = rt->stats;
+	stats.max_env_depth = lip_vm_max_env_depth(vm);
+	return stats;
+}
+
 void
 lip_destroy_vm(lip_context_t* ctx, lip_vm_t* vm)
 {
 	lip_runtime_link_t* rt = LIP_CONTAINER_OF(vm->rt, lip_runtime_link_t, vtable);
+	lip_release_buffers(rt, NULL);
 	lip_arena_allocator_destroy(rt->allocator);
 	lip_free(ctx->allocator, vm);
 }
@@ -24,30 +24,59 @@
 
 typedef struct lip_runtime_link_s lip_runtime_link_t;
 typedef struct lip_symbol_s lip_symbol_t;
+typedef struct lip_mapping_s lip_mapping_t;
+typedef struct lip_bundle_s lip_bundle_t;
 
-KHASH_DECLARE(lip_module, lip_string_ref_t, lip_symbol_t)
-KHASH_DECLARE(lip_symtab, lip_string_ref_t, khash_t(lip_module)*)
-KHASH_DECLARE(lip_ptr_set, void*, char)
+KHASH_DECLARE(lip_module, lip_hashed_string_ref_t, lip_symbol_t)
+KHASH_DECLARE(lip_symtab, lip_hashed_string_ref_t, khash_t(lip_module)*)
+KHASH_DECLARE(lip_symbol_set, lip_hashed_string_ref_t, char)
 KHASH_DECLARE(lip_ptr_map, const void*, void*)
 
 struct lip_symbol_s
 {
 	bool is_public;
+	bool has_signature;
+	lip_signature_t signature;
 	lip_closure_t* value;
 };
 
 struct lip_module_context_s
 {
 	lip_allocator_t* allocator;
-	lip_string_ref_t name;
+	lip_hashed_string_ref_t name;
 	khash_t(lip_module)* content;
 };
 
+// A bytecode file executed in place
+struct lip_mapping_s
+{
+	const void* ptr;
+	size_t size;
+};
+
+// Compiled modules indexed by name in a single file, see bundle.c
+struct lip_bundle_s
+{
+	lip_mapping_t mapping;
+	// Otherwise the file was read into memory
+	bool mapped;
+	// Allocation holding the file when it is not mapped
+	void* block;
+	lip_string_ref_t filename;
+	uint32_t capacity;
+};
+
 struct lip_runtime_s
 {
 	lip_runtime_config_t cfg;
 	khash_t(lip_symtab)* symtab;
 	lip_rwlock_t rt_lock;
+	khash_t(lip_symbol_set)* symbols;
+	lip_rwlock_t symbol_lock;
+	// Exported functions can point into these so they are only released with
+	// the runtime
+	lip_array(lip_mapping_t) mappings;
+	lip_array(lip_bundle_t) bundles;
 };
 
 struct lip_runtime_link_s
@@ -55,6 +84,8 @@ struct lip_runtime_link_s
 	lip_runtime_interface_t vtable;
 	lip_allocator_t* allocator;
 	lip_context_t* ctx;
+	lip_vm_stats_t stats;
+	lip_buffer_t* buffers;
 };
 
 struct lip_context_s
@@ -87,6 +118,9 @@ struct lip_script_s
 {
 	lip_closure_t* closure;
 	bool linked;
+	bool mapped;
+	// Released with the script unless a module keeps it
+	lip_mapping_t mapping;
 };
 
 void
@@ -96,7 +130,42 @@ void
 lip_ctx_end_load(lip_context_t* ctx);
 
 bool
-lip_link_function(lip_context_t* ctx, lip_function_t* fn);
+lip_link_closure(lip_context_t* ctx, lip_closure_t* closure);
+
+// Wrap a loaded function. A mapped function is not freed with the script and
+// `mapping` is released with it if it is not empty.
+lip_script_t*
+lip_new_script(
+	lip_context_t* ctx, lip_function_t* fn, bool mapped, lip_mapping_t mapping
+);
+
+// Takes the runtime read lock
+lip_function_t*
+lip_find_bundled_module(
+	lip_context_t* ctx, lip_string_ref_t name, lip_string_ref_t* filename
+);
+
+void
+lip_destroy_all_bundles(lip_runtime_t* runtime);
+
+// Read a whole file into a buffer from the runtime allocator, `NULL` on error.
+// The content starts at the returned address, aligned to `alignment`, and
+// `block` receives the allocation to free.
+const char*
+lip_read_file(
+	lip_context_t* ctx,
+	lip_string_ref_t filename,
+	size_t alignment,
+	size_t* size,
+	void** block
+);
+
+// Look up a symbol with the runtime lock held, `NULL` if it is not defined
+const lip_symbol_t*
+lip_find_declared_symbol(lip_context_t* ctx, lip_string_ref_t symbol_name);
+
+bool
+lip_check_ast(lip_context_t* ctx, lip_string_ref_t filename, const lip_ast_t* ast);
 
 void
 lip_ctx_begin_rt_read(lip_context_t* ctx);
@@ -113,12 +182,28 @@ lip_ctx_end_rt_write(lip_context_t* ctx);
 lip_string_ref_t
 lip_format_parse_error(const lip_error_t* error);
 
+/// `NULL` once lip_runtime_config_s::max_symbols symbols are interned
+lip_string_t*
+lip_intern_symbol(lip_runtime_t* runtime, lip_hashed_string_ref_t name);
+
 void
 lip_unload_all_scripts(lip_context_t* ctx);
 
 void
 lip_destroy_all_modules(lip_runtime_t* runtime);
 
+// Empty the module with the given name or add it to the runtime
+khash_t(lip_module)*
+lip_reset_module_locked(lip_runtime_t* runtime, lip_hashed_string_ref_t name);
+
+// Name of an exported function, in the form `module/symbol`
+lip_string_t*
+lip_new_debug_name(
+	lip_allocator_t* allocator,
+	lip_string_ref_t module_name,
+	lip_string_ref_t symbol_name
+);
+
 LIP_MAYBE_UNUSED static inline void
 lip_set_context_error(
 	lip_context_t* ctx,
@@ -158,8 +243,37 @@ lip_panic(lip_context_t* ctx, const char* msg)
 	ctx->panic_handler(ctx, msg);
 }
 
+LIP_MAYBE_UNUSED static inline bool
+lip_mapping_contains(const lip_mapping_t* mapping, const void* ptr)
+{
+	const char* start = mapping->ptr;
+	return start <= (const char*)ptr && (const char*)ptr < start + mapping->size;
+}
+
+// Whether a function is executed from a mapped file or a bundle. The runtime
+// lock must be held.
+LIP_MAYBE_UNUSED static bool
+lip_is_mapped(lip_runtime_t* runtime, const lip_function_t* function)
+{
+	lip_array_foreach(lip_mapping_t, mapping, runtime->mappings)
+	{
+		if(lip_mapping_contains(mapping, function)) { return true; }
+	}
+
+	lip_array_foreach(lip_bundle_t, bundle, runtime->bundles)
+	{
+		if(lip_mapping_contains(&bundle->mapping, function)) { return true; }
+	}
+
+	return false;
+}
+
+// Copy a closure out of the script defining it. Its function is shared if it
+// is mapped and it gets a new link table.
 LIP_MAYBE_UNUSED static lip_closure_t*
-lip_copy_closure(lip_allocator_t* allocator, lip_closure_t* closure)
+lip_copy_closure(
+	lip_runtime_t* runtime, lip_allocator_t* allocator, lip_closure_t* closure
+)
 {
 	size_t closure_size =
 		sizeof(lip_closure_t) +
@@ -170,9 +284,13 @@ lip_copy_closure(lip_allocator_t* allocator, lip_closure_t* closure)
 	if(!closure->is_native)
 	{
 		lip_function_t* function = closure->function.lip;
-		lip_function_t* function_copy = lip_malloc(allocator, function->size);
-		memcpy(function_copy, function, function->size);
-		closure_copy->function.lip = function_copy;
+		if(!lip_is_mapped(runtime, function))
+		{
+			lip_function_t* function_copy = lip_malloc(allocator, function->size);
+			memcpy(function_copy, function, function->size);
+			closure_copy->function.lip = function_copy;
+		}
+		closure_copy->links = lip_new_link_table(allocator, function);
 	}
 
 	return closure_copy;
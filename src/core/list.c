@@ -0,0 +1,369 @@
+#include <lip/core.h>
+#include <lip/core/vm.h>
+#include "utils.h"
+
+#define LIP_VECTOR_BITS 5
+#define LIP_VECTOR_WIDTH (1 << LIP_VECTOR_BITS)
+#define LIP_VECTOR_MASK (LIP_VECTOR_WIDTH - 1)
+#define LIP_LIST_BUILDER_MIN_CAPACITY 8
+
+typedef struct lip_vector_node_s lip_vector_node_t;
+typedef struct lip_vector_tail_s lip_vector_tail_t;
+
+/*
+ * A persistent vector is a 32-way trie of full leaves plus a tail buffer
+ * holding the last (up to 32) elements.
+ *
+ * Tail buffers are shared between versions. A version can push into a shared
+ * tail in place as long as nothing was pushed after it, which makes building a
+ * list with a series of appends cheap. A full tail becomes a leaf of the trie
+ * as is.
+ */
+struct lip_vector_s
+{
+	size_t count;
+	unsigned int shift;
+	unsigned int tail_len;
+	const lip_vector_node_t* root;
+	lip_vector_tail_t* tail;
+};
+
+struct lip_vector_node_s
+{
+	const void* children[LIP_VECTOR_WIDTH];
+};
+
+struct lip_vector_tail_s
+{
+	unsigned int num_used;
+	lip_value_t values[LIP_VECTOR_WIDTH];
+};
+
+static size_t
+lip_vector_tail_offset(const lip_vector_t* vector)
+{
+	return vector->count - vector->tail_len;
+}
+
+static lip_vector_t*
+lip_vector_alloc(lip_vm_t* vm)
+{
+	return vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_vector_t));
+}
+
+static lip_vector_node_t*
+lip_vector_copy_node(lip_vm_t* vm, const lip_vector_node_t* node)
+{
+	lip_vector_node_t* copy =
+		vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_vector_node_t));
+	if(node)
+	{
+		*copy = *node;
+	}
+	else
+	{
+		memset(copy, 0, sizeof(*copy));
+	}
+
+	return copy;
+}
+
+static const void*
+lip_vector_new_path(lip_vm_t* vm, unsigned int level, const void* leaf)
+{
+	if(level == 0) { return leaf; }
+
+	lip_vector_node_t* node = lip_vector_copy_node(vm, NULL);
+	node->children[0] = lip_vector_new_path(vm, level - LIP_VECTOR_BITS, leaf);
+	return node;
+}
+
+static const lip_vector_node_t*
+lip_vector_push_leaf(
+	lip_vm_t* vm,
+	size_t count,
+	unsigned int level,
+	const lip_vector_node_t* parent,
+	const void* leaf
+)
+{
+	size_t index = ((count - 1) >> level) & LIP_VECTOR_MASK;
+	lip_vector_node_t* node = lip_vector_copy_node(vm, parent);
+
+	if(level == LIP_VECTOR_BITS)
+	{
+		node->children[index] = leaf;
+	}
+	else
+	{
+		const lip_vector_node_t* child = parent ? parent->children[index] : NULL;
+		node->children[index] = child
+			? lip_vector_push_leaf(vm, count, level - LIP_VECTOR_BITS, child, leaf)
+			: lip_vector_new_path(vm, level - LIP_VECTOR_BITS, leaf);
+	}
+
+	return node;
+}
+
+static const lip_vector_t*
+lip_vector_push(lip_vm_t* vm, const lip_vector_t* vector, lip_value_t value)
+{
+	lip_vector_t* result = lip_vector_alloc(vm);
+	lip_vector_tail_t* tail = vector ? vector->tail : NULL;
+	unsigned int tail_len = vector ? vector->tail_len : 0;
+
+	if(tail_len < LIP_VECTOR_WIDTH)
+	{
+		*result = vector ? *vector : (lip_vector_t){ .shift = LIP_VECTOR_BITS };
+
+		// Only copy the tail if another version already pushed into it
+		if(tail == NULL || tail->num_used != tail_len)
+		{
+			lip_vector_tail_t* new_tail =
+				vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_vector_tail_t));
+			if(tail_len > 0)
+			{
+				memcpy(new_tail->values, tail->values, sizeof(lip_value_t) * tail_len);
+			}
+			tail = new_tail;
+		}
+
+		tail->values[tail_len] = value;
+		tail->num_used = tail_len + 1;
+		result->tail = tail;
+		result->tail_len = tail_len + 1;
+		result->count = vector ? vector->count + 1 : 1;
+		return result;
+	}
+
+	// The full tail becomes a leaf
+	const void* leaf = tail->values;
+	const lip_vector_node_t* root;
+	unsigned int shift = vector->shift;
+	if((vector->count >> LIP_VECTOR_BITS) > ((size_t)1 << shift))
+	{
+		lip_vector_node_t* new_root = lip_vector_copy_node(vm, NULL);
+		new_root->children[0] = vector->root;
+		new_root->children[1] = lip_vector_new_path(vm, shift, leaf);
+		root = new_root;
+		shift += LIP_VECTOR_BITS;
+	}
+	else
+	{
+		root = lip_vector_push_leaf(vm, vector->count, shift, vector->root, leaf);
+	}
+
+	lip_vector_tail_t* new_tail =
+		vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_vector_tail_t));
+	new_tail->values[0] = value;
+	new_tail->num_used = 1;
+	*result = (lip_vector_t){
+		.count = vector->count + 1,
+		.shift = shift,
+		.root = root,
+		.tail = new_tail,
+		.tail_len = 1
+	};
+	return result;
+}
+
+static size_t
+lip_vector_chunk(const lip_vector_t* vector, size_t index, const lip_value_t** chunk)
+{
+	size_t tail_offset = lip_vector_tail_offset(vector);
+	if(index >= tail_offset)
+	{
+		*chunk = &vector->tail->values[index - tail_offset];
+		return vector->count - index;
+	}
+
+	const void* node = vector->root;
+	for(unsigned int level = vector->shift; level > 0; level -= LIP_VECTOR_BITS)
+	{
+		node = ((const lip_vector_node_t*)node)->children[
+			(index >> level) & LIP_VECTOR_MASK
+		];
+	}
+
+	*chunk = (const lip_value_t*)node + (index & LIP_VECTOR_MASK);
+	return LIP_VECTOR_WIDTH - (index & LIP_VECTOR_MASK);
+}
+
+static lip_value_t
+lip_make_list_value(lip_list_t* list)
+{
+	return (lip_value_t){
+		.type = LIP_VAL_LIST,
+		.data = { .reference = list }
+	};
+}
+
+static const lip_vector_t*
+lip_list_to_vector(lip_vm_t* vm, const lip_list_t* list, size_t* offset)
+{
+	if(list->vector)
+	{
+		*offset = list->offset;
+		// Elements dropped by lip_list_tail are still part of the vector
+		return list->vector;
+	}
+
+	*offset = 0;
+	const lip_vector_t* vector = NULL;
+	for(size_t i = 0; i < list->length; ++i)
+	{
+		vector = lip_vector_push(vm, vector, list->elements[i]);
+	}
+
+	return vector;
+}
+
+static lip_value_t
+lip_make_vector_list(
+	lip_vm_t* vm, const lip_vector_t* vector, size_t offset
+)
+{
+	lip_list_t* list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
+	*list = (lip_list_t){
+		.length = (vector ? vector->count : 0) - offset,
+		.vector = vector,
+		.offset = offset
+	};
+	return lip_make_list_value(list);
+}
+
+size_t
+lip_list_chunk(const lip_list_t* list, size_t index, const lip_value_t** chunk)
+{
+	if(list->vector == NULL)
+	{
+		*chunk = list->elements + index;
+		return list->length - index;
+	}
+
+	return lip_vector_chunk(list->vector, list->offset + index, chunk);
+}
+
+lip_list_t*
+lip_alloc_list(lip_vm_t* vm, size_t length)
+{
+	lip_list_t* list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
+	lip_value_t* elements =
+		vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_value_t) * length);
+	*list = (lip_list_t){
+		.length = length,
+		.elements = elements,
+		.root = elements
+	};
+	return list;
+}
+
+lip_value_t
+lip_list_append(lip_vm_t* vm, const lip_list_t* list, lip_value_t element)
+{
+	if(list->vector == NULL && list->length < LIP_LIST_FLAT_MAX)
+	{
+		lip_list_t* new_list = lip_alloc_list(vm, list->length + 1);
+		memcpy(new_list->elements, list->elements, sizeof(lip_value_t) * list->length);
+		new_list->elements[list->length] = element;
+		return lip_make_list_value(new_list);
+	}
+
+	size_t offset;
+	const lip_vector_t* vector = lip_list_to_vector(vm, list, &offset);
+	return lip_make_vector_list(vm, lip_vector_push(vm, vector, element), offset);
+}
+
+lip_value_t
+lip_list_concat(lip_vm_t* vm, const lip_list_t* lhs, const lip_list_t* rhs)
+{
+	size_t length = lhs->length + rhs->length;
+	if(rhs->length == 0) { return lip_make_list_value((lip_list_t*)lhs); }
+
+	if(length <= LIP_LIST_FLAT_MAX)
+	{
+		lip_list_t* list = lip_alloc_list(vm, length);
+		size_t index = 0;
+		lip_list_iterator_t itr;
+		lip_value_t element;
+		for(lip_list_begin(lhs, &itr); lip_list_next(&itr, &element);)
+		{
+			list->elements[index++] = element;
+		}
+		for(lip_list_begin(rhs, &itr); lip_list_next(&itr, &element);)
+		{
+			list->elements[index++] = element;
+		}
+		return lip_make_list_value(list);
+	}
+
+	size_t offset;
+	const lip_vector_t* vector = lip_list_to_vector(vm, lhs, &offset);
+	lip_list_iterator_t itr;
+	lip_value_t element;
+	for(lip_list_begin(rhs, &itr); lip_list_next(&itr, &element);)
+	{
+		vector = lip_vector_push(vm, vector, element);
+	}
+
+	return lip_make_vector_list(vm, vector, offset);
+}
+
+lip_value_t
+lip_list_tail(lip_vm_t* vm, const lip_list_t* list)
+{
+	lip_list_t* new_list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
+	*new_list = *list;
+	new_list->length = list->length - 1;
+	if(list->vector)
+	{
+		++new_list->offset;
+	}
+	else
+	{
+		++new_list->elements;
+	}
+
+	return lip_make_list_value(new_list);
+}
+
+void
+lip_list_builder_begin(lip_vm_t* vm, lip_list_builder_t* builder, size_t capacity)
+{
+	*builder = (lip_list_builder_t){ .vm = vm };
+	lip_list_builder_reserve(builder, capacity);
+}
+
+void
+lip_list_builder_reserve(lip_list_builder_t* builder, size_t capacity)
+{
+	capacity = LIP_MAX(capacity, LIP_LIST_BUILDER_MIN_CAPACITY);
+	if(capacity <= builder->capacity) { return; }
+
+	lip_vm_t* vm = builder->vm;
+	lip_value_t* elements =
+		vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_value_t) * capacity);
+	if(builder->length > 0)
+	{
+		memcpy(elements, builder->elements, sizeof(lip_value_t) * builder->length);
+	}
+
+	builder->elements = elements;
+	builder->capacity = capacity;
+}
+
+lip_value_t
+lip_list_builder_freeze(lip_list_builder_t* builder)
+{
+	lip_vm_t* vm = builder->vm;
+	lip_list_t* list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
+	*list = (lip_list_t){
+		.length = builder->length,
+		.elements = builder->elements,
+		.root = builder->elements
+	};
+
+	// The buffer now belongs to the list
+	*builder = (lip_list_builder_t){ .vm = vm };
+	return lip_make_list_value(list);
+}
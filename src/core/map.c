@@ -0,0 +1,538 @@
+#include <lip/core.h>
+#include <lip/core/vm.h>
+#include <lip/core/prim_ops.h>
+#include "utils.h"
+
+#define LIP_MAP_BITS 5
+#define LIP_MAP_MASK ((1u << LIP_MAP_BITS) - 1)
+#define LIP_MAP_HASH_BITS 32
+
+typedef struct lip_map_entry_s lip_map_entry_t;
+
+struct lip_map_entry_s
+{
+	lip_value_t key;
+	lip_value_t value;
+};
+
+/*
+ * A node of the hash array mapped trie.
+ *
+ * Each level consumes 5 bits of a key's hash. A slot in a node either holds
+ * an entry (bit set in datamap) or a child node (bit set in nodemap). Entries
+ * are packed at the start of lip_map_node_s::entries, followed by pointers to
+ * the children.
+ *
+ * Once all bits of the hash are consumed, keys with the same hash are kept
+ * unordered in a collision node: a node with num_collisions entries and no
+ * children.
+ */
+struct lip_map_node_s
+{
+	uint32_t datamap;
+	uint32_t nodemap;
+	uint32_t num_collisions;
+	LIP_FLEXIBLE_ARRAY_MEMBER(lip_map_entry_t, entries);
+};
+
+static const lip_map_t lip_empty_map = { .size = 0, .root = NULL };
+
+static unsigned int
+lip_popcount(uint32_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned int)__builtin_popcount(bits);
+#else
+	bits = bits - ((bits >> 1) & 0x55555555u);
+	bits = (bits & 0x33333333u) + ((bits >> 2) & 0x33333333u);
+	return (((bits + (bits >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+#endif
+}
+
+static uint32_t
+lip_map_bit(uint32_t hash, unsigned int shift)
+{
+	return 1u << ((hash >> shift) & LIP_MAP_MASK);
+}
+
+static unsigned int
+lip_map_index(uint32_t bitmap, uint32_t bit)
+{
+	return lip_popcount(bitmap & (bit - 1));
+}
+
+static unsigned int
+lip_map_num_entries(const lip_map_node_t* node)
+{
+	return node->num_collisions > 0
+		? node->num_collisions
+		: lip_popcount(node->datamap);
+}
+
+static unsigned int
+lip_map_num_children(const lip_map_node_t* node)
+{
+	return lip_popcount(node->nodemap);
+}
+
+static const lip_map_node_t**
+lip_map_children(const lip_map_node_t* node)
+{
+	return (const lip_map_node_t**)(node->entries + lip_map_num_entries(node));
+}
+
+static lip_map_node_t*
+lip_map_alloc_node(lip_vm_t* vm, unsigned int num_entries, unsigned int num_children)
+{
+	size_t size = sizeof(lip_map_node_t)
+		+ sizeof(lip_map_entry_t) * num_entries
+		+ sizeof(lip_map_node_t*) * num_children;
+	lip_map_node_t* node = vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, size);
+	node->datamap = 0;
+	node->nodemap = 0;
+	node->num_collisions = 0;
+	return node;
+}
+
+static lip_value_t
+lip_make_map_value(lip_vm_t* vm, size_t size, const lip_map_node_t* root)
+{
+	lip_map_t* map = vm->rt->malloc(vm->rt, LIP_VAL_MAP, sizeof(lip_map_t));
+	*map = (lip_map_t){ .size = size, .root = root };
+	return (lip_value_t){
+		.type = LIP_VAL_MAP,
+		.data = { .reference = map }
+	};
+}
+
+static const lip_map_node_t*
+lip_map_make_pair(
+	lip_vm_t* vm,
+	unsigned int shift,
+	lip_map_entry_t lhs, uint32_t lhs_hash,
+	lip_map_entry_t rhs, uint32_t rhs_hash
+)
+{
+	if(shift >= LIP_MAP_HASH_BITS)
+	{
+		lip_map_node_t* node = lip_map_alloc_node(vm, 2, 0);
+		node->num_collisions = 2;
+		node->entries[0] = lhs;
+		node->entries[1] = rhs;
+		return node;
+	}
+
+	uint32_t lhs_bit = lip_map_bit(lhs_hash, shift);
+	uint32_t rhs_bit = lip_map_bit(rhs_hash, shift);
+	if(lhs_bit == rhs_bit)
+	{
+		lip_map_node_t* node = lip_map_alloc_node(vm, 0, 1);
+		node->nodemap = lhs_bit;
+		lip_map_children(node)[0] = lip_map_make_pair(
+			vm, shift + LIP_MAP_BITS, lhs, lhs_hash, rhs, rhs_hash
+		);
+		return node;
+	}
+
+	lip_map_node_t* node = lip_map_alloc_node(vm, 2, 0);
+	node->datamap = lhs_bit | rhs_bit;
+	node->entries[lhs_bit < rhs_bit ? 0 : 1] = lhs;
+	node->entries[lhs_bit < rhs_bit ? 1 : 0] = rhs;
+	return node;
+}
+
+static lip_map_node_t*
+lip_map_copy_node(
+	lip_vm_t* vm,
+	const lip_map_node_t* node,
+	int entry_delta,
+	int child_delta
+)
+{
+	unsigned int num_entries = lip_map_num_entries(node);
+	unsigned int num_children = lip_map_num_children(node);
+	lip_map_node_t* copy = lip_map_alloc_node(
+		vm, num_entries + entry_delta, num_children + child_delta
+	);
+	copy->datamap = node->datamap;
+	copy->nodemap = node->nodemap;
+	copy->num_collisions = node->num_collisions;
+	if(entry_delta == 0)
+	{
+		memcpy(copy->entries, node->entries, sizeof(lip_map_entry_t) * num_entries);
+	}
+	if(entry_delta == 0 && child_delta == 0)
+	{
+		memcpy(
+			lip_map_children(copy),
+			lip_map_children(node),
+			sizeof(lip_map_node_t*) * num_children
+		);
+	}
+
+	return copy;
+}
+
+static const lip_map_node_t*
+lip_map_node_assoc(
+	lip_vm_t* vm,
+	const lip_map_node_t* node,
+	unsigned int shift,
+	uint32_t hash,
+	lip_map_entry_t entry,
+	bool* added
+)
+{
+	if(node->num_collisions > 0)
+	{
+		for(unsigned int i = 0; i < node->num_collisions; ++i)
+		{
+			if(lip_gen_cmp(node->entries[i].key, entry.key) == 0)
+			{
+				lip_map_node_t* copy = lip_map_copy_node(vm, node, 0, 0);
+				copy->entries[i] = entry;
+				return copy;
+			}
+		}
+
+		lip_map_node_t* copy = lip_map_alloc_node(vm, node->num_collisions + 1, 0);
+		copy->num_collisions = node->num_collisions + 1;
+		memcpy(
+			copy->entries, node->entries,
+			sizeof(lip_map_entry_t) * node->num_collisions
+		);
+		copy->entries[node->num_collisions] = entry;
+		*added = true;
+		return copy;
+	}
+
+	uint32_t bit = lip_map_bit(hash, shift);
+	unsigned int num_entries = lip_map_num_entries(node);
+	unsigned int num_children = lip_map_num_children(node);
+	const lip_map_node_t** children = lip_map_children(node);
+
+	if(node->datamap & bit)
+	{
+		unsigned int index = lip_map_index(node->datamap, bit);
+		lip_map_entry_t existing = node->entries[index];
+		if(lip_gen_cmp(existing.key, entry.key) == 0)
+		{
+			lip_map_node_t* copy = lip_map_copy_node(vm, node, 0, 0);
+			copy->entries[index].value = entry.value;
+			return copy;
+		}
+
+		// Push both entries down into a new child
+		const lip_map_node_t* child = lip_map_make_pair(
+			vm, shift + LIP_MAP_BITS,
+			existing, lip_gen_hash(existing.key),
+			entry, hash
+		);
+		unsigned int child_index = lip_map_index(node->nodemap, bit);
+		lip_map_node_t* copy = lip_map_copy_node(vm, node, -1, 1);
+		copy->datamap &= ~bit;
+		copy->nodemap |= bit;
+		memcpy(copy->entries, node->entries, sizeof(lip_map_entry_t) * index);
+		memcpy(
+			copy->entries + index,
+			node->entries + index + 1,
+			sizeof(lip_map_entry_t) * (num_entries - index - 1)
+		);
+		const lip_map_node_t** new_children = lip_map_children(copy);
+		memcpy(new_children, children, sizeof(lip_map_node_t*) * child_index);
+		new_children[child_index] = child;
+		memcpy(
+			new_children + child_index + 1,
+			children + child_index,
+			sizeof(lip_map_node_t*) * (num_children - child_index)
+		);
+		*added = true;
+		return copy;
+	}
+	else if(node->nodemap & bit)
+	{
+		unsigned int child_index = lip_map_index(node->nodemap, bit);
+		lip_map_node_t* copy = lip_map_copy_node(vm, node, 0, 0);
+		lip_map_children(copy)[child_index] = lip_map_node_assoc(
+			vm, children[child_index], shift + LIP_MAP_BITS, hash, entry, added
+		);
+		return copy;
+	}
+	else
+	{
+		unsigned int index = lip_map_index(node->datamap, bit);
+		lip_map_node_t* copy = lip_map_copy_node(vm, node, 1, 0);
+		copy->datamap |= bit;
+		memcpy(copy->entries, node->entries, sizeof(lip_map_entry_t) * index);
+		copy->entries[index] = entry;
+		memcpy(
+			copy->entries + index + 1,
+			node->entries + index,
+			sizeof(lip_map_entry_t) * (num_entries - index)
+		);
+		memcpy(
+			lip_map_children(copy),
+			children,
+			sizeof(lip_map_node_t*) * num_children
+		);
+		*added = true;
+		return copy;
+	}
+}
+
+// Return the only entry of a node if it has no other entry or child
+static const lip_map_entry_t*
+lip_map_single_entry(const lip_map_node_t* node)
+{
+	return lip_map_num_entries(node) == 1 && node->nodemap == 0
+		? &node->entries[0]
+		: NULL;
+}
+
+static const lip_map_node_t*
+lip_map_node_dissoc(
+	lip_vm_t* vm,
+	const lip_map_node_t* node,
+	unsigned int shift,
+	uint32_t hash,
+	lip_value_t key,
+	bool* removed
+)
+{
+	if(node->num_collisions > 0)
+	{
+		for(unsigned int i = 0; i < node->num_collisions; ++i)
+		{
+			if(lip_gen_cmp(node->entries[i].key, key) != 0) { continue; }
+
+			if(node->num_collisions == 1) { *removed = true; return NULL; }
+
+			lip_map_node_t* copy = lip_map_alloc_node(vm, node->num_collisions - 1, 0);
+			copy->num_collisions = node->num_collisions - 1;
+			memcpy(copy->entries, node->entries, sizeof(lip_map_entry_t) * i);
+			memcpy(
+				copy->entries + i,
+				node->entries + i + 1,
+				sizeof(lip_map_entry_t) * (node->num_collisions - i - 1)
+			);
+			*removed = true;
+			return copy;
+		}
+
+		return node;
+	}
+
+	uint32_t bit = lip_map_bit(hash, shift);
+	unsigned int num_entries = lip_map_num_entries(node);
+	unsigned int num_children = lip_map_num_children(node);
+	const lip_map_node_t** children = lip_map_children(node);
+
+	if(node->datamap & bit)
+	{
+		unsigned int index = lip_map_index(node->datamap, bit);
+		if(lip_gen_cmp(node->entries[index].key, key) != 0) { return node; }
+
+		*removed = true;
+		if(num_entries == 1 && num_children == 0) { return NULL; }
+
+		lip_map_node_t* copy = lip_map_copy_node(vm, node, -1, 0);
+		copy->datamap &= ~bit;
+		memcpy(copy->entries, node->entries, sizeof(lip_map_entry_t) * index);
+		memcpy(
+			copy->entries + index,
+			node->entries + index + 1,
+			sizeof(lip_map_entry_t) * (num_entries - index - 1)
+		);
+		memcpy(
+			lip_map_children(copy),
+			children,
+			sizeof(lip_map_node_t*) * num_children
+		);
+		return copy;
+	}
+	else if(node->nodemap & bit)
+	{
+		unsigned int child_index = lip_map_index(node->nodemap, bit);
+		const lip_map_node_t* child = lip_map_node_dissoc(
+			vm, children[child_index], shift + LIP_MAP_BITS, hash, key, removed
+		);
+		if(child == children[child_index]) { return node; }
+
+		const lip_map_entry_t* single_entry = child ? lip_map_single_entry(child) : NULL;
+		if(child != NULL && single_entry == NULL)
+		{
+			lip_map_node_t* copy = lip_map_copy_node(vm, node, 0, 0);
+			lip_map_children(copy)[child_index] = child;
+			return copy;
+		}
+
+		if(child == NULL && num_entries == 0 && num_children == 1) { return NULL; }
+
+		// Remove the child, pulling its last entry up into this node
+		int entry_delta = single_entry ? 1 : 0;
+		lip_map_node_t* copy = lip_map_copy_node(vm, node, entry_delta, -1);
+		copy->nodemap &= ~bit;
+		if(single_entry)
+		{
+			unsigned int index = lip_map_index(node->datamap, bit);
+			copy->datamap |= bit;
+			memcpy(copy->entries, node->entries, sizeof(lip_map_entry_t) * index);
+			copy->entries[index] = *single_entry;
+			memcpy(
+				copy->entries + index + 1,
+				node->entries + index,
+				sizeof(lip_map_entry_t) * (num_entries - index)
+			);
+		}
+		else
+		{
+			memcpy(copy->entries, node->entries, sizeof(lip_map_entry_t) * num_entries);
+		}
+		const lip_map_node_t** new_children = lip_map_children(copy);
+		memcpy(new_children, children, sizeof(lip_map_node_t*) * child_index);
+		memcpy(
+			new_children + child_index,
+			children + child_index + 1,
+			sizeof(lip_map_node_t*) * (num_children - child_index - 1)
+		);
+		return copy;
+	}
+	else
+	{
+		return node;
+	}
+}
+
+lip_value_t
+lip_make_map(lip_vm_t* vm)
+{
+	(void)vm;
+	return (lip_value_t){
+		.type = LIP_VAL_MAP,
+		.data = { .reference = (void*)&lip_empty_map }
+	};
+}
+
+bool
+lip_map_get(const lip_map_t* map, lip_value_t key, lip_value_t* value)
+{
+	const lip_map_node_t* node = map->root;
+	if(node == NULL) { return false; }
+
+	uint32_t hash = lip_gen_hash(key);
+	for(unsigned int shift = 0;; shift += LIP_MAP_BITS)
+	{
+		if(node->num_collisions > 0)
+		{
+			for(unsigned int i = 0; i < node->num_collisions; ++i)
+			{
+				if(lip_gen_cmp(node->entries[i].key, key) == 0)
+				{
+					if(value) { *value = node->entries[i].value; }
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		uint32_t bit = lip_map_bit(hash, shift);
+		if(node->datamap & bit)
+		{
+			const lip_map_entry_t* entry =
+				&node->entries[lip_map_index(node->datamap, bit)];
+			if(lip_gen_cmp(entry->key, key) != 0) { return false; }
+
+			if(value) { *value = entry->value; }
+			return true;
+		}
+		else if(node->nodemap & bit)
+		{
+			node = lip_map_children(node)[lip_map_index(node->nodemap, bit)];
+		}
+		else
+		{
+			return false;
+		}
+	}
+}
+
+lip_value_t
+lip_map_assoc(lip_vm_t* vm, const lip_map_t* map, lip_value_t key, lip_value_t value)
+{
+	lip_map_entry_t entry = { .key = key, .value = value };
+	uint32_t hash = lip_gen_hash(key);
+
+	if(map->root == NULL)
+	{
+		lip_map_node_t* root = lip_map_alloc_node(vm, 1, 0);
+		root->datamap = lip_map_bit(hash, 0);
+		root->entries[0] = entry;
+		return lip_make_map_value(vm, 1, root);
+	}
+
+	bool added = false;
+	const lip_map_node_t* root =
+		lip_map_node_assoc(vm, map->root, 0, hash, entry, &added);
+	return lip_make_map_value(vm, map->size + (added ? 1 : 0), root);
+}
+
+lip_value_t
+lip_map_dissoc(lip_vm_t* vm, const lip_map_t* map, lip_value_t key)
+{
+	lip_value_t map_value = {
+		.type = LIP_VAL_MAP,
+		.data = { .reference = (void*)map }
+	};
+	if(map->root == NULL) { return map_value; }
+
+	bool removed = false;
+	const lip_map_node_t* root =
+		lip_map_node_dissoc(vm, map->root, 0, lip_gen_hash(key), key, &removed);
+	if(!removed) { return map_value; }
+
+	return root ? lip_make_map_value(vm, map->size - 1, root) : lip_make_map(vm);
+}
+
+void
+lip_map_begin(const lip_map_t* map, lip_map_iterator_t* itr)
+{
+	itr->depth = 0;
+	if(map->root)
+	{
+		itr->stack[0].node = map->root;
+		itr->stack[0].index = 0;
+		itr->depth = 1;
+	}
+}
+
+bool
+lip_map_next(lip_map_iterator_t* itr, lip_value_t* key, lip_value_t* value)
+{
+	while(itr->depth > 0)
+	{
+		unsigned int top = itr->depth - 1;
+		const lip_map_node_t* node = itr->stack[top].node;
+		unsigned int index = itr->stack[top].index++;
+		unsigned int num_entries = lip_map_num_entries(node);
+
+		if(index < num_entries)
+		{
+			*key = node->entries[index].key;
+			*value = node->entries[index].value;
+			return true;
+		}
+		else if(index - num_entries < lip_map_num_children(node))
+		{
+			itr->stack[itr->depth].node = lip_map_children(node)[index - num_entries];
+			itr->stack[itr->depth].index = 0;
+			++itr->depth;
+		}
+		else
+		{
+			--itr->depth;
+		}
+	}
+
+	return false;
+}
@@ -1,19 +1,21 @@
 #include "lip_internal.h"
 #include <lip/core/asm.h>
+#include <lip/bind.h>
 #include "utils.h"
 
 typedef bool(*lip_import_iteratee_t)(
 	lip_function_t* fn,
 	lip_import_t* import,
-	lip_loc_range_t loc,
-	lip_string_ref_t module_name,
-	lip_string_ref_t symbol_name,
+	lip_value_t* link,
+	lip_hashed_string_ref_t module_name,
+	lip_hashed_string_ref_t symbol_name,
 	void* ctx
 );
 
 typedef bool(*lip_function_iteratee_t)(
 	lip_function_t* fn,
 	lip_function_layout_t* layout,
+	lip_value_t* links,
 	void* ctx
 );
 
@@ -42,35 +44,41 @@ lip_copy_string_ref(lip_allocator_t* allocator, lip_string_ref_t str)
 	};
 }
 
-static bool
-lip_import_referenced(
-	lip_function_t* fn, uint16_t import_index, lip_loc_range_t* loc
-)
+static inline lip_hashed_string_ref_t
+lip_copy_hashed_string_ref(lip_allocator_t* allocator, lip_hashed_string_ref_t str)
 {
-	lip_function_layout_t layout;
-	lip_function_layout(fn, &layout);
+	return (lip_hashed_string_ref_t){
+		.str = lip_copy_string_ref(allocator, str.str),
+		.hash = str.hash
+	};
+}
 
-	for(uint16_t i = 0; i < fn->num_instructions; ++i)
+// Find the first instruction loading an import. Locations are only needed to
+// report errors so instructions are not decoded otherwise.
+static lip_loc_range_t
+lip_find_import_location(
+	const lip_function_t* fn, const lip_function_layout_t* layout, uint32_t index
+)
+{
+	for(uint32_t i = 0; i < fn->num_instructions; ++i)
 	{
-		lip_instruction_t instr = layout.instructions[i];
 		lip_opcode_t opcode;
 		lip_operand_t operand;
-		lip_disasm(instr, &opcode, &operand);
-		if(opcode == LIP_OP_IMP && operand == import_index)
+		lip_disasm(layout->instructions[i], &opcode, &operand);
+		if(opcode == LIP_OP_IMP && (uint32_t)operand == index)
 		{
-			*loc = layout.locations[i + 1]; // slot 0 is function's location
-			return true;
+			return lip_function_location(fn, i + 1); // 0 is function's location
 		}
 	}
 
-	return false;
+	return lip_function_location(fn, 0);
 }
 
 static lip_symbol_t*
 lip_lookup_symbol_in_symtab(
 	khash_t(lip_symtab)* symtab,
-	lip_string_ref_t module_name,
-	lip_string_ref_t symbol_name
+	lip_hashed_string_ref_t module_name,
+	lip_hashed_string_ref_t symbol_name
 )
 {
 	khiter_t itr = kh_get(lip_symtab, symtab, module_name);
@@ -85,32 +93,33 @@ lip_lookup_symbol_in_symtab(
 
 static void
 lip_split_fqn(
-	lip_string_ref_t fqn,
-	lip_string_ref_t* module_name,
-	lip_string_ref_t* symbol_name
+	lip_hashed_string_ref_t fqn,
+	lip_hashed_string_ref_t* module_name,
+	lip_hashed_string_ref_t* symbol_name
 )
 {
-	if(fqn.length == 1 && fqn.ptr[0] == '/')
+	char* pos = fqn.str.length == 1 && fqn.str.ptr[0] == '/'
+		? NULL
+		: memchr(fqn.str.ptr, '/', fqn.str.length);
+
+	if(pos)
 	{
-		*module_name = lip_string_ref("");
-		*symbol_name = fqn;
+		lip_string_ref_t module_ref = {
+			.ptr = fqn.str.ptr,
+			.length = pos - fqn.str.ptr
+		};
+		lip_string_ref_t symbol_ref = {
+			.ptr = pos + 1,
+			.length = fqn.str.length - module_ref.length - 1
+		};
+		*module_name = lip_hashed_string_ref(module_ref);
+		*symbol_name = lip_hashed_string_ref(symbol_ref);
 	}
 	else
 	{
-		char* pos = memchr(fqn.ptr, '/', fqn.length);
-
-		if(pos)
-		{
-			module_name->ptr = fqn.ptr;
-			module_name->length = pos - fqn.ptr;
-			symbol_name->ptr = pos + 1;
-			symbol_name->length = fqn.length - module_name->length - 1;
-		}
-		else
-		{
-			*module_name = lip_string_ref("");
-			*symbol_name = fqn;
-		}
+		// The hash of an unqualified name is reused as is
+		*module_name = lip_hashed_string_ref(lip_string_ref(""));
+		*symbol_name = fqn;
 	}
 }
 
@@ -119,72 +128,91 @@ lip_purge_module(lip_runtime_t* runtime, khash_t(lip_module)* module)
 {
 	kh_foreach(i, module)
 	{
-		lip_free(runtime->cfg.allocator, (void*)kh_key(module, i).ptr);
+		lip_free(runtime->cfg.allocator, (void*)kh_key(module, i).str.ptr);
 		lip_closure_t* closure = kh_val(module, i).value;
 		lip_free(runtime->cfg.allocator, closure->debug_name);
 		if(!closure->is_native)
 		{
-			lip_free(runtime->cfg.allocator, closure->function.lip);
+			if(!lip_is_mapped(runtime, closure->function.lip))
+			{
+				lip_free(runtime->cfg.allocator, closure->function.lip);
+			}
+			lip_free(runtime->cfg.allocator, closure->links);
 		}
 		lip_free(runtime->cfg.allocator, closure);
 	}
 	kh_clear(lip_module, module);
 }
 
-static void
-lip_commit_module_locked(lip_context_t* ctx, lip_string_ref_t name, khash_t(lip_module)* module)
+khash_t(lip_module)*
+lip_reset_module_locked(lip_runtime_t* runtime, lip_hashed_string_ref_t name)
 {
-	lip_assert(ctx, ctx->rt_write_lock_depth > 0);
-	lip_runtime_t* runtime = ctx->runtime;
 	khash_t(lip_symtab)* symtab = runtime->symtab;
 	khiter_t itr = kh_get(lip_symtab, symtab, name);
-
-	khash_t(lip_module)* target_module;
 	if(itr != kh_end(symtab))
 	{
-		target_module = kh_val(symtab, itr);
-		lip_purge_module(runtime, target_module);
+		khash_t(lip_module)* module = kh_val(symtab, itr);
+		lip_purge_module(runtime, module);
+		return module;
 	}
-	else
-	{
-		lip_string_ref_t module_name = lip_copy_string_ref(runtime->cfg.allocator, name);
-		target_module = kh_init(lip_module, runtime->cfg.allocator);
 
-		int ret;
-		khiter_t itr = kh_put(lip_symtab, symtab, module_name, &ret);
-		kh_val(symtab, itr) = target_module;
-	}
+	lip_hashed_string_ref_t module_name =
+		lip_copy_hashed_string_ref(runtime->cfg.allocator, name);
+	khash_t(lip_module)* module = kh_init(lip_module, runtime->cfg.allocator);
+
+	int ret;
+	itr = kh_put(lip_symtab, symtab, module_name, &ret);
+	kh_val(symtab, itr) = module;
+	return module;
+}
+
+lip_string_t*
+lip_new_debug_name(
+	lip_allocator_t* allocator,
+	lip_string_ref_t module_name,
+	lip_string_ref_t symbol_name
+)
+{
+	size_t str_len = module_name.length + 1 + symbol_name.length;
+	lip_string_t* debug_name =
+		lip_malloc(allocator, sizeof(lip_string_t) + str_len + 1);
+	memcpy(debug_name->ptr, module_name.ptr, module_name.length);
+	debug_name->ptr[module_name.length] = '/';
+	memcpy(
+		debug_name->ptr + module_name.length + 1,
+		symbol_name.ptr, symbol_name.length
+	);
+	debug_name->ptr[str_len] = '\0';
+	debug_name->length = str_len;
+	debug_name->hash = 0;
+	return debug_name;
+}
+
+static void
+lip_commit_module_locked(
+	lip_context_t* ctx, lip_hashed_string_ref_t name, khash_t(lip_module)* module
+)
+{
+	lip_assert(ctx, ctx->rt_write_lock_depth > 0);
+	lip_runtime_t* runtime = ctx->runtime;
+	khash_t(lip_module)* target_module = lip_reset_module_locked(runtime, name);
 
 	kh_foreach(i, module)
 	{
-		lip_string_ref_t key = kh_key(module, i);
+		lip_hashed_string_ref_t key = kh_key(module, i);
 		lip_symbol_t value = kh_val(module, i);
 
-		lip_string_ref_t symbol_name = lip_copy_string_ref(runtime->cfg.allocator, key);
-		value.value = lip_copy_closure(runtime->cfg.allocator, value.value);
-
-		lip_arena_allocator_reset(ctx->temp_pool);
-		lip_array(char) fqn_buf = lip_array_create(ctx->temp_pool, char, 64);
-		lip_sprintf(
-			&fqn_buf,
-			"%.*s/%.*s",
-			(int)name.length, name.ptr,
-			(int)key.length, key.ptr
-		);
-		size_t str_len = lip_array_len(fqn_buf);
-		lip_string_t* debug_name = lip_malloc(
-			runtime->cfg.allocator, sizeof(lip_string_t) + str_len + 1
-		);
-		memcpy(debug_name->ptr, fqn_buf, str_len);
-		debug_name->ptr[str_len] = '\0';
-		debug_name->length = str_len;
-		value.value->debug_name = debug_name;
+		lip_hashed_string_ref_t symbol_name =
+			lip_copy_hashed_string_ref(runtime->cfg.allocator, key);
+		value.value = lip_copy_closure(runtime, runtime->cfg.allocator, value.value);
+		value.value->debug_name =
+			lip_new_debug_name(runtime->cfg.allocator, name.str, key.str);
 
 		int ret;
 		if(!value.value->is_native)
 		{
 			khiter_t itr = kh_put(lip_ptr_map,
-				ctx->new_exported_functions, value.value->function.lip, &ret
+				ctx->new_exported_functions, value.value, &ret
 			);
 			kh_val(ctx->new_exported_functions, itr) = target_module;
 		}
@@ -194,12 +222,11 @@ lip_commit_module_locked(lip_context_t* ctx, lip_string_ref_t name, khash_t(lip_
 	}
 }
 
-static bool
-lip_lookup_symbol_locked(
+static lip_symbol_t*
+lip_find_symbol_locked(
 	lip_context_t* ctx,
-	lip_string_ref_t module,
-	lip_string_ref_t symbol_name,
-	lip_value_t* result
+	lip_hashed_string_ref_t module,
+	lip_hashed_string_ref_t symbol_name
 )
 {
 	lip_symbol_t* symbol = NULL;
@@ -215,7 +242,9 @@ lip_lookup_symbol_locked(
 
 	if(symbol == NULL)
 	{
-		lip_lookup_symbol_in_symtab(ctx->loading_symtab, module, symbol_name);
+		symbol = lip_lookup_symbol_in_symtab(
+			ctx->loading_symtab, module, symbol_name
+		);
 	}
 
 	if(symbol == NULL)
@@ -225,6 +254,18 @@ lip_lookup_symbol_locked(
 		);
 	}
 
+	return symbol;
+}
+
+static bool
+lip_lookup_symbol_locked(
+	lip_context_t* ctx,
+	lip_hashed_string_ref_t module,
+	lip_hashed_string_ref_t symbol_name,
+	lip_value_t* result
+)
+{
+	lip_symbol_t* symbol = lip_find_symbol_locked(ctx, module, symbol_name);
 	if(symbol == NULL) { return false; }
 
 	*result = (lip_value_t){
@@ -245,12 +286,14 @@ lip_set_link_error(
 	lip_context_t* ctx,
 	lip_string_ref_t error_message,
 	lip_function_t* fn,
-	lip_loc_range_t loc,
+	const lip_import_t* import,
 	bool stack
 )
 {
 	lip_function_layout_t layout;
 	lip_function_layout(fn, &layout);
+	lip_loc_range_t loc =
+		lip_find_import_location(fn, &layout, import - layout.imports);
 
 	lip_error_record_t* error_record = lip_new(ctx->module_pool, lip_error_record_t);
 	*error_record = (lip_error_record_t){
@@ -289,11 +332,11 @@ static void
 lip_set_undefined_symbol_error(
 	lip_context_t* ctx,
 	lip_function_t* fn,
-	lip_string_t* name,
-	lip_loc_range_t loc,
+	const lip_import_t* import,
 	bool stack
 )
 {
+	lip_string_t* name = lip_function_resource(fn, import->name);
 	lip_array(char) msg_buf = lip_array_create(ctx->module_pool, char, 64);
 	lip_sprintf(&msg_buf, "Undefined symbol: %.*s", (int)name->length, name->ptr);
 	lip_array_push(msg_buf, '\0');
@@ -301,7 +344,7 @@ lip_set_undefined_symbol_error(
 		.length = lip_array_len(msg_buf) - 1,
 		.ptr = msg_buf
 	};
-	lip_set_link_error(ctx, error_message, fn, loc, stack);
+	lip_set_link_error(ctx, error_message, fn, import, stack);
 }
 
 lip_module_context_t*
@@ -312,7 +355,7 @@ lip_begin_module(lip_context_t* ctx, lip_string_ref_t name)
 	*module_context = (lip_module_context_t){
 		.content = kh_init(lip_module, ctx->module_pool),
 		.allocator = ctx->module_pool,
-		.name = name
+		.name = lip_hashed_string_ref(name)
 	};
 	return module_context;
 }
@@ -334,13 +377,15 @@ lip_discard_module(lip_context_t* ctx, lip_module_context_t* module)
 	lip_ctx_end_load(ctx);
 }
 
-void
-lip_declare_function(
+static lip_symbol_t*
+lip_declare_native(
 	lip_module_context_t* module, lip_string_ref_t name, lip_native_fn_t fn
 )
 {
 	int ret;
-	khiter_t itr  = kh_put(lip_module, module->content, name, &ret);
+	khiter_t itr = kh_put(
+		lip_module, module->content, lip_hashed_string_ref(name), &ret
+	);
 
 	lip_closure_t* closure = lip_new(module->allocator, lip_closure_t);
 	*closure = (lip_closure_t){
@@ -353,6 +398,58 @@ lip_declare_function(
 		.is_public = true,
 		.value = closure
 	};
+	return &kh_val(module->content, itr);
+}
+
+void
+lip_declare_function(
+	lip_module_context_t* module, lip_string_ref_t name, lip_native_fn_t fn
+)
+{
+	lip_declare_native(module, name, fn);
+}
+
+void
+lip_declare_function_with_signature(
+	lip_module_context_t* module,
+	lip_string_ref_t name,
+	lip_native_fn_t fn,
+	lip_signature_t signature
+)
+{
+	lip_symbol_t* symbol = lip_declare_native(module, name, fn);
+	symbol->has_signature = true;
+	symbol->signature = signature;
+}
+
+lip_exec_status_t
+lip_builtin_declare(lip_vm_t* vm, lip_value_t* result)
+{
+	lip_bind_args((symbol, name), (boolean, is_public), (function, fn));
+	lip_runtime_link_t* rt = LIP_CONTAINER_OF(vm->rt, lip_runtime_link_t, vtable);
+
+	khash_t(lip_module)* module = rt->ctx->current_module;
+	lip_bind_assert(module != NULL, "Cannot use `declare` out of module context");
+
+	lip_closure_t* closure = fn.data.reference;
+	lip_bind_assert(closure->env_len == 0, "Cannot `declare` function with captured var");
+
+	// Symbols live as long as the runtime, the key is copied once loaded
+	lip_string_t* name_str = name.data.reference;
+	int ret;
+	khiter_t itr = kh_put(
+		lip_module, module,
+		lip_hashed_string_ref_from_string(name_str), &ret
+	);
+	lip_bind_assert_fmt(
+		ret != 0, "Redeclared '%.*s'", (int)name_str->length, name_str->ptr
+	);
+	kh_val(module, itr) = (lip_symbol_t){
+		.value = closure,
+		.is_public = is_public
+	};
+
+	lip_return(lip_make_nil(vm));
 }
 
 void
@@ -376,29 +473,40 @@ lip_destroy_all_modules(lip_runtime_t* runtime)
 {
 	kh_foreach(itr, runtime->symtab)
 	{
-		lip_free(runtime->cfg.allocator, (void*)kh_key(runtime->symtab, itr).ptr);
+		lip_free(runtime->cfg.allocator, (void*)kh_key(runtime->symtab, itr).str.ptr);
 		khash_t(lip_module)* module = kh_val(runtime->symtab, itr);
 		lip_purge_module(runtime, module);
 		kh_destroy(lip_module, module);
 	}
 }
 
+// Visit a function and all of its nested functions. `links` is the link table
+// of the function, it can be `NULL` if the iteratee does not need it.
+// Functions with nothing to link, including their nested functions, are skipped
+// so their bodies are not decoded again: loading already verified all of them.
 static bool
 lip_iterate_functions(
 	lip_function_t* fn,
+	lip_value_t* links,
 	lip_function_iteratee_t iteratee,
 	void* ctx
 )
 {
+	if(fn->num_links == 0) { return true; }
+
 	lip_function_layout_t layout;
 	lip_function_layout(fn, &layout);
-	if(!iteratee(fn, &layout, ctx)) { return false; }
+	if(!iteratee(fn, &layout, links, ctx)) { return false; }
 
-	for(uint16_t i = 0; i < fn->num_functions; ++i)
+	for(uint32_t i = 0; i < fn->num_functions; ++i)
 	{
 		lip_function_t* nested_fn =
 			lip_function_resource(fn, layout.function_offsets[i]);
-		if(!lip_iterate_functions(nested_fn, iteratee, ctx)) { return false; }
+		lip_value_t* nested_links = links ? links + nested_fn->link_offset : NULL;
+		if(!lip_iterate_functions(nested_fn, nested_links, iteratee, ctx))
+		{
+			return false;
+		}
 	}
 
 	return true;
@@ -408,36 +516,38 @@ static bool
 lip_apply_import_iteratee(
 	lip_function_t* fn,
 	lip_function_layout_t* layout,
+	lip_value_t* links,
 	void* ctx_
 )
 {
 	struct lip_import_itr_ctx_s* ctx = ctx_;
 
-	for(uint16_t i = 0; i < fn->num_imports; ++i)
+	bool result = true;
+	for(uint32_t i = 0; i < fn->num_imports && result; ++i)
 	{
-		// Some imports are replaced with builtins ops
-		lip_loc_range_t loc;
-		if(!lip_import_referenced(fn, i, &loc)) { continue; }
+		if(layout->imports[i].kind != LIP_IMPORT_FUNCTION) { continue; }
 
 		lip_string_t* name = lip_function_resource(fn, layout->imports[i].name);
-		lip_string_ref_t module_name, function_name;
-		lip_string_ref_t symbol_name_ref = { .length = name->length, .ptr = name->ptr };
-		lip_split_fqn(symbol_name_ref, &module_name, &function_name);
+		lip_hashed_string_ref_t module_name, function_name;
+		// Names can be in a read-only mapping, their hash is not written back
+		lip_split_fqn(
+			lip_hashed_string_ref(lip_string_ref_from_string(name)),
+			&module_name, &function_name
+		);
 
-		if(!ctx->iteratee(
-			fn, &layout->imports[i], loc, module_name, function_name, ctx->user_ctx
-		))
-		{
-			return false;
-		}
+		result = ctx->iteratee(
+			fn, &layout->imports[i], links ? &links[i] : NULL,
+			module_name, function_name, ctx->user_ctx
+		);
 	}
 
-	return true;
+	return result;
 }
 
 static bool
 lip_iterate_imports(
 	lip_function_t* fn,
+	lip_value_t* links,
 	lip_import_iteratee_t iteratee,
 	void* ctx
 )
@@ -446,26 +556,39 @@ lip_iterate_imports(
 		.user_ctx = ctx,
 		.iteratee = iteratee
 	};
-	return lip_iterate_functions(fn, lip_apply_import_iteratee, &itr_ctx);
+	return lip_iterate_functions(fn, links, lip_apply_import_iteratee, &itr_ctx);
 }
 
-
 static bool
-lip_replace_import_instructions(
+lip_intern_symbols(
 	lip_function_t* fn,
 	lip_function_layout_t* layout,
-	void* ctx
+	lip_value_t* links,
+	void* ctx_
 )
 {
-	(void)ctx;
-	for(uint16_t i = 0; i < fn->num_instructions; ++i)
+	struct lip_link_ctx_s* link_ctx = ctx_;
+	lip_context_t* ctx = link_ctx->ctx;
+
+	for(uint32_t i = 0; i < fn->num_imports; ++i)
 	{
-		lip_instruction_t* instr = &layout->instructions[i];
-		lip_opcode_t opcode;
-		lip_operand_t operand;
-		lip_disasm(*instr, &opcode, &operand);
+		if(layout->imports[i].kind != LIP_IMPORT_SYMBOL) { continue; }
 
-		if(opcode == LIP_OP_IMP) { *instr = lip_asm(LIP_OP_IMPS, operand); }
+		lip_value_t* link = &links[i];
+		if(link->type != LIP_VAL_SYMBOL)
+		{
+			lip_string_t* name = lip_function_resource(fn, layout->imports[i].name);
+			lip_string_t* symbol = lip_intern_symbol(
+				ctx->runtime, lip_hashed_string_ref(lip_string_ref_from_string(name))
+			);
+			// LDS reports the error if it is still not interned when executed
+			if(symbol == NULL) { continue; }
+
+			*link = (lip_value_t) {
+				.type = LIP_VAL_SYMBOL,
+				.data = { .reference = symbol }
+			};
+		}
 	}
 
 	return true;
@@ -475,21 +598,21 @@ static bool
 lip_hard_link_import(
 	lip_function_t* fn,
 	lip_import_t* import,
-	lip_loc_range_t loc,
-	lip_string_ref_t module_name,
-	lip_string_ref_t symbol_name,
+	lip_value_t* link,
+	lip_hashed_string_ref_t module_name,
+	lip_hashed_string_ref_t symbol_name,
 	void* ctx_
 )
 {
 	(void)fn;
-	(void)loc;
+	(void)import;
 
 	struct lip_link_ctx_s* link_ctx = ctx_;
 	lip_context_t* ctx = link_ctx->ctx;
 	khash_t(lip_module)* module = link_ctx->module;
 
 	lip_symbol_t* symbol = NULL;
-	if(module_name.length == 0 && module != NULL)
+	if(module_name.str.length == 0 && module != NULL)
 	{
 		khiter_t itr =  kh_get(lip_module, module, symbol_name);
 		if(itr != kh_end(module)) { symbol = &kh_value(module, itr); }
@@ -504,7 +627,7 @@ lip_hard_link_import(
 
 	lip_assert(ctx, symbol != NULL);
 
-	import->value = (lip_value_t) {
+	*link = (lip_value_t) {
 		.type = LIP_VAL_FUNCTION,
 		.data = { .reference = symbol->value }
 	};
@@ -514,32 +637,36 @@ lip_hard_link_import(
 
 static void
 lip_hard_link_function(
-	lip_context_t* ctx, lip_function_t* fn, khash_t(lip_module)* module
+	lip_context_t* ctx, lip_closure_t* closure, khash_t(lip_module)* module
 )
 {
 	lip_assert(ctx, ctx->rt_read_lock_depth + ctx->rt_write_lock_depth > 0);
 
+	lip_function_t* fn = closure->function.lip;
 	struct lip_link_ctx_s link_ctx = {
 		.ctx = ctx,
 		.module = module,
 		.top_level_fn = fn
 	};
-	lip_iterate_imports(fn, lip_hard_link_import, &link_ctx);
-	lip_iterate_functions(fn, lip_replace_import_instructions, &link_ctx);
+	lip_iterate_imports(
+		fn, closure->links, lip_hard_link_import, &link_ctx
+	);
+	lip_iterate_functions(fn, closure->links, lip_intern_symbols, &link_ctx);
 }
 
 static bool
 lip_soft_link_import(
 	lip_function_t* fn,
 	lip_import_t* import,
-	lip_loc_range_t loc,
-	lip_string_ref_t module_name,
-	lip_string_ref_t symbol_name,
+	lip_value_t* link,
+	lip_hashed_string_ref_t module_name,
+	lip_hashed_string_ref_t symbol_name,
 	void* ctx_
 )
 {
+	(void)link;
+
 	lip_context_t* ctx = ctx_;
-	lip_string_t* import_name = lip_function_resource(fn, import->name);
 
 	// Try to resolve symbol using pending modules
 	khiter_t itr = kh_get(lip_symtab, ctx->loading_symtab, module_name);
@@ -553,7 +680,7 @@ lip_soft_link_import(
 		}
 		else
 		{
-			lip_set_undefined_symbol_error(ctx, fn, import_name, loc, false);
+			lip_set_undefined_symbol_error(ctx, fn, import, false);
 			return false;
 		}
 	}
@@ -570,15 +697,15 @@ lip_soft_link_import(
 		}
 		else
 		{
-			lip_set_undefined_symbol_error(ctx, fn, import_name, loc, false);
+			lip_set_undefined_symbol_error(ctx, fn, import, false);
 			return false;
 		}
 	}
 
 	// Try to load the referenced module
-	if(!lip_load_module(ctx, module_name))
+	if(!lip_load_module(ctx, module_name.str))
 	{
-		lip_set_undefined_symbol_error(ctx, fn, import_name, loc, true);
+		lip_set_undefined_symbol_error(ctx, fn, import, true);
 		return false;
 	}
 
@@ -589,7 +716,7 @@ lip_soft_link_import(
 	itr = kh_get(lip_module, module, symbol_name);
 	if(!(itr != kh_end(module) && kh_val(module, itr).is_public))
 	{
-		lip_set_undefined_symbol_error(ctx, fn, import_name, loc, false);
+		lip_set_undefined_symbol_error(ctx, fn, import, false);
 		return false;
 	}
 
@@ -597,15 +724,17 @@ lip_soft_link_import(
 }
 
 bool
-lip_link_function(lip_context_t* ctx, lip_function_t* fn)
+lip_link_closure(lip_context_t* ctx, lip_closure_t* closure)
 {
 	lip_assert(ctx, ctx->load_depth > 0);
-	bool linked = lip_iterate_imports(fn, lip_soft_link_import, ctx);
+	bool linked = lip_iterate_imports(
+		closure->function.lip, NULL, lip_soft_link_import, ctx
+	);
 
 	if(linked)
 	{
 		int ret;
-		kh_put(lip_ptr_set, ctx->new_script_functions, fn, &ret);
+		kh_put(lip_ptr_set, ctx->new_script_functions, closure, &ret);
 	}
 
 	return linked;
@@ -638,7 +767,7 @@ lip_ctx_end_load(lip_context_t* ctx)
 		kh_foreach(itr, ctx->new_script_functions)
 		{
 			lip_hard_link_function(
-				ctx, kh_key(ctx->new_script_functions, itr), NULL
+				ctx, (void*)kh_key(ctx->new_script_functions, itr), NULL
 			);
 		}
 	}
@@ -649,9 +778,9 @@ lip_ctx_end_load(lip_context_t* ctx)
 bool
 lip_lookup_symbol(lip_context_t* ctx, lip_string_ref_t symbol_name, lip_value_t* result)
 {
-	lip_string_ref_t module, symbol;
+	lip_hashed_string_ref_t module, symbol;
 
-	lip_split_fqn(symbol_name, &module, &symbol);
+	lip_split_fqn(lip_hashed_string_ref(symbol_name), &module, &symbol);
 
 	lip_ctx_begin_rt_read(ctx);
 	bool ret_val = lip_lookup_symbol_locked(ctx, module, symbol, result);
@@ -660,35 +789,47 @@ lip_lookup_symbol(lip_context_t* ctx, lip_string_ref_t symbol_name, lip_value_t*
 	return ret_val;
 }
 
+const lip_symbol_t*
+lip_find_declared_symbol(lip_context_t* ctx, lip_string_ref_t symbol_name)
+{
+	lip_assert(ctx, ctx->rt_read_lock_depth + ctx->rt_write_lock_depth > 0);
+
+	lip_hashed_string_ref_t module, symbol;
+	lip_split_fqn(lip_hashed_string_ref(symbol_name), &module, &symbol);
+	return lip_find_symbol_locked(ctx, module, symbol);
+}
+
 static bool
 lip_link_module_import_pre_exec(
 	lip_function_t* fn,
 	lip_import_t* import,
-	lip_loc_range_t loc,
-	lip_string_ref_t module_name,
-	lip_string_ref_t symbol_name,
+	lip_value_t* link,
+	lip_hashed_string_ref_t module_name,
+	lip_hashed_string_ref_t symbol_name,
 	void* ctx
 )
 {
 	// All built-ins and local functions will be checked post-exec
-	if(module_name.length == 0) { return true; }
+	if(module_name.str.length == 0) { return true; }
 
-	return lip_soft_link_import(fn, import, loc, module_name, symbol_name, ctx);
+	return lip_soft_link_import(fn, import, link, module_name, symbol_name, ctx);
 }
 
 static bool
 lip_link_module_pre_exec(lip_context_t* ctx, lip_function_t* fn)
 {
-	return lip_iterate_imports(fn, lip_link_module_import_pre_exec, ctx);
+	return lip_iterate_imports(
+		fn, NULL, lip_link_module_import_pre_exec, ctx
+	);
 }
 
 static bool
 lip_link_module_import_post_exec(
 	lip_function_t* fn,
 	lip_import_t* import,
-	lip_loc_range_t loc,
-	lip_string_ref_t module_name,
-	lip_string_ref_t symbol_name,
+	lip_value_t* link,
+	lip_hashed_string_ref_t module_name,
+	lip_hashed_string_ref_t symbol_name,
 	void* ctx_
 )
 {
@@ -696,7 +837,7 @@ lip_link_module_import_post_exec(
 	lip_context_t* ctx = link_ctx->ctx;
 	khash_t(lip_module)* module = link_ctx->module;
 
-	if(module_name.length == 0)
+	if(module_name.str.length == 0)
 	{
 		if(kh_get(lip_module, module, symbol_name) != kh_end(module))
 		{
@@ -705,18 +846,18 @@ lip_link_module_import_post_exec(
 
 		if(true
 			&& link_ctx->top_level_fn != fn
-			&& lip_string_ref_equal(symbol_name, lip_string_ref("declare"))
+			&& lip_string_ref_equal(symbol_name.str, lip_string_ref("declare"))
 		)
 		{
 			lip_set_link_error(
 				ctx, lip_string_ref("Cannot use `declare` inside a `declare`-d function"),
-				fn, loc, false
+				fn, import, false
 			);
 			return false;
 		}
 	}
 
-	return lip_soft_link_import(fn, import, loc, module_name, symbol_name, ctx);
+	return lip_soft_link_import(fn, import, link, module_name, symbol_name, ctx);
 }
 
 static bool
@@ -729,7 +870,9 @@ lip_link_module_post_exec(
 		.module = module,
 		.top_level_fn = fn
 	};
-	return lip_iterate_imports(fn, lip_link_module_import_post_exec, &link_ctx);
+	return lip_iterate_imports(
+		fn, NULL, lip_link_module_import_post_exec, &link_ctx
+	);
 }
 
 bool
@@ -769,8 +912,11 @@ lip_load_module(lip_context_t* ctx, lip_string_ref_t name)
 
 	lip_array_clear(ctx->error_records);
 
+	// Bundled modules are found without touching the filesystem
+	lip_function_t* bundled_fn = lip_find_bundled_module(ctx, name, &filename);
+
 	// Try all search patterns until the first one that matches an existing file
-	for(unsigned int i = 0; i < num_patterns; ++i)
+	for(unsigned int i = 0; bundled_fn == NULL && i < num_patterns; ++i)
 	{
 		lip_array(char) filename_buf = lip_array_create(ctx->module_pool, char, 512);
 		lip_string_ref_t pattern = patterns[i];
@@ -823,7 +969,7 @@ lip_load_module(lip_context_t* ctx, lip_string_ref_t name)
 		}
 	}
 
-	if(file == NULL)
+	if(file == NULL && bundled_fn == NULL)
 	{
 		lip_array(char) error_msg_buf = lip_array_create(ctx->module_pool, char, 64);
 		lip_sprintf(
@@ -843,8 +989,22 @@ lip_load_module(lip_context_t* ctx, lip_string_ref_t name)
 		returnVal(false);
 	}
 
-	script = lip_load_script(ctx, filename, file);
-	if(script == NULL) { returnVal(false); }
+	if(bundled_fn != NULL)
+	{
+		script = lip_new_script(ctx, bundled_fn, true, (lip_mapping_t){ .ptr = NULL });
+	}
+	else
+	{
+		// Let the script loader map the file if it can
+		if(fs->map != NULL)
+		{
+			fs->end_read(fs, file);
+			file = NULL;
+		}
+
+		script = lip_load_script(ctx, filename, file);
+		if(script == NULL) { returnVal(false); }
+	}
 
 	// Ignore all local or builtin references and let the dynamic linker deals
 	// with them
@@ -854,7 +1014,9 @@ lip_load_module(lip_context_t* ctx, lip_string_ref_t name)
 	}
 
 	khash_t(lip_module)* module = kh_init(lip_module, ctx->module_pool);
-	lip_string_ref_t name_copy = lip_copy_string_ref(ctx->module_pool, name);
+	lip_hashed_string_ref_t name_copy = lip_hashed_string_ref(
+		lip_copy_string_ref(ctx->module_pool, name)
+	);
 	khiter_t itr = kh_put(lip_symtab, ctx->loading_symtab, name_copy, &ret);
 	kh_val(ctx->loading_symtab, itr) = module;
 
@@ -884,15 +1046,22 @@ lip_load_module(lip_context_t* ctx, lip_string_ref_t name)
 			returnVal(false);
 		}
 
+		// Exported functions keep executing from the mapped file
+		if(script->mapping.ptr != NULL)
+		{
+			lip_array_push(ctx->runtime->mappings, script->mapping);
+			script->mapping.ptr = NULL;
+		}
+
 		// Copy out all declared name-function pairs because the script is going
 		// to be freed
 		kh_foreach(itr, module)
 		{
-			lip_string_ref_t* key = &kh_key(module, itr);
+			lip_hashed_string_ref_t* key = &kh_key(module, itr);
 			lip_symbol_t* value = &kh_val(module, itr);
 
-			value->value = lip_copy_closure(ctx->module_pool, value->value);
-			*key = lip_copy_string_ref(ctx->module_pool, *key);
+			value->value = lip_copy_closure(ctx->runtime, ctx->module_pool, value->value);
+			*key = lip_copy_hashed_string_ref(ctx->module_pool, *key);
 		}
 		returnVal(true);
 	}
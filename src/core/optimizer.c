@@ -0,0 +1,1144 @@
+#include <lip/core/ast.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <lip/core/memory.h>
+#include <lip/core/array.h>
+#include <lip/core/prim_ops.h>
+
+// Maximum number of nodes in the body of a lambda inlined at its call sites
+#define LIP_INLINE_MAX_SIZE 32
+
+typedef struct lip_optimizer_s lip_optimizer_t;
+typedef struct lip_local_s lip_local_t;
+typedef struct lip_substitution_s lip_substitution_t;
+typedef struct lip_ast_constant_s lip_ast_constant_t;
+
+struct lip_local_s
+{
+	lip_string_ref_t name;
+	// Lambda bound to this name which can be inlined
+	const lip_ast_t* inline_fn;
+	// Number of locals in scope where inline_fn was defined
+	size_t def_depth;
+};
+
+struct lip_substitution_s
+{
+	lip_string_ref_t name;
+	// NULL when name is shadowed
+	const lip_ast_t* replacement;
+};
+
+struct lip_optimizer_s
+{
+	lip_allocator_t* allocator;
+	lip_allocator_t* temp_allocator;
+	unsigned int level;
+	unsigned int next_id;
+	lip_array(lip_local_t) locals;
+};
+
+struct lip_ast_constant_s
+{
+	lip_value_type_t type;
+	union
+	{
+		double number;
+		bool boolean;
+		lip_string_ref_t string;
+	} data;
+};
+
+static lip_ast_t*
+lip_optimize_exp(lip_optimizer_t* opt, lip_ast_t* ast);
+
+static lip_local_t*
+lip_find_local(const lip_optimizer_t* opt, lip_string_ref_t name, size_t from)
+{
+	size_t num_locals = lip_array_len(opt->locals);
+	for(size_t i = num_locals; i > from; --i)
+	{
+		if(lip_string_ref_equal(name, opt->locals[i - 1].name))
+		{
+			return &opt->locals[i - 1];
+		}
+	}
+
+	return NULL;
+}
+
+static bool
+lip_is_local(const lip_optimizer_t* opt, lip_string_ref_t name)
+{
+	return lip_find_local(opt, name, 0) != NULL;
+}
+
+static void
+lip_push_local(lip_optimizer_t* opt, lip_string_ref_t name)
+{
+	lip_local_t local = { .name = name };
+	lip_array_push(opt->locals, local);
+}
+
+static bool
+lip_is_builtin(const lip_optimizer_t* opt, const lip_ast_t* ast, const char* name)
+{
+	return true
+		&& ast->type == LIP_AST_IDENTIFIER
+		&& lip_string_ref_equal(lip_string_ref(name), ast->data.string)
+		&& !lip_is_local(opt, ast->data.string);
+}
+
+static bool
+lip_ast_constant(
+	const lip_optimizer_t* opt,
+	const lip_ast_t* ast,
+	lip_ast_constant_t* constant
+)
+{
+	switch(ast->type)
+	{
+		case LIP_AST_NUMBER:
+			constant->type = LIP_VAL_NUMBER;
+			constant->data.number = ast->data.number;
+			return true;
+		case LIP_AST_STRING:
+			constant->type = LIP_VAL_STRING;
+			constant->data.string = ast->data.string;
+			return true;
+		case LIP_AST_IDENTIFIER:
+			if(lip_is_builtin(opt, ast, "true") || lip_is_builtin(opt, ast, "false"))
+			{
+				constant->type = LIP_VAL_BOOLEAN;
+				constant->data.boolean = ast->data.string.ptr[0] == 't';
+				return true;
+			}
+			else if(lip_is_builtin(opt, ast, "nil"))
+			{
+				constant->type = LIP_VAL_NIL;
+				return true;
+			}
+			else
+			{
+				return false;
+			}
+		default:
+			return false;
+	}
+}
+
+static bool
+lip_ast_truthiness(const lip_optimizer_t* opt, const lip_ast_t* ast, bool* truthy)
+{
+	lip_ast_constant_t constant;
+	if(ast->type == LIP_AST_SYMBOL || ast->type == LIP_AST_LAMBDA)
+	{
+		*truthy = true;
+		return true;
+	}
+	else if(lip_ast_constant(opt, ast, &constant))
+	{
+		*truthy = !(false
+			|| constant.type == LIP_VAL_NIL
+			|| (constant.type == LIP_VAL_BOOLEAN && !constant.data.boolean));
+		return true;
+	}
+	else
+	{
+		return false;
+	}
+}
+
+// Expressions which can be dropped when their value is not used
+static bool
+lip_ast_is_pure(const lip_optimizer_t* opt, const lip_ast_t* ast)
+{
+	switch(ast->type)
+	{
+		case LIP_AST_NUMBER:
+		case LIP_AST_STRING:
+		case LIP_AST_SYMBOL:
+		case LIP_AST_LAMBDA:
+			return true;
+		case LIP_AST_IDENTIFIER:
+			{
+				lip_ast_constant_t constant;
+				return lip_is_local(opt, ast->data.string)
+					|| lip_ast_constant(opt, ast, &constant);
+			}
+		default:
+			return false;
+	}
+}
+
+static bool
+lip_occurs(lip_string_ref_t name, const lip_ast_t* ast);
+
+static bool
+lip_occurs_in_block(lip_string_ref_t name, lip_array(lip_ast_t*) block)
+{
+	lip_array_foreach(lip_ast_t*, exp, block)
+	{
+		if(lip_occurs(name, *exp)) { return true; }
+	}
+
+	return false;
+}
+
+// Conservative: shadowing is ignored
+static bool
+lip_occurs(lip_string_ref_t name, const lip_ast_t* ast)
+{
+	switch(ast->type)
+	{
+		case LIP_AST_IDENTIFIER:
+			return lip_string_ref_equal(name, ast->data.string);
+		case LIP_AST_APPLICATION:
+			return lip_occurs(name, ast->data.application.function)
+				|| lip_occurs_in_block(name, ast->data.application.arguments);
+		case LIP_AST_IF:
+			return lip_occurs(name, ast->data.if_.condition)
+				|| lip_occurs(name, ast->data.if_.then)
+				|| (ast->data.if_.else_ && lip_occurs(name, ast->data.if_.else_));
+		case LIP_AST_LET:
+		case LIP_AST_LETREC:
+		case LIP_AST_LOOP:
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+			{
+				if(lip_occurs(name, binding->value)) { return true; }
+			}
+			return lip_occurs_in_block(name, ast->data.let.body);
+		case LIP_AST_LAMBDA:
+			return lip_occurs_in_block(name, ast->data.lambda.body);
+		case LIP_AST_DO:
+			return lip_occurs_in_block(name, ast->data.do_);
+		case LIP_AST_RECUR:
+			return lip_occurs_in_block(name, ast->data.recur);
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			return false;
+	}
+
+	return true;
+}
+
+static lip_ast_t*
+lip_copy_ast(lip_optimizer_t* opt, const lip_ast_t* ast)
+{
+	lip_ast_t* copy = lip_new(opt->allocator, lip_ast_t);
+	*copy = *ast;
+	return copy;
+}
+
+static lip_ast_t*
+lip_make_number_ast(lip_optimizer_t* opt, const lip_ast_t* ast, double number)
+{
+	// Keep results which the compiler can load exactly
+	if(!isfinite(number) || (number == 0.0 && signbit(number))) { return NULL; }
+
+	lip_ast_t* result = lip_copy_ast(opt, ast);
+	result->type = LIP_AST_NUMBER;
+	result->data.number = number;
+	return result;
+}
+
+static lip_ast_t*
+lip_make_identifier_ast(lip_optimizer_t* opt, const lip_ast_t* ast, const char* name)
+{
+	if(lip_is_local(opt, lip_string_ref(name))) { return NULL; }
+
+	lip_ast_t* result = lip_copy_ast(opt, ast);
+	result->type = LIP_AST_IDENTIFIER;
+	result->data.string = lip_string_ref(name);
+	return result;
+}
+
+static lip_ast_t*
+lip_make_boolean_ast(lip_optimizer_t* opt, const lip_ast_t* ast, bool boolean)
+{
+	return lip_make_identifier_ast(opt, ast, boolean ? "true" : "false");
+}
+
+#define lip_cmp_scalar(lhs, rhs) (((lhs) > (rhs)) - ((lhs) < (rhs)))
+
+// Same order as lip_gen_cmp
+static int
+lip_ast_constant_cmp(const lip_ast_constant_t* lhs, const lip_ast_constant_t* rhs)
+{
+	int type_cmp = (int)lhs->type - (int)rhs->type;
+	if(type_cmp != 0) { return type_cmp; }
+
+	switch(lhs->type)
+	{
+		case LIP_VAL_NUMBER:
+			return lip_cmp_scalar(lhs->data.number, rhs->data.number);
+		case LIP_VAL_BOOLEAN:
+			return lhs->data.boolean - rhs->data.boolean;
+		case LIP_VAL_STRING:
+			{
+				lip_string_ref_t lstr = lhs->data.string;
+				lip_string_ref_t rstr = rhs->data.string;
+				size_t min_len = LIP_MIN(lstr.length, rstr.length);
+				int cmp = min_len > 0 ? memcmp(lstr.ptr, rstr.ptr, min_len) : 0;
+				return cmp != 0 ? cmp : lip_cmp_scalar(lstr.length, rstr.length);
+			}
+		default:
+			return 0;
+	}
+}
+
+// Evaluate a prim op application with constant operands, NULL if it cannot be
+// done at compile-time
+static lip_ast_t*
+lip_fold_prim_op(lip_optimizer_t* opt, const lip_ast_t* ast)
+{
+	const lip_ast_t* function = ast->data.application.function;
+	if(function->type != LIP_AST_IDENTIFIER) { return NULL; }
+	if(lip_is_local(opt, function->data.string)) { return NULL; }
+
+	lip_string_ref_t name = function->data.string;
+	lip_array(lip_ast_t*) args = ast->data.application.arguments;
+	size_t num_args = lip_array_len(args);
+
+	lip_ast_constant_t lhs, rhs;
+	bool has_lhs = num_args >= 1 && lip_ast_constant(opt, args[0], &lhs);
+	bool has_rhs = num_args >= 2 && lip_ast_constant(opt, args[1], &rhs);
+	bool has_numbers = true
+		&& (num_args == 1 || num_args == 2)
+		&& has_lhs && lhs.type == LIP_VAL_NUMBER
+		&& (num_args == 1 || (has_rhs && rhs.type == LIP_VAL_NUMBER));
+
+	if(false
+		|| lip_string_ref_equal(lip_string_ref("+"), name)
+		|| lip_string_ref_equal(lip_string_ref("*"), name))
+	{
+		bool is_add = name.ptr[0] == '+';
+		double result = is_add ? 0.0 : 1.0;
+		for(size_t i = 0; i < num_args; ++i)
+		{
+			lip_ast_constant_t arg;
+			if(!lip_ast_constant(opt, args[i], &arg) || arg.type != LIP_VAL_NUMBER)
+			{
+				return NULL;
+			}
+
+			result = is_add ? result + arg.data.number : result * arg.data.number;
+		}
+
+		return lip_make_number_ast(opt, ast, result);
+	}
+	else if(lip_string_ref_equal(lip_string_ref("-"), name) && has_numbers)
+	{
+		return lip_make_number_ast(
+			opt, ast,
+			num_args == 1 ? -lhs.data.number : lhs.data.number - rhs.data.number
+		);
+	}
+	else if(lip_string_ref_equal(lip_string_ref("/"), name) && has_numbers)
+	{
+		return lip_make_number_ast(
+			opt, ast,
+			num_args == 1 ? 1.0 / lhs.data.number : lhs.data.number / rhs.data.number
+		);
+	}
+	else if(lip_string_ref_equal(lip_string_ref("!"), name) && num_args == 1)
+	{
+		bool truthy;
+		if(!lip_ast_truthiness(opt, args[0], &truthy)) { return NULL; }
+		return lip_make_boolean_ast(opt, ast, !truthy);
+	}
+
+	if(num_args != 2 || !has_lhs || !has_rhs) { return NULL; }
+
+	int cmp = lip_ast_constant_cmp(&lhs, &rhs);
+	if(lip_string_ref_equal(lip_string_ref("cmp"), name))
+	{
+		return lip_make_number_ast(opt, ast, cmp);
+	}
+
+#define LIP_FOLD_CMP_OP(op, id) \
+	if(lip_string_ref_equal(lip_string_ref(#op), name)) { \
+		return lip_make_boolean_ast(opt, ast, cmp op 0); \
+	}
+	LIP_CMP_OP(LIP_FOLD_CMP_OP)
+#undef LIP_FOLD_CMP_OP
+
+	return NULL;
+}
+
+// Optimize each expression of a block, flattening nested `do` and dropping
+// pure expressions whose value is discarded
+static lip_array(lip_ast_t*)
+lip_optimize_block(lip_optimizer_t* opt, lip_array(lip_ast_t*) block)
+{
+	size_t block_size = lip_array_len(block);
+	lip_array(lip_ast_t*) result = NULL;
+	for(size_t i = 0; i < block_size; ++i)
+	{
+		lip_ast_t* exp = lip_optimize_exp(opt, block[i]);
+		bool is_last = i == block_size - 1;
+		bool is_nested = exp->type == LIP_AST_DO && lip_array_len(exp->data.do_) > 0;
+		bool is_dead = !is_last && lip_ast_is_pure(opt, exp);
+
+		if(result == NULL && (exp != block[i] || is_nested || is_dead))
+		{
+			result = lip_array_create(opt->temp_allocator, lip_ast_t*, block_size);
+			for(size_t j = 0; j < i; ++j) { lip_array_push(result, block[j]); }
+		}
+
+		if(result == NULL || is_dead) { continue; }
+
+		if(is_nested)
+		{
+			size_t nested_size = lip_array_len(exp->data.do_);
+			for(size_t j = 0; j < nested_size; ++j)
+			{
+				lip_ast_t* nested_exp = exp->data.do_[j];
+				bool is_nested_last = is_last && j == nested_size - 1;
+				if(is_nested_last || !lip_ast_is_pure(opt, nested_exp))
+				{
+					lip_array_push(result, nested_exp);
+				}
+			}
+		}
+		else
+		{
+			lip_array_push(result, exp);
+		}
+	}
+
+	if(result == NULL) { return block; }
+
+	// Arrays from the AST allocator may not be able to grow
+	size_t result_size = lip_array_len(result);
+	lip_array(lip_ast_t*) new_block =
+		lip_array_create(opt->allocator, lip_ast_t*, result_size);
+	lip_array_resize(new_block, result_size);
+	memcpy(new_block, result, sizeof(lip_ast_t*) * result_size);
+	lip_array_destroy(result);
+	return new_block;
+}
+
+static lip_ast_t*
+lip_make_block_ast(
+	lip_optimizer_t* opt, const lip_ast_t* ast, lip_array(lip_ast_t*) block
+)
+{
+	if(lip_array_len(block) == 1) { return block[0]; }
+
+	lip_ast_t* result = lip_copy_ast(opt, ast);
+	result->type = LIP_AST_DO;
+	result->data.do_ = block;
+	return result;
+}
+
+static bool
+lip_ast_fits(const lip_ast_t* ast, size_t* budget);
+
+static bool
+lip_block_fits(lip_array(lip_ast_t*) block, size_t* budget)
+{
+	lip_array_foreach(lip_ast_t*, exp, block)
+	{
+		if(!lip_ast_fits(*exp, budget)) { return false; }
+	}
+
+	return true;
+}
+
+// Whether ast has at most *budget nodes, *budget is reduced by its size
+static bool
+lip_ast_fits(const lip_ast_t* ast, size_t* budget)
+{
+	if(*budget == 0) { return false; }
+	--*budget;
+
+	switch(ast->type)
+	{
+		case LIP_AST_APPLICATION:
+			return lip_ast_fits(ast->data.application.function, budget)
+				&& lip_block_fits(ast->data.application.arguments, budget);
+		case LIP_AST_IF:
+			return lip_ast_fits(ast->data.if_.condition, budget)
+				&& lip_ast_fits(ast->data.if_.then, budget)
+				&& (!ast->data.if_.else_ || lip_ast_fits(ast->data.if_.else_, budget));
+		case LIP_AST_LET:
+		case LIP_AST_LETREC:
+		case LIP_AST_LOOP:
+			lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+			{
+				if(!lip_ast_fits(binding->value, budget)) { return false; }
+			}
+			return lip_block_fits(ast->data.let.body, budget);
+		case LIP_AST_LAMBDA:
+			return lip_block_fits(ast->data.lambda.body, budget);
+		case LIP_AST_DO:
+			return lip_block_fits(ast->data.do_, budget);
+		case LIP_AST_RECUR:
+			return lip_block_fits(ast->data.recur, budget);
+		case LIP_AST_IDENTIFIER:
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			return true;
+	}
+
+	return true;
+}
+
+static void
+lip_set_inline_fn(
+	lip_optimizer_t* opt, size_t index, size_t def_depth, const lip_ast_t* value
+)
+{
+	size_t budget = LIP_INLINE_MAX_SIZE;
+	bool can_inline = true
+		&& opt->level >= 2
+		&& value->type == LIP_AST_LAMBDA
+		&& !value->data.lambda.is_vararg
+		&& lip_array_len(value->data.lambda.body) > 0
+		&& lip_block_fits(value->data.lambda.body, &budget);
+
+	opt->locals[index].inline_fn = can_inline ? value : NULL;
+	opt->locals[index].def_depth = def_depth;
+}
+
+static bool
+lip_is_rebound(
+	const lip_optimizer_t* opt,
+	const lip_ast_t* ast,
+	lip_array(lip_string_ref_t)* bound,
+	size_t def_depth
+);
+
+static bool
+lip_block_is_rebound(
+	const lip_optimizer_t* opt,
+	lip_array(lip_ast_t*) block,
+	lip_array(lip_string_ref_t)* bound,
+	size_t def_depth
+)
+{
+	lip_array_foreach(lip_ast_t*, exp, block)
+	{
+		if(lip_is_rebound(opt, *exp, bound, def_depth)) { return true; }
+	}
+
+	return false;
+}
+
+// Whether a free variable of ast now refers to a local introduced after
+// def_depth instead of the one it referred to where ast was defined
+static bool
+lip_is_rebound(
+	const lip_optimizer_t* opt,
+	const lip_ast_t* ast,
+	lip_array(lip_string_ref_t)* bound,
+	size_t def_depth
+)
+{
+	size_t num_bound = lip_array_len(*bound);
+	bool result = false;
+	switch(ast->type)
+	{
+		case LIP_AST_IDENTIFIER:
+			for(size_t i = 0; i < num_bound; ++i)
+			{
+				if(lip_string_ref_equal(ast->data.string, (*bound)[i])) { return false; }
+			}
+			return lip_find_local(opt, ast->data.string, def_depth) != NULL;
+		case LIP_AST_APPLICATION:
+			return lip_is_rebound(opt, ast->data.application.function, bound, def_depth)
+				|| lip_block_is_rebound(opt, ast->data.application.arguments, bound, def_depth);
+		case LIP_AST_IF:
+			return lip_is_rebound(opt, ast->data.if_.condition, bound, def_depth)
+				|| lip_is_rebound(opt, ast->data.if_.then, bound, def_depth)
+				|| (ast->data.if_.else_
+					&& lip_is_rebound(opt, ast->data.if_.else_, bound, def_depth));
+		case LIP_AST_LET:
+		case LIP_AST_LETREC:
+		case LIP_AST_LOOP:
+			{
+				bool is_recursive = ast->type == LIP_AST_LETREC;
+				if(is_recursive)
+				{
+					lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+					{
+						lip_array_push(*bound, binding->name);
+					}
+				}
+
+				lip_array_foreach(lip_let_binding_t, binding, ast->data.let.bindings)
+				{
+					result = result || lip_is_rebound(opt, binding->value, bound, def_depth);
+					if(!is_recursive) { lip_array_push(*bound, binding->name); }
+				}
+
+				result = result
+					|| lip_block_is_rebound(opt, ast->data.let.body, bound, def_depth);
+			}
+			break;
+		case LIP_AST_LAMBDA:
+			lip_array_foreach(lip_string_ref_t, arg, ast->data.lambda.arguments)
+			{
+				lip_array_push(*bound, *arg);
+			}
+			result = lip_block_is_rebound(opt, ast->data.lambda.body, bound, def_depth);
+			break;
+		case LIP_AST_DO:
+			return lip_block_is_rebound(opt, ast->data.do_, bound, def_depth);
+		case LIP_AST_RECUR:
+			return lip_block_is_rebound(opt, ast->data.recur, bound, def_depth);
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			return false;
+	}
+
+	lip_array_resize(*bound, num_bound);
+	return result;
+}
+
+static void
+lip_shadow(lip_array(lip_substitution_t)* substs, lip_string_ref_t name)
+{
+	lip_substitution_t subst = { .name = name };
+	lip_array_push(*substs, subst);
+}
+
+static lip_ast_t*
+lip_substitute(
+	lip_optimizer_t* opt,
+	const lip_ast_t* ast,
+	lip_array(lip_substitution_t)* substs
+);
+
+static lip_array(lip_ast_t*)
+lip_substitute_block(
+	lip_optimizer_t* opt,
+	lip_array(lip_ast_t*) block,
+	lip_array(lip_substitution_t)* substs
+)
+{
+	lip_array(lip_ast_t*) result =
+		lip_array_create(opt->allocator, lip_ast_t*, lip_array_len(block));
+	lip_array_foreach(lip_ast_t*, exp, block)
+	{
+		lip_array_push(result, lip_substitute(opt, *exp, substs));
+	}
+
+	return result;
+}
+
+// Deep copy of ast with free occurences of the substituted names replaced
+static lip_ast_t*
+lip_substitute(
+	lip_optimizer_t* opt,
+	const lip_ast_t* ast,
+	lip_array(lip_substitution_t)* substs
+)
+{
+	size_t num_substs = lip_array_len(*substs);
+	lip_ast_t* copy = lip_copy_ast(opt, ast);
+	switch(ast->type)
+	{
+		case LIP_AST_IDENTIFIER:
+			for(size_t i = num_substs; i > 0; --i)
+			{
+				const lip_substitution_t* subst = &(*substs)[i - 1];
+				if(lip_string_ref_equal(subst->name, ast->data.string))
+				{
+					if(subst->replacement)
+					{
+						*copy = *subst->replacement;
+						copy->location = ast->location;
+					}
+					break;
+				}
+			}
+			break;
+		case LIP_AST_APPLICATION:
+			copy->data.application.function =
+				lip_substitute(opt, ast->data.application.function, substs);
+			copy->data.application.arguments =
+				lip_substitute_block(opt, ast->data.application.arguments, substs);
+			break;
+		case LIP_AST_IF:
+			copy->data.if_.condition = lip_substitute(opt, ast->data.if_.condition, substs);
+			copy->data.if_.then = lip_substitute(opt, ast->data.if_.then, substs);
+			copy->data.if_.else_ = ast->data.if_.else_
+				? lip_substitute(opt, ast->data.if_.else_, substs)
+				: NULL;
+			break;
+		case LIP_AST_LET:
+		case LIP_AST_LETREC:
+		case LIP_AST_LOOP:
+			{
+				bool is_recursive = ast->type == LIP_AST_LETREC;
+				lip_array(lip_let_binding_t) bindings = ast->data.let.bindings;
+				lip_array(lip_let_binding_t) new_bindings = lip_array_create(
+					opt->allocator, lip_let_binding_t, lip_array_len(bindings)
+				);
+
+				if(is_recursive)
+				{
+					lip_array_foreach(lip_let_binding_t, binding, bindings)
+					{
+						lip_shadow(substs, binding->name);
+					}
+				}
+
+				lip_array_foreach(lip_let_binding_t, binding, bindings)
+				{
+					lip_let_binding_t new_binding = *binding;
+					new_binding.value = lip_substitute(opt, binding->value, substs);
+					lip_array_push(new_bindings, new_binding);
+
+					if(!is_recursive) { lip_shadow(substs, binding->name); }
+				}
+
+				copy->data.let.bindings = new_bindings;
+				copy->data.let.body = lip_substitute_block(opt, ast->data.let.body, substs);
+			}
+			break;
+		case LIP_AST_LAMBDA:
+			lip_array_foreach(lip_string_ref_t, arg, ast->data.lambda.arguments)
+			{
+				lip_shadow(substs, *arg);
+			}
+			copy->data.lambda.body = lip_substitute_block(opt, ast->data.lambda.body, substs);
+			break;
+		case LIP_AST_DO:
+			copy->data.do_ = lip_substitute_block(opt, ast->data.do_, substs);
+			break;
+		case LIP_AST_RECUR:
+			copy->data.recur = lip_substitute_block(opt, ast->data.recur, substs);
+			break;
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			break;
+	}
+
+	lip_array_resize(*substs, num_substs);
+	return copy;
+}
+
+static lip_string_ref_t
+lip_fresh_name(lip_optimizer_t* opt, lip_string_ref_t name)
+{
+	// The leading space keeps it apart from every name the parser can produce
+	size_t size = name.length + 16;
+	char* buf = lip_malloc(opt->allocator, size);
+	int length = snprintf(
+		buf, size, " %.*s#%u", (int)name.length, name.ptr, opt->next_id++
+	);
+	return (lip_string_ref_t){ .length = (size_t)length, .ptr = buf };
+}
+
+static bool
+lip_is_literal(const lip_ast_t* ast)
+{
+	return ast->type == LIP_AST_NUMBER
+		|| ast->type == LIP_AST_STRING
+		|| ast->type == LIP_AST_SYMBOL;
+}
+
+// Replace a call to a known lambda with a copy of its body, NULL if it cannot
+// be done
+static lip_ast_t*
+lip_inline_call(lip_optimizer_t* opt, const lip_ast_t* ast)
+{
+	const lip_ast_t* function = ast->data.application.function;
+	size_t num_locals = lip_array_len(opt->locals);
+	const lip_ast_t* lambda;
+	size_t def_depth;
+	if(function->type == LIP_AST_LAMBDA)
+	{
+		lambda = function;
+		def_depth = num_locals;
+	}
+	else if(function->type == LIP_AST_IDENTIFIER)
+	{
+		const lip_local_t* local = lip_find_local(opt, function->data.string, 0);
+		if(local == NULL || local->inline_fn == NULL) { return NULL; }
+
+		lambda = local->inline_fn;
+		def_depth = local->def_depth;
+	}
+	else
+	{
+		return NULL;
+	}
+
+	lip_array(lip_string_ref_t) params = lambda->data.lambda.arguments;
+	lip_array(lip_ast_t*) args = ast->data.application.arguments;
+	size_t num_args = lip_array_len(args);
+	bool can_inline = true
+		&& !lambda->data.lambda.is_vararg
+		&& num_args == lip_array_len(params)
+		&& lip_array_len(lambda->data.lambda.body) > 0;
+	if(!can_inline) { return NULL; }
+
+	// Free variables of the body must still refer to the same bindings
+	if(def_depth < num_locals)
+	{
+		lip_array(lip_string_ref_t) bound =
+			lip_array_create(opt->temp_allocator, lip_string_ref_t, num_args + 1);
+		for(size_t i = 0; i < num_args; ++i) { lip_array_push(bound, params[i]); }
+
+		bool is_rebound =
+			lip_block_is_rebound(opt, lambda->data.lambda.body, &bound, def_depth);
+		lip_array_destroy(bound);
+		if(is_rebound) { return NULL; }
+	}
+
+	// Literal arguments are substituted, the others are bound to fresh names
+	lip_array(lip_substitution_t) substs =
+		lip_array_create(opt->temp_allocator, lip_substitution_t, num_args + 1);
+	for(size_t i = 0; i < num_args; ++i)
+	{
+		lip_ast_t* replacement = args[i];
+		if(!lip_is_literal(args[i]))
+		{
+			replacement = lip_copy_ast(opt, args[i]);
+			replacement->type = LIP_AST_IDENTIFIER;
+			replacement->data.string = lip_fresh_name(opt, params[i]);
+		}
+
+		lip_substitution_t subst = { .name = params[i], .replacement = replacement };
+		lip_array_push(substs, subst);
+	}
+
+	lip_array(lip_ast_t*) body =
+		lip_substitute_block(opt, lambda->data.lambda.body, &substs);
+
+	// Arguments are evaluated from right to left
+	lip_array(lip_let_binding_t) bindings =
+		lip_array_create(opt->allocator, lip_let_binding_t, num_args);
+	for(size_t i = num_args; i > 0; --i)
+	{
+		lip_ast_t* arg = args[i - 1];
+		if(lip_is_literal(arg)) { continue; }
+
+		lip_string_ref_t name = substs[i - 1].replacement->data.string;
+		if(lip_ast_is_pure(opt, arg) && !lip_occurs_in_block(name, body)) { continue; }
+
+		lip_let_binding_t binding = {
+			.name = name,
+			.value = arg,
+			.location = arg->location
+		};
+		lip_array_push(bindings, binding);
+		lip_push_local(opt, name);
+	}
+	lip_array_destroy(substs);
+
+	// Arguments may now be foldable in the body
+	body = lip_optimize_block(opt, body);
+	lip_array_resize(opt->locals, num_locals);
+
+	if(lip_array_len(bindings) == 0) { return lip_make_block_ast(opt, ast, body); }
+
+	lip_ast_t* result = lip_copy_ast(opt, ast);
+	result->type = LIP_AST_LET;
+	result->data.let.bindings = bindings;
+	result->data.let.body = body;
+	return result;
+}
+
+static lip_ast_t*
+lip_optimize_application(lip_optimizer_t* opt, lip_ast_t* ast)
+{
+	lip_ast_t* function = lip_optimize_exp(opt, ast->data.application.function);
+	lip_array(lip_ast_t*) args = ast->data.application.arguments;
+	size_t num_args = lip_array_len(args);
+	lip_array(lip_ast_t*) new_args = NULL;
+	for(size_t i = 0; i < num_args; ++i)
+	{
+		lip_ast_t* arg = lip_optimize_exp(opt, args[i]);
+		if(new_args == NULL && arg != args[i])
+		{
+			new_args = lip_array_create(opt->allocator, lip_ast_t*, num_args);
+			for(size_t j = 0; j < i; ++j) { lip_array_push(new_args, args[j]); }
+		}
+
+		if(new_args != NULL) { lip_array_push(new_args, arg); }
+	}
+
+	if(function != ast->data.application.function || new_args != NULL)
+	{
+		ast = lip_copy_ast(opt, ast);
+		ast->data.application.function = function;
+		ast->data.application.arguments = new_args != NULL ? new_args : args;
+	}
+
+	if(opt->level >= 2)
+	{
+		lip_ast_t* inlined = lip_inline_call(opt, ast);
+		if(inlined != NULL) { return inlined; }
+	}
+
+	lip_ast_t* folded = lip_fold_prim_op(opt, ast);
+	return folded != NULL ? folded : ast;
+}
+
+static lip_ast_t*
+lip_optimize_if(lip_optimizer_t* opt, lip_ast_t* ast)
+{
+	lip_ast_t* condition = lip_optimize_exp(opt, ast->data.if_.condition);
+	lip_ast_t* then = lip_optimize_exp(opt, ast->data.if_.then);
+	lip_ast_t* else_ = ast->data.if_.else_
+		? lip_optimize_exp(opt, ast->data.if_.else_)
+		: NULL;
+
+	bool truthy;
+	if(lip_ast_truthiness(opt, condition, &truthy))
+	{
+		if(truthy) { return then; }
+		if(else_) { return else_; }
+
+		lip_ast_t* nil = lip_make_identifier_ast(opt, ast, "nil");
+		if(nil) { return nil; }
+	}
+
+	if(false
+		|| condition != ast->data.if_.condition
+		|| then != ast->data.if_.then
+		|| else_ != ast->data.if_.else_)
+	{
+		ast = lip_copy_ast(opt, ast);
+		ast->data.if_.condition = condition;
+		ast->data.if_.then = then;
+		ast->data.if_.else_ = else_;
+	}
+
+	return ast;
+}
+
+static bool
+lip_binding_is_used(
+	lip_array(lip_let_binding_t) bindings,
+	size_t index,
+	bool is_recursive,
+	lip_array(lip_ast_t*) body
+)
+{
+	lip_string_ref_t name = bindings[index].name;
+	size_t num_bindings = lip_array_len(bindings);
+	for(size_t i = is_recursive ? 0 : index + 1; i < num_bindings; ++i)
+	{
+		if(lip_occurs(name, bindings[i].value)) { return true; }
+	}
+
+	return lip_occurs_in_block(name, body);
+}
+
+static lip_ast_t*
+lip_optimize_let(lip_optimizer_t* opt, lip_ast_t* ast)
+{
+	bool is_recursive = ast->type == LIP_AST_LETREC;
+	size_t num_locals = lip_array_len(opt->locals);
+	lip_array(lip_let_binding_t) bindings = ast->data.let.bindings;
+	size_t num_bindings = lip_array_len(bindings);
+
+	// A lambda referring to any name of its group is never inlined so the
+	// others can be inlined anywhere in the group
+	for(size_t i = 0; is_recursive && i < num_bindings; ++i)
+	{
+		lip_push_local(opt, bindings[i].name);
+		lip_set_inline_fn(opt, num_locals + i, num_locals, bindings[i].value);
+	}
+
+	lip_array(lip_let_binding_t) new_bindings =
+		lip_array_create(opt->allocator, lip_let_binding_t, num_bindings);
+	bool* is_pure = lip_malloc(opt->allocator, sizeof(bool) * num_bindings);
+	bool changed = false;
+	for(size_t i = 0; i < num_bindings; ++i)
+	{
+		lip_let_binding_t binding = bindings[i];
+		binding.value = lip_optimize_exp(opt, binding.value);
+		changed = changed || binding.value != bindings[i].value;
+		is_pure[i] = lip_ast_is_pure(opt, binding.value);
+		lip_array_push(new_bindings, binding);
+
+		if(is_recursive)
+		{
+			lip_set_inline_fn(opt, num_locals + i, num_locals, binding.value);
+		}
+		else
+		{
+			size_t index = lip_array_len(opt->locals);
+			lip_push_local(opt, binding.name);
+			lip_set_inline_fn(opt, index, index, binding.value);
+		}
+	}
+
+	lip_array(lip_ast_t*) body = lip_optimize_block(opt, ast->data.let.body);
+	changed = changed || body != ast->data.let.body;
+
+	// Drop unused bindings without side effects
+	size_t out_index = 0;
+	for(size_t i = 0; i < num_bindings; ++i)
+	{
+		bool is_dead = true
+			&& is_pure[i]
+			&& !lip_binding_is_used(new_bindings, i, is_recursive, body);
+		if(is_dead)
+		{
+			changed = true;
+		}
+		else
+		{
+			new_bindings[out_index++] = new_bindings[i];
+		}
+	}
+	lip_array_resize(new_bindings, out_index);
+
+	lip_free(opt->allocator, is_pure);
+	lip_array_resize(opt->locals, num_locals);
+
+	if(!changed) { return ast; }
+	if(out_index == 0) { return lip_make_block_ast(opt, ast, body); }
+
+	ast = lip_copy_ast(opt, ast);
+	ast->data.let.bindings = new_bindings;
+	ast->data.let.body = body;
+	return ast;
+}
+
+// Loop variables change with each iteration so they are neither inlined nor
+// dropped
+static lip_ast_t*
+lip_optimize_loop(lip_optimizer_t* opt, lip_ast_t* ast)
+{
+	size_t num_locals = lip_array_len(opt->locals);
+	lip_array(lip_let_binding_t) bindings = ast->data.let.bindings;
+	size_t num_bindings = lip_array_len(bindings);
+
+	lip_array(lip_let_binding_t) new_bindings =
+		lip_array_create(opt->allocator, lip_let_binding_t, num_bindings);
+	bool changed = false;
+	for(size_t i = 0; i < num_bindings; ++i)
+	{
+		lip_let_binding_t binding = bindings[i];
+		binding.value = lip_optimize_exp(opt, binding.value);
+		changed = changed || binding.value != bindings[i].value;
+		lip_array_push(new_bindings, binding);
+		lip_push_local(opt, binding.name);
+	}
+
+	lip_array(lip_ast_t*) body = lip_optimize_block(opt, ast->data.let.body);
+	changed = changed || body != ast->data.let.body;
+	lip_array_resize(opt->locals, num_locals);
+
+	if(!changed) { return ast; }
+
+	ast = lip_copy_ast(opt, ast);
+	ast->data.let.bindings = new_bindings;
+	ast->data.let.body = body;
+	return ast;
+}
+
+static lip_ast_t*
+lip_optimize_recur(lip_optimizer_t* opt, lip_ast_t* ast)
+{
+	lip_array(lip_ast_t*) args = ast->data.recur;
+	size_t num_args = lip_array_len(args);
+	lip_array(lip_ast_t*) new_args = NULL;
+	for(size_t i = 0; i < num_args; ++i)
+	{
+		lip_ast_t* arg = lip_optimize_exp(opt, args[i]);
+		if(new_args == NULL && arg != args[i])
+		{
+			new_args = lip_array_create(opt->allocator, lip_ast_t*, num_args);
+			for(size_t j = 0; j < i; ++j) { lip_array_push(new_args, args[j]); }
+		}
+
+		if(new_args != NULL) { lip_array_push(new_args, arg); }
+	}
+
+	if(new_args == NULL) { return ast; }
+
+	ast = lip_copy_ast(opt, ast);
+	ast->data.recur = new_args;
+	return ast;
+}
+
+static lip_ast_t*
+lip_optimize_lambda(lip_optimizer_t* opt, lip_ast_t* ast)
+{
+	size_t num_locals = lip_array_len(opt->locals);
+	lip_array_foreach(lip_string_ref_t, arg, ast->data.lambda.arguments)
+	{
+		lip_push_local(opt, *arg);
+	}
+
+	lip_array(lip_ast_t*) body = lip_optimize_block(opt, ast->data.lambda.body);
+	lip_array_resize(opt->locals, num_locals);
+
+	if(body != ast->data.lambda.body)
+	{
+		ast = lip_copy_ast(opt, ast);
+		ast->data.lambda.body = body;
+	}
+
+	return ast;
+}
+
+static lip_ast_t*
+lip_optimize_exp(lip_optimizer_t* opt, lip_ast_t* ast)
+{
+	switch(ast->type)
+	{
+		case LIP_AST_APPLICATION:
+			return lip_optimize_application(opt, ast);
+		case LIP_AST_IF:
+			return lip_optimize_if(opt, ast);
+		case LIP_AST_LET:
+		case LIP_AST_LETREC:
+			return lip_optimize_let(opt, ast);
+		case LIP_AST_LAMBDA:
+			return lip_optimize_lambda(opt, ast);
+		case LIP_AST_LOOP:
+			return lip_optimize_loop(opt, ast);
+		case LIP_AST_RECUR:
+			return lip_optimize_recur(opt, ast);
+		case LIP_AST_DO:
+			{
+				lip_array(lip_ast_t*) block = lip_optimize_block(opt, ast->data.do_);
+				if(block == ast->data.do_ && lip_array_len(block) != 1) { return ast; }
+				return lip_make_block_ast(opt, ast, block);
+			}
+		case LIP_AST_IDENTIFIER:
+		case LIP_AST_SYMBOL:
+		case LIP_AST_STRING:
+		case LIP_AST_NUMBER:
+			return ast;
+	}
+
+	return ast;
+}
+
+lip_ast_t*
+lip_optimize_ast(
+	lip_allocator_t* allocator,
+	lip_allocator_t* temp_allocator,
+	lip_ast_t* ast,
+	unsigned int level
+)
+{
+	if(level == 0) { return ast; }
+
+	lip_optimizer_t opt = {
+		.allocator = allocator,
+		.temp_allocator = temp_allocator,
+		.level = level,
+		.locals = lip_array_create(temp_allocator, lip_local_t, 16)
+	};
+	lip_ast_t* result = lip_optimize_exp(&opt, ast);
+	lip_array_destroy(opt.locals);
+	return result;
+}
@@ -3,6 +3,7 @@
 #include <lip/core/extra.h>
 #include <string.h>
 #include "utils.h"
+#include "vendor/xxhash.h"
 
 #define lip_prim_op_bind_args(...) \
 	const unsigned int arity_min = 0 + lip_pp_map(lip_bind_count_arity, __VA_ARGS__); \
@@ -65,47 +66,226 @@ LIP_PRIM_OP_FN(NOT)
 	lip_return(lip_make_boolean(vm, is_false));
 }
 
+#define lip_cmp_scalar(lhs, rhs) (((lhs) > (rhs)) - ((lhs) < (rhs)))
+
+// Find the smallest entry whose key is greater than `prev`, or the smallest one
+// if `prev` is NULL
+static bool
+lip_map_next_ordered(
+	const lip_map_t* map,
+	const lip_value_t* prev,
+	lip_value_t* key,
+	lip_value_t* value
+)
+{
+	bool found = false;
+	lip_map_iterator_t itr;
+	lip_value_t entry_key, entry_value;
+	for(lip_map_begin(map, &itr); lip_map_next(&itr, &entry_key, &entry_value);)
+	{
+		if(true
+			&& (prev == NULL || lip_gen_cmp(entry_key, *prev) > 0)
+			&& (!found || lip_gen_cmp(entry_key, *key) < 0)
+		)
+		{
+			*key = entry_key;
+			*value = entry_value;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
 static int
+lip_map_cmp(const lip_map_t* lmap, const lip_map_t* rmap)
+{
+	int size_cmp = lip_cmp_scalar(lmap->size, rmap->size);
+	if(size_cmp != 0) { return size_cmp; }
+
+	lip_map_iterator_t itr;
+	lip_value_t key, lvalue, rvalue;
+	bool equal = true;
+	for(lip_map_begin(lmap, &itr); equal && lip_map_next(&itr, &key, &lvalue);)
+	{
+		equal = lip_map_get(rmap, key, &rvalue) && lip_gen_cmp(lvalue, rvalue) == 0;
+	}
+	if(equal) { return 0; }
+
+	// Order unequal maps as their entries sorted by key. This is quadratic
+	// but it does not allocate and equal maps never get here.
+	lip_value_t lkey, rkey, lprev, rprev;
+	for(size_t i = 0; i < lmap->size; ++i)
+	{
+		lip_map_next_ordered(lmap, i > 0 ? &lprev : NULL, &lkey, &lvalue);
+		lip_map_next_ordered(rmap, i > 0 ? &rprev : NULL, &rkey, &rvalue);
+
+		int cmp = lip_gen_cmp(lkey, rkey);
+		if(cmp == 0) { cmp = lip_gen_cmp(lvalue, rvalue); }
+		if(cmp != 0) { return cmp; }
+
+		lprev = lkey;
+		rprev = rkey;
+	}
+
+	return 0;
+}
+
+// Borrowed buffers behave as strings
+static lip_value_type_t
+lip_value_type_class(lip_value_type_t type)
+{
+	return type == LIP_VAL_BUFFER ? LIP_VAL_STRING : type;
+}
+
+int
 lip_gen_cmp(lip_value_t lhs, lip_value_t rhs)
 {
-	int type_cmp = lhs.type - rhs.type;
+	lip_value_type_t type = lip_value_type_class(lhs.type);
+	int type_cmp = (int)type - (int)lip_value_type_class(rhs.type);
 	if(LIP_UNLIKELY(type_cmp != 0)) { return type_cmp; }
 
-	switch(lhs.type)
+	switch(type)
 	{
 		case LIP_VAL_NIL:
 			return 0;
 		case LIP_VAL_NUMBER:
-			return lhs.data.number - rhs.data.number;
+			return lip_number_cmp(lhs.data.number, rhs.data.number);
 		case LIP_VAL_BOOLEAN:
 			return lhs.data.boolean - rhs.data.boolean;
+		case LIP_VAL_SYMBOL:
+			// Symbols are interned so equal ones are identical, but they are
+			// still ordered by name like strings
+			if(lhs.data.reference == rhs.data.reference) { return 0; }
+			// fallthrough
 		case LIP_VAL_STRING:
 			{
-				lip_string_t* lstr = lip_as_string(lhs);
-				lip_string_t* rstr = lip_as_string(rhs);
-				size_t min_len = LIP_MIN(lstr->length, rstr->length);
-				int cmp = memcmp(lstr->ptr, rstr->ptr, min_len);
-				return cmp != 0 ? cmp : (int)(lstr->length - rstr->length);
+				lip_string_ref_t lstr = lip_as_string_ref(&lhs);
+				lip_string_ref_t rstr = lip_as_string_ref(&rhs);
+				size_t min_len = LIP_MIN(lstr.length, rstr.length);
+				int cmp = memcmp(lstr.ptr, rstr.ptr, min_len);
+				return cmp != 0 ? cmp : lip_cmp_scalar(lstr.length, rstr.length);
 			}
 			break;
 		case LIP_VAL_PLACEHOLDER:
-			return lhs.data.index - rhs.data.index;
+			return lip_cmp_scalar(lhs.data.index, rhs.data.index);
 		case LIP_VAL_LIST:
 			{
 				const lip_list_t* llist = lip_as_list(lhs);
 				const lip_list_t* rlist = lip_as_list(rhs);
 
-				size_t cmp_len = LIP_MIN(llist->length, rlist->length);
-				for(size_t i = 0; i < cmp_len; ++i)
+				lip_list_iterator_t litr, ritr;
+				lip_value_t lelem, relem;
+				lip_list_begin(llist, &litr);
+				lip_list_begin(rlist, &ritr);
+				while(lip_list_next(&litr, &lelem) && lip_list_next(&ritr, &relem))
 				{
-					int cmp = lip_gen_cmp(llist->elements[i], rlist->elements[i]);
+					int cmp = lip_gen_cmp(lelem, relem);
 					if(cmp != 0) { return cmp; }
 				}
 
-				return (int)(llist->length - rlist->length);
+				return lip_cmp_scalar(llist->length, rlist->length);
+			}
+		case LIP_VAL_MAP:
+			return lip_map_cmp(lip_as_map(lhs), lip_as_map(rhs));
+		case LIP_VAL_VEC:
+			{
+				const lip_vec_t* lvec = lip_as_vec(lhs);
+				const lip_vec_t* rvec = lip_as_vec(rhs);
+				size_t min_len = LIP_MIN(lvec->length, rvec->length);
+				for(size_t i = 0; i < min_len; ++i)
+				{
+					int cmp = lip_gen_cmp(
+						lip_make_number(NULL, lvec->elements[i]),
+						lip_make_number(NULL, rvec->elements[i])
+					);
+					if(cmp != 0) { return cmp; }
+				}
+
+				return lip_cmp_scalar(lvec->length, rvec->length);
+			}
+		default:
+			return lip_cmp_scalar(
+				(uintptr_t)lhs.data.reference, (uintptr_t)rhs.data.reference
+			);
+	}
+}
+
+#define lip_hash_combine(seed, hash) \
+	((seed) ^ ((hash) + 0x9e3779b9u + ((seed) << 6) + ((seed) >> 2)))
+
+uint32_t
+lip_gen_hash(lip_value_t value)
+{
+	lip_value_type_t type = lip_value_type_class(value.type);
+	switch(type)
+	{
+		case LIP_VAL_NIL:
+			return 0;
+		case LIP_VAL_NUMBER:
+			{
+				double number = value.data.number;
+				// Make sure numbers which compare equal hash the same
+				if(number == 0.0) { number = 0.0; }
+				if(number != number) { return 0x7ff80000u; }
+				return XXH32(&number, sizeof(number), LIP_VAL_NUMBER);
+			}
+		case LIP_VAL_BOOLEAN:
+			return value.data.boolean;
+		case LIP_VAL_SYMBOL:
+			return XXH32(&value.data.reference, sizeof(value.data.reference), type);
+		case LIP_VAL_STRING:
+			// Buffers and inline strings have no cached hash
+			return value.type == LIP_VAL_STRING && value.small_len == 0
+				? lip_string_hash(value.data.reference)
+				: lip_string_ref_hash(lip_as_string_ref(&value));
+		case LIP_VAL_PLACEHOLDER:
+			return XXH32(&value.data.index, sizeof(value.data.index), value.type);
+		case LIP_VAL_LIST:
+			{
+				const lip_list_t* list = lip_as_list(value);
+				uint32_t hash = (uint32_t)list->length;
+
+				lip_list_iterator_t itr;
+				lip_value_t element;
+				for(lip_list_begin(list, &itr); lip_list_next(&itr, &element);)
+				{
+					hash = lip_hash_combine(hash, lip_gen_hash(element));
+				}
+
+				return hash;
+			}
+		case LIP_VAL_MAP:
+			{
+				const lip_map_t* map = lip_as_map(value);
+				uint32_t hash = (uint32_t)map->size;
+
+				// Entries are visited in an order which depends on the shape
+				// of the trie so they must be combined commutatively
+				lip_map_iterator_t itr;
+				lip_value_t key, entry_value;
+				for(lip_map_begin(map, &itr); lip_map_next(&itr, &key, &entry_value);)
+				{
+					hash += lip_hash_combine(lip_gen_hash(key), lip_gen_hash(entry_value));
+				}
+
+				return hash;
+			}
+		case LIP_VAL_VEC:
+			{
+				const lip_vec_t* vec = lip_as_vec(value);
+				uint32_t hash = (uint32_t)vec->length;
+				for(size_t i = 0; i < vec->length; ++i)
+				{
+					hash = lip_hash_combine(
+						hash, lip_gen_hash(lip_make_number(NULL, vec->elements[i]))
+					);
+				}
+
+				return hash;
 			}
 		default:
-			return (ptrdiff_t)((char*)lhs.data.reference - (char*)rhs.data.reference);
+			return XXH32(&value.data.reference, sizeof(value.data.reference), value.type);
 	}
 }
 
@@ -7,6 +7,21 @@
 #include <lip/core/asm.h>
 #include <lip/core/array.h>
 
+static void
+lip_print_pair_instruction(
+	lip_out_t* output,
+	lip_opcode_t opcode,
+	uint32_t first,
+	uint32_t second
+)
+{
+	lip_printf(
+		output, "%*s %u, %u",
+		-4, lip_opcode_t_to_str(opcode) + sizeof("LIP_OP_") - 1,
+		first, second
+	);
+}
+
 void
 lip_print_instruction(
 	lip_out_t* output,
@@ -22,21 +37,27 @@ lip_print_instruction(
 		case LIP_OP_NOP:
 		case LIP_OP_NIL:
 		case LIP_OP_RET:
+		case LIP_OP_ADDN:
+		case LIP_OP_SUBN:
+		case LIP_OP_MULN:
+		case LIP_OP_FDIVN:
+		case LIP_OP_EQN:
+		case LIP_OP_NEQN:
+		case LIP_OP_GTN:
+		case LIP_OP_LTN:
+		case LIP_OP_GTEN:
+		case LIP_OP_LTEN:
 			lip_printf(
 				output, "%*s",
 				-4, lip_opcode_t_to_str(opcode) + sizeof("LIP_OP_") - 1
 			);
 			break;
 		case LIP_OP_CLS:
+		case LIP_OP_LLST:
 			{
-				int function_index = operand & 0xFFF;
-				int num_captures = (operand >> 12) & 0xFFF;
-
-				lip_printf(
-					output, "%*s %d, %d",
-					-4, lip_opcode_t_to_str(opcode) + sizeof("LIP_OP_") - 1,
-					function_index, num_captures
-				);
+				uint32_t first, second;
+				lip_disasm_pair(operand, &first, &second);
+				lip_print_pair_instruction(output, opcode, first, second);
 			}
 			break;
 		case LIP_OP_LABEL:
@@ -94,24 +115,31 @@ lip_print_value(
 			);
 			break;
 		case LIP_VAL_STRING:
+		case LIP_VAL_BUFFER:
 			{
-				lip_string_t* string = value.data.reference;
+				lip_string_ref_t string = lip_as_string_ref(&value);
 				lip_printf(
-					output, "\"%.*s\"\n", (int)string->length, string->ptr
+					output, "\"%.*s\"\n", (int)string.length, string.ptr
 				);
 			}
 			break;
 		case LIP_VAL_SYMBOL:
 			{
-				lip_string_t* string = value.data.reference;
+				lip_string_ref_t string = lip_as_string_ref(&value);
 				lip_printf(
-					output, "'%.*s\n", (int)string->length, string->ptr
+					output, "'%.*s\n", (int)string.length, string.ptr
 				);
 			}
 			break;
 		case LIP_VAL_LIST:
 			lip_print_list(depth, indent, output, value.data.reference);
 			break;
+		case LIP_VAL_MAP:
+			lip_print_map(depth, indent, output, value.data.reference);
+			break;
+		case LIP_VAL_VEC:
+			lip_print_vec(depth, indent, output, value.data.reference);
+			break;
 		case LIP_VAL_FUNCTION:
 			lip_print_closure(depth, indent, output, value.data.reference);
 			break;
@@ -124,6 +152,12 @@ lip_print_value(
 				(uintptr_t)value.data.reference
 			);
 			break;
+		case LIP_VAL_LIST_BUILDER:
+			lip_printf(
+				output, "<list builder: 0x%" PRIxPTR ">\n",
+				(uintptr_t)value.data.reference
+			);
+			break;
 		default:
 			lip_printf(output, "<corrupted: #%u>\n", value.type);
 			break;
@@ -166,7 +200,7 @@ lip_print_function(
 		lip_printf(output, "%*sImports:\n", indent * 2, "");
 	}
 
-	for(uint16_t i = 0; i < function->num_imports; ++i)
+	for(uint32_t i = 0; i < function->num_imports; ++i)
 	{
 		lip_import_t import = layout.imports[i];
 		lip_string_t* import_name =
@@ -182,7 +216,7 @@ lip_print_function(
 		lip_printf(output, "%*sConstants:\n", indent * 2, "");
 	}
 
-	for(uint16_t i = 0; i < function->num_constants; ++i)
+	for(uint32_t i = 0; i < function->num_constants; ++i)
 	{
 		lip_printf(output, "%*s%u: ", indent * 2 + 2, "", i);
 		switch(layout.constants[i].type)
@@ -213,11 +247,31 @@ lip_print_function(
 	}
 
 	lip_printf(output, "%*sCode:\n", indent * 2, "");
-	for(uint16_t i = 0; i < function->num_instructions; ++i)
+	bool is_wide = false;
+	lip_operand_t wide_operand = 0;
+	lip_loc_reader_t loc_reader;
+	lip_loc_reader_init(&loc_reader, function);
+	lip_loc_reader_next(&loc_reader); // Skip the function's location
+	for(uint32_t i = 0; i < function->num_instructions; ++i)
 	{
+		lip_opcode_t opcode;
+		lip_operand_t operand;
+		lip_disasm(layout.instructions[i], &opcode, &operand);
+
 		lip_printf(output, "%*s%*u: ", indent * 2 + 1, "", 3, i);
-		lip_print_instruction(output, layout.instructions[i]);
-		lip_loc_range_t loc = layout.locations[i + 1];
+		if(is_wide)
+		{
+			uint32_t first, second;
+			lip_disasm_wide_pair(wide_operand, operand, &first, &second);
+			lip_print_pair_instruction(output, opcode, first, second);
+		}
+		else
+		{
+			lip_print_instruction(output, layout.instructions[i]);
+		}
+		is_wide = opcode == LIP_OP_WIDE;
+		wide_operand = operand;
+		lip_loc_range_t loc = lip_loc_reader_next(&loc_reader);
 		lip_printf(output, "%*s; %u:%u - %u:%u\n",
 			3, "",
 			loc.start.line, loc.start.column, loc.end.line, loc.end.column
@@ -229,7 +283,7 @@ lip_print_function(
 		lip_printf(output, "%*sFunctions:\n", indent * 2, "");
 	}
 
-	for(uint16_t i = 0; i < function->num_functions; ++i)
+	for(uint32_t i = 0; i < function->num_functions; ++i)
 	{
 		lip_printf(output, "%*s%u: ", indent * 2 + 1, "", i);
 		lip_print_function(
@@ -253,10 +307,58 @@ lip_print_list(
 
 	if(depth == 0) { return; }
 
-	for(size_t i = 0; i < list->length; ++i)
+	lip_list_iterator_t itr;
+	lip_value_t element;
+	for(lip_list_begin(list, &itr); lip_list_next(&itr, &element);)
+	{
+		lip_printf(output, "%*s- ", indent * 2 + 2, "");
+		lip_print_value(depth - 1, indent + 1, output, element);
+	}
+}
+
+void
+lip_print_map(
+	unsigned int depth,
+	unsigned int indent,
+	lip_out_t* output,
+	const lip_map_t* map
+)
+{
+	lip_printf(
+		output, "<map: 0x%" PRIxPTR ">\n", (uintptr_t)map
+	);
+
+	if(depth == 0) { return; }
+
+	lip_map_iterator_t itr;
+	lip_value_t key, value;
+	for(lip_map_begin(map, &itr); lip_map_next(&itr, &key, &value);)
+	{
+		lip_printf(output, "%*s- ", indent * 2 + 2, "");
+		lip_print_value(depth - 1, indent + 1, output, key);
+		lip_printf(output, "%*s: ", indent * 2 + 4, "");
+		lip_print_value(depth - 1, indent + 2, output, value);
+	}
+}
+
+void
+lip_print_vec(
+	unsigned int depth,
+	unsigned int indent,
+	lip_out_t* output,
+	const lip_vec_t* vec
+)
+{
+	lip_printf(
+		output, "<vec: 0x%" PRIxPTR ">\n", (uintptr_t)vec
+	);
+
+	if(depth == 0) { return; }
+
+	for(size_t i = 0; i < vec->length; ++i)
 	{
 		lip_printf(output, "%*s- ", indent * 2 + 2, "");
-		lip_print_value(depth - 1, indent + 1, output, list->elements[i]);
+		lip_print_value(depth - 1, indent + 1, output, lip_make_number(NULL, vec->elements[i]));
 	}
 }
 
@@ -294,7 +396,7 @@ lip_print_closure(
 		lip_printf(output, "%*sEnvironment:\n", indent * 2 + 1, "");
 	}
 
-	for(uint16_t i = 0; i < closure->env_len; ++i)
+	for(unsigned int i = 0; i < closure->env_len; ++i)
 	{
 		lip_printf(output, "%*s%u: ", indent * 2 + 2, "", i);
 		lip_print_value(depth - 1, indent + 1, output, closure->environment[i]);
@@ -428,8 +530,13 @@ lip_print_ast(
 			lip_printf(output, "\n");
 			lip_print_ast_block(depth - 1, indent + 1, output, ast->data.do_);
 			break;
+		case LIP_AST_RECUR:
+			lip_printf(output, "\n");
+			lip_print_ast_block(depth - 1, indent + 1, output, ast->data.recur);
+			break;
 		case LIP_AST_LET:
 		case LIP_AST_LETREC:
+		case LIP_AST_LOOP:
 			lip_printf(
 				output, "\n%*sBindings:\n", indent * 2 + 1, ""
 			);
@@ -84,12 +84,14 @@ lip_repl(
 					lip_compiler_begin(&ctx->compiler, source_name);
 					lip_compiler_add_ast(&ctx->compiler, ast_result.value.result);
 					lip_function_t* fn = lip_compiler_end(&ctx->compiler, ctx->temp_pool);
-					lip_ctx_begin_load(ctx);
-					bool linked = lip_link_function(ctx, fn);
-					lip_ctx_end_load(ctx);
-
-					if(!linked)
+					if(fn == NULL)
 					{
+						lip_set_compile_error(
+							ctx,
+							lip_string_ref(ctx->compiler.error),
+							source_name,
+							LIP_LOC_NOWHERE
+						);
 						repl_handler->print(
 							repl_handler,
 							LIP_EXEC_ERROR,
@@ -97,13 +99,27 @@ lip_repl(
 						);
 						continue;
 					}
-
 					lip_closure_t* closure = lip_new(ctx->temp_pool, lip_closure_t);
 					*closure = (lip_closure_t){
 						.function = { .lip = fn },
+						.links = lip_new_link_table(ctx->temp_pool, fn),
 						.is_native = false,
 						.env_len = 0,
 					};
+					lip_ctx_begin_load(ctx);
+					bool linked = lip_link_closure(ctx, closure);
+					lip_ctx_end_load(ctx);
+
+					if(!linked)
+					{
+						repl_handler->print(
+							repl_handler,
+							LIP_EXEC_ERROR,
+							(lip_value_t) { .type = LIP_VAL_NIL }
+						);
+						continue;
+					}
+
 					lip_reset_vm(vm);
 					lip_value_t result;
 					lip_exec_status_t status = lip_call(
@@ -1,6 +1,9 @@
 #include "lip_internal.h"
 #include <lip/core/io.h>
 #include <lip/core/pp.h>
+#include "utils.h"
+#include "vendor/xxhash.h"
+#include <time.h>
 
 struct lip_prefix_stream_s
 {
@@ -12,6 +15,15 @@ struct lip_prefix_stream_s
 
 static const char LIP_BINARY_MAGIC[] = {'L', 'I', 'P', 0};
 
+// Magic, pointer size, byte order mark and version, padded so that a mapped
+// function is suitably aligned
+#define LIP_BYTECODE_HEADER_SIZE 16
+#define LIP_BYTECODE_PADDING_SIZE \
+	(LIP_BYTECODE_HEADER_SIZE - sizeof(LIP_BINARY_MAGIC) \
+	 - sizeof(uint8_t) - sizeof(uint16_t) - sizeof(uint32_t))
+
+#define LIP_SOURCE_CHUNK_SIZE 4096
+
 static size_t
 lip_prefix_stream_read(void* buff, size_t size, lip_in_t* vtable)
 {
@@ -56,8 +68,12 @@ lip_load_bytecode(lip_context_t* ctx, lip_string_ref_t filename, lip_in_t* input
 	lip_checked_read(&ptr_size, sizeof(ptr_size), input);
 	uint16_t bom;
 	lip_checked_read(&bom, sizeof(bom), input);
+	uint32_t version;
+	lip_checked_read(&version, sizeof(version), input);
+	char padding[LIP_BYTECODE_PADDING_SIZE];
+	lip_checked_read(padding, sizeof(padding), input);
 
-	if(ptr_size != sizeof(void*) || bom != 1)
+	if(ptr_size != sizeof(void*) || bom != 1 || version != LIP_BYTECODE_VERSION)
 	{
 		lip_set_context_error(
 			ctx, "Format error",
@@ -100,6 +116,17 @@ lip_load_bytecode(lip_context_t* ctx, lip_string_ref_t filename, lip_in_t* input
 		return NULL;
 	}
 
+	// The VM does not check instructions as it executes them
+	const char* error = lip_verify_function(ctx->allocator, function, header.size, 0);
+	if(error != NULL)
+	{
+		lip_free(ctx->allocator, function);
+		lip_set_context_error(
+			ctx, "Format error", lip_string_ref(error), filename, LIP_LOC_NOWHERE
+		);
+		return NULL;
+	}
+
 	return function;
 }
 
@@ -149,11 +176,33 @@ lip_load_source(lip_context_t* ctx, lip_string_ref_t filename, lip_in_t* input)
 						return NULL;
 					}
 
+					if(true
+						&& ctx->runtime->cfg.static_check
+						&& !lip_check_ast(ctx, filename, ast_result.value.result)
+					)
+					{
+						return NULL;
+					}
+
 					lip_compiler_add_ast(&ctx->compiler, ast_result.value.result);
 				}
 				break;
 			case LIP_STREAM_END:
-				return lip_compiler_end(&ctx->compiler, ctx->allocator);
+				{
+					lip_function_t* function =
+						lip_compiler_end(&ctx->compiler, ctx->allocator);
+					if(function == NULL)
+					{
+						lip_set_compile_error(
+							ctx,
+							lip_string_ref(ctx->compiler.error),
+							filename,
+							LIP_LOC_NOWHERE
+						);
+					}
+
+					return function;
+				}
 			case LIP_STREAM_ERROR:
 				{
 					const lip_error_t* error = lip_parser_last_error(&ctx->parser);
@@ -173,16 +222,20 @@ lip_load_source(lip_context_t* ctx, lip_string_ref_t filename, lip_in_t* input)
 	return NULL;
 }
 
+static bool
+lip_is_binary(const char* magic, size_t size)
+{
+	return size >= sizeof(LIP_BINARY_MAGIC)
+		&& memcmp(magic, LIP_BINARY_MAGIC, sizeof(LIP_BINARY_MAGIC)) == 0;
+}
+
 static lip_function_t*
 lip_load_function(lip_context_t* ctx, lip_string_ref_t filename, lip_in_t* input)
 {
 	char magic[sizeof(LIP_BINARY_MAGIC)];
 	size_t bytes_read = lip_read(magic, sizeof(magic), input);
-	bool is_binary = true
-		&& bytes_read == sizeof(magic)
-		&& memcmp(magic, LIP_BINARY_MAGIC, sizeof(LIP_BINARY_MAGIC)) == 0;
 
-	if(is_binary)
+	if(lip_is_binary(magic, bytes_read))
 	{
 		return lip_load_bytecode(ctx, filename, input);
 	}
@@ -197,10 +250,72 @@ lip_load_function(lip_context_t* ctx, lip_string_ref_t filename, lip_in_t* input
 	}
 }
 
+// Execute a compiled script from a read-only mapping of its file. Anything
+// else is left to the stream loader.
+// Verification reads every nested function, so the whole file is paged in on
+// load even if most of it never runs. Verifying a body on its first CLS would
+// avoid that, but like linking on CLS it needs synchronisation on a hot opcode
+// and turns malformed files into errors at call time.
+static lip_function_t*
+lip_map_bytecode(
+	lip_context_t* ctx, lip_string_ref_t filename, lip_mapping_t* mapping
+)
+{
+	lip_fs_t* fs = ctx->runtime->cfg.fs;
+	if(fs->map == NULL || fs->unmap == NULL) { return NULL; }
+
+	size_t size;
+	const char* ptr = fs->map(fs, filename, &size);
+	if(ptr == NULL) { return NULL; }
+
+	uint8_t ptr_size;
+	uint16_t bom;
+	uint32_t version;
+	lip_function_t header;
+	if(false
+		|| size < LIP_BYTECODE_HEADER_SIZE + sizeof(header)
+		|| !lip_is_binary(ptr, size)
+		|| (uintptr_t)(ptr + LIP_BYTECODE_HEADER_SIZE) % lip_function_t_alignment != 0
+	)
+	{
+		fs->unmap(fs, ptr, size);
+		return NULL;
+	}
+
+	const char* field = ptr + sizeof(LIP_BINARY_MAGIC);
+	memcpy(&ptr_size, field, sizeof(ptr_size));
+	field += sizeof(ptr_size);
+	memcpy(&bom, field, sizeof(bom));
+	field += sizeof(bom);
+	memcpy(&version, field, sizeof(version));
+	memcpy(&header, ptr + LIP_BYTECODE_HEADER_SIZE, sizeof(header));
+
+	if(false
+		|| ptr_size != sizeof(void*)
+		|| bom != 1
+		|| version != LIP_BYTECODE_VERSION
+		|| header.size <= sizeof(header)
+		|| header.size > size - LIP_BYTECODE_HEADER_SIZE
+		|| lip_verify_function(
+			ctx->allocator,
+			(const lip_function_t*)(ptr + LIP_BYTECODE_HEADER_SIZE),
+			header.size,
+			0
+		) != NULL
+	)
+	{
+		fs->unmap(fs, ptr, size);
+		return NULL;
+	}
+
+	*mapping = (lip_mapping_t){ .ptr = ptr, .size = size };
+	return (lip_function_t*)(ptr + LIP_BYTECODE_HEADER_SIZE);
+}
+
 static bool
-lip_do_dump_script(
+lip_dump_function(
 	lip_context_t* ctx,
-	lip_script_t* script,
+	lip_function_t* function,
 	lip_string_ref_t filename,
 	lip_out_t* output
 )
@@ -216,19 +331,242 @@ lip_do_dump_script(
 		} \
 	} while(0)
 
-	lip_closure_t* closure = script->closure;
-
 	lip_checked_write(LIP_BINARY_MAGIC, sizeof(LIP_BINARY_MAGIC), output);
 	uint8_t ptr_size = sizeof(void*);
 	lip_checked_write(&ptr_size, sizeof(ptr_size), output);
 	uint16_t bom = 1;
 	lip_checked_write(&bom, sizeof(bom), output);
+	uint32_t version = LIP_BYTECODE_VERSION;
+	lip_checked_write(&version, sizeof(version), output);
+	char padding[LIP_BYTECODE_PADDING_SIZE] = { 0 };
+	lip_checked_write(padding, sizeof(padding), output);
 
-	lip_checked_write(closure->function.lip, closure->function.lip->size, output);
+	lip_checked_write(function, function->size, output);
 
 	return true;
 }
 
+// Signatures decide static checks and which calls borrow their arguments so
+// they are part of the key. Entries are summed as the order of a symtab is not
+// stable.
+static uint64_t
+lip_symtab_signatures_hash(khash_t(lip_symtab)* symtab)
+{
+	uint64_t hash = 0;
+	kh_foreach(i, symtab)
+	{
+		lip_string_ref_t module_name = kh_key(symtab, i).str;
+		khash_t(lip_module)* module = kh_val(symtab, i);
+		uint64_t module_seed = XXH64(module_name.ptr, module_name.length, 0);
+
+		kh_foreach(j, module)
+		{
+			const lip_symbol_t* symbol = &kh_val(module, j);
+			if(!symbol->has_signature) { continue; }
+
+			lip_string_ref_t symbol_name = kh_key(module, j).str;
+			const lip_signature_t* signature = &symbol->signature;
+			uint64_t seed = module_seed
+				^ (uint64_t)signature->arity_min << 16
+				^ (uint64_t)signature->arity_max << 8
+				^ (uint64_t)signature->borrows_args;
+			seed = XXH64(symbol_name.ptr, symbol_name.length, seed);
+			hash += XXH64(
+				signature->param_types, sizeof(signature->param_types), seed
+			);
+		}
+	}
+
+	return hash;
+}
+
+// Key of a script in the bytecode cache
+static uint64_t
+lip_bytecode_cache_key(
+	lip_context_t* ctx, lip_string_ref_t filename, lip_string_ref_t source
+)
+{
+	uint64_t options = 0
+		| (uint64_t)LIP_BYTECODE_VERSION << 32
+		| (uint64_t)ctx->compiler.optimization_level << 2
+		| (uint64_t)ctx->compiler.strip_debug_info << 1
+		| (uint64_t)ctx->runtime->cfg.static_check;
+
+	// The loading symtab is only cleared when the next load starts
+	lip_ctx_begin_rt_read(ctx);
+	uint64_t signatures = lip_symtab_signatures_hash(ctx->runtime->symtab);
+	if(ctx->load_depth > 0)
+	{
+		signatures += lip_symtab_signatures_hash(ctx->loading_symtab);
+	}
+	lip_ctx_end_rt_read(ctx);
+
+	uint64_t seed = XXH64(filename.ptr, filename.length, options ^ signatures);
+	return XXH64(source.ptr, source.length, seed);
+}
+
+static void
+lip_format_key(char hex[sizeof(uint64_t) * 2 + 1], uint64_t key)
+{
+	static const char digits[] = "0123456789abcdef";
+	for(size_t i = 0; i < sizeof(key) * 2; ++i)
+	{
+		hex[i] = digits[(key >> (60 - i * 4)) & 0xF];
+	}
+	hex[sizeof(key) * 2] = '\0';
+}
+
+static lip_string_ref_t
+lip_bytecode_cache_path(lip_array(char)* buf, lip_string_ref_t dir, uint64_t key)
+{
+	char hex[sizeof(key) * 2 + 1];
+	lip_format_key(hex, key);
+
+	lip_sprintf(buf, "%.*s/%s.lipc", (int)dir.length, dir.ptr, hex);
+	size_t length = lip_array_len(*buf);
+	lip_array_push(*buf, '\0');
+	return (lip_string_ref_t){ .length = length, .ptr = *buf };
+}
+
+// Entries are written under a name of their own then renamed so that another
+// process never reads a partial file
+static lip_string_ref_t
+lip_bytecode_cache_temp_path(
+	lip_array(char)* buf, lip_context_t* ctx, lip_string_ref_t path
+)
+{
+	static unsigned int counter = 0;
+	uint64_t nonce = (uint64_t)(uintptr_t)ctx
+		^ (uint64_t)time(NULL) << 32
+		^ (uint64_t)clock()
+		^ (uint64_t)counter++ << 48;
+	char hex[sizeof(nonce) * 2 + 1];
+	lip_format_key(hex, XXH64(&nonce, sizeof(nonce), 0));
+
+	lip_sprintf(buf, "%.*s.%s.tmp", (int)path.length, path.ptr, hex);
+	size_t length = lip_array_len(*buf);
+	lip_array_push(*buf, '\0');
+	return (lip_string_ref_t){ .length = length, .ptr = *buf };
+}
+
+static lip_function_t*
+lip_load_cached_bytecode(lip_context_t* ctx, lip_string_ref_t path)
+{
+	lip_fs_t* fs = ctx->runtime->cfg.fs;
+	lip_in_t* input = fs->begin_read(fs, path);
+	if(input == NULL) { return NULL; }
+
+	char magic[sizeof(LIP_BINARY_MAGIC)];
+	size_t bytes_read = lip_read(magic, sizeof(magic), input);
+	lip_function_t* function = lip_is_binary(magic, bytes_read)
+		? lip_load_bytecode(ctx, path, input)
+		: NULL;
+	fs->end_read(fs, input);
+
+	return function;
+}
+
+static lip_function_t*
+lip_load_function_with_cache(
+	lip_context_t* ctx, lip_string_ref_t filename, lip_in_t* input
+)
+{
+	// The whole source is needed to find its cache entry
+	lip_array(char) source = lip_array_create(
+		ctx->allocator, char, LIP_SOURCE_CHUNK_SIZE
+	);
+	for(;;)
+	{
+		size_t length = lip_array_len(source);
+		lip_array_resize(source, length + LIP_SOURCE_CHUNK_SIZE);
+		size_t bytes_read = lip_read(source + length, LIP_SOURCE_CHUNK_SIZE, input);
+		lip_array_resize(source, length + bytes_read);
+		if(bytes_read < LIP_SOURCE_CHUNK_SIZE) { break; }
+	}
+
+	lip_string_ref_t source_ref = {
+		.length = lip_array_len(source),
+		.ptr = source
+	};
+	struct lip_isstream_s sstream;
+	lip_in_t* source_input = lip_make_isstream(source_ref, &sstream);
+	if(lip_is_binary(source_ref.ptr, source_ref.length))
+	{
+		lip_function_t* function = lip_load_function(ctx, filename, source_input);
+		lip_array_destroy(source);
+		return function;
+	}
+
+	lip_array(char) path_buf = lip_array_create(ctx->allocator, char, 64);
+	lip_string_ref_t path = lip_bytecode_cache_path(
+		&path_buf,
+		ctx->runtime->cfg.bytecode_cache_dir,
+		lip_bytecode_cache_key(ctx, filename, source_ref)
+	);
+
+	lip_function_t* function = lip_load_cached_bytecode(ctx, path);
+	if(function == NULL)
+	{
+		// A bad entry is replaced, it is not an error of the script
+		lip_array_clear(ctx->error_records);
+		ctx->error = (lip_context_error_t){ .records = ctx->error_records };
+
+		function = lip_load_source(ctx, filename, source_input);
+
+		// Failing to fill the cache only costs a compilation next time
+		lip_fs_t* fs = ctx->runtime->cfg.fs;
+		if(function != NULL && fs->rename != NULL)
+		{
+			lip_array(char) temp_buf = lip_array_create(ctx->allocator, char, 64);
+			lip_string_ref_t temp_path =
+				lip_bytecode_cache_temp_path(&temp_buf, ctx, path);
+
+			lip_out_t* output = fs->begin_write(fs, temp_path);
+			if(output != NULL)
+			{
+				lip_context_error_t error = ctx->error;
+				bool dumped = lip_dump_function(ctx, function, path, output);
+				ctx->error = error;
+				fs->end_write(fs, output);
+
+				if(!dumped || !fs->rename(fs, temp_path, path))
+				{
+					fs->remove(fs, temp_path);
+				}
+			}
+
+			lip_array_destroy(temp_buf);
+		}
+	}
+
+	lip_array_destroy(path_buf);
+	lip_array_destroy(source);
+	return function;
+}
+
+lip_script_t*
+lip_new_script(
+	lip_context_t* ctx, lip_function_t* fn, bool mapped, lip_mapping_t mapping
+)
+{
+	lip_closure_t* closure = lip_new(ctx->allocator, lip_closure_t);
+	*closure = (lip_closure_t){
+		.function = { .lip = fn },
+		.links = lip_new_link_table(ctx->allocator, fn),
+		.is_native = false,
+		.env_len = 0,
+	};
+
+	lip_script_t* script = lip_new(ctx->allocator, lip_script_t);
+	*script = (lip_script_t){
+		.closure = closure,
+		.linked = false,
+		.mapped = mapped,
+		.mapping = mapping,
+	};
+	return script;
+}
+
 lip_script_t*
 lip_load_script(
 	lip_context_t* ctx,
@@ -236,7 +574,12 @@ lip_load_script(
 	lip_in_t* input
 )
 {
-	bool own_input = input == NULL;
+	lip_mapping_t mapping = { .ptr = NULL };
+	lip_function_t* fn = input == NULL
+		? lip_map_bytecode(ctx, filename, &mapping)
+		: NULL;
+
+	bool own_input = input == NULL && fn == NULL;
 	if(own_input)
 	{
 		lip_fs_t* fs = ctx->runtime->cfg.fs;
@@ -250,23 +593,16 @@ lip_load_script(
 		}
 	}
 
-	lip_function_t* fn = lip_load_function(ctx, filename, input);
-
-	lip_script_t* script = NULL;
-	lip_ctx_begin_load(ctx);
-	if(fn)
+	if(fn == NULL)
 	{
-		lip_closure_t* closure = lip_new(ctx->allocator, lip_closure_t);
-		*closure = (lip_closure_t){
-			.function = { .lip = fn },
-			.is_native = false,
-			.env_len = 0,
-		};
-
-		script = lip_new(ctx->allocator, lip_script_t);
-		*script = (lip_script_t){ .closure = closure, .linked = false };
+		fn = ctx->runtime->cfg.bytecode_cache_dir.length > 0
+			? lip_load_function_with_cache(ctx, filename, input)
+			: lip_load_function(ctx, filename, input);
 	}
 
+	lip_script_t* script = NULL;
+	lip_ctx_begin_load(ctx);
+	if(fn) { script = lip_new_script(ctx, fn, mapping.ptr != NULL, mapping); }
 	lip_ctx_end_load(ctx);
 
 	if(own_input)
@@ -301,7 +637,7 @@ lip_dump_script(
 		}
 	}
 
-	bool result = lip_do_dump_script(ctx, script, filename, output);
+	bool result = lip_dump_function(ctx, script->closure->function.lip, filename, output);
 
 	if(own_output)
 	{
@@ -316,13 +652,22 @@ void
 lip_unload_script(lip_context_t* ctx, lip_script_t* script)
 {
 	lip_closure_t* closure = script->closure;
-	khiter_t itr = kh_get(lip_ptr_set, ctx->new_script_functions, closure->function.lip);
+	khiter_t itr = kh_get(lip_ptr_set, ctx->new_script_functions, closure);
 	if(itr != kh_end(ctx->new_script_functions))
 	{
 		kh_del(lip_ptr_set, ctx->new_script_functions, itr);
 	}
 
-	lip_free(ctx->allocator, closure->function.lip);
+	if(!script->mapped)
+	{
+		lip_free(ctx->allocator, closure->function.lip);
+	}
+	else if(script->mapping.ptr != NULL)
+	{
+		lip_fs_t* fs = ctx->runtime->cfg.fs;
+		fs->unmap(fs, script->mapping.ptr, script->mapping.size);
+	}
+	lip_free(ctx->allocator, closure->links);
 	lip_free(ctx->allocator, closure);
 	lip_free(ctx->allocator, script);
 }
@@ -334,9 +679,8 @@ lip_exec_status_t
 
 	if(!script->linked)
 	{
-		lip_function_t* fn = script->closure->function.lip;
 		lip_ctx_begin_load(rt->ctx);
-		bool linked = lip_link_function(rt->ctx, fn);
+		bool linked = lip_link_closure(rt->ctx, script->closure);
 		lip_ctx_end_load(rt->ctx);
 		script->linked = linked;
 		if(!linked) { return LIP_EXEC_ERROR; }
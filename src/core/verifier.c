@@ -0,0 +1,666 @@
+#include <lip/core/vm.h>
+#include <lip/core/asm.h>
+#include <lip/core/prim_ops.h>
+
+// Depth recorded for instructions which were not reached yet and for words
+// which belong to a longer instruction
+#define LIP_DEPTH_UNSEEN UINT32_MAX
+#define LIP_DEPTH_OPERAND (UINT32_MAX - 1)
+
+typedef struct lip_verifier_s lip_verifier_t;
+typedef struct lip_step_s lip_step_t;
+
+struct lip_verifier_s
+{
+	const lip_function_t* function;
+	lip_function_layout_t layout;
+	bool check_frame;
+	uint32_t num_captures;
+	// Smallest environment given to each nested function, if needed
+	uint32_t* nested_captures;
+};
+
+// Effect of an instruction on control flow and on the operand stack
+struct lip_step_s
+{
+	uint32_t length;
+	uint32_t num_pops;
+	uint32_t num_pushes;
+	bool falls_through;
+	bool jumps;
+	uint32_t target;
+};
+
+static bool
+lip_verify_frame_index(
+	const lip_verifier_t* verifier, uint32_t index, uint32_t limit
+)
+{
+	return !verifier->check_frame || index < limit;
+}
+
+static bool
+lip_verify_scratch(
+	const lip_verifier_t* verifier, uint32_t index, size_t num_slots
+)
+{
+	return !verifier->check_frame
+		|| (uint64_t)index + num_slots <= verifier->function->num_locals;
+}
+
+// Check the pseudo-instructions of a closure starting at `address`
+static const char*
+lip_verify_closure(
+	lip_verifier_t* verifier,
+	uint32_t address,
+	uint32_t function_index,
+	uint32_t num_captures
+)
+{
+	const lip_function_t* function = verifier->function;
+	if(function_index >= function->num_functions)
+	{
+		return "Invalid function index";
+	}
+
+	if(num_captures > function->num_instructions - address)
+	{
+		return "Truncated instruction";
+	}
+
+	for(uint32_t i = 0; i < num_captures; ++i)
+	{
+		lip_opcode_t opcode;
+		lip_operand_t operand;
+		lip_disasm(verifier->layout.instructions[address + i], &opcode, &operand);
+
+		uint32_t limit;
+		switch(opcode)
+		{
+			case LIP_OP_LARG:
+				limit = function->num_args;
+				break;
+			case LIP_OP_LDLV:
+				limit = function->num_locals;
+				break;
+			case LIP_OP_LDCV:
+				limit = verifier->num_captures;
+				break;
+			default:
+				return "Invalid capture";
+		}
+
+		if(!lip_verify_frame_index(verifier, operand, limit))
+		{
+			return "Invalid capture";
+		}
+	}
+
+	if(verifier->nested_captures != NULL)
+	{
+		uint32_t* nested_captures = &verifier->nested_captures[function_index];
+		*nested_captures = LIP_MIN(*nested_captures, num_captures);
+	}
+
+	return NULL;
+}
+
+// Decode [WIDE]; CLS and its captures, which follow LCLS
+static const char*
+lip_verify_scratch_closure(
+	lip_verifier_t* verifier,
+	uint32_t address,
+	uint32_t local_index,
+	uint32_t* length
+)
+{
+	const lip_instruction_t* instructions = verifier->layout.instructions;
+	uint32_t num_instructions = verifier->function->num_instructions;
+	if(address >= num_instructions) { return "Truncated instruction"; }
+
+	lip_opcode_t opcode;
+	lip_operand_t operand;
+	lip_disasm(instructions[address], &opcode, &operand);
+
+	uint32_t function_index, num_captures;
+	if(opcode == LIP_OP_CLS)
+	{
+		lip_disasm_pair(operand, &function_index, &num_captures);
+		*length = 1;
+	}
+	else if(opcode == LIP_OP_WIDE && address + 1 < num_instructions)
+	{
+		lip_operand_t wide_operand = operand;
+		lip_disasm(instructions[address + 1], &opcode, &operand);
+		if(opcode != LIP_OP_CLS) { return "Invalid scratch closure"; }
+		lip_disasm_wide_pair(wide_operand, operand, &function_index, &num_captures);
+		*length = 2;
+	}
+	else
+	{
+		return "Invalid scratch closure";
+	}
+
+	if(!lip_verify_scratch(
+		verifier, local_index, lip_closure_scratch_slots(num_captures)
+	))
+	{
+		return "Invalid scratch slot";
+	}
+
+	*length += num_captures;
+	return lip_verify_closure(
+		verifier, address + *length - num_captures, function_index, num_captures
+	);
+}
+
+static const char*
+lip_verify_step(lip_verifier_t* verifier, uint32_t address, lip_step_t* step)
+{
+	const lip_function_t* function = verifier->function;
+	const lip_function_layout_t* layout = &verifier->layout;
+
+	lip_opcode_t opcode;
+	lip_operand_t operand;
+	lip_disasm(layout->instructions[address], &opcode, &operand);
+	// Negative operands are out of every range
+	uint32_t index = (uint32_t)operand;
+
+	*step = (lip_step_t){
+		.length = 1,
+		.falls_through = true
+	};
+
+	switch(opcode)
+	{
+		case LIP_OP_NOP:
+			break;
+		case LIP_OP_POP:
+			step->num_pops = index;
+			break;
+		case LIP_OP_NIL:
+		case LIP_OP_LDI:
+		case LIP_OP_LDB:
+			step->num_pushes = 1;
+			break;
+		case LIP_OP_LDK:
+			if(index >= function->num_constants) { return "Invalid constant index"; }
+			step->num_pushes = 1;
+			break;
+		case LIP_OP_LDS:
+		case LIP_OP_IMP:
+			if(false
+				|| index >= function->num_imports
+				|| layout->imports[index].kind != (opcode == LIP_OP_IMP
+					? LIP_IMPORT_FUNCTION : LIP_IMPORT_SYMBOL)
+			)
+			{
+				return "Invalid import index";
+			}
+			step->num_pushes = 1;
+			break;
+		case LIP_OP_LARG:
+			if(!lip_verify_frame_index(verifier, index, function->num_args))
+			{
+				return "Invalid argument index";
+			}
+			step->num_pushes = 1;
+			break;
+		case LIP_OP_LDLV:
+			if(!lip_verify_frame_index(verifier, index, function->num_locals))
+			{
+				return "Invalid local index";
+			}
+			step->num_pushes = 1;
+			break;
+		case LIP_OP_LDCV:
+			if(!lip_verify_frame_index(verifier, index, verifier->num_captures))
+			{
+				return "Invalid capture index";
+			}
+			step->num_pushes = 1;
+			break;
+		case LIP_OP_PLHR:
+		case LIP_OP_RCLS:
+			if(!lip_verify_frame_index(verifier, index, function->num_locals))
+			{
+				return "Invalid local index";
+			}
+			break;
+		case LIP_OP_SET:
+			if(!lip_verify_frame_index(verifier, index, function->num_locals))
+			{
+				return "Invalid local index";
+			}
+			step->num_pops = 1;
+			break;
+		case LIP_OP_JMP:
+		case LIP_OP_JOF:
+			if(index >= function->num_instructions) { return "Invalid jump target"; }
+			step->num_pops = opcode == LIP_OP_JOF ? 1 : 0;
+			step->falls_through = opcode == LIP_OP_JOF;
+			step->jumps = true;
+			step->target = index;
+			break;
+		case LIP_OP_CALL:
+		case LIP_OP_CALLK:
+		case LIP_OP_TAIL:
+		case LIP_OP_TAILK:
+			if(index > UINT8_MAX) { return "Too many arguments"; }
+			step->num_pops = index + 1;
+			step->num_pushes = 1;
+			step->falls_through = opcode == LIP_OP_CALL || opcode == LIP_OP_CALLK;
+			break;
+		case LIP_OP_CALLSELF:
+		case LIP_OP_TAILSELF:
+			if(index > UINT8_MAX) { return "Too many arguments"; }
+			if(verifier->check_frame
+				&& (function->is_vararg || index != function->num_args))
+			{
+				return "Invalid self call";
+			}
+			step->num_pops = index;
+			step->num_pushes = 1;
+			step->falls_through = opcode == LIP_OP_CALLSELF;
+			break;
+		case LIP_OP_RET:
+			step->num_pops = 1;
+			step->falls_through = false;
+			break;
+		case LIP_OP_CLS:
+			{
+				uint32_t function_index, num_captures;
+				lip_disasm_pair(operand, &function_index, &num_captures);
+				step->length += num_captures;
+				step->num_pushes = 1;
+				return lip_verify_closure(
+					verifier, address + 1, function_index, num_captures
+				);
+			}
+		case LIP_OP_LCLS:
+			{
+				uint32_t length = 0;
+				const char* error =
+					lip_verify_scratch_closure(verifier, address + 1, index, &length);
+				step->length += length;
+				step->num_pushes = 1;
+				return error;
+			}
+		case LIP_OP_LLST:
+			{
+				uint32_t local_index, num_elements;
+				lip_disasm_pair(operand, &local_index, &num_elements);
+				if(!lip_verify_scratch(
+					verifier, local_index, lip_list_scratch_slots(num_elements)
+				))
+				{
+					return "Invalid scratch slot";
+				}
+				step->num_pops = num_elements;
+				step->num_pushes = 1;
+			}
+			break;
+		case LIP_OP_WIDE:
+			{
+				if(address + 1 >= function->num_instructions)
+				{
+					return "Truncated instruction";
+				}
+
+				lip_opcode_t wide_opcode;
+				lip_operand_t wide_operand;
+				lip_disasm(layout->instructions[address + 1], &wide_opcode, &wide_operand);
+				uint32_t first, second;
+				lip_disasm_wide_pair(operand, wide_operand, &first, &second);
+
+				step->length = 2;
+				step->num_pushes = 1;
+				if(wide_opcode == LIP_OP_CLS)
+				{
+					step->length += second;
+					return lip_verify_closure(verifier, address + 2, first, second);
+				}
+				else if(wide_opcode == LIP_OP_LLST)
+				{
+					if(!lip_verify_scratch(
+						verifier, first, lip_list_scratch_slots(second)
+					))
+					{
+						return "Invalid scratch slot";
+					}
+					step->num_pops = second;
+				}
+				else
+				{
+					return "Invalid wide instruction";
+				}
+			}
+			break;
+#define LIP_VERIFY_PRIM_OP(op, name) case LIP_OP_##name:
+		LIP_PRIM_OP(LIP_VERIFY_PRIM_OP)
+			step->num_pops = index;
+			step->num_pushes = 1;
+			break;
+		case LIP_OP_ADDN:
+		case LIP_OP_SUBN:
+		case LIP_OP_MULN:
+		case LIP_OP_FDIVN:
+		case LIP_OP_EQN:
+		case LIP_OP_NEQN:
+		case LIP_OP_GTN:
+		case LIP_OP_LTN:
+		case LIP_OP_GTEN:
+		case LIP_OP_LTEN:
+			step->num_pops = 2;
+			step->num_pushes = 1;
+			break;
+		default:
+			return "Illegal instruction";
+	}
+
+	return NULL;
+}
+
+static const char*
+lip_verify_edge(
+	uint32_t* depths,
+	uint32_t* worklist,
+	uint32_t* num_pending,
+	uint32_t num_instructions,
+	uint32_t target,
+	uint32_t depth
+)
+{
+	if(target >= num_instructions) { return "Control reaches end of function"; }
+
+	if(depths[target] == LIP_DEPTH_OPERAND)
+	{
+		return "Invalid jump target";
+	}
+	else if(depths[target] == LIP_DEPTH_UNSEEN)
+	{
+		depths[target] = depth;
+		worklist[(*num_pending)++] = target;
+		return NULL;
+	}
+	else
+	{
+		return depths[target] == depth ? NULL : "Inconsistent operand stack depth";
+	}
+}
+
+static const char*
+lip_verify_code(
+	lip_verifier_t* verifier,
+	uint32_t* depths,
+	uint32_t* worklist,
+	uint32_t* max_stack
+)
+{
+	uint32_t num_instructions = verifier->function->num_instructions;
+	if(num_instructions == 0) { return "Control reaches end of function"; }
+
+	// Decode every instruction once to find where they start
+	for(uint32_t address = 0; address < num_instructions;)
+	{
+		lip_step_t step;
+		const char* error = lip_verify_step(verifier, address, &step);
+		if(error != NULL) { return error; }
+
+		depths[address] = LIP_DEPTH_UNSEEN;
+		for(uint32_t i = 1; i < step.length; ++i)
+		{
+			depths[address + i] = LIP_DEPTH_OPERAND;
+		}
+		address += step.length;
+	}
+
+	// Follow control flow, every instruction must see the same stack depth
+	// from all of its predecessors
+	uint32_t num_pending = 1;
+	worklist[0] = 0;
+	depths[0] = 0;
+	*max_stack = 0;
+	while(num_pending > 0)
+	{
+		uint32_t address = worklist[--num_pending];
+		uint32_t depth = depths[address];
+
+		lip_step_t step;
+		lip_verify_step(verifier, address, &step);
+		if(depth < step.num_pops) { return "Operand stack underflow"; }
+
+		uint32_t next_depth = depth - step.num_pops + step.num_pushes;
+		*max_stack = LIP_MAX(*max_stack, next_depth);
+
+		const char* error = NULL;
+		if(step.falls_through)
+		{
+			error = lip_verify_edge(
+				depths, worklist, &num_pending, num_instructions,
+				address + step.length, next_depth
+			);
+		}
+		if(error == NULL && step.jumps)
+		{
+			error = lip_verify_edge(
+				depths, worklist, &num_pending, num_instructions,
+				step.target, next_depth
+			);
+		}
+		if(error != NULL) { return error; }
+	}
+
+	return NULL;
+}
+
+static const char*
+lip_verify_with(
+	lip_allocator_t* allocator,
+	lip_verifier_t* verifier,
+	uint32_t* max_stack
+)
+{
+	size_t num_instructions = verifier->function->num_instructions;
+	uint32_t* depths = lip_malloc(
+		allocator, sizeof(uint32_t) * LIP_MAX(num_instructions * 2, 1)
+	);
+	const char* error = lip_verify_code(
+		verifier, depths, depths + num_instructions, max_stack
+	);
+	lip_free(allocator, depths);
+	return error;
+}
+
+const char*
+lip_verify_instructions(
+	lip_allocator_t* allocator,
+	const lip_function_t* function,
+	bool check_frame,
+	uint32_t num_captures,
+	uint32_t* max_stack
+)
+{
+	lip_verifier_t verifier = {
+		.function = function,
+		.check_frame = check_frame,
+		.num_captures = num_captures
+	};
+	lip_function_layout(function, &verifier.layout);
+	return lip_verify_with(allocator, &verifier, max_stack);
+}
+
+static bool
+lip_verify_string(const lip_function_t* function, uint32_t offset)
+{
+	if(false
+		|| offset % lip_string_t_alignment != 0
+		|| offset > function->size - sizeof(lip_string_t)
+	)
+	{
+		return false;
+	}
+
+	// A wrong hash would be written back by lip_string_hash, which faults when
+	// the function is mapped read-only
+	const lip_string_t* string =
+		lip_function_resource(function, offset);
+	return string->length < function->size - offset - sizeof(lip_string_t)
+		&& string->ptr[string->length] == '\0'
+		&& string->hash == lip_string_ref_hash((lip_string_ref_t){
+			.length = string->length,
+			.ptr = string->ptr
+		});
+}
+
+// Check that every block of the function is within its size so that
+// lip_function_layout can be trusted
+static bool
+lip_verify_layout(const lip_function_t* function, size_t size)
+{
+	if(false
+		|| size < sizeof(lip_function_t)
+		|| function->size <= sizeof(lip_function_t)
+		|| function->size > size
+		|| (function->is_vararg && function->num_args == 0)
+	)
+	{
+		return false;
+	}
+
+	// Bound every count first so that no block of the layout can wrap around
+	size = function->size;
+	const char* base = (const char*)function;
+	const lip_string_t* source_name = lip_align_ptr(
+		base + sizeof(lip_function_t), lip_string_t_alignment
+	);
+	if(false
+		|| (size_t)((const char*)source_name - base) + sizeof(lip_string_t) > size
+		|| source_name->length > size
+		|| function->num_imports > size / sizeof(lip_import_t)
+		|| function->num_constants > size / sizeof(lip_value_t)
+		|| function->num_functions > size / sizeof(uint32_t)
+		|| function->num_instructions > size / sizeof(lip_instruction_t)
+	)
+	{
+		return false;
+	}
+
+	lip_function_layout_t layout;
+	lip_function_layout(function, &layout);
+	const char* end = (const char*)(layout.instructions + function->num_instructions);
+	// The location table is only decoded within the size of the function
+	if(false
+		|| (size_t)(end - base) > size
+		|| function->location_offset > size
+		|| (true
+			&& function->location_offset != 0
+			&& function->location_offset < (size_t)(end - base)
+		)
+	)
+	{
+		return false;
+	}
+
+	for(uint32_t i = 0; i < function->num_imports; ++i)
+	{
+		if(false
+			|| layout.imports[i].kind > LIP_IMPORT_SYMBOL
+			|| !lip_verify_string(function, layout.imports[i].name)
+		)
+		{
+			return false;
+		}
+	}
+
+	for(uint32_t i = 0; i < function->num_constants; ++i)
+	{
+		lip_value_t constant = layout.constants[i];
+		switch(constant.type)
+		{
+			case LIP_VAL_NUMBER:
+				break;
+			case LIP_VAL_STRING:
+			case LIP_VAL_SYMBOL:
+				if(!lip_verify_string(function, constant.data.index)) { return false; }
+				break;
+			default:
+				return false;
+		}
+	}
+
+	for(uint32_t i = 0; i < function->num_functions; ++i)
+	{
+		uint32_t offset = layout.function_offsets[i];
+		if(false
+			|| offset % lip_function_t_alignment != 0
+			|| offset < (size_t)(end - base)
+			|| offset > size - sizeof(lip_function_t)
+		)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const char*
+lip_verify_function(
+	lip_allocator_t* allocator,
+	const lip_function_t* function,
+	size_t size,
+	uint32_t num_captures
+)
+{
+	if(!lip_verify_layout(function, size)) { return "Malformed function"; }
+
+	uint32_t* nested_captures = lip_malloc(
+		allocator, sizeof(uint32_t) * LIP_MAX(function->num_functions, 1)
+	);
+	// Nested functions which are never closed over can not run
+	for(uint32_t i = 0; i < function->num_functions; ++i)
+	{
+		nested_captures[i] = UINT32_MAX;
+	}
+
+	lip_verifier_t verifier = {
+		.function = function,
+		.check_frame = true,
+		.num_captures = num_captures,
+		.nested_captures = nested_captures
+	};
+	lip_function_layout(function, &verifier.layout);
+
+	uint32_t max_stack;
+	const char* error = lip_verify_with(allocator, &verifier, &max_stack);
+	if(error == NULL && max_stack > function->max_stack)
+	{
+		error = "Operand stack deeper than declared";
+	}
+
+	// The link tables of nested functions follow the imports of this one
+	uint64_t num_links = function->num_imports;
+	for(uint32_t i = 0; error == NULL && i < function->num_functions; ++i)
+	{
+		uint32_t offset = verifier.layout.function_offsets[i];
+		const lip_function_t* nested = lip_function_resource(function, offset);
+		if(nested->link_offset != num_links)
+		{
+			error = "Malformed link table";
+			break;
+		}
+		num_links += nested->num_links;
+
+		error = lip_verify_function(
+			allocator, nested, function->size - offset, nested_captures[i]
+		);
+	}
+	if(error == NULL && num_links != function->num_links)
+	{
+		error = "Malformed link table";
+	}
+
+	lip_free(allocator, nested_captures);
+	return error;
+}
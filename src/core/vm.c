@@ -25,22 +25,36 @@ lip_vm_init(
 	lip_memblock_info_t os_block, env_block, cs_block;
 	lip_vm_memory_layout(config, &os_block, &env_block, &cs_block);
 
+	lip_value_t* os_base = lip_locate_memblock(mem, &os_block);
+	lip_stack_frame_t* cs_base = lip_locate_memblock(mem, &cs_block);
 	*vm = (lip_vm_t){
 		.config = *config,
 		.rt = rt,
 		.status = LIP_EXEC_OK,
 		.mem = mem,
-		.sp = (lip_value_t*)lip_locate_memblock(mem, &os_block) + config->os_len,
-		.fp = lip_locate_memblock(mem, &cs_block)
+		.sp = os_base + LIP_VM_STACK_RESERVE + config->os_len,
+		.fp = cs_base,
+		.os_limit = os_base + LIP_VM_STACK_RESERVE,
+		.env_limit = lip_locate_memblock(mem, &env_block),
+		// The last frame is only written to by a call which is then rejected
+		.cs_limit = cs_base + LIP_MAX(config->cs_len, 1) - 1
 	};
 
 	// Clear out debug info
 	memset(vm->fp, 0, sizeof(lip_stack_frame_t) * config->cs_len);
 
 	*(vm->fp) = (lip_stack_frame_t){
-		.ep = (lip_value_t*)lip_locate_memblock(mem, &env_block) + config->env_len,
+		.ep = vm->env_limit + config->env_len,
 		.bp = vm->sp
 	};
+	vm->env_low = vm->fp->ep;
+}
+
+size_t
+lip_vm_max_env_depth(const lip_vm_t* vm)
+{
+	// The environment stack grows downward
+	return (size_t)(vm->env_limit + vm->config.env_len - vm->env_low);
 }
 
 lip_exec_status_t
@@ -58,6 +72,15 @@ lip_exec_status_t
 		return vm->status;
 	}
 
+	if(LIP_UNLIKELY(false
+		|| vm->fp >= vm->cs_limit
+		|| (size_t)(vm->sp - vm->os_limit) < (size_t)num_args + 1
+	))
+	{
+		*result = lip_make_string_copy(vm, lip_string_ref("Stack overflow"));
+		return LIP_EXEC_ERROR;
+	}
+
 	vm->sp -= num_args;
 	va_list args;
 	va_start(args, num_args);
@@ -122,7 +145,7 @@ lip_get_args(const lip_vm_t* vm, uint8_t* num_args)
 }
 
 const lip_value_t*
-lip_get_env(const lip_vm_t* vm, uint8_t* env_len)
+lip_get_env(const lip_vm_t* vm, uint32_t* env_len)
 {
 	if(env_len) { *env_len = vm->fp->closure->env_len; }
 	return vm->fp->closure->environment;
@@ -131,9 +154,20 @@ lip_get_env(const lip_vm_t* vm, uint8_t* env_len)
 lip_value_t
 lip_make_string_copy(lip_vm_t* vm, lip_string_ref_t str)
 {
+	if(str.length <= LIP_SMALL_STRING_MAX)
+	{
+		lip_value_t value = {
+			.type = LIP_VAL_STRING,
+			.small_len = (uint8_t)(str.length + 1)
+		};
+		memcpy((char*)&value + offsetof(lip_value_t, small_chars), str.ptr, str.length);
+		return value;
+	}
+
 	size_t size = sizeof(lip_string_t) + str.length + 1; // null-terminator
 	lip_string_t* string = vm->rt->malloc(vm->rt, LIP_VAL_STRING, size);
 	string->length = str.length;
+	string->hash = 0;
 	memcpy(string->ptr, str.ptr, str.length);
 	string->ptr[str.length] = '\0';
 	return (lip_value_t){
@@ -142,6 +176,18 @@ lip_make_string_copy(lip_vm_t* vm, lip_string_ref_t str)
 	};
 }
 
+lip_value_t
+lip_make_symbol(lip_vm_t* vm, lip_string_ref_t name)
+{
+	lip_string_t* symbol = vm->rt->intern(vm->rt, name);
+	if(symbol == NULL) { return lip_make_nil(vm); }
+
+	return (lip_value_t){
+		.type = LIP_VAL_SYMBOL,
+		.data = { .reference = symbol }
+	};
+}
+
 lip_value_t
 lip_make_string(lip_vm_t* vm, const char* fmt, ...)
 {
@@ -165,11 +211,23 @@ lip_make_stringv(lip_vm_t* vm, const char* fmt, va_list args)
 	});
 }
 
+lip_vec_t*
+lip_alloc_vec(lip_vm_t* vm, size_t length)
+{
+	size_t size = sizeof(lip_vec_t)
+		+ sizeof(double) * length
+		+ LIP_VEC_ALIGNMENT - 1;
+	lip_vec_t* vec = vm->rt->malloc(vm->rt, LIP_VAL_VEC, size);
+	vec->length = length;
+	vec->elements = lip_align_ptr(vec + 1, LIP_VEC_ALIGNMENT);
+	return vec;
+}
+
 lip_value_t
 lip_make_function(
 	lip_vm_t* vm,
 	lip_native_fn_t native_fn,
-	uint8_t env_len,
+	uint32_t env_len,
 	lip_value_t env[]
 )
 {
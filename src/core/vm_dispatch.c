@@ -8,22 +8,24 @@
 #if !defined(LIP_NO_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__GNUG__) || defined(__clang__))
 #	define GENERATE_LABEL(ENUM) &&do_##ENUM,
 #	define BEGIN_LOOP() \
-		void* dispatch_table[] = { LIP_OP(GENERATE_LABEL) &&do_LIP_OP_ILLEGAL }; \
+		void* dispatch_table[] = { LIP_OP(GENERATE_LABEL) }; \
 		lip_opcode_t opcode; \
 		lip_operand_t operand; \
 		DISPATCH()
-#	define END_LOOP() do_LIP_OP_ILLEGAL: THROW("Illegal instruction");
+#	define END_LOOP()
 #	define BEGIN_OP(OP) do_LIP_OP_##OP: {
 #	define END_OP(OP) } DISPATCH();
+// Opcodes were checked by lip_verify_function or lip_asm_end
 #	define DISPATCH() \
 		CALL_HOOK(); \
 		lip_disasm(*(pc++), &opcode, &operand); \
-		goto *dispatch_table[LIP_MIN((unsigned int)opcode, LIP_STATIC_ARRAY_LEN(dispatch_table) - 1)];
+		goto *dispatch_table[opcode];
 #else
 #	define BEGIN_LOOP() \
 		lip_opcode_t opcode; \
 		lip_operand_t operand; \
 		DISPATCH()
+// Never reached with verified code but a switch needs somewhere to go
 #	define END_LOOP() do_LIP_OP_ILLEGAL: THROW("Illegal instruction");
 #	define BEGIN_OP(OP) do_LIP_OP_##OP: {
 #	define END_OP(OP) } DISPATCH()
@@ -83,6 +85,148 @@
 		if(status != LIP_EXEC_OK) { SAVE_CONTEXT(); return status; } \
 	END_OP(name)
 
+// Binary arithmetic on operands which the compiler knows to be numbers
+#define DO_NUMBER_OP(name, op) \
+	BEGIN_OP(name) \
+		sp[1].data.number = sp[0].data.number op sp[1].data.number; \
+		++sp; \
+	END_OP(name)
+
+#define DO_NUMBER_CMP_OP(name, op) \
+	BEGIN_OP(name) \
+		sp[1] = lip_make_boolean( \
+			vm, lip_number_cmp(sp[0].data.number, sp[1].data.number) op 0 \
+		); \
+		++sp; \
+	END_OP(name)
+
+// Whether a frame for a script function fits in what is left of the stacks.
+// The last frame is never entered so that a native function or lip_call can
+// always prepare a call which is then rejected here.
+static inline bool
+lip_vm_has_headroom(
+	const lip_vm_t* vm,
+	const lip_stack_frame_t* fp,
+	const lip_function_t* function,
+	const lip_value_t* sp,
+	const lip_value_t* ep
+)
+{
+	return true
+		&& fp < vm->cs_limit
+		&& (size_t)(sp - vm->os_limit) >= function->max_stack
+		&& (size_t)(ep - vm->env_limit) >= function->num_locals;
+}
+
+static inline void
+lip_vm_init_closure(
+	lip_closure_t* closure,
+	uint32_t function_index,
+	uint32_t num_captures,
+	const lip_instruction_t* captures,
+	const lip_stack_frame_t* fp,
+	const lip_function_layout_t* fn,
+	lip_value_t* bp,
+	lip_value_t* ep
+)
+{
+	lip_function_t* function = lip_function_resource(
+		fp->closure->function.lip, fn->function_offsets[function_index]
+	);
+	*closure = (lip_closure_t){
+		.is_native = false,
+		.function = { .lip = function },
+		.links = fp->closure->links + function->link_offset,
+		.env_len = num_captures
+	};
+	for(unsigned int i = 0; i < num_captures; ++i)
+	{
+		lip_opcode_t opcode;
+		int32_t var_index;
+		lip_disasm(captures[i], &opcode, &var_index);
+		// Only LARG, LDLV and LDCV pass verification
+		const lip_value_t* base =
+			opcode == LIP_OP_LARG ? bp
+			: opcode == LIP_OP_LDLV ? ep
+			: fp->closure->environment;
+		closure->environment[i] = base[var_index];
+	}
+}
+
+// Decode the CLS instruction following LCLS, in either form
+static inline void
+lip_vm_decode_cls(
+	lip_instruction_t** pc,
+	uint32_t* function_index,
+	uint32_t* num_captures
+)
+{
+	lip_opcode_t opcode;
+	lip_operand_t operand;
+	lip_disasm(*((*pc)++), &opcode, &operand);
+	if(opcode == LIP_OP_WIDE)
+	{
+		lip_operand_t wide_operand = operand;
+		lip_disasm(*((*pc)++), &opcode, &operand);
+		lip_disasm_wide_pair(wide_operand, operand, function_index, num_captures);
+	}
+	else
+	{
+		lip_disasm_pair(operand, function_index, num_captures);
+	}
+}
+
+// Whether CALLK and TAILK can enter a callee without the checks of a call
+static inline bool
+lip_vm_is_known_callee(const lip_value_t* callee, uint8_t num_args)
+{
+	if(callee->type != LIP_VAL_FUNCTION) { return false; }
+
+	const lip_closure_t* closure = callee->data.reference;
+	return true
+		&& !closure->is_native
+		&& !closure->function.lip->is_vararg
+		&& closure->function.lip->num_args == num_args;
+}
+
+// Set up a frame for a script closure whose type and arity were checked by
+// lip_vm_is_known_callee, once lip_vm_has_headroom has been checked
+static inline void
+lip_vm_enter_known(
+	lip_vm_t* vm,
+	lip_stack_frame_t* fp,
+	lip_closure_t* closure,
+	uint8_t num_args,
+	lip_value_t* sp,
+	lip_value_t* ep
+)
+{
+	fp->closure = closure;
+	fp->num_args = num_args;
+	fp->bp = sp;
+	fp->ep = ep - closure->function.lip->num_locals;
+	vm->env_low = LIP_MIN(vm->env_low, fp->ep);
+}
+
+static inline lip_value_t
+lip_vm_init_scratch_list(
+	lip_list_t* list,
+	uint32_t num_elements,
+	const lip_value_t* sp
+)
+{
+	*list = (lip_list_t){
+		.length = num_elements,
+		.elements = (lip_value_t*)list + lip_list_scratch_slots(0)
+	};
+	list->root = list->elements;
+	memcpy(list->elements, sp, sizeof(lip_value_t) * num_elements);
+	return (lip_value_t){
+		.type = LIP_VAL_LIST,
+		.data = { .reference = list }
+	};
+}
+
 #if defined(__GNUC__) || defined(__GNUG__) || defined(__clang__)
 #	pragma GCC diagnostic push
 #	pragma GCC diagnostic ignored "-Wpedantic"
@@ -120,17 +264,24 @@ lip_vm_loop(lip_vm_t* vm)
 		: lip_vm_loop_without_hook(vm);
 }
 
+static lip_exec_status_t
+lip_vm_call_error(lip_vm_t* vm, uint8_t num_args, lip_value_t message)
+{
+	lip_value_t* next_sp = vm->sp + num_args - 1;
+	*next_sp = message;
+	vm->sp = next_sp;
+	return LIP_EXEC_ERROR;
+}
+
 lip_exec_status_t
 lip_vm_do_call(lip_vm_t* vm, lip_value_t* fn, uint8_t num_args)
 {
 	if(LIP_UNLIKELY(fn->type != LIP_VAL_FUNCTION))
 	{
-		lip_value_t* next_sp = vm->sp + num_args - 1;
-		*next_sp = lip_make_string_copy(
-			vm, lip_string_ref("Trying to call a non-function")
+		return lip_vm_call_error(
+			vm, num_args,
+			lip_make_string_copy(vm, lip_string_ref("Trying to call a non-function"))
 		);
-		vm->sp = next_sp;
-		return LIP_EXEC_ERROR;
 	}
 
 	vm->fp->num_args = num_args;
@@ -138,12 +289,15 @@ lip_vm_do_call(lip_vm_t* vm, lip_value_t* fn, uint8_t num_args)
 	lip_closure_t* closure = (lip_closure_t*)fn->data.reference;
 	vm->fp->closure = closure;
 
-	bool is_native = closure->is_native;
-	unsigned int num_locals = is_native ? 0 : closure->function.lip->num_locals;
-	vm->fp->ep -= num_locals;
-
-	if(is_native)
+	if(closure->is_native)
 	{
+		if(LIP_UNLIKELY(vm->fp >= vm->cs_limit))
+		{
+			return lip_vm_call_error(
+				vm, num_args, lip_make_string_copy(vm, lip_string_ref("Stack overflow"))
+			);
+		}
+
 		// Ensure that a value is always returned
 		lip_value_t* next_sp = vm->sp + num_args - 1;
 		lip_exec_status_t status = closure->function.native(vm, next_sp);
@@ -154,34 +308,40 @@ lip_vm_do_call(lip_vm_t* vm, lip_value_t* fn, uint8_t num_args)
 	}
 	else
 	{
+		lip_function_t* function = closure->function.lip;
 		lip_function_layout_t layout;
-		lip_function_layout(closure->function.lip, &layout);
+		lip_function_layout(function, &layout);
 		vm->fp->pc = layout.instructions;
 
-		bool is_vararg = closure->function.lip->is_vararg;
-		const uint8_t arity = is_vararg
-			? closure->function.lip->num_args - 1
-			: closure->function.lip->num_args;
+		bool is_vararg = function->is_vararg;
+		const uint8_t arity = is_vararg ? function->num_args - 1 : function->num_args;
 		bool wrong_arity = is_vararg ? num_args < arity : num_args != arity;
 		if(LIP_UNLIKELY(wrong_arity))
 		{
-			lip_value_t* next_sp = vm->sp + num_args - 1;
-			*next_sp = lip_make_string(
-				vm,
-				"Bad number of arguments (%s %u expected, got %u)",
-				is_vararg ? "at least" : "exactly", arity, num_args
+			return lip_vm_call_error(
+				vm, num_args,
+				lip_make_string(
+					vm,
+					"Bad number of arguments (%s %u expected, got %u)",
+					is_vararg ? "at least" : "exactly", arity, num_args
+				)
+			);
+		}
+
+		// The only check against the size of the stacks until the next call
+		if(LIP_UNLIKELY(!lip_vm_has_headroom(vm, vm->fp, function, vm->sp, vm->fp->ep)))
+		{
+			return lip_vm_call_error(
+				vm, num_args, lip_make_string_copy(vm, lip_string_ref("Stack overflow"))
 			);
-			vm->sp = next_sp;
-			return LIP_EXEC_ERROR;
 		}
+		vm->fp->ep -= function->num_locals;
+		vm->env_low = LIP_MIN(vm->env_low, vm->fp->ep);
 
 		if(is_vararg)
 		{
 			size_t num_varargs = num_args - arity;
-			lip_list_t* list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
-			list->root = list->elements =
-				vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_value_t) * num_varargs);
-			list->length = num_varargs;
+			lip_list_t* list = lip_alloc_list(vm, num_varargs);
 			memcpy(list->elements, vm->sp + arity, sizeof(lip_value_t) * num_varargs);
 
 			// Ensure that there is enough space to place the vararg list
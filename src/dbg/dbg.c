@@ -267,22 +267,55 @@ lip_write_value(cmp_ctx_t* cmp, const lip_value_t* value)
 			cmp_write_bool(cmp, value->data.boolean);
 			break;
 		case LIP_VAL_STRING:
-			cmp_write_str_ref(cmp, lip_string_ref_from_string(value->data.reference));
+		case LIP_VAL_BUFFER:
+			cmp_write_str_ref(cmp, lip_as_string_ref(value));
 			break;
 		case LIP_VAL_LIST:
 			{
 				const lip_list_t* list = value->data.reference;
-				lip_write_value_array(cmp, list->length, list->elements);
+				cmp_write_array(cmp, list->length);
+				lip_list_iterator_t itr;
+				lip_value_t element;
+				for(lip_list_begin(list, &itr); lip_list_next(&itr, &element);)
+				{
+					lip_write_value(cmp, &element);
+				}
+			}
+			break;
+		case LIP_VAL_MAP:
+			{
+				const lip_map_t* map = value->data.reference;
+				cmp_write_map(cmp, 1);
+				cmp_write_str_ref(cmp, lip_string_ref("map"));
+				cmp_write_array(cmp, map->size * 2);
+				lip_map_iterator_t itr;
+				lip_value_t key, entry_value;
+				for(lip_map_begin(map, &itr); lip_map_next(&itr, &key, &entry_value);)
+				{
+					lip_write_value(cmp, &key);
+					lip_write_value(cmp, &entry_value);
+				}
+			}
+			break;
+		case LIP_VAL_VEC:
+			{
+				const lip_vec_t* vec = value->data.reference;
+				cmp_write_array(cmp, vec->length);
+				for(size_t i = 0; i < vec->length; ++i)
+				{
+					cmp_write_double(cmp, vec->elements[i]);
+				}
 			}
 			break;
 		case LIP_VAL_SYMBOL:
 			{
 				cmp_write_map(cmp, 1);
 				cmp_write_str_ref(cmp, lip_string_ref("symbol"));
-				cmp_write_str_ref(cmp, lip_string_ref_from_string(value->data.reference));
+				cmp_write_str_ref(cmp, lip_as_string_ref(value));
 			}
 			break;
 		case LIP_VAL_NATIVE:
+		case LIP_VAL_LIST_BUILDER:
 			{
 				cmp_write_map(cmp, 1);
 				cmp_write_str_ref(cmp, lip_string_ref("native"));
@@ -312,10 +345,10 @@ lip_write_value(cmp_ctx_t* cmp, const lip_value_t* value)
 }
 
 static void
-lip_write_value_array(cmp_ctx_t* cmp, uint16_t count, const lip_value_t* array)
+lip_write_value_array(cmp_ctx_t* cmp, uint32_t count, const lip_value_t* array)
 {
 	cmp_write_array(cmp, count);
-	for(uint16_t i = 0; i < count; ++i)
+	for(uint32_t i = 0; i < count; ++i)
 	{
 		lip_write_value(cmp, &array[i]);
 	}
@@ -360,7 +393,7 @@ lip_dbg_write_stack_frame(
 		filename = lip_string_ref_from_string(function_layout.source_name);
 		uint16_t location_index =
 			LIP_MAX(0, fp->pc - function_layout.instructions) + pc_offset;
-		location = function_layout.locations[location_index];
+		location = lip_function_location(fp->closure->function.lip, location_index);
 	}
 
 	lip_string_ref_t function_name;
@@ -460,7 +493,7 @@ lip_dbg_write_stack_frame(
 
 				cmp_write_str_ref(cmp, lip_string_ref("constants"));
 				cmp_write_array(cmp, fn->num_constants);
-				for(uint16_t i = 0; i < fn->num_constants; ++i)
+				for(uint32_t i = 0; i < fn->num_constants; ++i)
 				{
 					switch(layout.constants[i].type)
 					{
@@ -503,7 +536,9 @@ lip_dbg_write_stack_frame(
 
 				cmp_write_str_ref(cmp, lip_string_ref("bytecode"));
 				cmp_write_array(cmp, fn->num_instructions);
-				for(uint16_t i = 0; i < fn->num_instructions; ++i)
+				bool is_wide = false;
+				lip_operand_t wide_operand = 0;
+				for(uint32_t i = 0; i < fn->num_instructions; ++i)
 				{
 					lip_opcode_t opcode;
 					lip_operand_t operand;
@@ -523,16 +558,24 @@ lip_dbg_write_stack_frame(
 							);
 							break;
 						case LIP_OP_CLS:
+						case LIP_OP_LLST:
 							{
-								int function_index = operand & 0xFFF;
-								int num_captures = (operand >> 12) & 0xFFF;
+								uint32_t first, second;
+								if(is_wide)
+								{
+									lip_disasm_wide_pair(wide_operand, operand, &first, &second);
+								}
+								else
+								{
+									lip_disasm_pair(operand, &first, &second);
+								}
 								cmp_write_array(cmp, 3);
 								cmp_write_str_ref(
 									cmp,
 									lip_string_ref(opcode_str + sizeof("LIP_OP_") - 1)
 								);
-								cmp_write_integer(cmp, function_index);
-								cmp_write_integer(cmp, num_captures);
+								cmp_write_integer(cmp, first);
+								cmp_write_integer(cmp, second);
 							}
 							break;
 						case LIP_OP_LABEL:
@@ -553,13 +596,19 @@ lip_dbg_write_stack_frame(
 							}
 							break;
 					}
+
+					is_wide = opcode == LIP_OP_WIDE;
+					wide_operand = operand;
 				}
 
 				cmp_write_str_ref(cmp, lip_string_ref("locations"));
 				cmp_write_array(cmp, fn->num_instructions);
-				for(uint16_t i = 0; i < fn->num_instructions; ++i)
+				lip_loc_reader_t loc_reader;
+				lip_loc_reader_init(&loc_reader, fn);
+				lip_loc_reader_next(&loc_reader); // Skip the function's location
+				for(uint32_t i = 0; i < fn->num_instructions; ++i)
 				{
-					cmp_write_loc_range(cmp, layout.locations[i + 1]);
+					cmp_write_loc_range(cmp, lip_loc_reader_next(&loc_reader));
 				}
 			}
 
@@ -997,7 +1046,8 @@ lip_dbg_hook(
 		lip_function_layout_t layout;
 		lip_function_layout(fn, &layout);
 
-		lip_loc_range_t location = layout.locations[vm->fp->pc - layout.instructions + 1];
+		lip_loc_range_t location =
+			lip_function_location(fn, vm->fp->pc - layout.instructions + 1);
 		has_loc = memcmp(&location, &LIP_LOC_NOWHERE, sizeof(location)) != 0;
 	}
 
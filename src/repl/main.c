@@ -41,6 +41,12 @@ const struct optparse_long opts[] = {
 	{ "interactive", 'i', OPTPARSE_NONE },
 	{ "debug", 'd', OPTPARSE_OPTIONAL },
 	{ "execute", 'e', OPTPARSE_REQUIRED },
+	{ "stats", 's', OPTPARSE_NONE },
+	{ "check", 'c', OPTPARSE_NONE },
+	{ "bundle", 'b', OPTPARSE_REQUIRED },
+	{ "load", 'l', OPTPARSE_REQUIRED },
+	{ "image", 'I', OPTPARSE_REQUIRED },
+	{ "save-image", 'S', OPTPARSE_REQUIRED },
 	{ 0 }
 };
 
@@ -50,6 +56,12 @@ const char* help[] = {
 	NULL, "Enter interactive mode after executing `script`",
 	"off|step|error", "Enable debugger (default: 'step')",
 	"string", "Execute `string`",
+	NULL, "Print memory statistics on exit",
+	NULL, "Check calls in scripts before running them",
+	"file", "Look up modules in bundle `file` first",
+	"module", "Load `module` before running `script`",
+	"file", "Restore the modules saved in image `file`",
+	"file", "Save all loaded modules into image `file`",
 };
 
 static void
@@ -150,13 +162,20 @@ repl_run_script(
 int
 main(int argc, char* argv[])
 {
-	(void)argc;
 	int exit_code = EXIT_SUCCESS;
 
 	const char* debug_mode = "off";
 	bool interactive = false;
+	bool show_stats = false;
+	bool static_check = false;
 	const char* exec_string = NULL;
 	const char* script_filename = NULL;
+	const char** bundles = malloc(sizeof(const char*) * argc);
+	unsigned int num_bundles = 0;
+	const char** modules = malloc(sizeof(const char*) * argc);
+	unsigned int num_modules = 0;
+	const char* image_filename = NULL;
+	const char* save_image_filename = NULL;
 
 	lip_runtime_config_t* config = NULL;
 	lip_runtime_t* runtime = NULL;
@@ -193,17 +212,69 @@ main(int argc, char* argv[])
 			case 'e':
 				exec_string = options.optarg;
 				break;
+			case 's':
+				show_stats = true;
+				break;
+			case 'c':
+				static_check = true;
+				break;
+			case 'b':
+				bundles[num_bundles++] = options.optarg;
+				break;
+			case 'l':
+				modules[num_modules++] = options.optarg;
+				break;
+			case 'I':
+				image_filename = options.optarg;
+				break;
+			case 'S':
+				save_image_filename = options.optarg;
+				break;
 		}
 	}
 
 	script_filename = optparse_arg(&options);
 
 	config = lip_create_std_runtime_config(NULL);
+	config->static_check = static_check;
 	runtime = lip_create_runtime(config);
 	ctx = lip_create_context(runtime, NULL);
 	vm = lip_create_vm(ctx, NULL);
 	lip_load_stdlib(ctx);
 
+	if(image_filename && !lip_load_image(ctx, lip_string_ref(image_filename)))
+	{
+		lip_print_error(lip_stderr(), ctx);
+		quit(EXIT_FAILURE);
+	}
+
+	for(unsigned int i = 0; i < num_bundles; ++i)
+	{
+		if(!lip_add_bundle(ctx, lip_string_ref(bundles[i])))
+		{
+			lip_print_error(lip_stderr(), ctx);
+			quit(EXIT_FAILURE);
+		}
+	}
+
+	for(unsigned int i = 0; i < num_modules; ++i)
+	{
+		if(!lip_load_module(ctx, lip_string_ref(modules[i])))
+		{
+			lip_print_error(lip_stderr(), ctx);
+			quit(EXIT_FAILURE);
+		}
+	}
+
+	if(true
+		&& save_image_filename
+		&& !lip_save_image(ctx, lip_string_ref(save_image_filename), NULL)
+	)
+	{
+		lip_print_error(lip_stderr(), ctx);
+		quit(EXIT_FAILURE);
+	}
+
 	lip_dbg_config_t dbg_conf = {
 		.allocator = config->allocator,
 		.fs = config->fs,
@@ -243,7 +314,10 @@ main(int argc, char* argv[])
 		}
 	}
 
-	if(exec_string && !(interactive || script_filename))
+	if(true
+		&& (exec_string || num_modules > 0 || save_image_filename)
+		&& !(interactive || script_filename)
+	)
 	{
 		quit(EXIT_SUCCESS);
 	}
@@ -290,10 +364,20 @@ main(int argc, char* argv[])
 	}
 
 quit:
+	if(show_stats && vm)
+	{
+		lip_vm_stats_t stats = lip_get_vm_stats(vm);
+		fprintf(
+			stderr, "lip: %zu allocations, %zu bytes, %zu environment slots\n",
+			stats.num_allocations, stats.num_bytes_allocated, stats.max_env_depth
+		);
+	}
 	if(config) { lip_destroy_std_runtime_config(config); }
 	if(vm) { lip_destroy_vm(ctx, vm); }
 	if(ctx) { lip_destroy_context(ctx); }
 	if(runtime) { lip_destroy_runtime(runtime); }
 	if(dbg) { lip_destroy_debugger(dbg); }
+	free(modules);
+	free(bundles);
 	return exit_code;
 }
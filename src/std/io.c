@@ -1,7 +1,19 @@
+#if defined(__GNUC__) || defined(__clang__)
+#	define _XOPEN_SOURCE 700
+#endif
+
 #include <lip/std/io.h>
 #include <lip/core/memory.h>
 #include <errno.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#	define LIP_STD_FS_MMAP
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
 static struct lip_ofstream_s lip_stdout_ofstream;
 static struct lip_ofstream_s lip_stderr_ofstream;
 static struct lip_ifstream_s lip_stdin_ifstream;
@@ -81,6 +93,52 @@ lip_std_fs_last_error(lip_fs_t* vtable)
 	return lip_string_ref(strerror(errno));
 }
 
+static bool
+lip_std_fs_rename(lip_fs_t* vtable, lip_string_ref_t from, lip_string_ref_t to)
+{
+	(void)vtable;
+	return rename(from.ptr, to.ptr) == 0;
+}
+
+static void
+lip_std_fs_remove(lip_fs_t* vtable, lip_string_ref_t path)
+{
+	(void)vtable;
+	remove(path.ptr);
+}
+
+#ifdef LIP_STD_FS_MMAP
+
+static const void*
+lip_std_fs_map(lip_fs_t* vtable, lip_string_ref_t path, size_t* size)
+{
+	(void)vtable;
+
+	int fd = open(path.ptr, O_RDONLY);
+	if(fd < 0) { return NULL; }
+
+	struct stat stat_buf;
+	void* ptr = NULL;
+	if(fstat(fd, &stat_buf) == 0 && S_ISREG(stat_buf.st_mode) && stat_buf.st_size > 0)
+	{
+		ptr = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(ptr == MAP_FAILED) { ptr = NULL; }
+		*size = stat_buf.st_size;
+	}
+
+	close(fd);
+	return ptr;
+}
+
+static void
+lip_std_fs_unmap(lip_fs_t* vtable, const void* ptr, size_t size)
+{
+	(void)vtable;
+	munmap((void*)ptr, size);
+}
+
+#endif
+
 lip_fs_t*
 lip_create_std_fs(lip_allocator_t* allocator)
 {
@@ -92,7 +150,13 @@ lip_create_std_fs(lip_allocator_t* allocator)
 			.end_read = lip_std_fs_end_read,
 			.begin_write = lip_std_fs_begin_write,
 			.end_write = lip_std_fs_end_write,
-			.last_error = lip_std_fs_last_error
+			.last_error = lip_std_fs_last_error,
+			.rename = lip_std_fs_rename,
+			.remove = lip_std_fs_remove,
+#ifdef LIP_STD_FS_MMAP
+			.map = lip_std_fs_map,
+			.unmap = lip_std_fs_unmap,
+#endif
 		}
 	};
 	return &fs->vtable;
@@ -9,6 +9,44 @@
 #include <setjmp.h>
 #include "vendor/sort_r.h"
 
+// Parameters of the natives with a fixed signature. lip_bind_args in their body
+// and their declaration in lip_load_stdlib both expand these.
+#define LIP_STD_PARAMS_identity (any, x)
+#define LIP_STD_PARAMS_print (any, x), \
+	(number, depth, (optional, 3)), \
+	(number, indent, (optional, 0))
+#define LIP_STD_PARAMS_throw (string_ref, msg)
+#define LIP_STD_PARAMS_is_nil (any, x)
+#define LIP_STD_PARAMS_is_bool (any, x)
+#define LIP_STD_PARAMS_is_number (any, x)
+#define LIP_STD_PARAMS_is_string (any, x)
+#define LIP_STD_PARAMS_is_symbol (any, x)
+#define LIP_STD_PARAMS_is_list (any, x)
+#define LIP_STD_PARAMS_is_map (any, x)
+#define LIP_STD_PARAMS_is_vec (any, x)
+#define LIP_STD_PARAMS_is_fn (any, x)
+#define LIP_STD_PARAMS_head (list, x)
+#define LIP_STD_PARAMS_tail (list, x)
+#define LIP_STD_PARAMS_len (list, x)
+#define LIP_STD_PARAMS_nth (number, index), (list, x)
+#define LIP_STD_PARAMS_append (list, l), (any, x)
+#define LIP_STD_PARAMS_map (function, f), (list, l)
+#define LIP_STD_PARAMS_foldl (function, f), (list, l), (any, acc)
+#define LIP_STD_PARAMS_foldr (function, f), (list, l), (any, acc)
+#define LIP_STD_PARAMS_sort (list, l), \
+	(function, cmp, \
+	 (optional, (lip_make_function(vm, LIP_PRIM_OP_WRAPPER_NAME(CMP), 0, NULL))))
+#define LIP_STD_PARAMS_builder (number, capacity, (optional, 0))
+#define LIP_STD_PARAMS_push (list_builder, builder), (any, x)
+#define LIP_STD_PARAMS_freeze (list_builder, builder)
+#define LIP_STD_PARAMS_map_get (map, m), (any, key), (any, default_value, (optional, lip_make_nil(vm)))
+#define LIP_STD_PARAMS_map_has (map, m), (any, key)
+#define LIP_STD_PARAMS_map_assoc (map, m), (any, key), (any, value)
+#define LIP_STD_PARAMS_map_dissoc (map, m), (any, key)
+#define LIP_STD_PARAMS_map_len (map, m)
+#define LIP_STD_PARAMS_map_keys (map, m)
+#define LIP_STD_PARAMS_map_fold (function, f), (map, m), (any, acc)
+
 struct lip_cmp_ctx
 {
 	lip_vm_t* vm;
@@ -26,17 +64,13 @@ static lip_function(nop)
 
 static lip_function(identity)
 {
-	lip_bind_args((any, x));
+	lip_bind_args(LIP_STD_PARAMS_identity);
 	lip_return(x);
 }
 
 static lip_function(print)
 {
-	lip_bind_args(
-		(any, x),
-		(number, depth, (optional, 3)),
-		(number, indent, (optional, 0))
-	);
+	lip_bind_args(LIP_STD_PARAMS_print);
 	lip_print_value(depth, indent, lip_stdout(), x);
 	lip_return(lip_make_nil(vm));
 }
@@ -44,8 +78,9 @@ static lip_function(print)
 static lip_function(throw)
 {
 	lip_bind_track_native_location(vm);
-	lip_bind_args((string, msg));
-	*result = msg;
+	lip_bind_args(LIP_STD_PARAMS_throw);
+	(void)msg;
+	*result = argv[0];
 	return LIP_EXEC_ERROR;
 }
 
@@ -53,79 +88,64 @@ static lip_function(throw)
 
 static lip_function(is_nil)
 {
-	lip_bind_args((any, x));
+	lip_bind_args(LIP_STD_PARAMS_is_nil);
 	lip_return(lip_make_boolean(vm, x.type == LIP_VAL_NIL));
 }
 
 static lip_function(is_bool)
 {
-	lip_bind_args((any, x));
+	lip_bind_args(LIP_STD_PARAMS_is_bool);
 	lip_return(lip_make_boolean(vm, x.type == LIP_VAL_BOOLEAN));
 }
 
 static lip_function(is_number)
 {
-	lip_bind_args((any, x));
+	lip_bind_args(LIP_STD_PARAMS_is_number);
 	lip_return(lip_make_boolean(vm, x.type == LIP_VAL_NUMBER));
 }
 
 static lip_function(is_string)
 {
-	lip_bind_args((any, x));
-	lip_return(lip_make_boolean(vm, x.type == LIP_VAL_STRING));
+	lip_bind_args(LIP_STD_PARAMS_is_string);
+	lip_return(lip_make_boolean(vm, lip_is_string(x)));
 }
 
 static lip_function(is_symbol)
 {
-	lip_bind_args((any, x));
+	lip_bind_args(LIP_STD_PARAMS_is_symbol);
 	lip_return(lip_make_boolean(vm, x.type == LIP_VAL_SYMBOL));
 }
 
 static lip_function(is_list)
 {
-	lip_bind_args((any, x));
+	lip_bind_args(LIP_STD_PARAMS_is_list);
 	lip_return(lip_make_boolean(vm, x.type == LIP_VAL_LIST));
 }
 
-static lip_function(is_fn)
+static lip_function(is_map)
 {
-	lip_bind_args((any, x));
-	lip_return(lip_make_boolean(vm, x.type == LIP_VAL_FUNCTION));
+	lip_bind_args(LIP_STD_PARAMS_is_map);
+	lip_return(lip_make_boolean(vm, x.type == LIP_VAL_MAP));
 }
 
-/*static lip_function(declare)*/
-/*{*/
-	/*lip_bind_args((symbol, name), (boolean, public), (function, fn));*/
-	/*lip_runtime_link_t* rt = LIP_CONTAINER_OF(vm->rt, lip_runtime_link_t, vtable);*/
-
-	/*khash_t(lip_module)* module = rt->ctx->current_module;*/
-	/*lip_bind_assert(module != NULL, "Cannot use `declare` out of module context");*/
-
-	/*lip_closure_t* closure = fn.data.reference;*/
-	/*lip_bind_assert(closure->env_len == 0, "Cannot `declare` function with captured var");*/
-
-	/*lip_string_t* name_str = lip_as_string(name);*/
-	/*lip_string_ref_t name_ref = { .length = name_str->length, .ptr = name_str->ptr };*/
-	/*int ret;*/
-	/*khiter_t itr = kh_put(lip_module, module, name_ref, &ret);*/
-	/*lip_bind_assert_fmt(ret != 0, "Redeclared '%.*s", (int)name_str->length, name_str->ptr);*/
-	/*kh_val(module, itr) = (lip_symbol_t){*/
-		/*.value = fn.data.reference,*/
-		/*.is_public = public*/
-	/*};*/
+static lip_function(is_vec)
+{
+	lip_bind_args(LIP_STD_PARAMS_is_vec);
+	lip_return(lip_make_boolean(vm, x.type == LIP_VAL_VEC));
+}
 
-	/*lip_return(lip_make_nil(vm));*/
-/*}*/
+static lip_function(is_fn)
+{
+	lip_bind_args(LIP_STD_PARAMS_is_fn);
+	lip_return(lip_make_boolean(vm, x.type == LIP_VAL_FUNCTION));
+}
 
 // List functions
 static lip_function(list)
 {
 	lip_bind_prepare(vm);
 
-	lip_list_t* list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
-	list->root = list->elements =
-		vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_value_t) * argc);
-	list->length = argc;
+	lip_list_t* list = lip_alloc_list(vm, argc);
 	for(unsigned int i = 0; i < argc; ++i)
 	{
 		lip_bind_arg(i + 1, (any, element));
@@ -142,117 +162,81 @@ static lip_function(list)
 
 static lip_function(head)
 {
-	lip_bind_args((list, x));
+	lip_bind_args(LIP_STD_PARAMS_head);
 	const lip_list_t* list = lip_as_list(x);
 	lip_bind_assert(list->length > 0, "List must have at least one element");
 
-	lip_return(list->elements[0]);
+	lip_return(lip_list_nth(list, 0));
 }
 
 static lip_function(tail)
 {
-	lip_bind_args((list, x));
+	lip_bind_args(LIP_STD_PARAMS_tail);
 	const lip_list_t* list = lip_as_list(x);
 	lip_bind_assert(list->length > 0, "List must have at least one element");
 
-	lip_list_t* new_list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
-	new_list->length = list->length - 1;
-	new_list->root = list->root;
-	new_list->elements = list->elements + 1;
-
-	lip_value_t ret_val = (lip_value_t) {
-		.type = LIP_VAL_LIST,
-		.data = { .reference = new_list }
-	};
-	lip_return(ret_val);
+	lip_return(lip_list_tail(vm, list));
 }
 
 static lip_function(len)
 {
-	lip_bind_args((list, x));
+	lip_bind_args(LIP_STD_PARAMS_len);
 	lip_return(lip_make_number(vm, lip_as_list(x)->length));
 }
 
 static lip_function(nth)
 {
-	lip_bind_args((number, index), (list, x));
+	lip_bind_args(LIP_STD_PARAMS_nth);
 	const lip_list_t* list = lip_as_list(x);
 	lip_bind_assert(0 <= index && index < list->length, "List index out of bound");
-	lip_return(lip_as_list(x)->elements[(int)index]);
+	lip_return(lip_list_nth(list, (size_t)index));
 }
 
 static lip_function(concat)
 {
 	lip_bind_prepare(vm);
 
-	size_t length = 0;
-
+	lip_value_t ret_val = lip_make_nil(vm);
 	for(unsigned int i = 0; i < argc; ++i)
 	{
 		lip_bind_arg(i + 1, (list, list));
-		length += lip_as_list(list)->length;
+		ret_val = i == 0
+			? list
+			: lip_list_concat(vm, lip_as_list(ret_val), lip_as_list(list));
 	}
 
-	lip_list_t* list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
-	list->root = list->elements =
-		vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_value_t) * length);
-	list->length = length;
-
-	size_t index = 0;
-	for(unsigned int i = 0; i < argc; ++i)
+	if(argc == 0)
 	{
-		const lip_list_t* sublist = lip_as_list(argv[i]);
-		memcpy(
-			&list->elements[index],
-			sublist->elements,
-			sublist->length * sizeof(*sublist->elements)
-		);
-		index += sublist->length;
+		ret_val = (lip_value_t) {
+			.type = LIP_VAL_LIST,
+			.data = { .reference = lip_alloc_list(vm, 0) }
+		};
 	}
 
-	lip_value_t ret_val = (lip_value_t) {
-		.type = LIP_VAL_LIST,
-		.data = { .reference = list }
-	};
 	lip_return(ret_val);
 }
 
 static lip_function(append)
 {
-	lip_bind_args((list, l), (any, x));
-
-	const lip_list_t* list = lip_as_list(l);
-
-	lip_list_t* new_list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
-	new_list->root = new_list->elements =
-		vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_value_t) * (list->length + 1));
-	new_list->length = list->length + 1;
-
-	memcpy(new_list->elements, list->elements, sizeof(lip_value_t) * list->length);
-	new_list->elements[list->length] = x;
-
-	lip_value_t ret_val = (lip_value_t) {
-		.type = LIP_VAL_LIST,
-		.data = { .reference = new_list }
-	};
-	lip_return(ret_val);
+	lip_bind_args(LIP_STD_PARAMS_append);
+	lip_return(lip_list_append(vm, lip_as_list(l), x));
 }
 
 static lip_function(map)
 {
-	lip_bind_args((function, f), (list, l));
+	lip_bind_args(LIP_STD_PARAMS_map);
 
 	const lip_list_t* list = lip_as_list(l);
 
-	lip_list_t* new_list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
-	new_list->root = new_list->elements =
-		vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_value_t) * list->length);
-	new_list->length = list->length;
+	lip_list_t* new_list = lip_alloc_list(vm, list->length);
 
-	for(size_t i = 0; i < list->length; ++i)
+	lip_list_iterator_t itr;
+	lip_value_t element;
+	for(lip_list_begin(list, &itr); lip_list_next(&itr, &element);)
 	{
+		size_t i = itr.index - 1;
 		lip_exec_status_t status =
-			lip_call(vm, &new_list->elements[i], f, 1, list->elements[i]);
+			lip_call(vm, &new_list->elements[i], f, 1, element);
 		if(status != LIP_EXEC_OK)
 		{
 			*result = new_list->elements[i];
@@ -269,14 +253,16 @@ static lip_function(map)
 
 static lip_function(foldl)
 {
-	lip_bind_args((function, f), (list, l), (any, acc));
+	lip_bind_args(LIP_STD_PARAMS_foldl);
 
 	const lip_list_t* list = lip_as_list(l);
 
-	for(size_t i = 0; i < list->length; ++i)
+	lip_list_iterator_t itr;
+	lip_value_t element;
+	for(lip_list_begin(list, &itr); lip_list_next(&itr, &element);)
 	{
 		lip_exec_status_t status =
-			lip_call(vm, &acc, f, 2, list->elements[i], acc);
+			lip_call(vm, &acc, f, 2, element, acc);
 		if(status != LIP_EXEC_OK)
 		{
 			*result = acc;
@@ -289,14 +275,187 @@ static lip_function(foldl)
 
 static lip_function(foldr)
 {
-	lip_bind_args((function, f), (list, l), (any, acc));
+	lip_bind_args(LIP_STD_PARAMS_foldr);
 
 	const lip_list_t* list = lip_as_list(l);
 
 	for(size_t i = 0; i < list->length; ++i)
 	{
 		lip_exec_status_t status =
-			lip_call(vm, &acc, f, 2, list->elements[list->length - i - 1], acc);
+			lip_call(vm, &acc, f, 2, lip_list_nth(list, list->length - i - 1), acc);
+		if(status != LIP_EXEC_OK)
+		{
+			*result = acc;
+			return status;
+		}
+	}
+
+	lip_return(acc);
+}
+
+static lip_function(builder)
+{
+	lip_bind_args(LIP_STD_PARAMS_builder);
+	lip_bind_assert(capacity >= 0, "Capacity must not be negative");
+
+	lip_list_builder_t* builder =
+		vm->rt->malloc(vm->rt, LIP_VAL_NATIVE, sizeof(lip_list_builder_t));
+	lip_list_builder_begin(vm, builder, (size_t)capacity);
+
+	lip_value_t ret_val;
+	lip_bind_store_list_builder(ret_val, builder);
+	lip_return(ret_val);
+}
+
+static lip_function(push)
+{
+	lip_bind_args(LIP_STD_PARAMS_push);
+	lip_list_builder_push(builder, x);
+	lip_return(argv[0]);
+}
+
+static lip_function(freeze)
+{
+	lip_bind_args(LIP_STD_PARAMS_freeze);
+	lip_return(lip_list_builder_freeze(builder));
+}
+
+static lip_function(vec)
+{
+	lip_bind_prepare(vm);
+
+	lip_vec_t* vec = lip_alloc_vec(vm, argc);
+	for(unsigned int i = 0; i < argc; ++i)
+	{
+		lip_bind_arg(i + 1, (number, element));
+
+		vec->elements[i] = element;
+	}
+
+	lip_value_t ret_val = (lip_value_t) {
+		.type = LIP_VAL_VEC,
+		.data = { .reference = vec }
+	};
+	lip_return(ret_val);
+}
+
+// Map functions
+static lip_function(make_map)
+{
+	lip_bind_prepare(vm);
+	lip_bind_assert(argc % 2 == 0, "Map must be created with key-value pairs");
+
+	lip_value_t ret_val = lip_make_map(vm);
+	for(unsigned int i = 0; i < argc; i += 2)
+	{
+		ret_val = lip_map_assoc(vm, lip_as_map(ret_val), argv[i], argv[i + 1]);
+	}
+
+	lip_return(ret_val);
+}
+
+static lip_function(map_get)
+{
+	lip_bind_args(LIP_STD_PARAMS_map_get);
+
+	lip_value_t value;
+	lip_return(lip_map_get(lip_as_map(m), key, &value) ? value : default_value);
+}
+
+static lip_function(map_has)
+{
+	lip_bind_args(LIP_STD_PARAMS_map_has);
+	lip_return(lip_make_boolean(vm, lip_map_get(lip_as_map(m), key, NULL)));
+}
+
+static lip_function(map_assoc)
+{
+	lip_bind_args(LIP_STD_PARAMS_map_assoc);
+	lip_return(lip_map_assoc(vm, lip_as_map(m), key, value));
+}
+
+static lip_function(map_dissoc)
+{
+	lip_bind_args(LIP_STD_PARAMS_map_dissoc);
+	lip_return(lip_map_dissoc(vm, lip_as_map(m), key));
+}
+
+static lip_function(map_len)
+{
+	lip_bind_args(LIP_STD_PARAMS_map_len);
+	lip_return(lip_make_number(vm, lip_as_map(m)->size));
+}
+
+static lip_function(map_merge)
+{
+	lip_bind_prepare(vm);
+
+	lip_value_t ret_val = lip_make_map(vm);
+	for(unsigned int i = 0; i < argc; ++i)
+	{
+		lip_bind_arg(i + 1, (map, m));
+		const lip_map_t* lhs = lip_as_map(ret_val);
+		const lip_map_t* rhs = lip_as_map(m);
+
+		// Insert the smaller map into the larger one, values from the right
+		// take precedence
+		lip_map_iterator_t itr;
+		lip_value_t key, value;
+		if(rhs->size > lhs->size)
+		{
+			ret_val = m;
+			for(lip_map_begin(lhs, &itr); lip_map_next(&itr, &key, &value);)
+			{
+				if(!lip_map_get(rhs, key, NULL))
+				{
+					ret_val = lip_map_assoc(vm, lip_as_map(ret_val), key, value);
+				}
+			}
+		}
+		else
+		{
+			for(lip_map_begin(rhs, &itr); lip_map_next(&itr, &key, &value);)
+			{
+				ret_val = lip_map_assoc(vm, lip_as_map(ret_val), key, value);
+			}
+		}
+	}
+
+	lip_return(ret_val);
+}
+
+static lip_function(map_keys)
+{
+	lip_bind_args(LIP_STD_PARAMS_map_keys);
+
+	const lip_map_t* map = lip_as_map(m);
+	lip_list_t* list = lip_alloc_list(vm, map->size);
+
+	size_t i = 0;
+	lip_map_iterator_t itr;
+	lip_value_t key, value;
+	for(lip_map_begin(map, &itr); lip_map_next(&itr, &key, &value);)
+	{
+		list->elements[i++] = key;
+	}
+
+	lip_value_t ret_val = (lip_value_t) {
+		.type = LIP_VAL_LIST,
+		.data = { .reference = list }
+	};
+	lip_return(ret_val);
+}
+
+static lip_function(map_fold)
+{
+	lip_bind_args(LIP_STD_PARAMS_map_fold);
+
+	lip_map_iterator_t itr;
+	lip_value_t key, value;
+	for(lip_map_begin(lip_as_map(m), &itr); lip_map_next(&itr, &key, &value);)
+	{
+		lip_exec_status_t status =
+			lip_call(vm, &acc, f, 3, key, value, acc);
 		if(status != LIP_EXEC_OK)
 		{
 			*result = acc;
@@ -359,21 +518,17 @@ lip_cmp_fn(
 
 static lip_function(sort)
 {
-	lip_bind_args(
-		(list, l),
-		(function, cmp,
-		 (optional, (lip_make_function(vm, LIP_PRIM_OP_WRAPPER_NAME(CMP), 0, NULL))))
-	);
+	lip_bind_args(LIP_STD_PARAMS_sort);
 
 	const lip_list_t* list = lip_as_list(l);
 
-	lip_list_t* new_list = vm->rt->malloc(vm->rt, LIP_VAL_LIST, sizeof(lip_list_t));
-	new_list->root = new_list->elements = vm->rt->malloc(
-		vm->rt, LIP_VAL_NATIVE, sizeof(lip_value_t) * list->length
-	);
-	new_list->length = list->length;
-
-	memcpy(new_list->elements, list->elements, sizeof(lip_value_t) * list->length);
+	lip_list_t* new_list = lip_alloc_list(vm, list->length);
+	lip_list_iterator_t itr;
+	lip_value_t element;
+	for(lip_list_begin(list, &itr); lip_list_next(&itr, &element);)
+	{
+		new_list->elements[itr.index - 1] = element;
+	}
 
 	struct lip_cmp_ctx cmp_ctx = {
 		.vm = vm,
@@ -406,24 +561,46 @@ static lip_function(sort)
 	lip_return(ret_val);
 }
 
+#define LIP_DECLARE_BOUND_FUNCTION(name, fn) \
+	lip_declare_function_with_signature( \
+		module, lip_string_ref(name), fn, lip_bind_signature(LIP_STD_PARAMS_##fn) \
+	)
+// Functions which never keep or return a reference to their arguments
+#define LIP_DECLARE_BORROWING_FUNCTION(name, fn) \
+	lip_declare_function_with_signature( \
+		module, lip_string_ref(name), fn, \
+		lip_borrowing_signature(lip_bind_signature(LIP_STD_PARAMS_##fn)) \
+	)
+
+static lip_signature_t
+lip_borrowing_signature(lip_signature_t signature)
+{
+	signature.borrows_args = true;
+	return signature;
+}
+
 void
 lip_load_stdlib(lip_context_t* ctx)
 {
 	lip_module_context_t* module = lip_begin_module(ctx, lip_string_ref(""));
 	lip_declare_function(module, lip_string_ref("nop"), nop);
-	lip_declare_function(module, lip_string_ref("identity"), identity);
-	lip_declare_function(module, lip_string_ref("print"), print);
-	lip_declare_function(module, lip_string_ref("throw"), throw);
+	LIP_DECLARE_BOUND_FUNCTION("identity", identity);
+	LIP_DECLARE_BORROWING_FUNCTION("print", print);
+	LIP_DECLARE_BOUND_FUNCTION("throw", throw);
 	lip_declare_function(module, lip_string_ref("list"), list);
-	/*lip_declare_function(module, lip_string_ref("declare"), declare);*/
-
-	lip_declare_function(module, lip_string_ref("nil?"), is_nil);
-	lip_declare_function(module, lip_string_ref("bool?"), is_bool);
-	lip_declare_function(module, lip_string_ref("number?"), is_number);
-	lip_declare_function(module, lip_string_ref("string?"), is_string);
-	lip_declare_function(module, lip_string_ref("symbol?"), is_symbol);
-	lip_declare_function(module, lip_string_ref("list?"), is_list);
-	lip_declare_function(module, lip_string_ref("fn?"), is_fn);
+	lip_declare_function(module, lip_string_ref("map"), make_map);
+	lip_declare_function(module, lip_string_ref("vec"), vec);
+	lip_declare_function(module, lip_string_ref("declare"), lip_builtin_declare);
+
+	LIP_DECLARE_BOUND_FUNCTION("nil?", is_nil);
+	LIP_DECLARE_BOUND_FUNCTION("bool?", is_bool);
+	LIP_DECLARE_BOUND_FUNCTION("number?", is_number);
+	LIP_DECLARE_BOUND_FUNCTION("string?", is_string);
+	LIP_DECLARE_BOUND_FUNCTION("symbol?", is_symbol);
+	LIP_DECLARE_BOUND_FUNCTION("list?", is_list);
+	LIP_DECLARE_BOUND_FUNCTION("map?", is_map);
+	LIP_DECLARE_BOUND_FUNCTION("vec?", is_vec);
+	LIP_DECLARE_BOUND_FUNCTION("fn?", is_fn);
 
 #define LIP_STRINGIFY(x) LIP_STRINGIFY1(x)
 #define LIP_STRINGIFY1(x) #x
@@ -434,15 +611,34 @@ lip_load_stdlib(lip_context_t* ctx)
 	lip_end_module(ctx, module);
 
 	module = lip_begin_module(ctx, lip_string_ref("list"));
-	lip_declare_function(module, lip_string_ref("head"), head);
-	lip_declare_function(module, lip_string_ref("tail"), tail);
-	lip_declare_function(module, lip_string_ref("len"), len);
-	lip_declare_function(module, lip_string_ref("nth"), nth);
-	lip_declare_function(module, lip_string_ref("append"), append);
+	LIP_DECLARE_BORROWING_FUNCTION("head", head);
+	LIP_DECLARE_BOUND_FUNCTION("tail", tail);
+	LIP_DECLARE_BORROWING_FUNCTION("len", len);
+	LIP_DECLARE_BORROWING_FUNCTION("nth", nth);
+	LIP_DECLARE_BOUND_FUNCTION("append", append);
 	lip_declare_function(module, lip_string_ref("concat"), concat);
-	lip_declare_function(module, lip_string_ref("map"), map);
-	lip_declare_function(module, lip_string_ref("foldl"), foldl);
-	lip_declare_function(module, lip_string_ref("foldr"), foldr);
-	lip_declare_function(module, lip_string_ref("sort"), sort);
+	LIP_DECLARE_BORROWING_FUNCTION("map", map);
+	LIP_DECLARE_BOUND_FUNCTION("foldl", foldl);
+	LIP_DECLARE_BOUND_FUNCTION("foldr", foldr);
+	LIP_DECLARE_BOUND_FUNCTION("sort", sort);
+	LIP_DECLARE_BOUND_FUNCTION("builder", builder);
+	LIP_DECLARE_BOUND_FUNCTION("push", push);
+	LIP_DECLARE_BOUND_FUNCTION("freeze", freeze);
 	lip_end_module(ctx, module);
+
+	module = lip_begin_module(ctx, lip_string_ref("map"));
+	LIP_DECLARE_BOUND_FUNCTION("get", map_get);
+	LIP_DECLARE_BOUND_FUNCTION("has?", map_has);
+	LIP_DECLARE_BOUND_FUNCTION("assoc", map_assoc);
+	LIP_DECLARE_BOUND_FUNCTION("dissoc", map_dissoc);
+	LIP_DECLARE_BOUND_FUNCTION("len", map_len);
+	lip_declare_function(module, lip_string_ref("merge"), map_merge);
+	LIP_DECLARE_BOUND_FUNCTION("keys", map_keys);
+	LIP_DECLARE_BOUND_FUNCTION("fold", map_fold);
+	lip_end_module(ctx, module);
+
+	lip_load_veclib(ctx);
 }
+
+#undef LIP_DECLARE_BOUND_FUNCTION
+#undef LIP_DECLARE_BORROWING_FUNCTION
@@ -33,7 +33,8 @@ lip_create_std_runtime_config(lip_allocator_t* allocator)
 		},
 		.module_search_patterns = LIP_DEFAULT_MODULE_SEARCH_PATTERNS,
 		.num_module_search_patterns = LIP_STATIC_ARRAY_LEN(LIP_DEFAULT_MODULE_SEARCH_PATTERNS),
-		.fs = lip_create_std_fs(allocator)
+		.fs = lip_create_std_fs(allocator),
+		.max_symbols = 1 << 16
 	};
 
 	return cfg;
@@ -0,0 +1,667 @@
+#include <lip/std/lib.h>
+#include <lip/core.h>
+#include <lip/core/vm.h>
+#include <lip/bind.h>
+#include <lip/config.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#	define LIP_VEC_X86 1
+#	define LIP_VEC_TARGET(isa) __attribute__((target(isa)))
+#	include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#	define LIP_VEC_X86 1
+#	define LIP_VEC_TARGET(isa)
+#	include <immintrin.h>
+#	include <intrin.h>
+#else
+#	define LIP_VEC_X86 0
+#endif
+
+#if defined(LIP_THREADING_PTHREAD)
+#	include <pthread.h>
+#elif defined(LIP_THREADING_WINAPI)
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#endif
+
+typedef struct lip_vec_kernels_s lip_vec_kernels_t;
+
+typedef void(*lip_vec_map_fn_t)(
+	double* out, const double* lhs, const double* rhs, size_t n
+);
+typedef void(*lip_vec_map_scalar_fn_t)(
+	double* out, const double* lhs, double rhs, size_t n
+);
+typedef double(*lip_vec_reduce_fn_t)(const double* vec, size_t n);
+typedef double(*lip_vec_dot_fn_t)(const double* lhs, const double* rhs, size_t n);
+
+// Element-wise operations, comparisons yield 1 or 0
+#define LIP_VEC_MAP_OP(F) \
+	F(add, +) \
+	F(sub, -) \
+	F(mul, *) \
+	F(div, /) \
+	F(eq, ==) \
+	F(lt, <) \
+	F(le, <=) \
+	F(gt, >) \
+	F(ge, >=)
+
+// Reductions, min and max are undefined on empty vectors.
+// min and max return NaN if any element is NaN.
+#define LIP_VEC_REDUCE_OP(F) \
+	F(sum, 0.0, lip_vec_scalar_add, true, false) \
+	F(min, vec[0], lip_vec_scalar_min, false, true) \
+	F(max, vec[0], lip_vec_scalar_max, false, true)
+
+// Same results as the SSE instructions, including for NaN and signed zeros
+#define lip_vec_scalar_add(a, b) ((a) + (b))
+#define lip_vec_scalar_min(a, b) ((a) < (b) ? (a) : (b))
+#define lip_vec_scalar_max(a, b) ((a) > (b) ? (a) : (b))
+
+/*
+ * Reductions are computed in the same order whatever the instruction set so
+ * that they give the same results everywhere: elements are spread over
+ * LIP_VEC_LANES accumulators, each element going to the one given by its index
+ * modulo LIP_VEC_LANES. The accumulators are then combined pairwise and the
+ * remaining elements are added in order.
+ */
+#define LIP_VEC_LANES 8
+
+#define LIP_VEC_DECLARE_MAP_KERNEL(name, op) \
+	lip_vec_map_fn_t name; \
+	lip_vec_map_scalar_fn_t name##_scalar;
+#define LIP_VEC_DECLARE_REDUCE_KERNEL(name, init, op, allow_empty, check_nan) \
+	lip_vec_reduce_fn_t name;
+
+struct lip_vec_kernels_s
+{
+	const char* isa;
+	LIP_VEC_MAP_OP(LIP_VEC_DECLARE_MAP_KERNEL)
+	LIP_VEC_REDUCE_OP(LIP_VEC_DECLARE_REDUCE_KERNEL)
+	lip_vec_dot_fn_t dot;
+};
+
+/*
+ * Kernels are generated once per instruction set from the following macros.
+ * Before expanding LIP_VEC_DEFINE_KERNELS, define:
+ *
+ * - LIP_VEC_ISA: Suffix of the generated functions.
+ * - LIP_VEC_ATTR: Function attributes enabling the instruction set.
+ * - LIP_VEC_T, LIP_VEC_WIDTH: Register type and number of doubles it holds.
+ * - LIP_VEC_LOAD, LIP_VEC_STORE, LIP_VEC_SET1: Unaligned load/store and broadcast.
+ * - LIP_VEC_OP_<name>: One for each operation in LIP_VEC_MAP_OP, plus min, max
+ *   and unord, which yields 1 or 0 like the comparisons.
+ */
+#define LIP_VEC_KERNEL(name) \
+	lip_pp_concat(lip_pp_concat(lip_vec_, name), lip_pp_concat(_, LIP_VEC_ISA))
+
+#define LIP_VEC_DEFINE_MAP_KERNEL(name, op) \
+	LIP_VEC_ATTR static void \
+	LIP_VEC_KERNEL(name)(double* out, const double* lhs, const double* rhs, size_t n) \
+	{ \
+		size_t i = 0; \
+		for(; i + LIP_VEC_WIDTH <= n; i += LIP_VEC_WIDTH) \
+		{ \
+			LIP_VEC_STORE( \
+				out + i, \
+				LIP_VEC_OP_##name(LIP_VEC_LOAD(lhs + i), LIP_VEC_LOAD(rhs + i)) \
+			); \
+		} \
+		for(; i < n; ++i) { out[i] = lhs[i] op rhs[i]; } \
+	} \
+	LIP_VEC_ATTR static void \
+	LIP_VEC_KERNEL(name##_scalar)(double* out, const double* lhs, double rhs, size_t n) \
+	{ \
+		LIP_VEC_T rhs_v = LIP_VEC_SET1(rhs); \
+		size_t i = 0; \
+		for(; i + LIP_VEC_WIDTH <= n; i += LIP_VEC_WIDTH) \
+		{ \
+			LIP_VEC_STORE(out + i, LIP_VEC_OP_##name(LIP_VEC_LOAD(lhs + i), rhs_v)); \
+		} \
+		for(; i < n; ++i) { out[i] = lhs[i] op rhs; } \
+	}
+
+#define LIP_VEC_REGISTERS (LIP_VEC_LANES / LIP_VEC_WIDTH)
+
+// Combine the accumulators, then the elements left
+#define LIP_VEC_REDUCE_TAIL(acc_v, op, tail_exp) \
+	double lanes[LIP_VEC_LANES]; \
+	for(unsigned int k = 0; k < LIP_VEC_REGISTERS; ++k) \
+	{ \
+		LIP_VEC_STORE(lanes + k * LIP_VEC_WIDTH, acc_v[k]); \
+	} \
+	for(unsigned int width = LIP_VEC_LANES / 2; width > 0; width /= 2) \
+	{ \
+		for(unsigned int j = 0; j < width; ++j) \
+		{ \
+			lanes[j] = op(lanes[j], lanes[j + width]); \
+		} \
+	} \
+	double acc = lanes[0]; \
+	for(; i < n; ++i) { acc = op(acc, tail_exp); }
+
+#define LIP_VEC_DEFINE_REDUCE_KERNEL(name, init, op, allow_empty, check_nan) \
+	LIP_VEC_ATTR static double \
+	LIP_VEC_KERNEL(name)(const double* vec, size_t n) \
+	{ \
+		LIP_VEC_T acc_v[LIP_VEC_REGISTERS]; \
+		LIP_VEC_T nan_v = LIP_VEC_SET1(0.0); \
+		for(unsigned int k = 0; k < LIP_VEC_REGISTERS; ++k) \
+		{ \
+			acc_v[k] = LIP_VEC_SET1(init); \
+		} \
+		size_t i = 0; \
+		for(; i + LIP_VEC_LANES <= n; i += LIP_VEC_LANES) \
+		{ \
+			for(unsigned int k = 0; k < LIP_VEC_REGISTERS; ++k) \
+			{ \
+				LIP_VEC_T elems = LIP_VEC_LOAD(vec + i + k * LIP_VEC_WIDTH); \
+				acc_v[k] = LIP_VEC_OP_##name(acc_v[k], elems); \
+				if(check_nan) \
+				{ \
+					nan_v = LIP_VEC_OP_add(nan_v, LIP_VEC_OP_unord(elems, elems)); \
+				} \
+			} \
+		} \
+		if(check_nan) \
+		{ \
+			/* Return the first NaN, as the generic kernels would */ \
+			double nans[LIP_VEC_WIDTH]; \
+			LIP_VEC_STORE(nans, nan_v); \
+			bool has_nan = false; \
+			for(unsigned int j = 0; j < LIP_VEC_WIDTH; ++j) \
+			{ \
+				has_nan = has_nan || nans[j] != 0.0; \
+			} \
+			for(size_t j = has_nan ? 0 : i; j < n; ++j) \
+			{ \
+				if(vec[j] != vec[j]) { return vec[j]; } \
+			} \
+		} \
+		LIP_VEC_REDUCE_TAIL(acc_v, op, vec[i]) \
+		return acc; \
+	}
+
+#define LIP_VEC_DEFINE_KERNELS() \
+	LIP_VEC_MAP_OP(LIP_VEC_DEFINE_MAP_KERNEL) \
+	LIP_VEC_REDUCE_OP(LIP_VEC_DEFINE_REDUCE_KERNEL) \
+	LIP_VEC_ATTR static double \
+	LIP_VEC_KERNEL(dot)(const double* lhs, const double* rhs, size_t n) \
+	{ \
+		LIP_VEC_T acc_v[LIP_VEC_REGISTERS]; \
+		for(unsigned int k = 0; k < LIP_VEC_REGISTERS; ++k) \
+		{ \
+			acc_v[k] = LIP_VEC_SET1(0.0); \
+		} \
+		size_t i = 0; \
+		for(; i + LIP_VEC_LANES <= n; i += LIP_VEC_LANES) \
+		{ \
+			for(unsigned int k = 0; k < LIP_VEC_REGISTERS; ++k) \
+			{ \
+				size_t j = i + k * LIP_VEC_WIDTH; \
+				acc_v[k] = LIP_VEC_OP_add( \
+					acc_v[k], LIP_VEC_OP_mul(LIP_VEC_LOAD(lhs + j), LIP_VEC_LOAD(rhs + j)) \
+				); \
+			} \
+		} \
+		LIP_VEC_REDUCE_TAIL(acc_v, lip_vec_scalar_add, lhs[i] * rhs[i]) \
+		return acc; \
+	} \
+	static const lip_vec_kernels_t LIP_VEC_KERNEL(kernels) = { \
+		.isa = lip_pp_stringify(LIP_VEC_ISA), \
+		LIP_VEC_MAP_OP(LIP_VEC_REGISTER_MAP_KERNEL) \
+		LIP_VEC_REDUCE_OP(LIP_VEC_REGISTER_REDUCE_KERNEL) \
+		.dot = LIP_VEC_KERNEL(dot) \
+	};
+
+#define LIP_VEC_REGISTER_MAP_KERNEL(name, op) \
+	.name = LIP_VEC_KERNEL(name), \
+	.name##_scalar = LIP_VEC_KERNEL(name##_scalar),
+#define LIP_VEC_REGISTER_REDUCE_KERNEL(name, init, op, allow_empty, check_nan) \
+	.name = LIP_VEC_KERNEL(name),
+
+#define lip_pp_stringify(x) lip_pp_stringify1(x)
+#define lip_pp_stringify1(x) #x
+
+// Portable kernels, one element at a time
+
+#define LIP_VEC_ISA generic
+#define LIP_VEC_ATTR
+#define LIP_VEC_T double
+#define LIP_VEC_WIDTH 1
+#define LIP_VEC_LOAD(ptr) (*(ptr))
+#define LIP_VEC_STORE(ptr, v) (*(ptr) = (v))
+#define LIP_VEC_SET1(x) (x)
+#define LIP_VEC_OP_add(a, b) ((a) + (b))
+#define LIP_VEC_OP_sub(a, b) ((a) - (b))
+#define LIP_VEC_OP_mul(a, b) ((a) * (b))
+#define LIP_VEC_OP_div(a, b) ((a) / (b))
+#define LIP_VEC_OP_eq(a, b) ((double)((a) == (b)))
+#define LIP_VEC_OP_lt(a, b) ((double)((a) < (b)))
+#define LIP_VEC_OP_le(a, b) ((double)((a) <= (b)))
+#define LIP_VEC_OP_gt(a, b) ((double)((a) > (b)))
+#define LIP_VEC_OP_ge(a, b) ((double)((a) >= (b)))
+#define LIP_VEC_OP_unord(a, b) ((double)((a) != (a) || (b) != (b)))
+#define LIP_VEC_OP_sum(a, b) ((a) + (b))
+#define LIP_VEC_OP_min(a, b) lip_vec_scalar_min(a, b)
+#define LIP_VEC_OP_max(a, b) lip_vec_scalar_max(a, b)
+
+LIP_VEC_DEFINE_KERNELS()
+
+#undef LIP_VEC_ISA
+#undef LIP_VEC_ATTR
+#undef LIP_VEC_T
+#undef LIP_VEC_WIDTH
+#undef LIP_VEC_LOAD
+#undef LIP_VEC_STORE
+#undef LIP_VEC_SET1
+#undef LIP_VEC_OP_add
+#undef LIP_VEC_OP_sub
+#undef LIP_VEC_OP_mul
+#undef LIP_VEC_OP_div
+#undef LIP_VEC_OP_eq
+#undef LIP_VEC_OP_lt
+#undef LIP_VEC_OP_le
+#undef LIP_VEC_OP_gt
+#undef LIP_VEC_OP_ge
+#undef LIP_VEC_OP_unord
+#undef LIP_VEC_OP_sum
+#undef LIP_VEC_OP_min
+#undef LIP_VEC_OP_max
+
+#if LIP_VEC_X86
+
+// SSE2
+
+#define LIP_VEC_ISA sse2
+#define LIP_VEC_ATTR LIP_VEC_TARGET("sse2")
+#define LIP_VEC_T __m128d
+#define LIP_VEC_WIDTH 2
+#define LIP_VEC_LOAD(ptr) _mm_loadu_pd(ptr)
+#define LIP_VEC_STORE(ptr, v) _mm_storeu_pd(ptr, v)
+#define LIP_VEC_SET1(x) _mm_set1_pd(x)
+#define LIP_VEC_OP_add(a, b) _mm_add_pd(a, b)
+#define LIP_VEC_OP_sub(a, b) _mm_sub_pd(a, b)
+#define LIP_VEC_OP_mul(a, b) _mm_mul_pd(a, b)
+#define LIP_VEC_OP_div(a, b) _mm_div_pd(a, b)
+#define LIP_VEC_OP_eq(a, b) _mm_and_pd(_mm_cmpeq_pd(a, b), _mm_set1_pd(1.0))
+#define LIP_VEC_OP_lt(a, b) _mm_and_pd(_mm_cmplt_pd(a, b), _mm_set1_pd(1.0))
+#define LIP_VEC_OP_le(a, b) _mm_and_pd(_mm_cmple_pd(a, b), _mm_set1_pd(1.0))
+#define LIP_VEC_OP_gt(a, b) _mm_and_pd(_mm_cmpgt_pd(a, b), _mm_set1_pd(1.0))
+#define LIP_VEC_OP_ge(a, b) _mm_and_pd(_mm_cmpge_pd(a, b), _mm_set1_pd(1.0))
+#define LIP_VEC_OP_unord(a, b) _mm_and_pd(_mm_cmpunord_pd(a, b), _mm_set1_pd(1.0))
+#define LIP_VEC_OP_sum(a, b) _mm_add_pd(a, b)
+#define LIP_VEC_OP_min(a, b) _mm_min_pd(a, b)
+#define LIP_VEC_OP_max(a, b) _mm_max_pd(a, b)
+
+LIP_VEC_DEFINE_KERNELS()
+
+#undef LIP_VEC_ISA
+#undef LIP_VEC_ATTR
+#undef LIP_VEC_T
+#undef LIP_VEC_WIDTH
+#undef LIP_VEC_LOAD
+#undef LIP_VEC_STORE
+#undef LIP_VEC_SET1
+#undef LIP_VEC_OP_add
+#undef LIP_VEC_OP_sub
+#undef LIP_VEC_OP_mul
+#undef LIP_VEC_OP_div
+#undef LIP_VEC_OP_eq
+#undef LIP_VEC_OP_lt
+#undef LIP_VEC_OP_le
+#undef LIP_VEC_OP_gt
+#undef LIP_VEC_OP_ge
+#undef LIP_VEC_OP_unord
+#undef LIP_VEC_OP_sum
+#undef LIP_VEC_OP_min
+#undef LIP_VEC_OP_max
+
+// AVX2
+
+#define LIP_VEC_ISA avx2
+#define LIP_VEC_ATTR LIP_VEC_TARGET("avx2")
+#define LIP_VEC_T __m256d
+#define LIP_VEC_WIDTH 4
+#define LIP_VEC_LOAD(ptr) _mm256_loadu_pd(ptr)
+#define LIP_VEC_STORE(ptr, v) _mm256_storeu_pd(ptr, v)
+#define LIP_VEC_SET1(x) _mm256_set1_pd(x)
+#define LIP_VEC_OP_add(a, b) _mm256_add_pd(a, b)
+#define LIP_VEC_OP_sub(a, b) _mm256_sub_pd(a, b)
+#define LIP_VEC_OP_mul(a, b) _mm256_mul_pd(a, b)
+#define LIP_VEC_OP_div(a, b) _mm256_div_pd(a, b)
+#define LIP_VEC_CMP(a, b, pred) \
+	_mm256_and_pd(_mm256_cmp_pd(a, b, pred), _mm256_set1_pd(1.0))
+#define LIP_VEC_OP_eq(a, b) LIP_VEC_CMP(a, b, _CMP_EQ_OQ)
+#define LIP_VEC_OP_lt(a, b) LIP_VEC_CMP(a, b, _CMP_LT_OQ)
+#define LIP_VEC_OP_le(a, b) LIP_VEC_CMP(a, b, _CMP_LE_OQ)
+#define LIP_VEC_OP_gt(a, b) LIP_VEC_CMP(a, b, _CMP_GT_OQ)
+#define LIP_VEC_OP_ge(a, b) LIP_VEC_CMP(a, b, _CMP_GE_OQ)
+#define LIP_VEC_OP_unord(a, b) LIP_VEC_CMP(a, b, _CMP_UNORD_Q)
+#define LIP_VEC_OP_sum(a, b) _mm256_add_pd(a, b)
+#define LIP_VEC_OP_min(a, b) _mm256_min_pd(a, b)
+#define LIP_VEC_OP_max(a, b) _mm256_max_pd(a, b)
+
+LIP_VEC_DEFINE_KERNELS()
+
+#undef LIP_VEC_ISA
+#undef LIP_VEC_ATTR
+#undef LIP_VEC_T
+#undef LIP_VEC_WIDTH
+#undef LIP_VEC_LOAD
+#undef LIP_VEC_STORE
+#undef LIP_VEC_SET1
+#undef LIP_VEC_OP_add
+#undef LIP_VEC_OP_sub
+#undef LIP_VEC_OP_mul
+#undef LIP_VEC_OP_div
+#undef LIP_VEC_CMP
+#undef LIP_VEC_OP_eq
+#undef LIP_VEC_OP_lt
+#undef LIP_VEC_OP_le
+#undef LIP_VEC_OP_gt
+#undef LIP_VEC_OP_ge
+#undef LIP_VEC_OP_unord
+#undef LIP_VEC_OP_sum
+#undef LIP_VEC_OP_min
+#undef LIP_VEC_OP_max
+
+// AVX-512
+
+#define LIP_VEC_ISA avx512
+#define LIP_VEC_ATTR LIP_VEC_TARGET("avx512f")
+#define LIP_VEC_T __m512d
+#define LIP_VEC_WIDTH 8
+#define LIP_VEC_LOAD(ptr) _mm512_loadu_pd(ptr)
+#define LIP_VEC_STORE(ptr, v) _mm512_storeu_pd(ptr, v)
+#define LIP_VEC_SET1(x) _mm512_set1_pd(x)
+#define LIP_VEC_OP_add(a, b) _mm512_add_pd(a, b)
+#define LIP_VEC_OP_sub(a, b) _mm512_sub_pd(a, b)
+#define LIP_VEC_OP_mul(a, b) _mm512_mul_pd(a, b)
+#define LIP_VEC_OP_div(a, b) _mm512_div_pd(a, b)
+#define LIP_VEC_CMP(a, b, pred) \
+	_mm512_maskz_mov_pd(_mm512_cmp_pd_mask(a, b, pred), _mm512_set1_pd(1.0))
+#define LIP_VEC_OP_eq(a, b) LIP_VEC_CMP(a, b, _CMP_EQ_OQ)
+#define LIP_VEC_OP_lt(a, b) LIP_VEC_CMP(a, b, _CMP_LT_OQ)
+#define LIP_VEC_OP_le(a, b) LIP_VEC_CMP(a, b, _CMP_LE_OQ)
+#define LIP_VEC_OP_gt(a, b) LIP_VEC_CMP(a, b, _CMP_GT_OQ)
+#define LIP_VEC_OP_ge(a, b) LIP_VEC_CMP(a, b, _CMP_GE_OQ)
+#define LIP_VEC_OP_unord(a, b) LIP_VEC_CMP(a, b, _CMP_UNORD_Q)
+#define LIP_VEC_OP_sum(a, b) _mm512_add_pd(a, b)
+#define LIP_VEC_OP_min(a, b) _mm512_min_pd(a, b)
+#define LIP_VEC_OP_max(a, b) _mm512_max_pd(a, b)
+
+LIP_VEC_DEFINE_KERNELS()
+
+#undef LIP_VEC_ISA
+#undef LIP_VEC_ATTR
+#undef LIP_VEC_T
+#undef LIP_VEC_WIDTH
+#undef LIP_VEC_LOAD
+#undef LIP_VEC_STORE
+#undef LIP_VEC_SET1
+#undef LIP_VEC_OP_add
+#undef LIP_VEC_OP_sub
+#undef LIP_VEC_OP_mul
+#undef LIP_VEC_OP_div
+#undef LIP_VEC_CMP
+#undef LIP_VEC_OP_eq
+#undef LIP_VEC_OP_lt
+#undef LIP_VEC_OP_le
+#undef LIP_VEC_OP_gt
+#undef LIP_VEC_OP_ge
+#undef LIP_VEC_OP_unord
+#undef LIP_VEC_OP_sum
+#undef LIP_VEC_OP_min
+#undef LIP_VEC_OP_max
+
+#endif
+
+static const lip_vec_kernels_t*
+lip_vec_select_kernels(void)
+{
+#if LIP_VEC_X86 && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	__cpuid(info, 1);
+	bool has_sse2 = (info[3] & (1 << 26)) != 0;
+	bool has_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+	if(has_avx && max_leaf >= 7)
+	{
+		// Check that the OS saves the AVX (and AVX-512) registers
+		unsigned long long xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		if((xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)))
+		{
+			return &lip_vec_kernels_avx512;
+		}
+		if((xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)))
+		{
+			return &lip_vec_kernels_avx2;
+		}
+	}
+	if(has_sse2) { return &lip_vec_kernels_sse2; }
+#elif LIP_VEC_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f")) { return &lip_vec_kernels_avx512; }
+	if(__builtin_cpu_supports("avx2")) { return &lip_vec_kernels_avx2; }
+	if(__builtin_cpu_supports("sse2")) { return &lip_vec_kernels_sse2; }
+#endif
+
+	return &lip_vec_kernels_generic;
+}
+
+// Only written by lip_vec_init_kernels, once per process
+static const lip_vec_kernels_t* lip_vec_kernels = &lip_vec_kernels_generic;
+
+static void
+lip_vec_init_kernels(void)
+{
+	lip_vec_kernels = lip_vec_select_kernels();
+}
+
+#if defined(LIP_THREADING_PTHREAD)
+
+static pthread_once_t lip_vec_kernels_once = PTHREAD_ONCE_INIT;
+
+static void
+lip_vec_init_kernels_once(void)
+{
+	pthread_once(&lip_vec_kernels_once, lip_vec_init_kernels);
+}
+
+#elif defined(LIP_THREADING_WINAPI)
+
+static INIT_ONCE lip_vec_kernels_once = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK
+lip_vec_init_kernels_winapi(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	(void)once;
+	(void)param;
+	(void)context;
+
+	lip_vec_init_kernels();
+	return TRUE;
+}
+
+static void
+lip_vec_init_kernels_once(void)
+{
+	InitOnceExecuteOnce(&lip_vec_kernels_once, lip_vec_init_kernels_winapi, NULL, NULL);
+}
+
+#else
+
+static void
+lip_vec_init_kernels_once(void)
+{
+	static bool initialized = false;
+	if(!initialized)
+	{
+		lip_vec_init_kernels();
+		initialized = true;
+	}
+}
+
+#endif
+
+static lip_value_t
+lip_make_vec_value(lip_vec_t* vec)
+{
+	return (lip_value_t){
+		.type = LIP_VAL_VEC,
+		.data = { .reference = vec }
+	};
+}
+
+// Parameters of the natives, expanded by lip_bind_args in their body and by
+// their declaration in lip_load_veclib
+#define LIP_VEC_PARAMS_vec_make (number, length), (number, fill, (optional, 0))
+#define LIP_VEC_PARAMS_vec_from_list (list, l)
+#define LIP_VEC_PARAMS_vec_to_list (vec, vec)
+#define LIP_VEC_PARAMS_vec_len (vec, vec)
+#define LIP_VEC_PARAMS_vec_nth (number, index), (vec, vec)
+#define LIP_VEC_PARAMS_vec_dot (vec, lhs), (vec, rhs)
+#define LIP_VEC_PARAMS_MAP_FN (vec, lhs), (any, rhs)
+#define LIP_VEC_PARAMS_REDUCE_FN (vec, vec)
+
+static lip_function(vec_make)
+{
+	lip_bind_args(LIP_VEC_PARAMS_vec_make);
+	lip_bind_assert(length >= 0, "Length must not be negative");
+
+	lip_vec_t* vec = lip_alloc_vec(vm, (size_t)length);
+	for(size_t i = 0; i < vec->length; ++i) { vec->elements[i] = fill; }
+
+	lip_return(lip_make_vec_value(vec));
+}
+
+static lip_function(vec_from_list)
+{
+	lip_bind_args(LIP_VEC_PARAMS_vec_from_list);
+
+	const lip_list_t* list = lip_as_list(l);
+	lip_vec_t* vec = lip_alloc_vec(vm, list->length);
+
+	lip_list_iterator_t itr;
+	lip_value_t element;
+	for(lip_list_begin(list, &itr); lip_list_next(&itr, &element);)
+	{
+		lip_bind_assert(element.type == LIP_VAL_NUMBER, "List must only contain numbers");
+		vec->elements[itr.index - 1] = element.data.number;
+	}
+
+	lip_return(lip_make_vec_value(vec));
+}
+
+static lip_function(vec_to_list)
+{
+	lip_bind_args(LIP_VEC_PARAMS_vec_to_list);
+
+	lip_list_t* list = lip_alloc_list(vm, vec->length);
+	for(size_t i = 0; i < vec->length; ++i)
+	{
+		list->elements[i] = lip_make_number(vm, vec->elements[i]);
+	}
+
+	lip_value_t ret_val = (lip_value_t) {
+		.type = LIP_VAL_LIST,
+		.data = { .reference = list }
+	};
+	lip_return(ret_val);
+}
+
+static lip_function(vec_len)
+{
+	lip_bind_args(LIP_VEC_PARAMS_vec_len);
+	lip_return(lip_make_number(vm, vec->length));
+}
+
+static lip_function(vec_nth)
+{
+	lip_bind_args(LIP_VEC_PARAMS_vec_nth);
+	lip_bind_assert(0 <= index && index < vec->length, "Vector index out of bound");
+	lip_return(lip_make_number(vm, vec->elements[(size_t)index]));
+}
+
+static lip_function(vec_isa)
+{
+	lip_bind_prepare(vm);
+	lip_bind_assert_argc(0);
+	lip_return(lip_make_string_copy(vm, lip_string_ref(lip_vec_kernels->isa)));
+}
+
+#define LIP_VEC_DEFINE_MAP_FN(name, op) \
+	static lip_function(vec_##name) \
+	{ \
+		lip_bind_args(LIP_VEC_PARAMS_MAP_FN); \
+		lip_vec_t* out = lip_alloc_vec(vm, lhs->length); \
+		if(rhs.type == LIP_VAL_NUMBER) \
+		{ \
+			lip_vec_kernels->name##_scalar( \
+				out->elements, lhs->elements, rhs.data.number, lhs->length \
+			); \
+		} \
+		else \
+		{ \
+			lip_vec_t* rhs_vec; \
+			lip_bind_load_vec(2, rhs_vec, rhs); \
+			lip_bind_assert(rhs_vec->length == lhs->length, "Vectors must have the same length"); \
+			lip_vec_kernels->name( \
+				out->elements, lhs->elements, rhs_vec->elements, lhs->length \
+			); \
+		} \
+		lip_return(lip_make_vec_value(out)); \
+	}
+
+#define LIP_VEC_DEFINE_REDUCE_FN(name, init, op, allow_empty, check_nan) \
+	static lip_function(vec_##name) \
+	{ \
+		lip_bind_args(LIP_VEC_PARAMS_REDUCE_FN); \
+		lip_bind_assert(allow_empty || vec->length > 0, "Vector must have at least one element"); \
+		lip_return(lip_make_number(vm, lip_vec_kernels->name(vec->elements, vec->length))); \
+	}
+
+LIP_VEC_MAP_OP(LIP_VEC_DEFINE_MAP_FN)
+LIP_VEC_REDUCE_OP(LIP_VEC_DEFINE_REDUCE_FN)
+
+static lip_function(vec_dot)
+{
+	lip_bind_args(LIP_VEC_PARAMS_vec_dot);
+	lip_bind_assert(rhs->length == lhs->length, "Vectors must have the same length");
+	lip_return(lip_make_number(vm, lip_vec_kernels->dot(lhs->elements, rhs->elements, lhs->length)));
+}
+
+#define LIP_DECLARE_BOUND_FUNCTION(name, fn, params) \
+	lip_declare_function_with_signature( \
+		module, lip_string_ref(name), fn, lip_bind_signature(params) \
+	)
+
+void
+lip_load_veclib(lip_context_t* ctx)
+{
+	lip_vec_init_kernels_once();
+
+	lip_module_context_t* module = lip_begin_module(ctx, lip_string_ref("vec"));
+	LIP_DECLARE_BOUND_FUNCTION("make", vec_make, LIP_VEC_PARAMS_vec_make);
+	LIP_DECLARE_BOUND_FUNCTION("from-list", vec_from_list, LIP_VEC_PARAMS_vec_from_list);
+	LIP_DECLARE_BOUND_FUNCTION("to-list", vec_to_list, LIP_VEC_PARAMS_vec_to_list);
+	LIP_DECLARE_BOUND_FUNCTION("len", vec_len, LIP_VEC_PARAMS_vec_len);
+	LIP_DECLARE_BOUND_FUNCTION("nth", vec_nth, LIP_VEC_PARAMS_vec_nth);
+	lip_declare_function(module, lip_string_ref("isa"), vec_isa);
+#define LIP_VEC_REGISTER_MAP_FN(name, op) \
+	LIP_DECLARE_BOUND_FUNCTION(#name, vec_##name, LIP_VEC_PARAMS_MAP_FN);
+#define LIP_VEC_REGISTER_REDUCE_FN(name, init, op, allow_empty, check_nan) \
+	LIP_DECLARE_BOUND_FUNCTION(#name, vec_##name, LIP_VEC_PARAMS_REDUCE_FN);
+	LIP_VEC_MAP_OP(LIP_VEC_REGISTER_MAP_FN)
+	LIP_VEC_REDUCE_OP(LIP_VEC_REGISTER_REDUCE_FN)
+#undef LIP_VEC_REGISTER_MAP_FN
+#undef LIP_VEC_REGISTER_REDUCE_FN
+	LIP_DECLARE_BOUND_FUNCTION("dot", vec_dot, LIP_VEC_PARAMS_vec_dot);
+	lip_end_module(ctx, module);
+}
+
+#undef LIP_DECLARE_BOUND_FUNCTION
@@ -201,9 +201,8 @@ normal(const MunitParameter params[], void* fixture)
 	munit_assert_ptr(function_layout.instructions + function->num_instructions, <=, (char*)function + function->size);
 	lip_assert_typed_alignment(function_layout.instructions, lip_instruction_t);
 
-	munit_assert_ptr(function, <, function_layout.locations);
-	munit_assert_ptr(function_layout.locations + function->num_instructions, <=, (char*)function + function->size);
-	lip_assert_typed_alignment(function_layout.locations, lip_loc_range_t);
+	munit_assert_uint32(function->location_offset, >=, (char*)(function_layout.instructions + function->num_instructions) - (char*)function);
+	munit_assert_uint32(function->location_offset, <, function->size);
 
 	for(lip_asm_index_t i = 0; i < num_instructions; ++i)
 	{
@@ -218,7 +217,7 @@ normal(const MunitParameter params[], void* fixture)
 			.start = { .line = i, .column = i},
 			.end = { .line = i, .column = i + 1}
 		};
-		lip_assert_loc_range_equal(location, function_layout.locations[i + 1]);
+		lip_assert_loc_range_equal(location, lip_function_location(function, i + 1));
 	}
 
 	lip_free(lip_default_allocator, function);
@@ -270,7 +269,7 @@ lip_assert_asm_(
 
 		lip_assert_enum(lip_opcode_t, opcode1, ==, opcode2);
 		munit_assert_int32(operand1, ==, operand2);
-		munit_assert_uint(expected_locations[i], ==, function_layout.locations[i + 1].start.line);
+		munit_assert_uint(expected_locations[i], ==, lip_function_location(function, i + 1).start.line);
 	}
 
 	lip_free(lip_default_allocator, function);
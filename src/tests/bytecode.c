@@ -0,0 +1,1079 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <lip/bind.h>
+#include <lip/core/extra.h>
+#include <lip/core/asm.h>
+#include <lip/core/vm.h>
+#include "script_helper.h"
+
+// Compiled files are written to bin/, like the other suites do
+
+#define LIP_TEST_MAX_PATHS 8
+// Size of the header of a compiled script, before its function
+#define LIP_TEST_HEADER_SIZE 16
+
+// Forwards to the standard filesystem, remembering what was written
+struct recording_fs_s
+{
+	lip_fs_t vtable;
+	lip_fs_t* inner;
+	unsigned int num_writes;
+	unsigned int num_paths;
+	char paths[LIP_TEST_MAX_PATHS][256];
+	char temp_path[256];
+};
+
+static lip_in_t*
+recording_fs_begin_read(lip_fs_t* vtable, lip_string_ref_t path)
+{
+	struct recording_fs_s* fs = LIP_CONTAINER_OF(vtable, struct recording_fs_s, vtable);
+	return fs->inner->begin_read(fs->inner, path);
+}
+
+static void
+recording_fs_end_read(lip_fs_t* vtable, lip_in_t* input)
+{
+	struct recording_fs_s* fs = LIP_CONTAINER_OF(vtable, struct recording_fs_s, vtable);
+	fs->inner->end_read(fs->inner, input);
+}
+
+static lip_out_t*
+recording_fs_begin_write(lip_fs_t* vtable, lip_string_ref_t path)
+{
+	struct recording_fs_s* fs = LIP_CONTAINER_OF(vtable, struct recording_fs_s, vtable);
+	++fs->num_writes;
+	snprintf(fs->temp_path, sizeof(fs->temp_path), "%.*s", (int)path.length, path.ptr);
+	return fs->inner->begin_write(fs->inner, path);
+}
+
+static void
+recording_fs_end_write(lip_fs_t* vtable, lip_out_t* output)
+{
+	struct recording_fs_s* fs = LIP_CONTAINER_OF(vtable, struct recording_fs_s, vtable);
+	fs->inner->end_write(fs->inner, output);
+}
+
+static lip_string_ref_t
+recording_fs_last_error(lip_fs_t* vtable)
+{
+	struct recording_fs_s* fs = LIP_CONTAINER_OF(vtable, struct recording_fs_s, vtable);
+	return fs->inner->last_error(fs->inner);
+}
+
+static bool
+recording_fs_rename(lip_fs_t* vtable, lip_string_ref_t from, lip_string_ref_t to)
+{
+	struct recording_fs_s* fs = LIP_CONTAINER_OF(vtable, struct recording_fs_s, vtable);
+	munit_assert_uint(fs->num_paths, <, LIP_TEST_MAX_PATHS);
+	snprintf(
+		fs->paths[fs->num_paths++], sizeof(fs->paths[0]),
+		"%.*s", (int)to.length, to.ptr
+	);
+	return fs->inner->rename(fs->inner, from, to);
+}
+
+static void
+recording_fs_remove(lip_fs_t* vtable, lip_string_ref_t path)
+{
+	struct recording_fs_s* fs = LIP_CONTAINER_OF(vtable, struct recording_fs_s, vtable);
+	fs->inner->remove(fs->inner, path);
+}
+
+static bool
+file_exists(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if(file != NULL) { fclose(file); }
+	return file != NULL;
+}
+
+static lip_function(host_identity)
+{
+	lip_bind_args((number, x));
+	lip_return(lip_make_number(vm, x));
+}
+
+static MunitResult
+cache(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	struct recording_fs_s fs = {
+		.vtable = {
+			.begin_read = recording_fs_begin_read,
+			.end_read = recording_fs_end_read,
+			.begin_write = recording_fs_begin_write,
+			.end_write = recording_fs_end_write,
+			.last_error = recording_fs_last_error,
+			.rename = recording_fs_rename,
+			.remove = recording_fs_remove,
+		},
+		.inner = fixture->config->fs
+	};
+	fixture->config->fs = &fs.vtable;
+	fixture->config->bytecode_cache_dir = lip_string_ref("bin");
+	lip_test_restart(fixture);
+
+	// Entries of earlier runs must not be found
+	char code[64];
+	snprintf(code, sizeof(code), "; %u\n(+ 1 2)", munit_rand_uint32());
+
+	// Entries are written under another name then renamed
+	lip_assert_script_number(fixture, code, 3);
+	munit_assert_uint(1, ==, fs.num_writes);
+	munit_assert_uint(1, ==, fs.num_paths);
+	munit_assert_string_not_equal(fs.temp_path, fs.paths[0]);
+	munit_assert_false(file_exists(fs.temp_path));
+	munit_assert_true(file_exists(fs.paths[0]));
+
+	lip_assert_script_number(fixture, code, 3);
+	munit_assert_uint(1, ==, fs.num_writes);
+
+	// A broken entry is compiled again and does not leave an error behind
+	FILE* file = fopen(fs.paths[0], "wb");
+	munit_assert_not_null(file);
+	fwrite("LIP\0broken", 1, 10, file);
+	fclose(file);
+	munit_assert_not_null(lip_test_load(fixture, code));
+	munit_assert_uint(0, ==, lip_get_error(fixture->context)->num_records);
+	munit_assert_size(0, ==, lip_get_error(fixture->context)->message.length);
+	munit_assert_uint(2, ==, fs.num_writes);
+	lip_assert_script_number(fixture, code, 3);
+	munit_assert_uint(2, ==, fs.num_writes);
+
+	// Declared signatures change the compiled code
+	lip_module_context_t* module = lip_begin_module(
+		fixture->context, lip_string_ref("host")
+	);
+	lip_declare_function_with_signature(
+		module, lip_string_ref("identity"), host_identity,
+		lip_bind_signature((number, x))
+	);
+	lip_end_module(fixture->context, module);
+	lip_assert_script_number(fixture, code, 3);
+	munit_assert_uint(3, ==, fs.num_writes);
+
+	fixture->config->static_check = true;
+	lip_test_restart(fixture);
+	lip_assert_script_number(fixture, code, 3);
+	munit_assert_uint(4, ==, fs.num_writes);
+
+	for(unsigned int i = 0; i < fs.num_paths; ++i) { remove(fs.paths[i]); }
+	fixture->config->fs = fs.inner;
+
+	return MUNIT_OK;
+}
+
+static void
+patch_file(const char* path, long offset, const void* data, size_t size)
+{
+	FILE* file = fopen(path, "r+b");
+	munit_assert_not_null(file);
+	munit_assert_int(0, ==, fseek(file, offset, SEEK_SET));
+	munit_assert_size(size, ==, fwrite(data, 1, size, file));
+	fclose(file);
+}
+
+// Offset of the hash of the last string with the given content in a file
+static long
+find_string_hash(const char* path, const char* content)
+{
+	char buf[16384];
+	FILE* file = fopen(path, "rb");
+	munit_assert_not_null(file);
+	size_t size = fread(buf, 1, sizeof(buf), file);
+	fclose(file);
+
+	size_t length = strlen(content) + 1;
+	for(size_t i = size - length; i >= offsetof(lip_string_t, ptr); --i)
+	{
+		if(memcmp(buf + i, content, length) == 0)
+		{
+			return (long)(i - offsetof(lip_string_t, ptr) + offsetof(lip_string_t, hash));
+		}
+	}
+
+	munit_errorf("\"%s\" not found in %s", content, path);
+	return -1;
+}
+
+static lip_exec_status_t
+exec_file(lip_script_fixture_t* fixture, const char* path, lip_value_t* result)
+{
+	if(fixture->script != NULL)
+	{
+		lip_unload_script(fixture->context, fixture->script);
+	}
+
+	// Kept loaded like in lip_test_load, the traceback of an error refers to it
+	fixture->script = lip_load_script(
+		fixture->context, lip_string_ref(path), NULL
+	);
+	if(fixture->script == NULL) { return LIP_EXEC_ERROR; }
+
+	return lip_test_exec(fixture, fixture->script, result);
+}
+
+static MunitResult
+mapped(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	const char* path = "bin/test_mmap.lipc";
+	lip_script_t* script = lip_test_load(
+		fixture, "(list/len (list 'symbol-name \"string-content\" 'symbol-name))"
+	);
+	munit_assert_not_null(script);
+	munit_assert_true(
+		lip_dump_script(fixture->context, script, lip_string_ref(path), NULL)
+	);
+
+	// Mapped functions are read-only, running and unloading must not write to them
+	lip_value_t result;
+	for(int i = 0; i < 2; ++i)
+	{
+		munit_assert_int(LIP_EXEC_OK, ==, exec_file(fixture, path, &result));
+		munit_assert_int(LIP_VAL_NUMBER, ==, result.type);
+		munit_assert_double(3, ==, result.data.number);
+	}
+
+	// Strings without their hash are rejected, mapped or not
+	uint32_t hash = 0;
+	patch_file(path, find_string_hash(path, "symbol-name"), &hash, sizeof(hash));
+	munit_assert_int(LIP_EXEC_ERROR, ==, exec_file(fixture, path, &result));
+	lip_fs_t* fs = fixture->config->fs;
+	const void*(*map)(lip_fs_t* self, lip_string_ref_t path, size_t* size) = fs->map;
+	fs->map = NULL;
+	munit_assert_int(LIP_EXEC_ERROR, ==, exec_file(fixture, path, &result));
+	fs->map = map;
+
+	hash = lip_string_ref_hash(lip_string_ref("symbol-name")) ^ 1;
+	patch_file(path, find_string_hash(path, "symbol-name"), &hash, sizeof(hash));
+	munit_assert_int(LIP_EXEC_ERROR, ==, exec_file(fixture, path, &result));
+
+	hash = lip_string_ref_hash(lip_string_ref("symbol-name"));
+	patch_file(path, find_string_hash(path, "symbol-name"), &hash, sizeof(hash));
+	munit_assert_int(LIP_EXEC_OK, ==, exec_file(fixture, path, &result));
+
+	hash = 0;
+	patch_file(path, find_string_hash(path, "string-content"), &hash, sizeof(hash));
+	munit_assert_int(LIP_EXEC_ERROR, ==, exec_file(fixture, path, &result));
+
+	remove(path);
+
+	return MUNIT_OK;
+}
+
+// Only guarantees LIP_MAX_ALIGNMENT, like many allocators on 32-bit platforms
+static void*
+misaligned_realloc(lip_allocator_t* self, void* old, size_t size)
+{
+	(void)self;
+	char* block = lip_realloc(
+		lip_std_allocator, old ? (char*)old - LIP_MAX_ALIGNMENT : NULL,
+		size + LIP_MAX_ALIGNMENT
+	);
+	return block ? block + LIP_MAX_ALIGNMENT : NULL;
+}
+
+static void
+misaligned_free(lip_allocator_t* self, void* mem)
+{
+	(void)self;
+	if(mem != NULL) { lip_free(lip_std_allocator, (char*)mem - LIP_MAX_ALIGNMENT); }
+}
+
+static lip_allocator_t misaligned_allocator = {
+	.realloc = misaligned_realloc,
+	.free = misaligned_free
+};
+
+static double last_record;
+
+static lip_function(host_record)
+{
+	lip_bind_args((number, x));
+	last_record = x;
+	lip_return(lip_make_nil(vm));
+}
+
+static void
+declare_host_record(lip_script_fixture_t* fixture)
+{
+	lip_module_context_t* module = lip_begin_module(
+		fixture->context, lip_string_ref("host")
+	);
+	lip_declare_function(module, lip_string_ref("record"), host_record);
+	lip_end_module(fixture->context, module);
+}
+
+static MunitResult
+bundle(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	declare_host_record(fixture);
+
+	// Each module tells which one was found when it runs
+	const char* path = "bin/test_bundle.lipb";
+	lip_string_ref_t names[] = {
+		lip_string_ref("bundled.a"),
+		lip_string_ref("bundled.b"),
+		lip_string_ref("bundled.c")
+	};
+	enum { num_modules = sizeof(names) / sizeof(names[0]) };
+	lip_script_t* scripts[num_modules];
+	for(int i = 0; i < num_modules; ++i)
+	{
+		char code[64];
+		snprintf(code, sizeof(code), "(host/record %d)", i + 1);
+		struct lip_isstream_s sstream;
+		lip_in_t* input = lip_make_isstream(lip_string_ref(code), &sstream);
+		scripts[i] = lip_load_script(fixture->context, names[i], input);
+		munit_assert_not_null(scripts[i]);
+	}
+
+	lip_string_ref_t duplicated_names[] = { names[0], names[1], names[0] };
+	munit_assert_false(lip_dump_bundle(
+		fixture->context, num_modules, duplicated_names, scripts,
+		lip_string_ref(path), NULL
+	));
+	lip_assert_ref_equal(
+		lip_string_ref("Duplicated module: bundled.a"),
+		lip_get_error(fixture->context)->records[0].message
+	);
+
+	munit_assert_true(lip_dump_bundle(
+		fixture->context, num_modules, names, scripts, lip_string_ref(path), NULL
+	));
+	for(int i = 0; i < num_modules; ++i)
+	{
+		lip_unload_script(fixture->context, scripts[i]);
+	}
+
+	// The bundle is mapped, then read into memory which may be less aligned
+	lip_fs_t* fs = fixture->config->fs;
+	const void*(*map)(lip_fs_t* self, lip_string_ref_t path, size_t* size) = fs->map;
+	for(int i = 0; i < 2; ++i)
+	{
+		if(i == 1)
+		{
+			fs->map = NULL;
+			fixture->config->allocator = &misaligned_allocator;
+		}
+		lip_test_restart(fixture);
+		declare_host_record(fixture);
+
+		munit_assert_true(lip_add_bundle(fixture->context, lip_string_ref(path)));
+		for(int j = num_modules - 1; j >= 0; --j)
+		{
+			last_record = 0;
+			munit_assert_true(lip_load_module(fixture->context, names[j]));
+			munit_assert_double(j + 1, ==, last_record);
+		}
+		munit_assert_false(
+			lip_load_module(fixture->context, lip_string_ref("bundled.d"))
+		);
+		lip_assert_error_message(fixture, "Could not load module bundled.d");
+	}
+
+	fixture->config->allocator = lip_std_allocator;
+	fs->map = map;
+	lip_test_restart(fixture);
+
+	// Anything else is rejected
+	FILE* file = fopen(path, "wb");
+	munit_assert_not_null(file);
+	fwrite("LIPB", 1, 4, file);
+	fclose(file);
+	munit_assert_false(lip_add_bundle(fixture->context, lip_string_ref(path)));
+	lip_assert_ref_equal(
+		lip_string_ref("Malformed bundle"),
+		lip_get_error(fixture->context)->records[0].message
+	);
+
+	remove(path);
+
+	return MUNIT_OK;
+}
+
+static void
+write_file(const char* path, const char* content)
+{
+	FILE* file = fopen(path, "wb");
+	munit_assert_not_null(file);
+	fputs(content, file);
+	fclose(file);
+}
+
+static MunitResult
+image(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	const char* path = "bin/test_image.lipi";
+	const char* sources[][2] = {
+		{ "bin/image.a.lip", "(declare 'twice true (fn (x) (* 2 x)))" },
+		{
+			"bin/image.b.lip",
+			"(declare 'quad true (fn (x) (image.a/twice (image.a/twice x))))"
+			"(declare 'sym true (fn () 'image-symbol))"
+			"(declare 'rec true (fn () (host/record 5)))"
+		}
+	};
+	for(int i = 0; i < 2; ++i) { write_file(sources[i][0], sources[i][1]); }
+
+	lip_string_ref_t patterns[] = { lip_string_ref("bin/!.lip") };
+	fixture->config->module_search_patterns = patterns;
+	fixture->config->num_module_search_patterns = 1;
+	lip_test_restart(fixture);
+	declare_host_record(fixture);
+
+	munit_assert_true(lip_load_module(fixture->context, lip_string_ref("image.b")));
+	lip_assert_script_number(fixture, "(image.b/quad 3)", 12);
+	munit_assert_true(lip_save_image(fixture->context, lip_string_ref(path), NULL));
+
+	// Modules come from the image alone
+	for(int i = 0; i < 2; ++i) { remove(sources[i][0]); }
+
+	// The image is mapped, then read into memory which may be less aligned
+	lip_fs_t* fs = fixture->config->fs;
+	const void*(*map)(lip_fs_t* self, lip_string_ref_t path, size_t* size) = fs->map;
+	for(int i = 0; i < 2; ++i)
+	{
+		if(i == 1)
+		{
+			fs->map = NULL;
+			fixture->config->allocator = &misaligned_allocator;
+		}
+
+		// Natives are referenced by name and must be declared first
+		lip_test_restart(fixture);
+		munit_assert_false(lip_load_image(fixture->context, lip_string_ref(path)));
+
+		lip_test_restart(fixture);
+		declare_host_record(fixture);
+		munit_assert_true(lip_load_image(fixture->context, lip_string_ref(path)));
+		lip_assert_script_number(fixture, "(image.b/quad 3)", 12);
+		lip_assert_script_number(fixture, "(image.a/twice 4)", 8);
+		lip_assert_script_number(
+			fixture, "(if (== (image.b/sym) 'image-symbol) 1 0)", 1
+		);
+		last_record = 0;
+		lip_assert_script_number(fixture, "(do (image.b/rec) 1)", 1);
+		munit_assert_double(5, ==, last_record);
+	}
+
+	// Functions in an image are verified like any other bytecode
+	fixture->config->allocator = lip_std_allocator;
+	fs->map = map;
+	lip_test_restart(fixture);
+	declare_host_record(fixture);
+	uint32_t hash = 0;
+	patch_file(path, find_string_hash(path, "image-symbol"), &hash, sizeof(hash));
+	munit_assert_false(lip_load_image(fixture->context, lip_string_ref(path)));
+	lip_assert_error_message(fixture, "Format error");
+
+	remove(path);
+
+	return MUNIT_OK;
+}
+
+// Compile a script and copy its function out of the dumped file
+static lip_function_t*
+compile_function(
+	lip_script_fixture_t* fixture,
+	const char* code,
+	char header[LIP_TEST_HEADER_SIZE]
+)
+{
+	lip_script_t* script = lip_test_load(fixture, code);
+	munit_assert_not_null(script);
+
+	lip_array(char) bytes = lip_array_create(lip_std_allocator, char, 256);
+	struct lip_osstream_s sstream;
+	munit_assert_true(lip_dump_script(
+		fixture->context, script, lip_string_ref("<test>"),
+		lip_make_osstream(&bytes, &sstream)
+	));
+
+	size_t size = lip_array_len(bytes) - LIP_TEST_HEADER_SIZE;
+	lip_function_t* function = lip_malloc(lip_std_allocator, size);
+	memcpy(header, bytes, LIP_TEST_HEADER_SIZE);
+	memcpy(function, bytes + LIP_TEST_HEADER_SIZE, size);
+	lip_array_destroy(bytes);
+	munit_assert_size(size, ==, function->size);
+	return function;
+}
+
+static lip_instruction_t*
+find_instruction(lip_function_t* function, lip_opcode_t opcode, lip_operand_t operand)
+{
+	lip_function_layout_t layout;
+	lip_function_layout(function, &layout);
+	for(uint32_t i = 0; i < function->num_instructions; ++i)
+	{
+		lip_opcode_t instr_opcode;
+		lip_operand_t instr_operand;
+		lip_disasm(layout.instructions[i], &instr_opcode, &instr_operand);
+		if(instr_opcode == opcode && instr_operand == operand)
+		{
+			return &layout.instructions[i];
+		}
+	}
+
+	munit_errorf("Instruction %d %d not found", opcode, operand);
+	return NULL;
+}
+
+static void
+write_function(
+	const char* path,
+	const char header[LIP_TEST_HEADER_SIZE],
+	const lip_function_t* function
+)
+{
+	FILE* file = fopen(path, "wb");
+	munit_assert_not_null(file);
+	fwrite(header, 1, LIP_TEST_HEADER_SIZE, file);
+	fwrite(function, 1, function->size, file);
+	fclose(file);
+}
+
+#define lip_assert_verify_error(function, msg) \
+	do { \
+		const char* error = lip_verify_function( \
+			lip_std_allocator, (function), (function)->size, 0 \
+		); \
+		munit_assert_not_null(error); \
+		munit_assert_string_equal((msg), error); \
+	} while(0)
+
+static MunitResult
+verifier(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	char header[LIP_TEST_HEADER_SIZE];
+	lip_function_t* function = compile_function(
+		fixture,
+		"(letrec ((f (fn (x) (if (< x 1) x (f (- x 1)))))) (f (f 1)))",
+		header
+	);
+	munit_assert_null(lip_verify_function(
+		lip_std_allocator, function, function->size, 0
+	));
+
+	lip_instruction_t* call = find_instruction(function, LIP_OP_CALLK, 1);
+	lip_instruction_t* callee = call - 1;
+	lip_instruction_t* tail = find_instruction(function, LIP_OP_TAILK, 1);
+	lip_instruction_t original_callee = *callee;
+
+	lip_opcode_t opcode;
+	lip_operand_t operand;
+	lip_disasm(*callee, &opcode, &operand);
+	*callee = lip_asm(opcode, 200);
+	lip_assert_verify_error(function, "Invalid local index");
+	*callee = 0xFFu << 24;
+	lip_assert_verify_error(function, "Illegal instruction");
+	*callee = lip_asm(LIP_OP_POP, 1);
+	lip_assert_verify_error(function, "Operand stack underflow");
+	*callee = original_callee;
+
+	*call = lip_asm(LIP_OP_CALLK, 300);
+	lip_assert_verify_error(function, "Too many arguments");
+	*call = lip_asm(LIP_OP_CALLK, 1);
+
+	*tail = lip_asm(LIP_OP_NOP, 0);
+	lip_assert_verify_error(function, "Control reaches end of function");
+	*tail = lip_asm(LIP_OP_TAILK, 1);
+
+	// The size of a function bounds its layout
+	const char* error = lip_verify_function(
+		lip_std_allocator, function, function->size - 1, 0
+	);
+	munit_assert_string_equal("Malformed function", error);
+
+	lip_free(lip_std_allocator, function);
+
+	return MUNIT_OK;
+}
+
+// CALLK and TAILK callees are not proven by the verifier, crafted files must
+// fail like a regular call instead of crashing
+static MunitResult
+known_callee(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	const char* path = "bin/test_known_callee.lipc";
+	// Recursive functions are not inlined
+	const char* code[] = {
+		"(letrec ((f (fn (x) (if (< x 1) x (f (- x 1)))))"
+		"         (g (fn (x y) (if (< x 1) y (g (- x 1) y)))))"
+		"  (+ (f 1) (g 1 2) 1))",
+		"(letrec ((f (fn (x) (if (< x 1) x (f (- x 1)))))"
+		"         (g (fn (x y) (if (< x 1) y (g (- x 1) y)))))"
+		"  (g 1 (f 2)))"
+	};
+	lip_opcode_t opcodes[] = { LIP_OP_CALLK, LIP_OP_TAILK };
+	lip_fs_t* fs = fixture->config->fs;
+	const void*(*map)(lip_fs_t* self, lip_string_ref_t path, size_t* size) = fs->map;
+
+	for(int i = 0; i < 2; ++i)
+	{
+		char header[LIP_TEST_HEADER_SIZE];
+		lip_function_t* function = compile_function(fixture, code[i], header);
+		lip_instruction_t* callee = find_instruction(
+			function, opcodes[i], i == 0 ? 1 : 2
+		) - 1;
+		lip_instruction_t original_callee = *callee;
+		lip_instruction_t other_callee =
+			*(find_instruction(function, LIP_OP_CALLK, i == 0 ? 2 : 1) - 1);
+
+		for(int mapped = 0; mapped < 2; ++mapped)
+		{
+			fs->map = mapped ? map : NULL;
+
+			lip_value_t result;
+			write_function(path, header, function);
+			munit_assert_int(LIP_EXEC_OK, ==, exec_file(fixture, path, &result));
+			munit_assert_double(i == 0 ? 3 : 0, ==, result.data.number);
+
+			*callee = lip_asm(LIP_OP_LDI, 5);
+			write_function(path, header, function);
+			munit_assert_int(LIP_EXEC_ERROR, ==, exec_file(fixture, path, &result));
+			lip_assert_error_message(fixture, "Trying to call a non-function");
+
+			*callee = other_callee;
+			write_function(path, header, function);
+			munit_assert_int(LIP_EXEC_ERROR, ==, exec_file(fixture, path, &result));
+			lip_assert_error_message(
+				fixture,
+				i == 0
+					? "Bad number of arguments (exactly 2 expected, got 1)"
+					: "Bad number of arguments (exactly 1 expected, got 2)"
+			);
+
+			*callee = original_callee;
+		}
+
+		lip_free(lip_std_allocator, function);
+	}
+
+	fs->map = map;
+	remove(path);
+
+	return MUNIT_OK;
+}
+
+// Linking skips nested functions without imports, but loading still verifies
+// every nested body, so a malformed one is rejected before any code runs
+static MunitResult
+nested_verify(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	const char* path = "bin/test_nested_verify.lipc";
+	char header[LIP_TEST_HEADER_SIZE];
+	lip_function_t* function = compile_function(
+		fixture, "(list/len (list (fn () (fn () 7))))", header
+	);
+
+	lip_function_layout_t layout;
+	lip_function_layout(function, &layout);
+	munit_assert_uint32(function->num_functions, ==, 1);
+	lip_function_t* outer = lip_function_resource(function, layout.function_offsets[0]);
+	lip_function_layout(outer, &layout);
+	munit_assert_uint32(outer->num_imports, ==, 0);
+	munit_assert_uint32(outer->num_functions, ==, 1);
+	lip_function_t* inner = lip_function_resource(outer, layout.function_offsets[0]);
+	lip_function_layout(inner, &layout);
+	lip_instruction_t original = layout.instructions[0];
+
+	lip_fs_t* fs = fixture->config->fs;
+	const void*(*map)(lip_fs_t* self, lip_string_ref_t path, size_t* size) = fs->map;
+	for(int mapped = 0; mapped < 2; ++mapped)
+	{
+		fs->map = mapped ? map : NULL;
+
+		lip_value_t result;
+		layout.instructions[0] = 0xFFu << 24;
+		write_function(path, header, function);
+		munit_assert_int(LIP_EXEC_ERROR, ==, exec_file(fixture, path, &result));
+		lip_assert_error_message(fixture, "Format error");
+
+		layout.instructions[0] = original;
+		write_function(path, header, function);
+		munit_assert_int(LIP_EXEC_OK, ==, exec_file(fixture, path, &result));
+		munit_assert_double(1, ==, result.data.number);
+	}
+
+	fs->map = map;
+	lip_free(lip_std_allocator, function);
+	remove(path);
+
+	return MUNIT_OK;
+}
+
+static lip_function(host_env_sum)
+{
+	uint32_t env_len;
+	const lip_value_t* env = lip_get_env(vm, &env_len);
+	double sum = 0;
+	for(uint32_t i = 0; i < env_len; ++i) { sum += env[i].data.number; }
+	lip_return(lip_make_number(vm, sum));
+}
+
+static lip_function(host_wide_env)
+{
+	lip_value_t env[300];
+	for(int i = 0; i < 300; ++i) { env[i] = lip_make_number(vm, i); }
+	lip_return(lip_make_function(vm, host_env_sum, 300, env));
+}
+
+static lip_instruction_t*
+find_opcode(lip_function_t* function, lip_opcode_t opcode)
+{
+	lip_function_layout_t layout;
+	lip_function_layout(function, &layout);
+	for(uint32_t i = 0; i < function->num_instructions; ++i)
+	{
+		lip_opcode_t instr_opcode;
+		lip_operand_t instr_operand;
+		lip_disasm(layout.instructions[i], &instr_opcode, &instr_operand);
+		if(instr_opcode == opcode) { return &layout.instructions[i]; }
+	}
+
+	munit_errorf("Opcode %d not found", opcode);
+	return NULL;
+}
+
+// Run a function from a compiled file, then from a mapped one
+static void
+assert_file_number(
+	lip_script_fixture_t* fixture,
+	const char* path,
+	const char header[LIP_TEST_HEADER_SIZE],
+	const lip_function_t* function,
+	double expected
+)
+{
+	lip_fs_t* fs = fixture->config->fs;
+	const void*(*map)(lip_fs_t* self, lip_string_ref_t path, size_t* size) = fs->map;
+	write_function(path, header, function);
+	for(int mapped = 0; mapped < 2; ++mapped)
+	{
+		fs->map = mapped ? map : NULL;
+		lip_value_t result;
+		munit_assert_int(LIP_EXEC_OK, ==, exec_file(fixture, path, &result));
+		munit_assert_int(LIP_VAL_NUMBER, ==, result.type);
+		munit_assert_double(expected, ==, result.data.number);
+	}
+	fs->map = map;
+}
+
+// Counts past the compact encoding use the WIDE prefix and 32-bit headers
+static MunitResult
+wide_operands(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	const char* path = "bin/test_wide.lipc";
+	static char code[1 << 20];
+	char header[LIP_TEST_HEADER_SIZE];
+	fixture->config->default_vm_config.os_len = 1 << 17;
+	fixture->config->default_vm_config.env_len = 1 << 16;
+	lip_test_restart(fixture);
+
+	// Nested functions past LIP_PAIR_FIELD_MAX, the last one in scratch
+	// since it is not called in tail position.
+	// Calls take at most 255 arguments so lists and sums are nested.
+	int len = snprintf(code, sizeof(code), "(let ((fs (list");
+	for(int i = 0; i < 4200; ++i)
+	{
+		len += snprintf(
+			code + len, sizeof(code) - len,
+			"%s (fn () %d)%s", i % 250 == 0 ? " (list" : "", i,
+			i % 250 == 249 || i == 4199 ? ")" : ""
+		);
+	}
+	snprintf(
+		code + len, sizeof(code) - len,
+		"))) (letrec ((f (fn (x)"
+		"                 (if (< x 1) ((list/nth 150 (list/nth 16 fs))) (f (- x 1))))))"
+		"  (+ (f 1) 1)))"
+	);
+	lip_assert_script_number(fixture, code, 4151);
+	lip_function_t* function = compile_function(fixture, code, header);
+	munit_assert_uint32(function->num_functions, ==, 4201);
+	munit_assert_not_null(find_instruction(function, LIP_OP_WIDE, 4100));
+	lip_opcode_t opcode;
+	lip_operand_t operand;
+	lip_disasm(*(find_opcode(function, LIP_OP_LCLS) + 1), &opcode, &operand);
+	munit_assert_int(LIP_OP_WIDE, ==, opcode);
+	munit_assert_int(4200, ==, operand);
+	assert_file_number(fixture, path, header, function, 4151);
+	lip_free(lip_std_allocator, function);
+
+	// Captures past LIP_PAIR_FIELD_MAX
+	len = snprintf(code, sizeof(code), "(let (");
+	for(int i = 0; i < 5000; ++i)
+	{
+		len += snprintf(
+			code + len, sizeof(code) - len, " (x%d (list/len (list %d)))", i, i
+		);
+	}
+	len += snprintf(
+		code + len, sizeof(code) - len,
+		") (letrec ((f (fn (n) (if (< n 1) (+"
+	);
+	for(int i = 0; i < 5000; ++i)
+	{
+		len += snprintf(
+			code + len, sizeof(code) - len,
+			"%s x%d%s", i % 250 == 0 ? " (+" : "", i, i % 250 == 249 ? ")" : ""
+		);
+	}
+	snprintf(code + len, sizeof(code) - len, ") (f (- n 1)))))) (f 1)))");
+	lip_assert_script_number(fixture, code, 5000);
+	function = compile_function(fixture, code, header);
+	lip_disasm(*(find_opcode(function, LIP_OP_WIDE) + 1), &opcode, &operand);
+	munit_assert_int(LIP_OP_CLS, ==, opcode);
+	// f captures itself too
+	munit_assert_int(5001, ==, operand);
+	assert_file_number(fixture, path, header, function, 5000);
+	lip_free(lip_std_allocator, function);
+
+	// Instructions past 16 bits
+	len = snprintf(code, sizeof(code), "(+");
+	for(int i = 0; i < 280; ++i)
+	{
+		len += snprintf(
+			code + len, sizeof(code) - len,
+			"%s (list/len (list", i % 140 == 0 ? " (+" : ""
+		);
+		for(int j = 0; j < 250; ++j)
+		{
+			len += snprintf(code + len, sizeof(code) - len, " 0");
+		}
+		len += snprintf(
+			code + len, sizeof(code) - len, "))%s", i % 140 == 139 ? ")" : ""
+		);
+	}
+	snprintf(code + len, sizeof(code) - len, ")");
+	lip_assert_script_number(fixture, code, 70000);
+	function = compile_function(fixture, code, header);
+	munit_assert_uint32(function->num_instructions, >, 0xFFFF);
+	assert_file_number(fixture, path, header, function, 70000);
+	lip_free(lip_std_allocator, function);
+
+	// The compiler keeps scratch lists in the first slots, a crafted file may
+	// place one anywhere in the frame
+	lip_asm_t lasm;
+	lip_asm_init(&lasm, lip_std_allocator);
+	lip_asm_begin(&lasm, lip_string_ref("<test>"), LIP_LOC_NOWHERE);
+	lip_asm_add(&lasm, LIP_OP_LDI, 8, LIP_LOC_NOWHERE);
+	lip_asm_add(&lasm, LIP_OP_LDI, 7, LIP_LOC_NOWHERE);
+	lip_asm_add_pair(&lasm, LIP_OP_LLST, 5000, 2, LIP_LOC_NOWHERE);
+	lip_asm_add(
+		&lasm, LIP_OP_IMP,
+		lip_asm_alloc_import(&lasm, lip_string_ref("list/len")),
+		LIP_LOC_NOWHERE
+	);
+	lip_asm_add(&lasm, LIP_OP_CALL, 1, LIP_LOC_NOWHERE);
+	lip_asm_add(&lasm, LIP_OP_RET, 0, LIP_LOC_NOWHERE);
+	function = lip_asm_end(&lasm, lip_std_allocator);
+	munit_assert_null(lasm.error);
+	lip_asm_cleanup(&lasm);
+	function->num_locals = 5000 + lip_list_scratch_slots(2);
+	munit_assert_not_null(find_instruction(function, LIP_OP_WIDE, 5000));
+	assert_file_number(fixture, path, header, function, 2);
+	function->num_locals = 5000;
+	write_function(path, header, function);
+	lip_value_t result;
+	munit_assert_int(LIP_EXEC_ERROR, ==, exec_file(fixture, path, &result));
+	lip_free(lip_std_allocator, function);
+
+	// Native closures hold as many captures as compiled ones
+	lip_module_context_t* module = lip_begin_module(
+		fixture->context, lip_string_ref("host")
+	);
+	lip_declare_function(module, lip_string_ref("wide-env"), host_wide_env);
+	lip_end_module(fixture->context, module);
+	lip_assert_script_number(fixture, "((host/wide-env))", 44850);
+
+	remove(path);
+
+	return MUNIT_OK;
+}
+
+#define LIP_TEST_NUM_ENTRIES 3000
+
+// Pools are deduplicated through hash indices and labels resolved in one pass,
+// both must hold up with many entries
+static MunitResult
+asm_indices(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	static char names[LIP_TEST_NUM_ENTRIES][16];
+	for(int i = 0; i < LIP_TEST_NUM_ENTRIES; ++i)
+	{
+		snprintf(names[i], sizeof(names[i]), "name%d", i);
+	}
+
+	lip_asm_t lasm;
+	lip_asm_init(&lasm, lip_std_allocator);
+	lip_asm_begin(&lasm, lip_string_ref("<test>"), LIP_LOC_NOWHERE);
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		for(int i = 0; i < LIP_TEST_NUM_ENTRIES; ++i)
+		{
+			// Numbers and strings share the constant pool
+			lip_string_ref_t name = lip_string_ref(names[i]);
+			munit_assert_uint32(
+				2 * i, ==, lip_asm_alloc_numeric_constant(&lasm, i + 0.5)
+			);
+			munit_assert_uint32(
+				2 * i + 1, ==, lip_asm_alloc_string_constant(&lasm, name)
+			);
+			munit_assert_uint32(i, ==, lip_asm_alloc_import(&lasm, name));
+			munit_assert_uint32(i, ==, lip_asm_alloc_symbol(&lasm, name));
+		}
+	}
+	// Numbers are told apart by their bit pattern
+	lip_asm_index_t zero = lip_asm_alloc_numeric_constant(&lasm, 0.0);
+	munit_assert_uint32(zero, !=, lip_asm_alloc_numeric_constant(&lasm, -0.0));
+	munit_assert_uint32(zero, ==, lip_asm_alloc_numeric_constant(&lasm, 0.0));
+	lip_asm_cleanup(&lasm);
+
+	// Each block jumps back to the previous one, the first one returns
+	lip_asm_index_t labels[LIP_TEST_NUM_ENTRIES];
+	lip_asm_init(&lasm, lip_std_allocator);
+	lip_asm_begin(&lasm, lip_string_ref("<test>"), LIP_LOC_NOWHERE);
+	for(int i = 0; i < LIP_TEST_NUM_ENTRIES; ++i)
+	{
+		labels[i] = lip_asm_new_label(&lasm);
+	}
+	lip_asm_add(&lasm, LIP_OP_JMP, labels[LIP_TEST_NUM_ENTRIES - 1], LIP_LOC_NOWHERE);
+	for(int i = 0; i < LIP_TEST_NUM_ENTRIES; ++i)
+	{
+		lip_asm_add(&lasm, LIP_OP_LABEL, labels[i], LIP_LOC_NOWHERE);
+		lip_asm_add(&lasm, LIP_OP_LDI, i, LIP_LOC_NOWHERE);
+		if(i == 0)
+		{
+			lip_asm_add(&lasm, LIP_OP_RET, 0, LIP_LOC_NOWHERE);
+		}
+		else
+		{
+			lip_asm_add(&lasm, LIP_OP_POP, 1, LIP_LOC_NOWHERE);
+			lip_asm_add(&lasm, LIP_OP_JMP, labels[i - 1], LIP_LOC_NOWHERE);
+		}
+	}
+	lip_function_t* function = lip_asm_end(&lasm, lip_std_allocator);
+	munit_assert_null(lasm.error);
+	lip_asm_cleanup(&lasm);
+
+	lip_function_layout_t layout;
+	lip_function_layout(function, &layout);
+	for(uint32_t i = 0; i < function->num_instructions; ++i)
+	{
+		lip_opcode_t opcode;
+		lip_operand_t operand;
+		lip_disasm(layout.instructions[i], &opcode, &operand);
+		if(opcode != LIP_OP_JMP) { continue; }
+
+		// The target loads the index of the previous block
+		lip_operand_t expected = LIP_TEST_NUM_ENTRIES - 1;
+		if(i > 0)
+		{
+			lip_disasm(layout.instructions[i - 2], &opcode, &expected);
+			expected -= 1;
+		}
+		lip_disasm(layout.instructions[operand], &opcode, &operand);
+		munit_assert_int(LIP_OP_LDI, ==, opcode);
+		munit_assert_int(expected, ==, operand);
+	}
+
+	const char* path = "bin/test_asm_indices.lipc";
+	char header[LIP_TEST_HEADER_SIZE];
+	lip_free(lip_std_allocator, compile_function(fixture, "0", header));
+	assert_file_number(fixture, path, header, function, 0);
+	lip_free(lip_std_allocator, function);
+	remove(path);
+
+	return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+	{
+		.name = "/cache",
+		.test = cache,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/mapped",
+		.test = mapped,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/bundle",
+		.test = bundle,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/image",
+		.test = image,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/verifier",
+		.test = verifier,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/known_callee",
+		.test = known_callee,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/nested_verify",
+		.test = nested_verify,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/wide_operands",
+		.test = wide_operands,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/asm_indices",
+		.test = asm_indices,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{ 0 }
+};
+
+MunitSuite bytecode = {
+	.prefix = "/bytecode",
+	.tests = tests
+};
@@ -0,0 +1,551 @@
+#include <stdio.h>
+#include <lip/bind.h>
+#include "script_helper.h"
+
+static MunitResult
+frame_alloc(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	lip_assert_script_number(
+		fixture,
+		"(let ((l (list 1 2 3))) (+ (list/len l) (list/nth 2 l)))",
+		6
+	);
+	lip_assert_script_number(
+		fixture,
+		"(let ((f (fn (x) (* x 2)))) (f (f 3)))",
+		12
+	);
+
+	// Lists larger than the frame's scratch region go on the heap
+	lip_assert_script_number(
+		fixture,
+		"(+ 1 (list/len (list"
+		" 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31 32"
+		" 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31 32"
+		" 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31 32"
+		" 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31 32"
+		" 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31 32"
+		" 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31 32"
+		" 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31 32"
+		" 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31)))",
+		256
+	);
+
+	// Scratch regions must not multiply the frame size of recursive calls
+	lip_assert_script_number(
+		fixture,
+		"(letrec ((f (fn (n)"
+		"              (if (== n 0)"
+		"                  0"
+		"                  (+ (list/len (list 1 2 3 4 5 6 7 8 9 10"
+		"                                     11 12 13 14 15 16 17 18 19 20))"
+		"                     (f (- n 1)))))))"
+		"  (f 12))",
+		240
+	);
+
+	// Folds return their accumulator, which must not live in the caller's frame
+	lip_assert_script_number(
+		fixture,
+		"(let ((g (fn (n) (let ((r (list/foldl + (list) (list n n n)))) r)))"
+		"      (h (fn (a b c d) (let ((z (+ a b c d))) (list z z z z z)))))"
+		"  (let ((x (g 7))) (h 100 200 300 400) (+ (list/len x) (list/nth 2 x))))",
+		10
+	);
+	lip_assert_script_number(
+		fixture,
+		"(let ((g (fn (n) (list/foldr + (list) (list n n n))))"
+		"      (h (fn (a b c d) (let ((z (+ a b c d))) (list z z z z z)))))"
+		"  (let ((x (g 7))) (h 100 200 300 400) (+ (list/len x) (list/nth 2 x))))",
+		10
+	);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+constant_fold(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	lip_assert_script_number(fixture, "(+ 1 (* 2 3) (- 10 4))", 13);
+	lip_assert_script_code(fixture, "(+ 1 (* 2 3) (- 10 4))", ": LDI  13 ", true);
+	lip_assert_script_code(fixture, "(+ 1 (* 2 3) (- 10 4))", ": ADD", false);
+
+	// Constant conditions select their branch
+	lip_assert_script_number(fixture, "(if (< 3 4) 1 2)", 1);
+	lip_assert_script_number(fixture, "(if (> 3 4) 1 2)", 2);
+	lip_assert_script_code(fixture, "(if (< 3 4) 1 2)", ": JOF", false);
+
+	// Unused bindings without side effects are dropped
+	lip_assert_script_number(fixture, "(let ((f (fn () 1)) (y 4)) y)", 4);
+	lip_assert_script_code(fixture, "(let ((f (fn () 1)) (y 4)) y)", ": CLS", false);
+
+	// Removed code still has to refer to defined symbols
+	const char* dead_code[] = {
+		"(let ((f (fn () (undefined-thing 1)))) 42)",
+		"(do (if false (undefined-thing) 1))",
+		"(if true 1 (let ((f (fn (x) (undefined-thing x)))) 2))"
+	};
+	for(size_t i = 0; i < sizeof(dead_code) / sizeof(dead_code[0]); ++i)
+	{
+		lip_assert_script_error(fixture, dead_code[i], "Undefined symbol: undefined-thing");
+	}
+	lip_assert_script_number(fixture, "(if false (list/len (list 1)) 2)", 2);
+
+	// A shadowed operator is not folded
+	lip_assert_script_number(fixture, "(let ((+ (fn (a b) (- a b)))) (+ 5 3))", 2);
+	lip_assert_script_number(fixture, "((fn (* x) (* x 3)) - 5)", 2);
+
+	// Operations which cannot be folded exactly are left to the VM
+	lip_assert_script_number(fixture, "(if (== (/ 1 0) (/ 2 0)) 1 0)", 1);
+	lip_assert_script_number(fixture, "(if (< (/ 1 (* 0 -1)) 0) 1 0)", 1);
+	lip_assert_script_error(
+		fixture,
+		"(+ 1 \"a\")",
+		"Bad argument #2 (LIP_VAL_NUMBER expected, got LIP_VAL_STRING)"
+	);
+
+	return MUNIT_OK;
+}
+
+static int counter;
+
+static lip_function(host_next)
+{
+	lip_return(lip_make_number(vm, ++counter));
+}
+
+static MunitResult
+inline_lambda(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	const char* square = "(let ((sq (fn (x) (* x x)))) (+ (sq 7) (sq 2)))";
+	lip_assert_script_number(fixture, square, 53);
+	lip_assert_script_code(fixture, square, ": CALL", false);
+	lip_assert_script_code(fixture, square, ": TAIL", false);
+	lip_assert_script_number(fixture, "((fn (a b) (- a b)) 10 4)", 6);
+
+	// Arguments are still evaluated once, in the same order as in a call
+	lip_module_context_t* module = lip_begin_module(
+		fixture->context, lip_string_ref("host")
+	);
+	lip_declare_function(module, lip_string_ref("next"), host_next);
+	lip_end_module(fixture->context, module);
+
+	counter = 0;
+	lip_assert_script_number(fixture, "(let ((f (fn (x) (+ x x)))) (f (host/next)))", 2);
+	munit_assert_int(1, ==, counter);
+
+	// The recursive version is not inlined
+	counter = 0;
+	lip_assert_script_number(
+		fixture,
+		"(letrec ((f (fn (a b) (if a (- b a) (f 1 1)))))"
+		"  (f (host/next) (host/next)))",
+		-1
+	);
+	counter = 0;
+	lip_assert_script_number(
+		fixture,
+		"(let ((f (fn (a b) (- b a))))"
+		"  (f (host/next) (host/next)))",
+		-1
+	);
+
+	// Free variables keep referring to the binding seen by the lambda
+	lip_assert_script_number(
+		fixture,
+		"(let ((a 1)) (let ((f (fn () a))) (let ((a 2)) (f))))",
+		1
+	);
+	lip_assert_script_number(
+		fixture,
+		"(let ((a 1) (f (fn (x) (+ x a)))) ((fn (a) (f a)) 10))",
+		11
+	);
+
+	// A parameter of an inlined argument does not hide a capture of the body
+	munit_assert_not_null(lip_test_load(
+		fixture, "(let ((a 0)) (fn (b) ((fn (d) a) (let ((g (fn (a) b))) g))))"
+	));
+	lip_assert_script_number(
+		fixture,
+		"(let ((a 5)) (let ((h (fn (b) ((fn (d) a) (let ((g (fn (a) b))) g))))) (h 1)))",
+		5
+	);
+
+	// Recursive functions are not inlined
+	const char* fact =
+		"(letrec ((fact (fn (n) (if (== n 0) 1 (* n (fact (- n 1)))))))"
+		"  (fact 5))";
+	lip_assert_script_number(fixture, fact, 120);
+	lip_assert_script_code(fixture, fact, ": CLS", true);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+direct_call(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	// Self tail calls reuse the frame, far past the depth of the call stack
+	const char* count =
+		"(letrec ((count (fn (n acc)"
+		"                  (if (== n 0) acc (count (- n 1) (+ acc 2))))))"
+		"  (count 10000 0))";
+	lip_assert_script_number(fixture, count, 20000);
+	lip_assert_script_code(fixture, count, ": TAILSELF 2", true);
+
+	const char* fib =
+		"(letrec ((fib (fn (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))))"
+		"  (fib 15))";
+	lip_assert_script_number(fixture, fib, 610);
+	lip_assert_script_code(fixture, fib, ": CALLSELF 1", true);
+
+	// Siblings of a letrec group call each other directly
+	const char* even =
+		"(letrec ((even? (fn (n) (if (== n 0) 1 (odd? (- n 1)))))"
+		"         (odd? (fn (n) (if (== n 0) 0 (even? (- n 1))))))"
+		"  (+ (even? 1000) (* 10 (even? 1001))))";
+	lip_assert_script_number(fixture, even, 1);
+	lip_assert_script_code(fixture, even, ": TAILK 1", true);
+
+	// Arity mismatches go through the generic call and fail at runtime
+	const char* mismatch =
+		"(letrec ((f (fn (x) (if (== x 0) 0 (f (- x 1))))))"
+		"  (f 1 2))";
+	lip_assert_script_code(fixture, mismatch, ": TAIL 2", true);
+	lip_assert_script_error(
+		fixture, mismatch, "Bad number of arguments (exactly 1 expected, got 2)"
+	);
+
+	// So do shadowed names
+	lip_assert_script_number(
+		fixture,
+		"(letrec ((f (fn (x) (if (== x 0) 0 (f (- x 1))))))"
+		"  (let ((f (fn (x) (* x 3)))) (f 4)))",
+		12
+	);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+number_inference(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	const char* count =
+		"(letrec ((f (fn (n) (if (<= n 0) 0 (+ 1 (f (- n 1)))))))"
+		"  (f 10))";
+	lip_assert_script_number(fixture, count, 10);
+	lip_assert_script_code(fixture, count, ": LTEN", true);
+	lip_assert_script_code(fixture, count, ": SUBN", true);
+
+	// A lambda called with anything else than numbers is not specialised
+	const char* numbers =
+		"(letrec ((lt (fn (a b) (if (< a b) 1 (if (== a b) 0 (- 0 (lt b a)))))))"
+		"  (+ (lt 1 2) (lt 3 2) (* 10 (lt 2 2))))";
+	const char* mixed =
+		"(letrec ((lt (fn (a b) (if (< a b) 1 (if (== a b) 0 (- 0 (lt b a)))))))"
+		"  (+ (lt 1 2) (lt \"b\" \"a\") (* 10 (lt 2 2))))";
+	lip_assert_script_number(fixture, numbers, 0);
+	lip_assert_script_code(fixture, numbers, ": LTN", true);
+	lip_assert_script_number(fixture, mixed, 0);
+	lip_assert_script_code(fixture, mixed, ": LTN", false);
+	lip_assert_script_code(fixture, mixed, ": LT ", true);
+
+	// Branches guarded by number? are specialised
+	const char* guarded =
+		"(let ((f (fn (x) (if (number? x) (< x 1) false))))"
+		"  (list/foldl (fn (x acc) (if (f x) (+ acc 1) acc)) (list 0 \"a\" 5 -1) 0))";
+	lip_assert_script_number(fixture, guarded, 2);
+	lip_assert_script_code(fixture, guarded, ": LTN", true);
+
+	// Typed comparisons order NaN like the generic ones
+	const char* nan_order =
+		"(letrec ((lt (fn (a b) (if (< a b) 1 (if (== a b) 0 (- 0 (lt b a)))))))"
+		"  (let ((nan (/ 0 0)))"
+		"    (+ (lt nan 1) (* 10 (lt 1 nan)) (* 100 (lt nan nan))%s)))";
+	char code[512];
+	lip_value_t generic;
+	snprintf(code, sizeof(code), nan_order, " (lt \"a\" \"a\")");
+	lip_assert_script_code(fixture, code, ": LTN", false);
+	munit_assert_int(LIP_EXEC_OK, ==, lip_test_run(fixture, code, &generic));
+	munit_assert_int(LIP_VAL_NUMBER, ==, generic.type);
+
+	snprintf(code, sizeof(code), nan_order, "");
+	lip_assert_script_code(fixture, code, ": LTN", true);
+	lip_assert_script_number(fixture, code, generic.data.number);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+static_check(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	fixture->config->static_check = true;
+	lip_test_restart(fixture);
+
+	lip_assert_script_syntax_error(
+		fixture,
+		"(+ 1 \"a\")",
+		"Bad argument #2 (LIP_VAL_NUMBER expected, got LIP_VAL_STRING)"
+	);
+	lip_assert_script_syntax_error(
+		fixture,
+		"(list/len (list) 1)",
+		"Bad number of arguments (exactly 1 expected, got 2)"
+	);
+
+	// Branches which are never taken are not checked
+	lip_assert_script_number(fixture, "(if false (+ 1 \"a\") 2)", 2);
+	lip_assert_script_number(fixture, "(if nil (+ 1 \"a\") 2)", 2);
+	lip_assert_script_number(fixture, "(if true 1 (+ 1 \"a\"))", 1);
+	lip_assert_script_number(fixture, "(if 0 1 (list/len 1 2))", 1);
+
+	// But the ones which may be are
+	lip_assert_script_syntax_error(
+		fixture,
+		"(if true (+ 1 \"a\") 2)",
+		"Bad argument #2 (LIP_VAL_NUMBER expected, got LIP_VAL_STRING)"
+	);
+	lip_assert_script_syntax_error(
+		fixture,
+		"(let ((x (list/len (list)))) (if x 2 (+ 1 \"a\")))",
+		"Bad argument #2 (LIP_VAL_NUMBER expected, got LIP_VAL_STRING)"
+	);
+	lip_assert_script_number(fixture, "(let ((false true)) (if false 1 2))", 1);
+	lip_assert_script_syntax_error(
+		fixture,
+		"(let ((false true)) (if false (+ 1 \"a\") 2))",
+		"Bad argument #2 (LIP_VAL_NUMBER expected, got LIP_VAL_STRING)"
+	);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+loop_recur(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	lip_assert_script_number(
+		fixture,
+		"(loop ((i 0) (acc 0)) (if (== i 5) acc (recur (+ i 1) (+ acc i))))",
+		10
+	);
+
+	// Local variables named loop and recur are called like any other
+	lip_assert_script_number(
+		fixture,
+		"(letrec ((loop (fn (n) (if (== n 0) 0 (loop (- n 1)))))) (loop 5))",
+		0
+	);
+	lip_assert_script_number(
+		fixture, "(let ((recur (fn (x) (* x 10)))) (recur 3))", 30
+	);
+	lip_assert_script_number(fixture, "((fn (&loop) (list/len loop)) 1 2)", 2);
+	lip_assert_script_number(
+		fixture,
+		"(loop ((i 0))"
+		"  (let ((recur (fn (x) (+ x 1))))"
+		"    (recur i)))",
+		1
+	);
+
+	// Bindings of a let are only in scope after them
+	lip_assert_script_number(
+		fixture,
+		"(let ((a (loop ((i 3)) i)) (loop (fn (x) x))) (loop a))",
+		3
+	);
+
+	// Outside of the scope of the variable, they are special forms again
+	lip_assert_script_number(
+		fixture,
+		"(+ (let ((loop (fn (x) x))) (loop 1))"
+		"   (loop ((i 0)) (if (< i 2) (recur (+ i 1)) i)))",
+		3
+	);
+	lip_assert_script_syntax_error(
+		fixture,
+		"(let ((loop 1)) loop) (recur 1)",
+		"'recur' must be in tail position of a 'loop'"
+	);
+
+	return MUNIT_OK;
+}
+
+static size_t
+env_depth(lip_script_fixture_t* fixture, const char* code, double expected)
+{
+	lip_assert_script_number(fixture, code, expected);
+	return lip_get_vm_stats(fixture->vm).max_env_depth;
+}
+
+static MunitResult
+max_env_depth(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	const char* code =
+		"(letrec ((f (fn (n)"
+		"              (if (== n 0)"
+		"                  0"
+		"                  (let ((x (list/len (list n n))))"
+		"                    (+ x (f (- n 1))))))))"
+		"  (f %d))";
+	char buf[256];
+	snprintf(buf, sizeof(buf), code, 0);
+	size_t depth0 = env_depth(fixture, buf, 0);
+	snprintf(buf, sizeof(buf), code, 10);
+	size_t depth10 = env_depth(fixture, buf, 20);
+	snprintf(buf, sizeof(buf), code, 20);
+	size_t depth20 = env_depth(fixture, buf, 40);
+
+	// Each frame of f reserves the same number of slots
+	munit_assert_size(depth0, >, 0);
+	munit_assert_size(depth10, >, depth0);
+	munit_assert_size(depth20 - depth10, ==, depth10 - depth0);
+
+	lip_reset_vm(fixture->vm);
+	munit_assert_size(0, ==, lip_get_vm_stats(fixture->vm).max_env_depth);
+
+	return MUNIT_OK;
+}
+
+// Each binding of a chain only reads the previous one
+static size_t
+let_chain_depth(lip_script_fixture_t* fixture, char* buf, size_t buf_size, int n)
+{
+	int len = snprintf(buf, buf_size, "(let ((x0 (list/len (list 0)))");
+	for(int i = 1; i < n; ++i)
+	{
+		len += snprintf(
+			buf + len, buf_size - len,
+			" (x%d (+ x%d (list/len (list x%d))))", i, i - 1, i - 1
+		);
+	}
+	snprintf(buf + len, buf_size - len, ") x%d)", n - 1);
+
+	lip_reset_vm(fixture->vm);
+	return env_depth(fixture, buf, n);
+}
+
+static MunitResult
+slot_reuse(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	static char buf[131072];
+	size_t short_chain = let_chain_depth(fixture, buf, sizeof(buf), 32);
+	size_t long_chain = let_chain_depth(fixture, buf, sizeof(buf), 2000);
+	munit_assert_size(long_chain, ==, short_chain);
+
+	// Every binding stays alive until the body
+	int len = snprintf(buf, sizeof(buf), "(let (");
+	for(int i = 0; i < 200; ++i)
+	{
+		len += snprintf(
+			buf + len, sizeof(buf) - len, " (x%d (list/len (list %d)))", i, i
+		);
+	}
+	len += snprintf(buf + len, sizeof(buf) - len, ") (+");
+	for(int i = 0; i < 200; ++i)
+	{
+		len += snprintf(buf + len, sizeof(buf) - len, " x%d", i);
+	}
+	snprintf(buf + len, sizeof(buf) - len, "))");
+	lip_reset_vm(fixture->vm);
+	munit_assert_size(env_depth(fixture, buf, 200), >=, 200);
+
+	return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+	{
+		.name = "/frame_alloc",
+		.test = frame_alloc,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/constant_fold",
+		.test = constant_fold,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/inline_lambda",
+		.test = inline_lambda,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/direct_call",
+		.test = direct_call,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/number_inference",
+		.test = number_inference,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/static_check",
+		.test = static_check,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/loop_recur",
+		.test = loop_recur,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/max_env_depth",
+		.test = max_env_depth,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/slot_reuse",
+		.test = slot_reuse,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{ 0 }
+};
+
+MunitSuite compiler = {
+	.prefix = "/compiler",
+	.tests = tests
+};
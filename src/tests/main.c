@@ -12,7 +12,10 @@
 	F(vm) \
 	F(runtime()) \
 	F(bind) \
-	F(cpp)
+	F(cpp) \
+	F(compiler) \
+	F(std) \
+	F(bytecode)
 
 #define DECLARE_SUITE(S) extern MunitSuite S;
 
@@ -0,0 +1,199 @@
+#ifndef LIP_TEST_SCRIPT_HELPER_H
+#define LIP_TEST_SCRIPT_HELPER_H
+
+#include <string.h>
+#include <lip/core.h>
+#include <lip/core/io.h>
+#include <lip/core/memory.h>
+#include <lip/core/array.h>
+#include <lip/core/print.h>
+#include <lip/std/runtime.h>
+#include <lip/std/lib.h>
+#include <lip/std/io.h>
+#include <lip/std/memory.h>
+#include "munit.h"
+
+// Fixture running scripts against the standard library, for suites which
+// check behaviour through lip_load_script and lip_exec_script.
+
+#define lip_assert_script_number(fixture, code, expected) \
+	do { \
+		lip_value_t result; \
+		lip_exec_status_t status = lip_test_run((fixture), (code), &result); \
+		if(status != LIP_EXEC_OK) { \
+			lip_print_error(lip_stderr(), (fixture)->context); \
+		} \
+		munit_assert_int(LIP_EXEC_OK, ==, status); \
+		munit_assert_int(LIP_VAL_NUMBER, ==, result.type); \
+		munit_assert_double(expected, ==, result.data.number); \
+	} while(0)
+
+#define lip_assert_script_error(fixture, code, msg) \
+	do { \
+		lip_value_t result; \
+		lip_exec_status_t status = lip_test_run((fixture), (code), &result); \
+		munit_assert_int(LIP_EXEC_ERROR, ==, status); \
+		lip_assert_error_message((fixture), (msg)); \
+	} while(0)
+
+#define lip_assert_script_syntax_error(fixture, code, msg) \
+	do { \
+		munit_assert_null(lip_test_load((fixture), (code))); \
+		const lip_context_error_t* error = lip_get_error((fixture)->context); \
+		munit_assert_uint(1, <=, error->num_records); \
+		lip_assert_ref_equal(lip_string_ref(msg), error->records[0].message); \
+	} while(0)
+
+#define lip_assert_script_code(fixture, code, pattern, present) \
+	do { \
+		lip_array(char) text = lip_test_disasm((fixture), (code)); \
+		if((strstr(text, (pattern)) != NULL) != (present)) { \
+			munit_errorf( \
+				"assert failed: \"%s\" %s in:\n%s", \
+				(pattern), (present) ? "found" : "not found", text \
+			); \
+		} \
+		lip_array_destroy(text); \
+	} while(0)
+
+#define lip_assert_error_message(fixture, msg) \
+	lip_assert_ref_equal( \
+		lip_string_ref(msg), lip_get_error((fixture)->context)->message \
+	)
+
+#define lip_assert_ref_equal(expected, actual) \
+	do { \
+		lip_string_ref_t expected_ = (expected); \
+		lip_string_ref_t actual_ = (actual); \
+		if(!lip_string_ref_equal(expected_, actual_)) { \
+			munit_errorf( \
+				"assert failed: \"%.*s\" == \"%.*s\"", \
+				(int)expected_.length, expected_.ptr, \
+				(int)actual_.length, actual_.ptr \
+			); \
+		} \
+	} while(0)
+
+typedef struct lip_script_fixture_s lip_script_fixture_t;
+
+struct lip_script_fixture_s
+{
+	lip_runtime_config_t* config;
+	lip_runtime_t* runtime;
+	lip_context_t* context;
+	lip_vm_t* vm;
+	lip_script_t* script;
+};
+
+LIP_MAYBE_UNUSED static void
+lip_test_start(lip_script_fixture_t* fixture)
+{
+	fixture->runtime = lip_create_runtime(fixture->config);
+	fixture->context = lip_create_context(fixture->runtime, NULL);
+	fixture->vm = lip_create_vm(fixture->context, NULL);
+	fixture->script = NULL;
+	lip_load_stdlib(fixture->context);
+}
+
+LIP_MAYBE_UNUSED static void
+lip_test_stop(lip_script_fixture_t* fixture)
+{
+	if(fixture->script != NULL)
+	{
+		lip_unload_script(fixture->context, fixture->script);
+	}
+	lip_destroy_vm(fixture->context, fixture->vm);
+	lip_destroy_context(fixture->context);
+	lip_destroy_runtime(fixture->runtime);
+}
+
+/// Restart the runtime so that changes to lip_script_fixture_s::config apply
+LIP_MAYBE_UNUSED static void
+lip_test_restart(lip_script_fixture_t* fixture)
+{
+	lip_test_stop(fixture);
+	lip_test_start(fixture);
+}
+
+LIP_MAYBE_UNUSED static void*
+script_setup(const MunitParameter params[], void* data)
+{
+	(void)params;
+	(void)data;
+
+	lip_script_fixture_t* fixture = lip_new(lip_std_allocator, lip_script_fixture_t);
+	fixture->config = lip_create_std_runtime_config(NULL);
+	lip_test_start(fixture);
+	return fixture;
+}
+
+LIP_MAYBE_UNUSED static void
+script_teardown(void* fixture_)
+{
+	lip_script_fixture_t* fixture = fixture_;
+	lip_test_stop(fixture);
+	lip_destroy_std_runtime_config(fixture->config);
+	lip_free(lip_std_allocator, fixture);
+}
+
+/// Load a script from a string, the previous one is unloaded
+LIP_MAYBE_UNUSED static lip_script_t*
+lip_test_load(lip_script_fixture_t* fixture, const char* code)
+{
+	if(fixture->script != NULL)
+	{
+		lip_unload_script(fixture->context, fixture->script);
+	}
+
+	struct lip_isstream_s sstream;
+	lip_in_t* input = lip_make_isstream(lip_string_ref(code), &sstream);
+	fixture->script = lip_load_script(
+		fixture->context, lip_string_ref("<test>"), input
+	);
+	return fixture->script;
+}
+
+LIP_MAYBE_UNUSED static lip_exec_status_t
+lip_test_exec(
+	lip_script_fixture_t* fixture, lip_script_t* script, lip_value_t* result
+)
+{
+	lip_reset_vm(fixture->vm);
+	return lip_exec_script(fixture->vm, script, result);
+}
+
+LIP_MAYBE_UNUSED static lip_exec_status_t
+lip_test_run(lip_script_fixture_t* fixture, const char* code, lip_value_t* result)
+{
+	lip_script_t* script = lip_test_load(fixture, code);
+	if(script == NULL)
+	{
+		lip_print_error(lip_stderr(), fixture->context);
+		munit_error("script failed to load");
+	}
+
+	return lip_test_exec(fixture, script, result);
+}
+
+/**
+ * Load a script and print its code, with nested functions.
+ * The result is null-terminated and freed with lip_array_destroy.
+ */
+LIP_MAYBE_UNUSED static lip_array(char)
+lip_test_disasm(lip_script_fixture_t* fixture, const char* code)
+{
+	lip_script_t* script = lip_test_load(fixture, code);
+	if(script == NULL)
+	{
+		lip_print_error(lip_stderr(), fixture->context);
+		munit_error("script failed to load");
+	}
+
+	lip_array(char) text = lip_array_create(lip_std_allocator, char, 256);
+	struct lip_osstream_s sstream;
+	lip_print_script(16, 0, lip_make_osstream(&text, &sstream), script);
+	lip_array_push(text, '\0');
+	return text;
+}
+
+#endif
@@ -0,0 +1,535 @@
+#include <stdio.h>
+#include <lip/bind.h>
+#include "script_helper.h"
+
+static MunitResult
+map_order(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	lip_assert_script_number(fixture, "(if (== (map 1 2 3 4) (map 3 4 1 2)) 1 0)", 1);
+	lip_assert_script_number(fixture, "(if (< (map 1 2) (map 1 3)) 1 0)", 1);
+	lip_assert_script_number(fixture, "(if (< (map 1 3) (map 1 2)) 1 0)", 0);
+	lip_assert_script_number(fixture, "(if (< (map 1 2) (map 2 1)) 1 0)", 1);
+	lip_assert_script_number(fixture, "(if (> (map 2 1) (map 1 2)) 1 0)", 1);
+	// Entries are compared in key order, not in insertion or hash order
+	lip_assert_script_number(fixture, "(if (> (map 1 2 5 0) (map 1 3 0 9)) 1 0)", 1);
+	lip_assert_script_number(fixture, "(if (< (map 0 1 5 0) (map 5 0 1 9)) 1 0)", 1);
+
+	// The order does not depend on which map was allocated first
+	lip_assert_script_number(
+		fixture,
+		"(let ((a (map \"x\" 1 \"y\" 2))"
+		"      (b (map \"y\" 2 \"x\" 0)))"
+		"  (+ (if (< b a) 1 0) (if (> a b) 2 0)))",
+		3
+	);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+symbol_order(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	// Symbols are ordered by name, whatever order they were interned in
+	lip_assert_script_number(fixture, "(if (< 'b 'a) 1 0)", 0);
+	lip_assert_script_number(fixture, "(if (> 'b 'a) 1 0)", 1);
+	lip_assert_script_number(fixture, "(if (< 'ab 'b) 1 0)", 1);
+	lip_assert_script_number(fixture, "(if (== 'c 'c) 1 0)", 1);
+	lip_assert_script_number(
+		fixture,
+		"(if (== (list/sort (list 'b 'c 'a)) (list 'a 'b 'c)) 1 0)",
+		1
+	);
+
+	return MUNIT_OK;
+}
+
+static lip_function(host_handle)
+{
+	(void)vm;
+	static int handle = 42;
+	lip_return(((lip_value_t){
+		.type = LIP_VAL_NATIVE,
+		.data = { .reference = &handle }
+	}));
+}
+
+static MunitResult
+list_builder(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	lip_assert_script_number(
+		fixture,
+		"(let ((b (list/builder)))"
+		"  (list/push (list/push b 1) 2)"
+		"  (list/push b 3)"
+		"  (let ((l (list/freeze b)))"
+		"    (+ (list/len l) (list/nth 0 l) (list/nth 2 l))))",
+		7
+	);
+	lip_assert_script_number(
+		fixture,
+		"(let ((b (list/builder 2)))"
+		"  (list/push b 1)"
+		"  (list/freeze b)"
+		"  (list/push b 5)"
+		"  (list/head (list/freeze b)))",
+		5
+	);
+
+	// Other native values are not builders
+	lip_module_context_t* module = lip_begin_module(
+		fixture->context, lip_string_ref("host")
+	);
+	lip_declare_function(module, lip_string_ref("handle"), host_handle);
+	lip_end_module(fixture->context, module);
+
+	lip_assert_script_error(
+		fixture,
+		"(list/push (host/handle) 1)",
+		"Bad argument #1 (LIP_VAL_LIST_BUILDER expected, got LIP_VAL_NATIVE)"
+	);
+	lip_assert_script_error(
+		fixture,
+		"(list/freeze (host/handle))",
+		"Bad argument #1 (LIP_VAL_LIST_BUILDER expected, got LIP_VAL_NATIVE)"
+	);
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+vec_reduce(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	lip_assert_script_number(fixture, "(vec/sum (vec 1 2 3 4 5 6 7 8 9 10 11))", 66);
+	lip_assert_script_number(fixture, "(vec/min (vec 5 3 9 -2 4 8 1 7 6 0 11))", -2);
+	lip_assert_script_number(fixture, "(vec/max (vec 5 3 9 -2 4 8 1 7 6 0 11))", 11);
+	lip_assert_script_number(fixture, "(vec/dot (vec 1 2 3 4 5 6 7 8 9) (vec/make 9 2))", 90);
+
+	// A NaN anywhere makes min and max NaN, whatever its position.
+	// Only vec comparisons tell NaN apart, == orders it like a number.
+	const char* is_nan =
+		"(let ((nan (/ 0 0))"
+		"      (x (%s (vec %s))))"
+		"  (- 1 (vec/sum (vec/eq (vec x) x))))";
+	const char* inputs[] = {
+		"nan 1 2",
+		"1 2 nan",
+		"1 2 3 4 5 6 7 8 9 nan 11 12 13 14 15 16 17",
+		"1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 nan"
+	};
+	for(size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i)
+	{
+		char code[256];
+		snprintf(code, sizeof(code), is_nan, "vec/min", inputs[i]);
+		lip_assert_script_number(fixture, code, 1);
+		snprintf(code, sizeof(code), is_nan, "vec/max", inputs[i]);
+		lip_assert_script_number(fixture, code, 1);
+	}
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+max_symbols(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	fixture->config->max_symbols = 2;
+	lip_test_restart(fixture);
+
+	lip_assert_script_number(fixture, "(if (== 'a 'a) 1 0)", 1);
+	lip_assert_script_number(fixture, "(list/len (list 'a 'b 'a 'b))", 4);
+	lip_assert_script_error(fixture, "(list 'a 'b 'c)", "Too many symbols");
+
+	// Symbols which are already interned can still be created
+	lip_value_t symbol = lip_make_symbol(fixture->vm, lip_string_ref("b"));
+	munit_assert_int(LIP_VAL_SYMBOL, ==, symbol.type);
+	symbol = lip_make_symbol(fixture->vm, lip_string_ref("c"));
+	munit_assert_int(LIP_VAL_NIL, ==, symbol.type);
+
+	return MUNIT_OK;
+}
+
+struct test_guard_s
+{
+	lip_buffer_guard_t guard;
+	unsigned int num_releases;
+};
+
+static void
+test_guard_release(lip_buffer_guard_t* guard)
+{
+	struct test_guard_s* test_guard = LIP_CONTAINER_OF(guard, struct test_guard_s, guard);
+	++test_guard->num_releases;
+}
+
+static struct test_guard_s test_guard = { .guard = { .release = test_guard_release } };
+
+static lip_string_t*
+alloc_string(lip_string_ref_t content)
+{
+	lip_string_t* str = lip_malloc(
+		lip_std_allocator, sizeof(lip_string_t) + content.length + 1
+	);
+	str->length = content.length;
+	str->hash = 0;
+	memcpy(str->ptr, content.ptr, content.length);
+	str->ptr[content.length] = '\0';
+	return str;
+}
+
+static MunitResult
+string_hash(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	// The hash is computed on first use and written back
+	lip_string_t* str = alloc_string(lip_string_ref("abc"));
+	uint32_t hash = lip_string_hash(str);
+	munit_assert_uint32(hash, ==, lip_string_ref_hash(lip_string_ref("abc")));
+	munit_assert_uint32(hash, ==, str->hash);
+	str->hash = hash ^ 1;
+	munit_assert_uint32(hash ^ 1, ==, lip_string_hash(str));
+	lip_free(lip_std_allocator, str);
+
+	// XXH32 of this content is 0, which marks a hash not computed yet
+	lip_string_ref_t zero = lip_string_ref("pojjjejaa");
+	munit_assert_uint32(0, !=, lip_string_ref_hash(zero));
+	str = alloc_string(zero);
+	munit_assert_uint32(lip_string_ref_hash(zero), ==, lip_string_hash(str));
+	munit_assert_uint32(lip_string_ref_hash(zero), ==, str->hash);
+	lip_free(lip_std_allocator, str);
+
+	lip_assert_script_number(
+		fixture, "(map/get (map \"pojjjejaa\" 1 \"abc\" 2) \"pojjjejaa\")", 1
+	);
+	lip_assert_script_number(fixture, "(if (== 'pojjjejaa 'pojjjejaa) 1 0)", 1);
+
+	return MUNIT_OK;
+}
+
+static lip_function(host_buffer)
+{
+	lip_return(lip_make_buffer(vm, lip_string_ref("borrowed content"), &test_guard.guard));
+}
+
+static lip_function(string_len)
+{
+	lip_bind_args((string, str));
+	lip_return(lip_make_number(vm, lip_as_string(&str).length));
+}
+
+static lip_function(string_ref_len)
+{
+	lip_bind_args((string_ref, str));
+	lip_return(lip_make_number(vm, str.length));
+}
+
+static lip_function(string_sum)
+{
+	lip_bind_args((any, str));
+	lip_string_ref_t ref = lip_as_string(&str);
+	double sum = 0;
+	for(size_t i = 0; i < ref.length; ++i) { sum += ref.ptr[i] - '0'; }
+	lip_return(lip_make_number(vm, sum));
+}
+
+static MunitResult
+string_content(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+
+	lip_module_context_t* module = lip_begin_module(
+		fixture->context, lip_string_ref("host")
+	);
+	lip_declare_function(module, lip_string_ref("string-sum"), string_sum);
+	lip_end_module(fixture->context, module);
+
+	// Short strings are stored inline, long ones on the heap
+	lip_assert_script_number(fixture, "(host/string-sum \"\")", 0);
+	lip_assert_script_number(fixture, "(host/string-sum \"123\")", 6);
+	lip_assert_script_number(fixture, "(host/string-sum \"11111111111\")", 11);
+	lip_assert_script_number(fixture, "(host/string-sum \"111111111111\")", 12);
+	lip_assert_script_number(fixture, "(host/string-sum \"1111111111111111111111111\")", 25);
+	lip_assert_script_number(fixture, "(host/string-sum 42)", 0);
+
+	lip_value_t value = lip_make_string_copy(fixture->vm, lip_string_ref("abc"));
+	lip_assert_ref_equal(lip_string_ref("abc"), lip_as_string(&value));
+
+	return MUNIT_OK;
+}
+
+static MunitResult
+buffer(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	test_guard.num_releases = 0;
+
+	lip_module_context_t* module = lip_begin_module(
+		fixture->context, lip_string_ref("host")
+	);
+	lip_declare_function(module, lip_string_ref("buffer"), host_buffer);
+	lip_declare_function(module, lip_string_ref("string-len"), string_len);
+	lip_declare_function(module, lip_string_ref("string-ref-len"), string_ref_len);
+	lip_end_module(fixture->context, module);
+
+	// Only string_ref parameters accept buffers
+	lip_assert_script_number(fixture, "(host/string-ref-len (host/buffer))", 16);
+	lip_assert_script_number(fixture, "(host/string-ref-len \"abc\")", 3);
+	lip_assert_script_number(fixture, "(host/string-len \"abc\")", 3);
+	lip_assert_script_error(
+		fixture,
+		"(host/string-len (host/buffer))",
+		"Bad argument #1 (LIP_VAL_STRING expected, got LIP_VAL_BUFFER)"
+	);
+	lip_assert_script_error(fixture, "(throw (host/buffer))", "borrowed content");
+
+	// Each run resets the VM, releasing what the previous one borrowed
+	munit_assert_uint(2, ==, test_guard.num_releases);
+
+	// Scopes release buffers without resetting the VM
+	lip_script_t* script = lip_test_load(fixture, "(host/buffer)");
+	munit_assert_not_null(script);
+	lip_reset_vm(fixture->vm);
+	munit_assert_uint(3, ==, test_guard.num_releases);
+
+	lip_value_t outer_result, inner_result;
+	munit_assert_int(LIP_EXEC_OK, ==, lip_exec_script(fixture->vm, script, &outer_result));
+	lip_buffer_scope_t scope = lip_begin_buffer_scope(fixture->vm);
+	munit_assert_int(LIP_EXEC_OK, ==, lip_exec_script(fixture->vm, script, &inner_result));
+	lip_end_buffer_scope(fixture->vm, scope);
+	munit_assert_uint(4, ==, test_guard.num_releases);
+
+	// Released buffers read as empty strings
+	munit_assert_size(0, ==, lip_as_string_ref(&inner_result).length);
+	munit_assert_size(16, ==, lip_as_string_ref(&outer_result).length);
+
+	lip_reset_vm(fixture->vm);
+	munit_assert_uint(5, ==, test_guard.num_releases);
+
+	// Buffers hash like strings with the same content
+	lip_assert_script_number(
+		fixture, "(map/get (map \"borrowed content\" 42) (host/buffer))", 42
+	);
+	lip_assert_script_number(
+		fixture, "(map/get (map (host/buffer) 42) \"borrowed content\")", 42
+	);
+	lip_assert_script_number(
+		fixture, "(if (map/has? (map (host/buffer) 42) \"borrowed\") 1 0)", 0
+	);
+
+	return MUNIT_OK;
+}
+
+// Check that a list holds first, first + 1, ... through both access paths
+static void
+assert_list_range(lip_value_t value, double first, size_t length)
+{
+	const lip_list_t* list = lip_as_list(value);
+	munit_assert_not_null(list);
+	munit_assert_size(length, ==, list->length);
+	for(size_t i = 0; i < length; ++i)
+	{
+		munit_assert_double(first + i, ==, lip_list_nth(list, i).data.number);
+	}
+
+	size_t count = 0;
+	lip_list_iterator_t itr;
+	lip_value_t element;
+	for(lip_list_begin(list, &itr); lip_list_next(&itr, &element); ++count)
+	{
+		munit_assert_double(first + count, ==, element.data.number);
+	}
+	munit_assert_size(length, ==, count);
+}
+
+static lip_value_t
+append_range(lip_vm_t* vm, lip_value_t list, double first, size_t length)
+{
+	for(size_t i = 0; i < length; ++i)
+	{
+		list = lip_list_append(vm, lip_as_list(list), lip_make_number(vm, first + i));
+	}
+
+	return list;
+}
+
+static MunitResult
+persistent_vector(const MunitParameter params[], void* fixture_)
+{
+	(void)params;
+
+	lip_script_fixture_t* fixture = fixture_;
+	lip_vm_t* vm = fixture->vm;
+	lip_value_t empty = {
+		.type = LIP_VAL_LIST,
+		.data = { .reference = lip_alloc_list(vm, 0) }
+	};
+
+	// Appends stay flat up to LIP_LIST_FLAT_MAX elements
+	lip_value_t flat = append_range(vm, empty, 0, LIP_LIST_FLAT_MAX);
+	munit_assert_not_null(lip_as_list(flat)->elements);
+	assert_list_range(flat, 0, LIP_LIST_FLAT_MAX);
+	lip_value_t vector = append_range(vm, flat, LIP_LIST_FLAT_MAX, 1);
+	munit_assert_null(lip_as_list(vector)->elements);
+	assert_list_range(vector, 0, LIP_LIST_FLAT_MAX + 1);
+
+	// 32 leaves of 32 elements fill the first level of the trie, 1056
+	// elements with the tail
+	lip_value_t versions[4];
+	size_t lengths[] = { 40, 64, 1056, 1057 };
+	lip_value_t big = append_range(vm, empty, 0, 3000);
+	assert_list_range(big, 0, 3000);
+	for(int i = 0; i < 4; ++i)
+	{
+		versions[i] = append_range(vm, empty, 0, lengths[i]);
+	}
+
+	// Versions which append to the same list do not see each other's
+	// elements, whether or not the tail was full
+	for(int i = 0; i < 4; ++i)
+	{
+		lip_value_t lhs = append_range(vm, versions[i], 10000, 40);
+		lip_value_t rhs = append_range(vm, versions[i], 20000, 1);
+		lip_value_t lhs_next = append_range(vm, lhs, 10040, 1);
+		assert_list_range(versions[i], 0, lengths[i]);
+		munit_assert_size(lengths[i] + 41, ==, lip_as_list(lhs_next)->length);
+		munit_assert_size(lengths[i] + 1, ==, lip_as_list(rhs)->length);
+		for(size_t j = 0; j < lengths[i]; ++j)
+		{
+			munit_assert_double(j, ==, lip_list_nth(lip_as_list(lhs), j).data.number);
+			munit_assert_double(j, ==, lip_list_nth(lip_as_list(rhs), j).data.number);
+		}
+		for(size_t j = 0; j < 41; ++j)
+		{
+			lip_value_t element = lip_list_nth(lip_as_list(lhs_next), lengths[i] + j);
+			munit_assert_double(10000 + j, ==, element.data.number);
+		}
+		munit_assert_double(
+			20000, ==, lip_list_nth(lip_as_list(rhs), lengths[i]).data.number
+		);
+	}
+
+	// Tails of a vector list keep sharing it, and can grow again
+	lip_value_t tail = big;
+	for(int i = 0; i < 1100; ++i) { tail = lip_list_tail(vm, lip_as_list(tail)); }
+	assert_list_range(tail, 1100, 1900);
+	assert_list_range(append_range(vm, tail, 3000, 50), 1100, 1950);
+	assert_list_range(big, 0, 3000);
+
+	// Concatenation switches to a vector past LIP_LIST_FLAT_MAX elements
+	lip_value_t half = append_range(vm, empty, 0, 16);
+	lip_value_t upper_half = append_range(vm, empty, 16, 16);
+	lip_value_t concat = lip_list_concat(vm, lip_as_list(half), lip_as_list(upper_half));
+	munit_assert_not_null(lip_as_list(concat)->elements);
+	assert_list_range(concat, 0, 32);
+
+	lip_value_t rest = append_range(vm, empty, 32, 20);
+	concat = lip_list_concat(vm, lip_as_list(concat), lip_as_list(rest));
+	munit_assert_null(lip_as_list(concat)->elements);
+	assert_list_range(concat, 0, 52);
+
+	// Either side may be a tail of a vector list
+	concat = lip_list_concat(vm, lip_as_list(concat), lip_as_list(tail));
+	munit_assert_size(52 + 1900, ==, lip_as_list(concat)->length);
+	for(size_t i = 0; i < 52 + 1900; ++i)
+	{
+		munit_assert_double(
+			i < 52 ? i : 1100 + i - 52, ==,
+			lip_list_nth(lip_as_list(concat), i).data.number
+		);
+	}
+
+	concat = lip_list_concat(vm, lip_as_list(tail), lip_as_list(rest));
+	munit_assert_size(1920, ==, lip_as_list(concat)->length);
+	munit_assert_double(1100, ==, lip_list_nth(lip_as_list(concat), 0).data.number);
+	munit_assert_double(32, ==, lip_list_nth(lip_as_list(concat), 1900).data.number);
+	assert_list_range(tail, 1100, 1900);
+
+	return MUNIT_OK;
+}
+
+static MunitTest tests[] = {
+	{
+		.name = "/map_order",
+		.test = map_order,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/symbol_order",
+		.test = symbol_order,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/persistent_vector",
+		.test = persistent_vector,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/list_builder",
+		.test = list_builder,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/vec_reduce",
+		.test = vec_reduce,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/string",
+		.test = string_content,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/string_hash",
+		.test = string_hash,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/max_symbols",
+		.test = max_symbols,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{
+		.name = "/buffer",
+		.test = buffer,
+		.setup = script_setup,
+		.tear_down = script_teardown
+	},
+	{ 0 }
+};
+
+MunitSuite std = {
+	.prefix = "/std",
+	.tests = tests
+};